@@ -0,0 +1,111 @@
+#ifndef PROCESS_SERVER_CHANNEL_BODY_CACHE_H
+#define PROCESS_SERVER_CHANNEL_BODY_CACHE_H
+
+#include "db.h"
+#include "rw-lock.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define CHANNEL_BODY_SHM_NAME "/cb_3fda69"        /** Channel body cache shared memory name. */
+#define CHANNEL_BODY_SLOTS 32                    /** Channels whose bodies are cached at once; a power of two. */
+#define CHANNEL_BODY_SECTION_MAX_SIZE UINT16_MAX /** Larger sections do not fit in a dispatch body. */
+#define CHANNEL_BODY_TOO_LARGE 2                 /** channel_body_read refused: the body would not fit in a dispatch. */
+
+#define CHANNEL_BODY_GET_USERS 1  /** Get flag: list the Users in the Channel. */
+#define CHANNEL_BODY_GET_ADMINS 2 /** Get flag: list the Administrators of the Channel. */
+#define CHANNEL_BODY_GET_BANNED 4 /** Get flag: list the Users banned from the Channel. */
+
+/**
+ * The sections of a Read-Channel Response body, in the order in which they are sent after the code.
+ */
+enum ChannelBodySection
+{
+    CHANNEL_BODY_INFO,   // Channel name, creator and publicity.
+    CHANNEL_BODY_USERS,
+    CHANNEL_BODY_ADMINS,
+    CHANNEL_BODY_BANNED,
+    CHANNEL_BODY_SECTIONS
+};
+
+/**
+ * The encoded sections of the Read-Channel Response body of one Channel, laid out one after the other in data. The
+ * slot is tagged with the generation of the Channel when its record was read, and only used while the Channel still
+ * has that generation; see object-cache.h. Only read or written while holding its lock.
+ */
+struct channel_body
+{
+    alignas(CACHE_LINE_SIZE) struct rw_lock lock;
+    int                                     in_use;
+    int                                     channel_id;
+    unsigned long                           generation;
+    int                                     oversized; // CHANNEL_BODY_GET flags of the lists too large to encode.
+    char                                    channel_name[NAME_MAX_SIZE + 1];
+    size_t                                  offsets[CHANNEL_BODY_SECTIONS + 1]; // Of each section, then of the end.
+    char                                    data[CHANNEL_BODY_SECTIONS * CHANNEL_BODY_SECTION_MAX_SIZE];
+};
+
+/**
+ * The channel body cache. Lives in shared memory. Every member of a Channel reads the Channel when it is pinged about
+ * it, so the body of the Read-Channel Response is encoded once, by the first reader after the Channel changes, and
+ * copied for every other reader. A Response only takes the sections it asks for. A slot is chosen by hashing the
+ * name of the Channel; Channels whose names share a slot evict each other.
+ */
+struct channel_body_cache
+{
+    alignas(CACHE_LINE_SIZE) atomic_ulong reads;
+    atomic_ulong                          encodes;
+    struct channel_body                   slots[CHANNEL_BODY_SLOTS];
+};
+
+/**
+ * open_channel_body_cache
+ * <p>
+ * Map the channel body cache into shared memory, empty it, and initialize the lock of every slot. Must be called
+ * before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_channel_body_cache(struct core_object *co, struct server_object *so);
+
+/**
+ * close_channel_body_cache
+ * <p>
+ * Unmap the channel body cache.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_channel_body_cache(struct core_object *co, struct server_object *so);
+
+/**
+ * print_channel_body_stats
+ * <p>
+ * Print the number of Read-Channel bodies served and the number of times a body was encoded.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void print_channel_body_stats(struct core_object *co, struct server_object *so);
+
+/**
+ * channel_body_read
+ * <p>
+ * Copy the body of a Read-Channel Response, encoding the Channel first if it changed since it was last encoded.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_name the name of the Channel
+ * @param get_flags the lists to include, as CHANNEL_BODY_GET flags
+ * @param body_get memory in which to store the body; must be freed
+ * @param body_size memory in which to store the size of the body
+ * @return 1 if the body was copied, 0 if the Channel does not exist, CHANNEL_BODY_TOO_LARGE if the body would not
+ * fit in a dispatch, -1 and set err on failure
+ */
+int channel_body_read(struct core_object *co, struct server_object *so, const char *channel_name, int get_flags,
+                      char **body_get, size_t *body_size);
+
+#endif //PROCESS_SERVER_CHANNEL_BODY_CACHE_H
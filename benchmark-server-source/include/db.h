@@ -8,6 +8,9 @@
 #define PASSWORD_MIN_SIZE 6                /** Minimum size for passwords. */
 #define PASSWORD_MAX_SIZE 30               /** Maximum size for passwords. */
 
+#define ACCOUNT_LOGIN_TOKEN_TAKEN 1        /** db_create_account refused: the login token is taken. */
+#define ACCOUNT_DISPLAY_NAME_TAKEN 2       /** db_create_account refused: the display name is taken. */
+
 #define VALIDATE_NAME(name) (strlen(name) <= NAME_MAX_SIZE)
 #define VALIDATE_PASSWORD(password) (strlen(password) >= PASSWORD_MIN_SIZE && strlen(password) <= PASSWORD_MAX_SIZE)
 #define VALIDATE_TIMESTAMP(timestamp) (timestamp > 0)
@@ -60,7 +63,7 @@ int db_read(struct core_object *co, struct server_object *so, int type, void *ob
  * @param so the state object
  * @param type the type of object to update
  * @param object_src the update to make
- * @return
+ * @return 0 on success, 1 if the update would give the object a name held by another, -1 and set err on failure
  */
 int db_update(struct core_object *co, struct server_object *so, int type, void *object_src);
 
@@ -77,75 +80,105 @@ int db_update(struct core_object *co, struct server_object *so, int type, void *
  */
 int db_destroy(struct core_object *co, struct server_object *so, int type, void *object);
 
+/**
+ * db_create_account
+ * <p>
+ * Insert a new User and its Auth into their databases in one transaction: either both are inserted or neither is.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param user the User to insert
+ * @param auth the Auth to insert
+ * @return 0 on success, ACCOUNT_LOGIN_TOKEN_TAKEN and/or ACCOUNT_DISPLAY_NAME_TAKEN if refused, -1 and set err on
+ * failure
+ */
+int db_create_account(struct core_object *co, struct server_object *so, User *user, Auth *auth);
+
+/**
+ * read_user_by_id
+ * <p>
+ * Read a User by ID, from the user table if the ID has a slot and from the User database if not.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param user_id the ID of the User
+ * @param user memory in which to store the User; its display name is newly allocated
+ * @return 0 if the User was read, 1 if not found, -1 and set err on failure
+ */
+int read_user_by_id(struct core_object *co, struct server_object *so, int user_id, User *user);
+
+/**
+ * set_online_status
+ * <p>
+ * Mark a User online or offline. The status is stored in the user table if the ID of the User has a slot, and
+ * written to the User database if not.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param user the User, whose online status is also updated
+ * @param online_status the online status
+ * @return 0 on success, -1 and set err on failure
+ */
+int set_online_status(struct core_object *co, struct server_object *so, User *user, int online_status);
+
 /**
  * safe_dbm_store
  * <p>
- * Safely store an item in a database.
+ * Safely store an item in a database. If the database has a name index, the index is updated under the same lock; a
+ * store which would give the record a name already held by a different record is refused. Returns once the store is
+ * as durable as the durability mode requires.
  * </p>
  * @param co the core object
- * @param db_name the database name
- * @param sem the database semaphore
+ * @param db the database
  * @param key the key under which to store
  * @param value the value to store
  * @param store_flags whether to insert or overwrite
- * @return 0 on successful insert, 1 if insert and record already exists, -1 and set err on failure
+ * @return 0 on successful insert, 1 if insert and record already exists or the name is taken, -1 and set err on failure
  */
-int safe_dbm_store(struct core_object *co, const char *db_name, sem_t *sem, datum *key, datum *value, int store_flags);
+int safe_dbm_store(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags);
 
 /**
  * safe_dbm_fetch
  * <p>
- * Safely fetch an item from a database.
+ * Safely fetch an item from a database. Users and Channels are served from the object cache of the process when
+ * it holds a current copy.
  * </p>
  * @param co the core object
- * @param db_name the name of the db from which to fetch
- * @param sem the db semaphore
+ * @param db the database from which to fetch
  * @param key the key of the item to fetch
  * @param serial_buffer the buffer into which to copy the fetched item
  * @return 0 if successful and copy occurs, 1 if item not found, -1 and set err on failure
  */
-int safe_dbm_fetch(struct core_object *co, const char *db_name, sem_t *sem, datum *key, uint8_t **serial_buffer);
+int safe_dbm_fetch(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer);
 
 /**
  * safe_dbm_delete
  * <p>
- * Safely delete an item from a database.
+ * Safely delete an item from a database, along with its name index entry if the database has a name index. Returns
+ * once the delete is as durable as the durability mode requires.
  * </p>
  * @param co the core object
- * @param db_name the database name
- * @param sem the database semaphore
+ * @param db the database
  * @param key the key to delete
  * @return 0 on success, -1 and set err on failure.
  */
-int safe_dbm_delete(struct core_object *co, const char *db_name, sem_t *sem, datum *key);
+int safe_dbm_delete(struct core_object *co, struct database *db, datum *key);
 
 /**
  * find_by_name
  * <p>
  * Find an entry in the database by a string name. The name must be the second parameter of the object following an int.
+ * If the database has a name index the lookup goes through it; otherwise every record is scanned. A name which the
+ * name filter of the database has never seen is reported as not located without a lookup, and Users and Channels are
+ * served from the object cache of the process when it holds a current copy.
  * </p>
  * @param co the core object
- * @param db_name the database in which to search
- * @param db_sem the semaphore for the database
+ * @param db the database in which to search
  * @param serial_object the object to store the result, or NULL if no resuilt is needed
  * @param name the
  * @return 0 on success and record not located, 1 on success and record located, -1 and set err on failure
  */
-int find_by_name(struct core_object *co, const char *db_name, sem_t *db_sem,
-                 uint8_t **serial_object, const char *name);
-
-/**
- * find_addr_id_pair_by_id
- * <p>
- * Search the database for an Address-User ID pair by User ID.
- * </p>
- * @param co the core object
- * @param so the server object
- * @param addr_id_pair the address id pair
- * @param id the id
- * @return 0 on success, -1 and set on failure
- */
-int find_addr_id_pair_by_id(struct core_object *co, struct server_object *so, AddrIdPair **addr_id_pair, int id);
+int find_by_name(struct core_object *co, struct database *db, uint8_t **serial_object, const char *name);
 
 /**
  * copy_dptr_to_buffer
@@ -162,7 +195,8 @@ int copy_dptr_to_buffer(struct core_object *co, uint8_t **buffer, datum *value);
 /**
  * determine_request_sender
  * <p>
- * Given a socket address on which a dispatch was sent, find the User that sent the dispatch.
+ * Given a socket address on which a dispatch was sent, find the User that sent the dispatch. The User is resolved
+ * from the session table, so no database is read.
  * </p>
  * @param co the core object
  * @param so the server object
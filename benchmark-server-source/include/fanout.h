@@ -0,0 +1,187 @@
+#ifndef PROCESS_SERVER_FANOUT_H
+#define PROCESS_SERVER_FANOUT_H
+
+#include "../../include/global-objects.h"
+#include "session-table.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define DISPATCH_HEADER_SIZE 4                                /** Version and type, object, and body size. */
+#define FANOUT_FRAMES 64                                      /** Frames which may be in flight at once. */
+#define FANOUT_FRAME_SIZE (DISPATCH_HEADER_SIZE + UINT16_MAX) /** Largest encoded dispatch. */
+#define FANOUT_MAX_RECIPIENTS SESSION_TABLE_CAPACITY          /** Only Users with a session are online. */
+
+#define PING_WINDOW_ENV "CHAT_PING_WINDOW_MS" /** Milliseconds within which updates to one Object share one Ping. */
+#define PING_DEFAULT_WINDOW_MS 50             /** Coalescing window if PING_WINDOW_ENV is unset. */
+
+/**
+ * A dispatch to be forwarded to several Clients, encoded once. A frame is free while it holds no references. The
+ * worker which fills a frame holds a reference until the parent has queued the frame on the connection of every
+ * recipient; each queue holds a reference until the frame is sent on its connection.
+ */
+struct fanout_frame
+{
+    atomic_uint        refs;
+    uint32_t           size;
+    size_t             recipient_count;
+    struct sockaddr_in recipients[FANOUT_MAX_RECIPIENTS];
+    uint8_t            data[FANOUT_FRAME_SIZE];
+};
+
+/**
+ * The fan-out engine. Lives in shared memory. Client sockets are held by the parent and only lent to a worker for
+ * one request at a time, so a worker cannot write to the Clients of other requests. Instead, a worker encodes the
+ * dispatch into a frame along with the socket addresses of its online recipients, and passes the frame to the parent
+ * when it reports the request handled, after its response is sent. The parent queues the frame on the connection of
+ * each recipient and writes it whenever the connection is not lent to a worker, so a forward never interleaves with a
+ * response; see struct fanout_queue. Pings are broadcast by the parent through the same frames and queues.
+ */
+struct fanout
+{
+    struct fanout_frame frames[FANOUT_FRAMES];
+};
+
+/**
+ * open_fanout
+ * <p>
+ * Map the fan-out frames into shared memory and read the Ping coalescing window. Must be called before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_fanout(struct core_object *co, struct server_object *so);
+
+/**
+ * close_fanout
+ * <p>
+ * Unmap the fan-out frames.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_fanout(struct core_object *co, struct server_object *so);
+
+/**
+ * fanout_to_channel
+ * <p>
+ * Forward a dispatch to the online members of a Channel once the response to the current request is sent. Members
+ * are found by walking the sessions and looking each User up in the membership index, so the cost depends on the
+ * number of online Users rather than the size of the Channel. Called by a worker while handling a request; at most
+ * one dispatch is forwarded per request, and a later call replaces an earlier one. If every frame is in flight, the
+ * forward is dropped.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch to forward
+ * @param channel_id the ID of the Channel
+ * @return 0 on success, -1 and set err on failure
+ */
+int fanout_to_channel(struct core_object *co, struct server_object *so, const struct dispatch *dispatch,
+                      int channel_id);
+
+/**
+ * fanout_ping_channel
+ * <p>
+ * Send a Ping about an updated Channel to its online members and to the online Users listed, once the response to the
+ * current request is sent. Called by a worker while handling a request which changes who belongs to the Channel, so
+ * that the Users which joined or left are pinged along with the members; it takes the place of a forward, and is not
+ * coalesced. If every frame is in flight, the Ping is dropped.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_name the name of the Channel
+ * @param channel_id the ID of the Channel
+ * @param user_ids the IDs of the Users, sorted
+ * @param user_count the number of Users
+ * @return 0 on success, -1 and set err on failure
+ */
+int fanout_ping_channel(struct core_object *co, struct server_object *so, const char *channel_name, int channel_id,
+                        const int *user_ids, size_t user_count);
+
+/**
+ * fanout_deliver
+ * <p>
+ * Queue a frame passed by a worker on the connection of each of its recipients, and send it at once on connections
+ * which are idle. Recipients which are no longer connected are skipped. Called by the parent.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param frame the frame
+ */
+void fanout_deliver(struct core_object *co, struct server_object *so, int frame);
+
+/**
+ * fanout_flush
+ * <p>
+ * Send as much of the queue of a connection as the socket accepts without blocking. While frames remain, the
+ * connection is polled for writing only, so that no request is lent to a worker in the middle of a frame. Called by
+ * the parent while the connection is not lent to a worker.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param conn_index the index of the connection in the array of client_addrs
+ */
+void fanout_flush(struct core_object *co, struct server_object *so, size_t conn_index);
+
+/**
+ * fanout_drop
+ * <p>
+ * Empty the queue of a connection, releasing its frames. Called by the parent when the connection closes.
+ * </p>
+ * @param so the server object
+ * @param conn_index the index of the connection in the array of client_addrs
+ */
+void fanout_drop(struct server_object *so, size_t conn_index);
+
+/**
+ * fanout_ping
+ * <p>
+ * Broadcast a Ping about an updated User or Channel to every Client once the response to the current request is
+ * sent. Called by a worker while handling a request; at most one Ping is broadcast per request, and a later call
+ * replaces an earlier one.
+ * </p>
+ * @param so the server object
+ * @param type PINGUSER or PINGCHANNEL
+ * @param name the display name of the User or the name of the Channel
+ */
+void fanout_ping(struct server_object *so, enum Type type, const char *name);
+
+/**
+ * fanout_schedule_ping
+ * <p>
+ * Schedule a Ping passed by a worker. The first update to an Object opens a coalescing window, and its Ping is
+ * broadcast when the window closes; updates to the same Object while the window is open share that Ping, so a burst
+ * of updates costs every Client one Ping. If the window is 0 or too many windows are open, the Ping is broadcast at
+ * once. Called by the parent.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param ping the Ping
+ */
+void fanout_schedule_ping(struct core_object *co, struct server_object *so, const struct ping *ping);
+
+/**
+ * fanout_ping_timeout
+ * <p>
+ * Shorten a poll timeout so that poll returns when the earliest coalescing window closes. Called by the parent.
+ * </p>
+ * @param so the server object
+ * @param timeout the poll timeout in milliseconds, or -1 for none
+ * @return the shortened timeout
+ */
+int fanout_ping_timeout(struct server_object *so, int timeout);
+
+/**
+ * fanout_send_due_pings
+ * <p>
+ * Broadcast the Pings whose coalescing windows have closed. Each Ping is encoded once, into one frame queued on every
+ * connection. Called by the parent.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void fanout_send_due_pings(struct core_object *co, struct server_object *so);
+
+#endif //PROCESS_SERVER_FANOUT_H
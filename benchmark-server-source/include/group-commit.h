@@ -0,0 +1,125 @@
+#ifndef PROCESS_SERVER_GROUP_COMMIT_H
+#define PROCESS_SERVER_GROUP_COMMIT_H
+
+#include "storage-engine.h"
+
+#include <pthread.h>
+
+#define DURABILITY_ENV "CHAT_DURABILITY"                  /** request, batch or async; async if unset. */
+#define GROUP_COMMIT_WINDOW_ENV "CHAT_GROUP_COMMIT_WINDOW_US" /** Microseconds a batch stays open for more writes. */
+#define GROUP_COMMIT_DEFAULT_WINDOW_US 200                /** Used if CHAT_GROUP_COMMIT_WINDOW_US is unset. */
+#define GROUP_COMMIT_MAX_WRITES 64                        /** A batch is committed as soon as it holds this many. */
+#define GROUP_COMMIT_BUFFER_SIZE (256 * 1024)             /** Bytes of keys and values a batch can hold. */
+
+/**
+ * When a write is acknowledged.
+ * <ul>
+ * <li>async: once it is applied; it reaches the disk whenever the operating system, or the storage engine, writes it
+ * back.</li>
+ * <li>request: once it is applied and forced to disk; every write pays for its own flush.</li>
+ * <li>batch: once it is applied and forced to disk as part of a group commit, which shares one lock acquisition and
+ * one flush between the writes of every worker that arrive within the window.</li>
+ * </ul>
+ * A write is forced to disk by forcing the write-ahead log, or the database files if the log is off.
+ */
+enum DurabilityMode
+{
+    DURABILITY_ASYNC,
+    DURABILITY_REQUEST,
+    DURABILITY_BATCH
+};
+
+/**
+ * A write waiting in a batch. The key and value are stored in the data of the batch.
+ */
+struct queued_write
+{
+    enum WriteKind kind;
+    int            store_flags;
+    size_t         key_offset;
+    size_t         key_size;
+    size_t         value_offset;
+    size_t         value_size;
+    int            status;
+};
+
+/**
+ * A batch goes from open, while writers add to it, to committing, while its leader applies it, to done, while its
+ * writers collect their statuses. The last writer to collect opens it again.
+ */
+enum BatchState
+{
+    BATCH_OPEN,
+    BATCH_COMMITTING,
+    BATCH_DONE
+};
+
+/**
+ * A batch of writes to one database.
+ */
+struct commit_batch
+{
+    enum BatchState     state;
+    int                 full;        // Set when a write did not fit, so the leader commits without waiting.
+    size_t              count;
+    size_t              used;        // Bytes of data in use.
+    size_t              uncollected; // Writers which have not yet collected their status.
+    struct queued_write writes[GROUP_COMMIT_MAX_WRITES];
+    uint8_t             data[GROUP_COMMIT_BUFFER_SIZE];
+};
+
+/**
+ * The group commit queue of a database. Lives in shared memory. Writers from every worker add their writes to the
+ * filling batch; the first writer of a batch leads it, waiting for the window to pass or the batch to fill, then
+ * applies the whole batch and wakes the others. Two batches are kept so that writers can fill one while the other is
+ * committed. Everything but the data of a committing batch is only read or written while holding the mutex.
+ */
+struct commit_queue
+{
+    pthread_mutex_t     mutex;
+    pthread_cond_t      changed; // Broadcast whenever a batch changes state or fills up.
+    long                window_us;
+    size_t              filling;
+    struct commit_batch batches[2];
+};
+
+/**
+ * open_commit_queues
+ * <p>
+ * Read the durability mode from CHAT_DURABILITY and set up every database for it. In batch mode, map a commit queue
+ * for each database into shared memory. Must be called after the write-ahead log is opened and before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err if the mode is unknown or on failure
+ */
+int open_commit_queues(struct core_object *co, struct server_object *so);
+
+/**
+ * close_commit_queues
+ * <p>
+ * Unmap the commit queues.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_commit_queues(struct core_object *co, struct server_object *so);
+
+/**
+ * commit_write
+ * <p>
+ * Apply a write to a database and force it to disk before returning. If the database has a commit queue, the write
+ * is applied as part of a group commit.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param kind store or remove
+ * @param key the key of the record
+ * @param value the record to store, or NULL when removing
+ * @param store_flags whether to insert or overwrite when storing
+ * @return what the engine's store or remove would return
+ */
+int commit_write(struct core_object *co, struct database *db, enum WriteKind kind, datum *key, datum *value,
+                 int store_flags);
+
+#endif //PROCESS_SERVER_GROUP_COMMIT_H
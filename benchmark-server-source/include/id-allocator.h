@@ -0,0 +1,103 @@
+#ifndef PROCESS_SERVER_ID_ALLOCATOR_H
+#define PROCESS_SERVER_ID_ALLOCATOR_H
+
+#include "rw-lock.h"
+
+#include <stdalign.h>
+
+#define ID_FILE_NAME "ids_3fda69" /** File holding the ID ceiling of every kind of ID. */
+#define ID_LEASE_SIZE 64          /** IDs a worker takes from a shared counter at once. */
+#define ID_RESERVE_SIZE 65536     /** IDs reserved on disk ahead of a shared counter. */
+#define USER_ID_RESERVE_SIZE 1024 /** User IDs reserved on disk ahead of their counter; see reserve_size. */
+
+/**
+ * The kinds of ID handed out by the allocator.
+ */
+enum IdKind
+{
+    USER_ID,
+    CHANNEL_ID,
+    MESSAGE_ID,
+    NUM_ID_KINDS
+};
+
+/**
+ * A shared counter. Next is the first ID not yet leased to a worker. Every ID below the ceiling has been recorded on
+ * disk as used, so IDs below it are never handed out again after a restart.
+ */
+struct id_counter
+{
+    alignas(CACHE_LINE_SIZE) atomic_long next;
+    atomic_long                          ceiling; // Only raised while holding the allocator lock.
+};
+
+/**
+ * The ID allocator. Lives in shared memory so that every worker hands out IDs from the same counters. Workers lease
+ * blocks of IDs from the counters with an atomic fetch-add and hand them out from private memory, so no lock is taken
+ * and no shared cache line is written for most IDs. The lock is only taken when a lease crosses the ceiling, to
+ * reserve more IDs on disk.
+ */
+struct id_allocator
+{
+    struct rw_lock    lock;
+    int               fd; // Opened before forking, so the same in every process.
+    struct id_counter counters[NUM_ID_KINDS];
+};
+
+/**
+ * A block of IDs leased by a worker. IDs from next up to end are the worker's to hand out.
+ */
+struct id_lease
+{
+    long next;
+    long end;
+};
+
+/**
+ * open_id_allocator
+ * <p>
+ * Map the ID allocator into shared memory and start each counter after both the ceiling recorded on disk and the
+ * greatest ID in its database. Must be called after the databases are opened and before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_id_allocator(struct core_object *co, struct server_object *so);
+
+/**
+ * close_id_allocator
+ * <p>
+ * Close the ID file and unmap the ID allocator.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_id_allocator(struct core_object *co, struct server_object *so);
+
+/**
+ * release_unused_ids
+ * <p>
+ * Lower the ceilings recorded on disk to the shared counters, so that IDs reserved but never leased are not skipped
+ * after a restart. Must only be called once every worker has exited.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int release_unused_ids(struct core_object *co, struct server_object *so);
+
+/**
+ * allocate_id
+ * <p>
+ * Get a unique ID of a kind. IDs are unique across every worker and across restarts.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param kind the kind of ID
+ * @param id_get memory in which to store the ID
+ * @return 0 on success, -1 and set err on failure
+ */
+int allocate_id(struct core_object *co, struct server_object *so, enum IdKind kind, int *id_get);
+
+#endif //PROCESS_SERVER_ID_ALLOCATOR_H
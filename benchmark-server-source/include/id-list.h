@@ -0,0 +1,112 @@
+#ifndef PROCESS_SERVER_ID_LIST_H
+#define PROCESS_SERVER_ID_LIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ID_LIST_BLOCK 64 /** IDs per block of an array container; only the first of each block is stored whole. */
+
+/**
+ * How an encoded list of IDs is laid out. Whichever container is smaller for the IDs is used.
+ * <ul>
+ * <li>An array container holds a table of blocks, each giving the first ID of the block and where the rest of the
+ * block starts, followed by the rest of every block: the difference between each ID and the one before it, as a
+ * variable length integer of seven bits per byte. A lookup searches the table, then decodes a single block.</li>
+ * <li>A bitmap container holds the first ID it can hold, which is a multiple of 64, and a bit for that ID and each
+ * ID after it up to the last ID of the list. A lookup tests one bit.</li>
+ * </ul>
+ * Both start with 32 bit fields, and the bitmap with 64 bit words after an 8 byte header. Fields and words are copied
+ * out rather than read in place, so an encoded list may start at any byte.
+ */
+enum id_list_container
+{
+    ID_LIST_ARRAY,
+    ID_LIST_BITMAP
+};
+
+/**
+ * An entry of the table of blocks of an array container.
+ */
+struct id_list_block
+{
+    int32_t  first;
+    uint32_t offset; // Of the differences following first, from the start of the list.
+};
+
+/**
+ * The header of a bitmap container. The words follow it.
+ */
+struct id_list_bitmap
+{
+    int32_t  base;
+    uint32_t word_count;
+};
+
+/**
+ * id_list_size
+ * <p>
+ * Choose the container for a list of IDs and get the size of the list once encoded.
+ * </p>
+ * @param ids the IDs, sorted, without duplicates, and not negative
+ * @param count the number of IDs
+ * @param container memory in which to store the container to use
+ * @return the size in bytes
+ */
+size_t id_list_size(const int *ids, size_t count, enum id_list_container *container);
+
+/**
+ * id_list_encode
+ * <p>
+ * Encode a list of IDs into memory of the size given by id_list_size, which must be zeroed.
+ * </p>
+ * @param list the memory in which to encode the list
+ * @param ids the IDs, sorted, without duplicates, and not negative
+ * @param count the number of IDs
+ * @param container the container given by id_list_size
+ */
+void id_list_encode(uint8_t *list, const int *ids, size_t count, enum id_list_container container);
+
+/**
+ * id_list_check
+ * <p>
+ * Check that the tables of an encoded list lie within it. Decoding is bounded by the size of the list, so a list
+ * whose differences are malformed is still safe to read, if not meaningful.
+ * </p>
+ * @param list the encoded list
+ * @param size the size of the list in bytes
+ * @param count the number of IDs in the list
+ * @param container the container of the list
+ * @return 1 if the list is well formed, 0 if not
+ */
+int id_list_check(const uint8_t *list, size_t size, size_t count, enum id_list_container container);
+
+/**
+ * id_list_contains
+ * <p>
+ * Check whether an encoded list holds an ID, in logarithmic time for an array container and constant time for a
+ * bitmap container.
+ * </p>
+ * @param list the encoded list
+ * @param size the size of the list in bytes
+ * @param count the number of IDs in the list
+ * @param container the container of the list
+ * @param id the ID
+ * @return 1 if it does, 0 if not
+ */
+int id_list_contains(const uint8_t *list, size_t size, size_t count, enum id_list_container container, int id);
+
+/**
+ * id_list_decode
+ * <p>
+ * Decode the IDs of an encoded list, in order.
+ * </p>
+ * @param list the encoded list
+ * @param size the size of the list in bytes
+ * @param count the number of IDs in the list
+ * @param container the container of the list
+ * @param ids memory in which to store the IDs; must hold count of them
+ * @return the number of IDs decoded, which is less than count only if the list is malformed
+ */
+size_t id_list_decode(const uint8_t *list, size_t size, size_t count, enum id_list_container container, int *ids);
+
+#endif //PROCESS_SERVER_ID_LIST_H
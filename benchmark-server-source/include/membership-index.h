@@ -0,0 +1,219 @@
+#ifndef PROCESS_SERVER_MEMBERSHIP_INDEX_H
+#define PROCESS_SERVER_MEMBERSHIP_INDEX_H
+
+#include "rw-lock.h"
+
+#define MEMBERSHIP_CAPACITY 65536          /** Least number of memberships held; a power of two. */
+#define MEMBERSHIP_MAX_CAPACITY (1 << 22)  /** Most memberships held, however many exist at startup. */
+#define MEMBERSHIP_NONE (-1)               /** Marks an empty bucket or the end of a list. */
+#define MEMBERSHIP_CHANNEL_LOCKS 64        /** Update locks shared out between Channels; a power of two. */
+
+/**
+ * A User being a member of a Channel. Every membership is linked into two lists: the members of its Channel and the
+ * Channels of its User.
+ */
+struct membership
+{
+    int channel_id;
+    int user_id;
+    int channel_prev;
+    int channel_next;
+    int user_prev;
+    int user_next; // Links the free slots while the slot is not in use.
+};
+
+/**
+ * The membership index. Lives in shared memory so that every worker can answer which Users are in a Channel, and
+ * which Channels a User is in, without reading and parsing Channel records. Memberships are stored in a pool of
+ * slots; three open addressing hash tables of slot numbers, with twice as many buckets as slots, index the pool by
+ * Channel and User together, and hold the first membership of each Channel and of each User. Only read or written
+ * while holding the lock.
+ * <p>
+ * The pool is sized at startup to twice the memberships of the existing Channels, and the arrays follow the index in
+ * the same mapping, which every worker inherits at the same address. If a membership does not fit later, the index
+ * is no longer complete and is bypassed until restart: queries read the Channel records instead.
+ * </p>
+ * <p>
+ * A Channel record and the memberships of its Users are changed together by updates to the Channel, which read the
+ * record, write it back and then update the memberships. An update holds the update lock of its Channel throughout,
+ * so two updates to one Channel never start from the same record, and holds the lock of the index while it writes
+ * the record, so the memberships change if and only if the record does. The lock of the index is therefore taken
+ * before the locks of the databases, and never while holding them.
+ * </p>
+ */
+struct membership_index
+{
+    struct rw_lock    lock;
+    struct rw_lock    channel_locks[MEMBERSHIP_CHANNEL_LOCKS];
+    size_t            mapping_size;
+    size_t            capacity;    // A power of two.
+    size_t            bucket_mask; // Buckets per hash table, less one.
+    int               complete;    // Whether every membership is held.
+    int               free_slot;
+    int               *pair_buckets;
+    int               *channel_buckets;
+    int               *user_buckets;
+    struct membership memberships[]; // The pool; the hash tables follow it.
+};
+
+/**
+ * open_membership_index
+ * <p>
+ * Map the membership index into shared memory and fill it from the member lists of every Channel. Must be called
+ * after the write-ahead log is replayed and before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_membership_index(struct core_object *co, struct server_object *so);
+
+/**
+ * close_membership_index
+ * <p>
+ * Unmap the membership index.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_membership_index(struct core_object *co, struct server_object *so);
+
+/**
+ * membership_add
+ * <p>
+ * Record that a User is a member of a Channel. Does nothing if they already are.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param user_id the ID of the User
+ * @return 0 on success, -1 and set err on failure
+ */
+int membership_add(struct core_object *co, struct server_object *so, int channel_id, int user_id);
+
+/**
+ * membership_remove
+ * <p>
+ * Record that a User is no longer a member of a Channel. Does nothing if they were not.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param user_id the ID of the User
+ * @return 0 on success, -1 and set err on failure
+ */
+int membership_remove(struct core_object *co, struct server_object *so, int channel_id, int user_id);
+
+/**
+ * membership_apply
+ * <p>
+ * Record that Users joined and left a Channel, all under one acquisition of the lock. Users who already are or are
+ * not members are skipped.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param added the IDs of the Users who joined
+ * @param added_count the number of Users who joined
+ * @param removed the IDs of the Users who left
+ * @param removed_count the number of Users who left
+ * @return 0 on success, -1 and set err on failure
+ */
+int membership_apply(struct core_object *co, struct server_object *so, int channel_id, const int *added,
+                     size_t added_count, const int *removed, size_t removed_count);
+
+/**
+ * membership_begin_apply
+ * <p>
+ * Acquire the lock of the index for writing, so that the record holding the memberships of a Channel can be written
+ * before membership_end_apply records them, and no worker sees one without the other. If this fails, nothing has been
+ * written, so nothing needs to be undone.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int membership_begin_apply(struct core_object *co, struct server_object *so);
+
+/**
+ * membership_end_apply
+ * <p>
+ * Record that Users joined and left a Channel, as membership_apply does, under the lock acquired by
+ * membership_begin_apply, and release it. Cannot fail; pass no Users to release the lock without changing anything.
+ * </p>
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param added the IDs of the Users who joined
+ * @param added_count the number of Users who joined
+ * @param removed the IDs of the Users who left
+ * @param removed_count the number of Users who left
+ */
+void membership_end_apply(struct server_object *so, int channel_id, const int *added, size_t added_count,
+                          const int *removed, size_t removed_count);
+
+/**
+ * membership_lock_channel
+ * <p>
+ * Acquire the update lock of a Channel; see struct membership_index.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @return 0 on success, -1 and set err on failure
+ */
+int membership_lock_channel(struct core_object *co, struct server_object *so, int channel_id);
+
+/**
+ * membership_unlock_channel
+ * <p>
+ * Release the update lock of a Channel.
+ * </p>
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ */
+void membership_unlock_channel(struct server_object *so, int channel_id);
+
+/**
+ * membership_contains
+ * <p>
+ * Check whether a User is a member of a Channel.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param user_id the ID of the User
+ * @return 1 if they are, 0 if not, -1 and set err on failure
+ */
+int membership_contains(struct core_object *co, struct server_object *so, int channel_id, int user_id);
+
+/**
+ * membership_channel_users
+ * <p>
+ * List the IDs of the members of a Channel.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param user_ids memory in which to store a new array of the IDs, or NULL if there are none
+ * @param count memory in which to store the number of IDs
+ * @return 0 on success, -1 and set err on failure
+ */
+int membership_channel_users(struct core_object *co, struct server_object *so, int channel_id, int **user_ids,
+                             size_t *count);
+
+/**
+ * membership_user_channels
+ * <p>
+ * List the IDs of the Channels of which a User is a member.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param user_id the ID of the User
+ * @param channel_ids memory in which to store a new array of the IDs, or NULL if there are none
+ * @param count memory in which to store the number of IDs
+ * @return 0 on success, -1 and set err on failure
+ */
+int membership_user_channels(struct core_object *co, struct server_object *so, int user_id, int **channel_ids,
+                             size_t *count);
+
+#endif //PROCESS_SERVER_MEMBERSHIP_INDEX_H
@@ -0,0 +1,124 @@
+#ifndef PROCESS_SERVER_MESSAGE_LOG_H
+#define PROCESS_SERVER_MESSAGE_LOG_H
+
+#include "rw-lock.h"
+
+#include <stdint.h>
+
+#define MESSAGE_LOG_DIR "mlog_3fda69"             /** Directory holding the message log of every Channel. */
+#define MESSAGE_LOG_SEGMENT_SIZE (1024 * 1024)    /** A new segment is started once the last reaches this size. */
+#define MESSAGE_LOG_LOCK_STRIPES 64               /** Channels share locks by Channel ID modulo this; a power of two. */
+
+/**
+ * The shared state of the message logs. Each Channel has its own log, made of:
+ * <ul>
+ * <li>segments holding the serialized Messages, appended in the order they were created;</li>
+ * <li>a sequence index whose n-th fixed size entry locates the n-th Message of the Channel;</li>
+ * <li>a B+tree of fixed size pages ordering the Messages by timestamp and Message ID; see message-tree.h.</li>
+ * </ul>
+ * Segments and indexes are only ever appended to, so reading any range of a Channel's history costs only the Messages
+ * in it.
+ * The logs of a Channel are guarded by one stripe of the locks.
+ */
+struct message_log
+{
+    struct rw_lock locks[MESSAGE_LOG_LOCK_STRIPES];
+};
+
+/**
+ * A position in the Messages of a Channel ordered by time, just after the Message it was taken from. Message IDs are
+ * unique, so a sequence of UINT32_MAX places it after the Message with that timestamp and ID.
+ */
+struct message_cursor
+{
+    int64_t  timestamp;
+    int      message_id;
+    uint32_t sequence;
+};
+
+/**
+ * open_message_log
+ * <p>
+ * Create the message log directory if it does not exist, map the locks into shared memory and initialize them. Must
+ * be called before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_message_log(struct core_object *co, struct server_object *so);
+
+/**
+ * close_message_log
+ * <p>
+ * Unmap the message log locks.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_message_log(struct core_object *co, struct server_object *so);
+
+/**
+ * message_log_append
+ * <p>
+ * Append a Message to the log of its Channel, and index it.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param message the Message
+ * @return 0 on success, -1 and set err on failure
+ */
+int message_log_append(struct core_object *co, struct server_object *so, const Message *message);
+
+/**
+ * message_log_read
+ * <p>
+ * Read a range of Messages from the log of a Channel, oldest first. The range is clipped to the Messages which exist.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param first the sequence number of the first Message to read
+ * @param count the number of Messages to read
+ * @param messages_get memory in which to store a NULL terminated list of pointers to the Messages
+ * @return the number of Messages read on success, -1 and set err on failure
+ */
+long message_log_read(struct core_object *co, struct server_object *so, int channel_id, size_t first, size_t count,
+                      Message ***messages_get);
+
+/**
+ * message_log_read_latest
+ * <p>
+ * Read up to count of the most recent Messages from the log of a Channel, oldest first.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param count the maximum number of Messages to read
+ * @param messages_get memory in which to store a NULL terminated list of pointers to the Messages
+ * @return the number of Messages read on success, -1 and set err on failure
+ */
+long message_log_read_latest(struct core_object *co, struct server_object *so, int channel_id, size_t count,
+                             Message ***messages_get);
+
+/**
+ * message_log_read_range
+ * <p>
+ * Read up to count Messages of a Channel with timestamps in a range, ordered by timestamp and then by Message ID. To
+ * read the next page of the range, pass a cursor taken from the last Message of the previous page. Messages appended
+ * after a crash which interrupted an append are only found once the next append has rebuilt the tree.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param from the earliest timestamp to read
+ * @param to the latest timestamp to read
+ * @param after where the previous page ended, or NULL to start at from
+ * @param count the maximum number of Messages to read
+ * @param messages_get memory in which to store a NULL terminated list of pointers to the Messages
+ * @return the number of Messages read on success, -1 and set err on failure
+ */
+long message_log_read_range(struct core_object *co, struct server_object *so, int channel_id, time_t from, time_t to,
+                            const struct message_cursor *after, size_t count, Message ***messages_get);
+
+#endif //PROCESS_SERVER_MESSAGE_LOG_H
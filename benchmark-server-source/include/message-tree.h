@@ -0,0 +1,102 @@
+#ifndef PROCESS_SERVER_MESSAGE_TREE_H
+#define PROCESS_SERVER_MESSAGE_TREE_H
+
+#include "objects.h"
+
+#include <stdint.h>
+
+#define MESSAGE_TREE_PAGE_SIZE 4096                              /** Size of every page of a tree file. */
+#define MESSAGE_TREE_MAX_HEIGHT 8                                /** Deeper trees are refused as corrupt. */
+#define MESSAGE_TREE_FANOUT ((MESSAGE_TREE_PAGE_SIZE - 16) / 24) /** Slots per page, after a 16 byte page header. */
+
+/**
+ * An entry of a message tree. Entries are ordered by timestamp, then Message ID, then sequence number, so every
+ * Message of a Channel has its own entry even if the Client reused a timestamp. In leaves, sequence locates the
+ * Message in the sequence index of the message log; in branches, the entry is a separator key.
+ */
+struct message_tree_entry
+{
+    int64_t  timestamp;
+    int32_t  message_id;
+    uint32_t sequence;
+};
+
+/**
+ * A slot of a page of a message tree.
+ */
+struct message_tree_slot
+{
+    struct message_tree_entry key;
+    uint32_t                  child; // Only used by branches.
+    uint32_t                  reserved;
+};
+
+/**
+ * One page of a message tree. A leaf holds entries in order and the page number of the next leaf. A branch holds
+ * the page number of its first child, followed by separator keys, each with the child holding the entries at or after
+ * it. Page 0 of a file holds the header, so 0 means no page.
+ */
+struct message_tree_page
+{
+    uint16_t                 leaf;
+    uint16_t                 count;
+    uint32_t                 link; // The next leaf of a leaf, or the first child of a branch.
+    uint64_t                 reserved;
+    struct message_tree_slot slots[MESSAGE_TREE_FANOUT];
+};
+
+/**
+ * message_tree_size
+ * <p>
+ * Get the number of entries in a message tree. A file which does not hold a message tree holds none.
+ * </p>
+ * @param co the core object
+ * @param fd the tree file
+ * @return the number of entries on success, -1 and set err on failure
+ */
+long message_tree_size(struct core_object *co, int fd);
+
+/**
+ * message_tree_reset
+ * <p>
+ * Empty a message tree.
+ * </p>
+ * @param co the core object
+ * @param fd the tree file
+ * @return 0 on success, -1 and set err on failure
+ */
+int message_tree_reset(struct core_object *co, int fd);
+
+/**
+ * message_tree_insert
+ * <p>
+ * Insert an entry into a message tree. Pages are written children first and the header last, so the size in the
+ * header only counts an entry once every page holding it is written; a tree whose size lags behind the sequence index
+ * must be rebuilt. Inserting an entry which is already present does nothing.
+ * </p>
+ * @param co the core object
+ * @param fd the tree file
+ * @param entry the entry
+ * @return 0 on success, -1 and set err on failure
+ */
+int message_tree_insert(struct core_object *co, int fd, const struct message_tree_entry *entry);
+
+/**
+ * message_tree_scan
+ * <p>
+ * Read entries in order, starting at a key, and following the leaves from left to right until enough are read or an
+ * entry is later than a time.
+ * </p>
+ * @param co the core object
+ * @param fd the tree file
+ * @param start the key at which to start
+ * @param after if set, skip an entry equal to start
+ * @param to_timestamp the latest timestamp to read
+ * @param entries memory in which to store the entries
+ * @param count the maximum number of entries to read
+ * @return the number of entries read on success, -1 and set err on failure
+ */
+long message_tree_scan(struct core_object *co, int fd, const struct message_tree_entry *start, int after,
+                       int64_t to_timestamp, struct message_tree_entry *entries, size_t count);
+
+#endif //PROCESS_SERVER_MESSAGE_TREE_H
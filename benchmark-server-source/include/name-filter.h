@@ -0,0 +1,92 @@
+#ifndef PROCESS_SERVER_NAME_FILTER_H
+#define PROCESS_SERVER_NAME_FILTER_H
+
+#include "objects.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define NAME_FILTER_SHM_NAME "/nf_3fda69"   /** Name filters shared memory name. */
+#define NAME_FILTER_COUNTERS (1UL << 20)    /** Counters per filter; a power of two. */
+#define NAME_FILTER_HASHES 4                /** Counters each name maps to. */
+#define NAME_FILTER_COUNTER_MAX UINT8_MAX   /** A counter which reaches this sticks, since it has lost count. */
+
+/**
+ * A counting Bloom filter over the names in the name index of a database. Lives in shared memory. Every name in the
+ * index has incremented each of its counters, so a name with any counter at zero is definitely not in the index and
+ * the lookup can be skipped. Counters are only changed while holding the database lock for writing, in step with the
+ * index, but are read without it.
+ */
+struct name_filter
+{
+    atomic_ulong checks;
+    atomic_ulong misses; // Checks which found the name definitely absent.
+    atomic_uchar counters[NAME_FILTER_COUNTERS];
+};
+
+/**
+ * open_name_filters
+ * <p>
+ * Map a name filter for every database with a name index into shared memory and fill it from the records of the
+ * database. Must be called after the write-ahead log is replayed and before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_name_filters(struct core_object *co, struct server_object *so);
+
+/**
+ * close_name_filters
+ * <p>
+ * Unmap the name filters.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_name_filters(struct core_object *co, struct server_object *so);
+
+/**
+ * print_name_filter_stats
+ * <p>
+ * Print how many checks of each name filter spared a lookup.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void print_name_filter_stats(struct core_object *co, struct server_object *so);
+
+/**
+ * name_filter_may_contain
+ * <p>
+ * Check whether a name may be in the name index of a database. Does not need the database lock.
+ * </p>
+ * @param db the database
+ * @param name the name, without a null terminator
+ * @return 0 if the name is definitely not in the index, 1 if it may be or the database has no filter
+ */
+int name_filter_may_contain(struct database *db, const datum *name);
+
+/**
+ * name_filter_add
+ * <p>
+ * Count a name which has been added to the name index of a database. Does nothing if the database has no filter.
+ * Must be called while holding the database lock for writing.
+ * </p>
+ * @param db the database
+ * @param name the name, without a null terminator
+ */
+void name_filter_add(struct database *db, const datum *name);
+
+/**
+ * name_filter_remove
+ * <p>
+ * Uncount a name which has been removed from the name index of a database. Must only be called for a name which was
+ * counted. Does nothing if the database has no filter. Must be called while holding the database lock for writing.
+ * </p>
+ * @param db the database
+ * @param name the name, without a null terminator
+ */
+void name_filter_remove(struct database *db, const datum *name);
+
+#endif //PROCESS_SERVER_NAME_FILTER_H
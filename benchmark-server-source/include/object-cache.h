@@ -0,0 +1,177 @@
+#ifndef PROCESS_SERVER_OBJECT_CACHE_H
+#define PROCESS_SERVER_OBJECT_CACHE_H
+
+#include "objects.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define OBJECT_CACHE_SHM_NAME "/oc_3fda69"              /** Object cache generation counters shared memory name. */
+#define OBJECT_CACHE_ENTRIES 256                        /** Records each process caches per database. */
+#define OBJECT_CACHE_BUCKETS (2 * OBJECT_CACHE_ENTRIES) /** Hash buckets per key; a power of two. */
+#define OBJECT_CACHE_RECORD_MAX 1024                    /** Larger records are not cached. */
+#define OBJECT_CACHE_GENERATIONS 4096                   /** Generation counters per database; a power of two. */
+#define OBJECT_CACHE_NONE (-1)                          /** Marks an empty bucket or the end of a list. */
+#define OBJECT_CACHE_PARENT_SLOT NUM_CHILD_PROCESSES    /** Statistics slot of the parent, after the workers. */
+
+/**
+ * Statistics of the cache of one process for one database. Only written by that process.
+ */
+struct object_cache_stats
+{
+    alignas(CACHE_LINE_SIZE) atomic_ulong hits;
+    atomic_ulong                          misses;
+    atomic_ulong                          evictions;
+};
+
+/**
+ * The shared half of the caches of a database. Lives in shared memory. Every write to a record bumps the generation
+ * counter of its ID after the write is applied, while the database lock is still held; records whose IDs share a
+ * counter invalidate each other, which costs a miss but is never wrong. Every write bumps the count of writes first,
+ * so that a reader which only learns the ID of a record from the record itself can tell whether a write slipped in
+ * between reading the record and reading its counter.
+ */
+struct object_generations
+{
+    alignas(CACHE_LINE_SIZE) atomic_ulong writes;
+    alignas(CACHE_LINE_SIZE) atomic_ulong counters[OBJECT_CACHE_GENERATIONS];
+    struct object_cache_stats             stats[NUM_CHILD_PROCESSES + 1];
+};
+
+/**
+ * A cached copy of a record, tagged with the generation of its ID when it was read.
+ */
+struct object_cache_entry
+{
+    unsigned long generation;
+    int           id;
+    int           id_next;   // Next entry in the same ID bucket.
+    int           name_next; // Next entry in the same name bucket.
+    int           lru_prev;  // Towards the most recently used entry.
+    int           lru_next;  // Towards the least recently used entry; links the free entries while not in use.
+    size_t        size;
+    uint8_t       record[OBJECT_CACHE_RECORD_MAX];
+};
+
+/**
+ * The cache of a database in one process. Allocated in the parent before forking, so every worker starts with an
+ * empty copy of its own and never shares it. Entries are found by ID or by name through two chained hash tables, and
+ * the least recently used entry is evicted when the cache is full. An entry is only used while the generation counter
+ * of its ID still holds the generation it was tagged with, so a hit costs one atomic load and a compare.
+ */
+struct object_cache
+{
+    struct object_generations *shared;
+    struct object_cache_stats *stats; // The slot of this process.
+    int                       lru_head;
+    int                       lru_tail;
+    int                       free_entry;
+    int                       id_buckets[OBJECT_CACHE_BUCKETS];
+    int                       name_buckets[OBJECT_CACHE_BUCKETS];
+    struct object_cache_entry entries[OBJECT_CACHE_ENTRIES];
+};
+
+/**
+ * open_object_caches
+ * <p>
+ * Map the generation counters into shared memory and allocate an empty cache for the User and Channel databases. Must
+ * be called before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_object_caches(struct core_object *co, struct server_object *so);
+
+/**
+ * close_object_caches
+ * <p>
+ * Free the caches of the calling process and unmap the generation counters.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_object_caches(struct core_object *co, struct server_object *so);
+
+/**
+ * attach_object_caches
+ * <p>
+ * Count the hits, misses and evictions of the calling worker in its own statistics slots.
+ * </p>
+ * @param so the server object
+ * @param worker the position of the worker among the children
+ */
+void attach_object_caches(struct server_object *so, size_t worker);
+
+/**
+ * print_object_cache_stats
+ * <p>
+ * Print the hits, misses and evictions of the caches of every process.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void print_object_cache_stats(struct core_object *co, struct server_object *so);
+
+/**
+ * object_cache_fetch
+ * <p>
+ * Fetch a record from a database through the cache of the database, which must have one.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key of the record
+ * @param serial_buffer memory in which to store a new copy of the record
+ * @return 0 if the record was copied, 1 if not found, -1 and set err on failure
+ */
+int object_cache_fetch(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer);
+
+/**
+ * object_cache_find_by_name
+ * <p>
+ * Find a record by name through the cache of the database, which must have one.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param serial_object memory in which to store a new copy of the record, or NULL if no result is needed
+ * @param name the name
+ * @return 1 if found, 0 if not found, -1 and set err on failure
+ */
+int object_cache_find_by_name(struct core_object *co, struct database *db, uint8_t **serial_object, const char *name);
+
+/**
+ * object_cache_invalidate
+ * <p>
+ * Bump the generation of a record which has been written, so that every cached copy of it is no longer used. Does
+ * nothing if the database has no cache. Must be called while holding the database lock for writing, after the write
+ * is applied.
+ * </p>
+ * @param db the database
+ * @param key the key of the record
+ */
+void object_cache_invalidate(struct database *db, const datum *key);
+
+/**
+ * object_cache_writes
+ * <p>
+ * Get the count of writes to a database, which must have a cache. Lets a copy derived from a record found by name be
+ * tagged with the generation of the record in the same way as the cache does; see struct object_generations.
+ * </p>
+ * @param db the database
+ * @return the count of writes
+ */
+unsigned long object_cache_writes(const struct database *db);
+
+/**
+ * object_cache_generation
+ * <p>
+ * Get the generation of a record, which changes whenever the record is written. The database must have a cache.
+ * </p>
+ * @param db the database
+ * @param id the ID of the record
+ * @return the generation
+ */
+unsigned long object_cache_generation(const struct database *db, int id);
+
+#endif //PROCESS_SERVER_OBJECT_CACHE_H
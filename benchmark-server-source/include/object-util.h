@@ -3,6 +3,131 @@
 
 #include "../include/objects.h"
 
+#include <stdalign.h>
+#include <stdint.h>
+
+#define RECORD_VERSION 1   /** Layout version of serialized records; records of other versions are refused. */
+#define RECORD_ALIGNMENT 8 /** Serialized records are padded to a multiple of this many bytes. */
+
+/**
+ * The header of a serialized record. Every record starts with the ID of its object, so the key of a record is its
+ * first bytes, followed by the version of the layout, and a table of the strings of the record. A string is null
+ * terminated and located anywhere after the fixed part of the record. The fixed part of each record, which is the
+ * header, the table and the fields of fixed length, is a struct, and records are padded to a multiple of
+ * RECORD_ALIGNMENT bytes, so a record read into memory returned by malloc, or stored after another record,
+ * can be read in place through the struct of its kind.
+ */
+struct record_header
+{
+    alignas(RECORD_ALIGNMENT) int32_t id; // Aligns every kind of record, whichever fields follow.
+    uint16_t                          version;
+    uint16_t                          field_count; // Number of entries in the table of fields, which follows.
+    uint32_t                          size;        // In bytes, including the padding.
+    uint32_t                          reserved;
+};
+
+/**
+ * The location of a string within a record. The first string of every record is its name.
+ */
+struct record_field
+{
+    uint32_t offset; // From the start of the record.
+    uint32_t length; // In bytes, not including the last null terminator.
+};
+
+/**
+ * The location of an encoded list of IDs within a record; see id-list.h. The list starts at a multiple of
+ * RECORD_ALIGNMENT bytes.
+ */
+struct record_ids
+{
+    uint32_t offset;    // From the start of the record.
+    uint32_t size;      // In bytes.
+    uint32_t count;     // Number of IDs.
+    uint32_t container; // An enum id_list_container.
+};
+
+/**
+ * Declares the members of the fixed part of a record for one field of its schema; see objects.h. The ID is held in
+ * the header, strings in the table of strings, and lists of IDs located by a record_ids.
+ */
+#define RECORD_MEMBER(kind, type, name) RECORD_MEMBER_##kind(name)
+#define RECORD_MEMBER_ID(name)
+#define RECORD_MEMBER_STRING(name) struct record_field name;
+#define RECORD_MEMBER_INT(name) int32_t name;
+#define RECORD_MEMBER_TIME(name) int64_t name;
+#define RECORD_MEMBER_IDS(name) struct record_ids name;
+
+/**
+ * Counts the strings of a schema, which is the number of entries in the table of strings of its records, as
+ * 0 SCHEMA(RECORD_STRING).
+ */
+#define RECORD_STRING(kind, type, name) + RECORD_IS_STRING_##kind
+#define RECORD_IS_STRING_ID 0
+#define RECORD_IS_STRING_STRING 1
+#define RECORD_IS_STRING_INT 0
+#define RECORD_IS_STRING_TIME 0
+#define RECORD_IS_STRING_IDS 0
+
+/**
+ * The wire format of each kind of field: a printf conversion, and the type it converts. Lists of IDs are not sent.
+ */
+#define WIRE_FORMAT_ID "%d"
+#define WIRE_FORMAT_STRING "%s"
+#define WIRE_FORMAT_INT "%d"
+#define WIRE_FORMAT_TIME "%lx"
+#define WIRE_TYPE_ID int
+#define WIRE_TYPE_STRING const char *
+#define WIRE_TYPE_INT int
+#define WIRE_TYPE_TIME unsigned long
+
+/**
+ * Number of strings of each kind of record.
+ */
+enum record_strings
+{
+    USER_RECORD_STRINGS    = 0 USER_SCHEMA(RECORD_STRING),
+    CHANNEL_RECORD_STRINGS = 0 CHANNEL_SCHEMA(RECORD_STRING),
+    MESSAGE_RECORD_STRINGS = 0 MESSAGE_SCHEMA(RECORD_STRING),
+    AUTH_RECORD_STRINGS    = 0 AUTH_SCHEMA(RECORD_STRING)
+};
+
+/**
+ * A serialized User.
+ */
+struct user_record
+{
+    struct record_header header;
+    USER_SCHEMA(RECORD_MEMBER)
+};
+
+/**
+ * A serialized Channel. Users are listed by ID, so renaming a User leaves the Channel records alone.
+ */
+struct channel_record
+{
+    struct record_header header;
+    CHANNEL_SCHEMA(RECORD_MEMBER)
+};
+
+/**
+ * A serialized Message.
+ */
+struct message_record
+{
+    struct record_header header;
+    MESSAGE_SCHEMA(RECORD_MEMBER)
+};
+
+/**
+ * A serialized Auth.
+ */
+struct auth_record
+{
+    struct record_header header;
+    AUTH_SCHEMA(RECORD_MEMBER)
+};
+
 /**
  * serialize_user
  * <p>
@@ -52,19 +177,20 @@ unsigned long serialize_message(struct core_object *co, uint8_t **serial_message
 unsigned long serialize_auth(struct core_object *co, uint8_t **serial_auth, const Auth *auth);
 
 /**
- * serialize_addr_id_pair
+ * patch_channel
  * <p>
- * Given a display name and a socket address, allocate memory for and create a byte
- * stream in the format [name, ip-addr, port-num].
+ * Serialize a Channel record again with some of its fields replaced. A string or list replaces that of the record if
+ * its pointer in the patch is not NULL, even if the list holds no IDs. The lists which are not replaced are copied
+ * still encoded, so only the lists which change are decoded and encoded again.
  * </p>
  * @param co the core object
- * @param addr_id_dst the destination buffer
- * @param user_id the display name
- * @param addr the socket addr
- * @return the size of the buffer on success, -1 and set err on failure.
+ * @param serial_channel the buffer into which to serialize the Channel
+ * @param source the Channel record, through its view
+ * @param patch the replacements; its ID is ignored
+ * @return size of Channel in bytes on success, 0 and set err on failure
  */
-unsigned long serialize_addr_id_pair(struct core_object *co, uint8_t **addr_id_dst, struct sockaddr_in *addr,
-                                     int *user_id);
+unsigned long patch_channel(struct core_object *co, uint8_t **serial_channel, const struct channel_record *source,
+                            const Channel *patch);
 
 /**
  * deserialize_user
@@ -74,8 +200,33 @@ unsigned long serialize_addr_id_pair(struct core_object *co, uint8_t **addr_id_d
  * @param co the core object
  * @param user_get the User struct
  * @param serial_user the bytes to deserialize
+ * @return 0 on success, -1 and set err on failure or if the record is malformed
  */
-void deserialize_user(struct core_object *co, User **user_get, uint8_t *serial_user);
+int deserialize_user(struct core_object *co, User **user_get, const uint8_t *serial_user);
+
+/**
+ * deserialize_channel
+ * <p>
+ * Store a byte string version of a Channel into a Channel struct. Its lists are newly allocated.
+ * </p>
+ * @param co the core object
+ * @param channel_get the Channel in which to store the bytes
+ * @param serial_channel the bytes to convert
+ * @return 0 on success, -1 and set err on failure or if the record is malformed
+ */
+int deserialize_channel(struct core_object *co, Channel **channel_get, const uint8_t *serial_channel);
+
+/**
+ * deserialize_message
+ * <p>
+ * Store a byte string version of a Message into a Message struct.
+ * </p>
+ * @param co the core object
+ * @param message_get the Message in which to store the bytes
+ * @param serial_message the bytes to convert
+ * @return 0 on success, -1 and set err on failure or if the record is malformed
+ */
+int deserialize_message(struct core_object *co, Message **message_get, const uint8_t *serial_message);
 
 /**
  * deserialize_auth
@@ -85,19 +236,109 @@ void deserialize_user(struct core_object *co, User **user_get, uint8_t *serial_u
  * @param co the core object
  * @param auth_get the auth in which to store the bytes
  * @param serial_auth the bytes to convert
+ * @return 0 on success, -1 and set err on failure or if the record is malformed
  */
-void deserialize_auth(struct core_object *co, Auth **auth_get, uint8_t *serial_auth);
+int deserialize_auth(struct core_object *co, Auth **auth_get, const uint8_t *serial_auth);
 
 /**
- * deserialize_addr_id_pair
+ * view_record
  * <p>
- * Deserialize a buffer into an AddrIdPair.
+ * Check a serialized record of any kind: that it has the current layout version and the expected number of fields,
+ * that its fixed part fits, and that every field lies after the fixed part and ends in a null terminator within the
+ * record. The memory at record must be aligned for the record and hold as many bytes as its header gives; a record
+ * fetched whole from a database, or checked with datum_record, does.
  * </p>
- * @param co the core object
- * @param addr_id_pair_get the address-id pair object in which to store the deserialized buffer
- * @param serial_addr_id the buffer to deserialize
+ * @param record the serialized record
+ * @param field_count the number of fields of the kind of record
+ * @param fixed_size the size of the fixed part of the kind of record
+ * @return the header of the record, or NULL if it is malformed
  */
-void deserialize_addr_id_pair(struct core_object *co, AddrIdPair **addr_id_pair_get, uint8_t *serial_addr_id);
+const struct record_header *view_record(const void *record, uint16_t field_count, size_t fixed_size);
+
+/**
+ * datum_record
+ * <p>
+ * Check that a datum holds at least as many bytes as the record it holds gives in its header.
+ * </p>
+ * @param value the datum
+ * @return the record, or NULL if the datum is too short
+ */
+const uint8_t *datum_record(const datum *value);
+
+/**
+ * view_user
+ * <p>
+ * View a serialized User in place. See view_record.
+ * </p>
+ * @param serial_user the serialized User
+ * @return the view, or NULL if the record is malformed
+ */
+const struct user_record *view_user(const void *serial_user);
+
+/**
+ * view_channel
+ * <p>
+ * View a serialized Channel in place. See view_record. The lists of IDs are also checked with id_list_check.
+ * </p>
+ * @param serial_channel the serialized Channel
+ * @return the view, or NULL if the record is malformed
+ */
+const struct channel_record *view_channel(const void *serial_channel);
+
+/**
+ * view_message
+ * <p>
+ * View a serialized Message in place. See view_record.
+ * </p>
+ * @param serial_message the serialized Message
+ * @return the view, or NULL if the record is malformed
+ */
+const struct message_record *view_message(const void *serial_message);
+
+/**
+ * view_auth
+ * <p>
+ * View a serialized Auth in place. See view_record.
+ * </p>
+ * @param serial_auth the serialized Auth
+ * @return the view, or NULL if the record is malformed
+ */
+const struct auth_record *view_auth(const void *serial_auth);
+
+/**
+ * record_string
+ * <p>
+ * Get a field of a viewed record.
+ * </p>
+ * @param record the record, through the view of its kind
+ * @param field the field
+ * @return the string; it points into the record
+ */
+const char *record_string(const void *record, const struct record_field *field);
+
+/**
+ * record_has_id
+ * <p>
+ * Check whether a list of IDs of a viewed record holds an ID, without decoding the list.
+ * </p>
+ * @param record the record, through the view of its kind
+ * @param ids the list
+ * @param id the ID
+ * @return 1 if it does, 0 if not
+ */
+int record_has_id(const void *record, const struct record_ids *ids, int id);
+
+/**
+ * record_copy_ids
+ * <p>
+ * Decode a list of IDs of a viewed record.
+ * </p>
+ * @param record the record, through the view of its kind
+ * @param ids the list
+ * @param dst memory in which to store the IDs, in order; must hold as many as the list
+ * @return the number of IDs decoded, which is less than the count of the list only if the list is malformed
+ */
+size_t record_copy_ids(const void *record, const struct record_ids *ids, int *dst);
 
 /**
  * free_user
@@ -108,6 +349,27 @@ void deserialize_addr_id_pair(struct core_object *co, AddrIdPair **addr_id_pair_
  * @param user the user to deallocate
  */
 void free_user(struct core_object *co, User *user);
+
+/**
+ * free_channel
+ * <p>
+ * Free a Channel's fields then the Channel. Must be allocated in the memory manager, as by deserialize_channel.
+ * </p>
+ * @param co the core object
+ * @param channel the Channel to deallocate
+ */
+void free_channel(struct core_object *co, Channel *channel);
+
+/**
+ * free_message
+ * <p>
+ * Free a Message's fields then the Message. Must be allocated in the memory manager.
+ * </p>
+ * @param co the core object
+ * @param message the Message to deallocate
+ */
+void free_message(struct core_object *co, Message *message);
+
 /**
  * free_auth
  * <p>
@@ -118,5 +380,17 @@ void free_user(struct core_object *co, User *user);
  */
 void free_auth(struct core_object *co, Auth *auth);
 
+/**
+ * format_user
+ * <p>
+ * Write the fields of a User in the wire format, each followed by an ETX. Like snprintf, writes at most size bytes
+ * including a null terminator, and returns the length the whole User takes, so a NULL buffer of size 0 measures it.
+ * </p>
+ * @param buffer the buffer in which to write, or NULL
+ * @param size the size of the buffer
+ * @param user the User
+ * @return the length of the User in the wire format, not including the null terminator
+ */
+size_t format_user(char *buffer, size_t size, const User *user);
 
 #endif //TEST_SERVER_OBJECT_UTIL_H
@@ -10,6 +10,7 @@
 #include <ndbm.h>
 #endif // NDBM_H
 #include <netinet/in.h>
+#include <time.h>
 
 // TODO delet this when done
 #define PRINT_BYTES(array, size) \
@@ -22,21 +23,31 @@
 #define POLLFDS_SIZE 2 + MAX_CONNECTIONS   /** The size of the pollfds array. +2 for listen socket and child-to-parent pipe. */
 #define READ_END 0                         /** Read end of child_finished_pipe or read child_finished_semaphore. */
 #define WRITE_END 1                        /** Write end of child_finished_pipe or read child_finished_semaphore. */
+#define FANOUT_QUEUE_LENGTH 16             /** The number of forwarded frames which may wait on one connection. */
+#define FANOUT_NONE (-1)                   /** No frame to forward. */
+#define PENDING_PINGS 64                   /** The number of coalescing windows which may be open at once. */
+#define PING_NAME_MAX_SIZE 20              /** Longest display name or Channel name carried by a Ping. */
 
 #define PIPE_WRITE_SEM_NAME "/pw_3fda69"   /** Pipe write semaphore name. */
 #define DOMAIN_READ_SEM_NAME "/dr_3fda69"  /** Domain socket read semaphore name. */
 #define DOMAIN_WRITE_SEM_NAME "/dw_3fda69" /** Domain socket write semaphore name. */
-#define USER_SEM_NAME "/u_3fda69"          /** User db semaphore name. */
-#define CHANNEL_SEM_NAME "/ch_3fda69"      /** Channel db semaphore name. */
-#define MESSAGE_SEM_NAME "/m_3fda69"       /** Message db semaphore name. */
-#define AUTH_SEM_NAME "/au_3fda69"         /** Auth db semaphore name. */
-#define NAME_ADDR_SEM_NAME "/ai_3fda69"    /** Auth db semaphore name. */
-
-#define USER_DB_NAME "dbu_3fda69"          /** User db name. */
-#define CHANNEL_DB_NAME "dbch_3fda69"      /** Channel db name. */
-#define MESSAGE_DB_NAME "dbm_3fda69"       /** Message db name. */
-#define AUTH_DB_NAME "dbau_3fda69"         /** Auth db name. */
-#define ADDR_ID_DB_NAME "dbai_3fda69"      /** Display name-Socket address database. */
+
+#define DB_GENERATIONS_SHM_NAME "/sg_3fda69" /** Database generation counters shared memory name. */
+#define DB_LOCKS_SHM_NAME "/sl_3fda69"       /** Database locks shared memory name. */
+
+#define USER_DB_NAME "dbu_3fda69"              /** User db name. */
+#define CHANNEL_DB_NAME "dbch_3fda69"          /** Channel db name. */
+#define MESSAGE_DB_NAME_FORMAT "dbm%zu_3fda69" /** Message db shard name, formatted with the shard number. */
+#define MESSAGE_DB_NAME_SIZE 16                /** Size of a buffer holding a Message db shard name. */
+#define AUTH_DB_NAME "dbau_3fda69"             /** Auth db name. */
+#define USER_INDEX_NAME "dbun_3fda69"          /** Display name-User ID index. */
+#define CHANNEL_INDEX_NAME "dbchn_3fda69"      /** Channel name-Channel ID index. */
+#define AUTH_INDEX_NAME "dbaut_3fda69"         /** Login token-User ID index. */
+
+#define DEFAULT_MESSAGE_SHARDS 8               /** Messages are split by Channel ID into this many dbs if unset. */
+#define MAX_MESSAGE_SHARDS 64                  /** The most Message databases which can be configured. */
+#define MAX_DATABASES (3 + MAX_MESSAGE_SHARDS) /** The most databases shared between the worker processes. */
+#define CACHE_LINE_SIZE 64                     /** Counters written by different workers go on separate cache lines. */
 
 #define DB_FLAGS O_RDWR | O_CREAT          /** Flags for opening db. */
 #define DB_FILE_MODE S_IRUSR | S_IWUSR     /** File mode for opening db. */
@@ -61,23 +72,119 @@ struct core_object
     struct server_object *so;
 };
 
+/**
+ * A database shared between the worker processes. Any number of processes may read at once; a writer excludes all
+ * others. The DBM handle belongs to the process that opened it and is kept open for the lifetime of that process.
+ * Whenever a process writes to the database it bumps the shared generation; a process whose handle generation lags
+ * behind the shared generation must reopen its handle before using it.
+ * <p>
+ * A database may have a name index, which maps the name stored in each record (the string following the leading int
+ * ID) to the key of that record. The index is guarded by the same lock and kept in step with every write.
+ * </p>
+ * <p>
+ * Records are stored by the storage engine of the database. The DBM handles are only used by the ndbm engine.
+ * </p>
+ * <p>
+ * Writes are acknowledged according to the durability mode; see group-commit.h.
+ * </p>
+ * <p>
+ * A name filter in front of the name index answers most lookups of absent names without the lock; see name-filter.h.
+ * </p>
+ * <p>
+ * Every process keeps its own cache of recently read Users and Channels; see object-cache.h.
+ * </p>
+ * <p>
+ * Users are also copied into a table addressed by User ID, which holds their online status; see user-table.h.
+ * </p>
+ */
+struct database
+{
+    const char                  *name;
+    const char                  *index_name;        // NULL if the database has no name index.
+    const struct storage_engine *engine;
+    void                        *engine_state;      // Owned by the engine.
+    struct rw_lock              *lock;              // Lives in shared memory.
+    DBM                         *dbm;
+    DBM                         *index_dbm;
+    unsigned long               generation;
+    unsigned long               *shared_generation; // Lives in shared memory; only read or written while holding lock.
+    int                         flush_writes;       // Force every write to disk before acknowledging it.
+    struct commit_queue         *commit_queue;      // Lives in shared memory; NULL unless writes are group committed.
+    struct write_ahead_log      *wal;               // Lives in shared memory; NULL if writes are not logged.
+    unsigned int                wal_id;             // Identifies the database in the write-ahead log.
+    struct name_filter          *name_filter;       // Lives in shared memory; NULL if the database has no name index.
+    struct object_cache         *object_cache;      // Private to the process; NULL if records are not cached.
+    struct user_table           *user_table;        // Lives in shared memory; NULL unless the database holds Users.
+};
+
 /**
  * Contains information about the server state.
  */
 struct server_object
 {
-    pid_t         child_pids[NUM_CHILD_PROCESSES];
-    int           domain_fds[2];
-    int           c_to_p_pipe_fds[2];
-    sem_t         *domain_sems[2];
-    sem_t         *c_to_p_pipe_sem_write;
-    sem_t         *user_db_sem;
-    sem_t         *channel_db_sem;
-    sem_t         *message_db_sem;
-    sem_t         *auth_db_sem;
-    sem_t         *addr_id_db_sem;
-    struct parent *parent;
-    struct child  *child;
+    pid_t                       child_pids[NUM_CHILD_PROCESSES];
+    int                         domain_fds[2];
+    int                         c_to_p_pipe_fds[2];
+    sem_t                       *domain_sems[2];
+    sem_t                       *c_to_p_pipe_sem_write;
+    struct database             user_db;
+    struct database             channel_db;
+    struct database             message_dbs[MAX_MESSAGE_SHARDS]; // Shards, by Channel ID; see message_shard.
+    char                        message_db_names[MAX_MESSAGE_SHARDS][MESSAGE_DB_NAME_SIZE];
+    size_t                      num_message_shards;  // Fixed when the data is created; see select_message_shards.
+    size_t                      num_databases;       // The Message shards and the User, Channel and Auth databases.
+    struct database             auth_db;
+    unsigned long               *db_generations;     // Shared memory; one generation counter per database.
+    struct rw_lock              *db_locks;           // Shared memory; one lock per database.
+    const struct storage_engine *engine;
+    long                        persist_interval_ms; // 0 if the engine does not persist in the background.
+    long                        ping_window_ms;      // 0 if Pings are not coalesced.
+    struct timespec             last_persist;
+    struct session_table        *session_table;
+    struct message_log          *message_log;
+    struct id_allocator         *id_allocator;
+    struct commit_queue         *commit_queues;      // Shared memory; one per database, NULL unless group committing.
+    struct write_ahead_log      *wal;                // Shared memory; NULL if the write-ahead log is off.
+    pid_t                       snapshot_pid;        // Of the process writing a snapshot; 0 if none is running.
+    struct name_filter          *name_filters;       // Shared memory; one per database, used if it has a name index.
+    struct membership_index     *membership_index;   // Shared memory.
+    struct object_generations   *object_generations; // Shared memory; one per cached database.
+    struct user_table           *user_table;         // Shared memory.
+    struct fanout               *fanout;             // Shared memory.
+    struct presence             *presence;           // Shared memory.
+    struct channel_body_cache   *channel_bodies;     // Shared memory.
+    struct parent               *parent;
+    struct child                *child;
+};
+
+/**
+ * The frames waiting to be forwarded on one connection, oldest first; see fanout.h. Only the oldest may be partly
+ * sent.
+ */
+struct fanout_queue
+{
+    int    frames[FANOUT_QUEUE_LENGTH];
+    size_t head;
+    size_t count;
+    size_t offset; // Bytes of the oldest frame already sent.
+};
+
+/**
+ * A Ping about the update of one Object; see fanout.h.
+ */
+struct ping
+{
+    uint8_t type; // PINGUSER or PINGCHANNEL; 0 if there is no Ping.
+    char    name[PING_NAME_MAX_SIZE + 1];
+};
+
+/**
+ * A Ping waiting for its coalescing window to close.
+ */
+struct pending_ping
+{
+    struct ping     ping;
+    struct timespec due;
 };
 
 /**
@@ -85,9 +192,11 @@ struct server_object
  */
 struct parent
 {
-    struct pollfd      pollfds[POLLFDS_SIZE]; // 0th position is the listen socket fd, 1st position is pipe.
-    struct sockaddr_in client_addrs[MAX_CONNECTIONS];
-    size_t             num_connections;
+    struct pollfd       pollfds[POLLFDS_SIZE]; // 0th position is the listen socket fd, 1st position is pipe.
+    struct sockaddr_in  client_addrs[MAX_CONNECTIONS];
+    struct fanout_queue fanout_queues[MAX_CONNECTIONS];
+    struct pending_ping pending_pings[PENDING_PINGS]; // Free if the type of the Ping is 0.
+    size_t              num_connections;
 };
 
 /**
@@ -95,9 +204,22 @@ struct parent
  */
 struct child
 {
+    size_t             worker; // Position among the children; selects the slots of the worker in shared memory.
     int                client_fd_parent;
     int                client_fd_local;
     struct sockaddr_in client_addr;
+    int                fanout_frame; // To forward once the response is sent; FANOUT_NONE if none.
+    struct ping        ping;         // To broadcast once the response is sent.
+};
+
+/**
+ * What a child sends the parent over the child-to-parent pipe once it has handled a dispatch.
+ */
+struct child_report
+{
+    int         client_fd;    // The fd known by the parent; negative if the client disconnected.
+    int         fanout_frame; // FANOUT_NONE if there is nothing to forward.
+    struct ping ping;         // The type is 0 if there is nothing to broadcast.
 };
 
 enum PrivilegeLevel
@@ -107,36 +229,69 @@ enum PrivilegeLevel
     GLOBAL_ADMIN
 };
 
+/**
+ * Object schemas. Each lists the fields of an object in the order in which they are stored and sent, as
+ * FIELD(kind, type, name) entries, where the kind is one of:
+ * <ul>
+ * <li>ID: the ID of the object, which keys its record; always first;</li>
+ * <li>STRING: a null terminated string; every string comes before the other fields but the ID;</li>
+ * <li>INT: an integer of at most 32 bits;</li>
+ * <li>TIME: a time, stored in 64 bits and sent in hexadecimal;</li>
+ * <li>IDS: a sorted list of IDs, counted by a name_count member; stored as an ID list and never sent whole.</li>
+ * </ul>
+ * The structs below, the serialized records in object-util.h and the codecs in object-util.c are all generated from
+ * these tables, so a field added to a schema is stored, loaded, freed and sent without further changes.
+ */
+#define USER_SCHEMA(FIELD)                           \
+    FIELD(ID, int, id)                               \
+    FIELD(STRING, char *, display_name)              \
+    FIELD(INT, enum PrivilegeLevel, privilege_level) \
+    FIELD(INT, int, online_status)
+
+#define CHANNEL_SCHEMA(FIELD)           \
+    FIELD(ID, int, id)                  \
+    FIELD(STRING, char *, channel_name) \
+    FIELD(STRING, char *, creator)      \
+    FIELD(IDS, int *, users)            \
+    FIELD(IDS, int *, administrators)   \
+    FIELD(IDS, int *, banned_users)
+
+#define MESSAGE_SCHEMA(FIELD)              \
+    FIELD(ID, int, id)                     \
+    FIELD(STRING, char *, message_content) \
+    FIELD(INT, int, user_id)               \
+    FIELD(INT, int, channel_id)            \
+    FIELD(TIME, time_t, timestamp)
+
+#define AUTH_SCHEMA(FIELD)             \
+    FIELD(ID, int, user_id)            \
+    FIELD(STRING, char *, login_token) \
+    FIELD(STRING, char *, password)
+
+/**
+ * Declares the members of an object struct for one field of its schema.
+ */
+#define OBJECT_MEMBER(kind, type, name) OBJECT_MEMBER_##kind(type, name)
+#define OBJECT_MEMBER_ID(type, name) type name;
+#define OBJECT_MEMBER_STRING(type, name) type name;
+#define OBJECT_MEMBER_INT(type, name) type name;
+#define OBJECT_MEMBER_TIME(type, name) type name;
+#define OBJECT_MEMBER_IDS(type, name) size_t name##_count; type name;
+
 /**
  * User. Contains information about a User.
  */
 typedef struct
 {
-    int                 id;
-    char                *display_name;
-    enum PrivilegeLevel privilege_level;
-    int                 online_status;
+    USER_SCHEMA(OBJECT_MEMBER)
 } User;
 
 /**
- * Channel. Contains information about a Channel.
+ * Channel. Contains information about a Channel. Its lists hold User IDs.
  */
 typedef struct
 {
-    int        id;
-    char       *channel_name;
-    char       *creator;
-    size_t     users_count;      // This is the number of users.
-    const char **users;          // This is a null terminated list of names.
-    size_t     users_size_bytes; // This is the number of bytes.
-    
-    size_t     administrators_count;
-    const char **administrators;
-    size_t     administrators_size_bytes;
-    
-    size_t     banned_users_count;
-    const char **banned_users;
-    size_t     banned_users_size_bytes;
+    CHANNEL_SCHEMA(OBJECT_MEMBER)
 } Channel;
 
 /**
@@ -144,11 +299,7 @@ typedef struct
  */
 typedef struct
 {
-    int    id;
-    int    user_id;
-    int    channel_id;
-    char   *message_content;
-    time_t timestamp;
+    MESSAGE_SCHEMA(OBJECT_MEMBER)
 } Message;
 
 /**
@@ -156,20 +307,7 @@ typedef struct
  */
 typedef struct
 {
-    int  user_id;
-    char *login_token;
-    char *password;
+    AUTH_SCHEMA(OBJECT_MEMBER)
 } Auth;
 
-/**
- * NameAddrPair. Contains display name and associated socket address.
- */
-typedef struct
-{
-    in_addr_t socket_ip;
-    in_port_t socket_port;
-    int       id;
-    
-} AddrIdPair;
-
 #endif //PROCESS_SERVER_OBJECTS_H
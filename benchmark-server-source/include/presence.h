@@ -0,0 +1,118 @@
+#ifndef PROCESS_SERVER_PRESENCE_H
+#define PROCESS_SERVER_PRESENCE_H
+
+#include "db.h"
+#include "rw-lock.h"
+#include "session-table.h"
+
+#define PRESENCE_CAPACITY SESSION_TABLE_CAPACITY /** Only Users with a session are online. */
+
+/**
+ * Largest body of a Read-User Response listing the online Users: the code, the count and every display name, each
+ * followed by an ETX.
+ */
+#define PRESENCE_BODY_MAX_SIZE (8 + PRESENCE_CAPACITY * (NAME_MAX_SIZE + 1))
+
+/**
+ * An online User.
+ */
+struct presence_entry
+{
+    int  user_id;
+    char display_name[NAME_MAX_SIZE + 1];
+};
+
+/**
+ * The presence set. Lives in shared memory and holds every online User, packed at the front of entries in no
+ * particular order, so that the online Users are listed without scanning the User database. It is kept in step with
+ * the online status of Users by logins, logouts and disconnects.
+ * <p>
+ * The body of the Read-User Response listing the online Users is cached along with the set, and rebuilt by the first
+ * reader after the set changes, since every Client asks for it when it logs in. Only read or written while holding
+ * the lock.
+ * </p>
+ */
+struct presence
+{
+    struct rw_lock        lock;
+    size_t                count;
+    struct presence_entry entries[PRESENCE_CAPACITY];
+    int                   body_valid;
+    size_t                body_size;
+    char                  body[PRESENCE_BODY_MAX_SIZE];
+};
+
+/**
+ * open_presence
+ * <p>
+ * Map the presence set into shared memory, empty it, and initialize its lock. Must be called before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_presence(struct core_object *co, struct server_object *so);
+
+/**
+ * close_presence
+ * <p>
+ * Unmap the presence set.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_presence(struct core_object *co, struct server_object *so);
+
+/**
+ * presence_add
+ * <p>
+ * Mark a User online. Does nothing if the User is already online.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param user the User
+ * @return 1 if the User was added, 0 if the User was already online, -1 and set err on failure
+ */
+int presence_add(struct core_object *co, struct server_object *so, const User *user);
+
+/**
+ * presence_remove
+ * <p>
+ * Mark a User offline. Does nothing if the User is not online.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param user_id the ID of the User
+ * @return 1 if the User was removed, 0 if the User was not online, -1 and set err on failure
+ */
+int presence_remove(struct core_object *co, struct server_object *so, int user_id);
+
+/**
+ * presence_list
+ * <p>
+ * Copy every online User.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param entries_get memory in which to copy the Users; must hold PRESENCE_CAPACITY of them
+ * @param count memory in which to store the number of Users
+ * @return 0 on success, -1 and set err on failure
+ */
+int presence_list(struct core_object *co, struct server_object *so, struct presence_entry *entries_get,
+                  size_t *count);
+
+/**
+ * presence_read_body
+ * <p>
+ * Copy the body of the Read-User Response listing the online Users, building it if the set changed since it was last
+ * built.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param body_get memory in which to store the body; must be freed
+ * @param body_size memory in which to store the size of the body
+ * @return 0 on success, -1 and set err on failure
+ */
+int presence_read_body(struct core_object *co, struct server_object *so, char **body_get, size_t *body_size);
+
+#endif //PROCESS_SERVER_PRESENCE_H
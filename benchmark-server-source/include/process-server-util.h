@@ -28,7 +28,9 @@ int open_pipe_semaphores_domain_sockets(struct core_object *co, struct server_ob
 /**
  * open_databases
  * <p>
- * Open the User, Channel, Message, and Auth databases.
+ * Set up the User, Channel, Message, and Auth databases. Map the shared generation counters which let
+ * each process know when its database handles must be reopened. Handles are opened lazily by each process on first
+ * use and kept open until the process closes its databases.
  * </p>
  * @param co the core object
  * @param so the server object
@@ -76,13 +78,27 @@ void c_destroy_child_state(struct core_object *co, struct server_object *so, str
 /**
  * close_databases
  * <p>
- * Close the User, Channel, Message, and Auth databases.
+ * Close this process' handles to the User, Channel, Message, and Auth databases and unmap the shared generation
+ * counters.
  * </p>
  * @param co the core object
  * @param so the server object
  */
 void close_databases(struct core_object *co, struct server_object *so);
 
+/**
+ * map_shared_memory
+ * <p>
+ * Map a zeroed region of memory which will be shared with all processes forked after the mapping is made. The
+ * backing shared memory object is unlinked immediately, so the region disappears once every process unmaps it.
+ * </p>
+ * @param co the core object
+ * @param name the name of the backing shared memory object
+ * @param size the size of the region in bytes
+ * @return the region on success, NULL and set err on failure
+ */
+void *map_shared_memory(struct core_object *co, const char *name, size_t size);
+
 /**
  * close_fd_report_undefined_error
  * <p>
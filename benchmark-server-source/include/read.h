@@ -0,0 +1,70 @@
+#ifndef SERVER_TEST_SADDLE_READ_H
+#define SERVER_TEST_SADDLE_READ_H
+
+#include "../../include/global-objects.h"
+#include "objects.h"
+
+/**
+ * handle_read
+ * <p>
+ * Switch on the Object of a READ Type Dispatch.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch
+ * @param body_tokens the tokenized dispatch body
+ * @return 0 on success, -1 and set err on failure
+ */
+int handle_read(struct core_object *co, struct server_object *so, struct dispatch *dispatch, char **body_tokens);
+
+/**
+ * handle_read_user
+ * <p>
+ * Read the information of a User, or list the online Users if no display name is given.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch
+ * @param body_tokens the tokenized dispatch body
+ * @return 0 on success, -1 and set err on failure.
+ */
+int handle_read_user(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
+        char **body_tokens);
+
+/**
+ * handle_read_channel
+ * <p>
+ * Read the information of a Channel, along with the lists of its Users, Administrators and banned Users asked for.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch
+ * @param body_tokens the tokenized dispatch body
+ * @return 0 on success, -1 and set err on failure.
+ */
+int handle_read_channel(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
+        char **body_tokens);
+
+/**
+ * handle_read_message
+ * <p>
+ * Read the Message History of a Channel: its latest Messages, as RFC 7.2.3 specifies for a body of a Channel Name and
+ * a Number of Messages.
+ * </p>
+ * <p>
+ * As an extension to the RFC, the body may go on with the earliest and latest timestamps of a range, in hexadecimal
+ * like the timestamps of Messages. The Response then holds one page of the Messages sent within the range, oldest
+ * first, and ends with a cursor field, the timestamp and Message ID of the last Message in hexadecimal joined by a
+ * dot. Sending the cursor back after the same range reads the next page. Clients which only send the two fields of
+ * the RFC never receive a cursor.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch
+ * @param body_tokens the tokenized dispatch body
+ * @return 0 on success, -1 and set err on failure.
+ */
+int handle_read_message(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
+        char **body_tokens);
+
+#endif //SERVER_TEST_SADDLE_READ_H
@@ -0,0 +1,77 @@
+#ifndef PROCESS_SERVER_RW_LOCK_H
+#define PROCESS_SERVER_RW_LOCK_H
+
+#include "objects.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * A reader/writer lock shared between processes. Must live in shared memory. Readers proceed in parallel and only
+ * writers exclude. Acquisitions which had to wait are counted along with the time spent waiting, so contention can be
+ * measured.
+ */
+struct rw_lock
+{
+    pthread_rwlock_t lock;
+    atomic_ulong     read_acquisitions;
+    atomic_ulong     read_waits;
+    atomic_ulong     read_wait_ns;
+    atomic_ulong     write_acquisitions;
+    atomic_ulong     write_waits;
+    atomic_ulong     write_wait_ns;
+};
+
+/**
+ * rw_lock_init
+ * <p>
+ * Initialize a process shared reader/writer lock and zero its counters. Must be called before forking.
+ * </p>
+ * @param co the core object
+ * @param lock the lock, in shared memory
+ * @return 0 on success, -1 and set err on failure
+ */
+int rw_lock_init(struct core_object *co, struct rw_lock *lock);
+
+/**
+ * rw_lock_read
+ * <p>
+ * Acquire a lock for reading, waiting while a writer holds it.
+ * </p>
+ * @param co the core object
+ * @param lock the lock
+ * @return 0 on success, -1 and set err on failure
+ */
+int rw_lock_read(struct core_object *co, struct rw_lock *lock);
+
+/**
+ * rw_lock_write
+ * <p>
+ * Acquire a lock for writing, waiting while any reader or writer holds it.
+ * </p>
+ * @param co the core object
+ * @param lock the lock
+ * @return 0 on success, -1 and set err on failure
+ */
+int rw_lock_write(struct core_object *co, struct rw_lock *lock);
+
+/**
+ * rw_lock_unlock
+ * <p>
+ * Release a lock held for reading or writing.
+ * </p>
+ * @param lock the lock
+ */
+void rw_lock_unlock(struct rw_lock *lock);
+
+/**
+ * rw_lock_print_stats
+ * <p>
+ * Print the acquisition and wait counters of a lock.
+ * </p>
+ * @param lock the lock
+ * @param name the name to print for the lock
+ */
+void rw_lock_print_stats(struct rw_lock *lock, const char *name);
+
+#endif //PROCESS_SERVER_RW_LOCK_H
@@ -0,0 +1,139 @@
+#ifndef PROCESS_SERVER_SESSION_TABLE_H
+#define PROCESS_SERVER_SESSION_TABLE_H
+
+#include "db.h"
+#include "rw-lock.h"
+
+#define SESSION_TABLE_CAPACITY 64                           /** Maximum number of simultaneous sessions. */
+#define SESSION_TABLE_BUCKETS (2 * SESSION_TABLE_CAPACITY) /** Hash buckets per key; a power of two. */
+#define SESSION_EMPTY (-1)                                  /** Marks an empty bucket. */
+
+/**
+ * Session. Contains the resolved User of a logged in connection.
+ */
+typedef struct
+{
+    in_addr_t           socket_ip;
+    in_port_t           socket_port;
+    int                 user_id;
+    enum PrivilegeLevel privilege_level;
+    char                display_name[NAME_MAX_SIZE + 1];
+} Session;
+
+/**
+ * The session table. Lives in shared memory so that every worker can resolve a connection to its User without
+ * touching the disk. Sessions are stored in a fixed pool of slots; two open addressing hash tables of slot numbers
+ * index the pool by socket address and by User ID. Only read or written while holding the lock.
+ */
+struct session_table
+{
+    struct rw_lock lock;
+    Session        sessions[SESSION_TABLE_CAPACITY];
+    int            in_use[SESSION_TABLE_CAPACITY];
+    int            addr_buckets[SESSION_TABLE_BUCKETS];
+    int            id_buckets[SESSION_TABLE_BUCKETS];
+};
+
+/**
+ * open_session_table
+ * <p>
+ * Map the session table into shared memory, empty it, and initialize its lock. Must be called before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_session_table(struct core_object *co, struct server_object *so);
+
+/**
+ * close_session_table
+ * <p>
+ * Unmap the session table.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_session_table(struct core_object *co, struct server_object *so);
+
+/**
+ * session_insert
+ * <p>
+ * Start a session for a User on a connection. Any session already held by the connection or by the User is ended,
+ * so the most recent login always wins.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param addr the socket address of the connection
+ * @param user the User logging in
+ * @return 0 on success, -1 and set err on failure
+ */
+int session_insert(struct core_object *co, struct server_object *so, const struct sockaddr_in *addr,
+                   const User *user);
+
+/**
+ * session_find_by_addr
+ * <p>
+ * Find the session of a connection.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param addr the socket address of the connection
+ * @param session_get memory in which to copy the session, or NULL if not required
+ * @return 1 if found, 0 if not found, -1 and set err on failure
+ */
+int session_find_by_addr(struct core_object *co, struct server_object *so, const struct sockaddr_in *addr,
+                         Session *session_get);
+
+/**
+ * session_find_by_user_id
+ * <p>
+ * Find the session of a User.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param user_id the ID of the User
+ * @param session_get memory in which to copy the session, or NULL if not required
+ * @return 1 if found, 0 if not found, -1 and set err on failure
+ */
+int session_find_by_user_id(struct core_object *co, struct server_object *so, int user_id, Session *session_get);
+
+/**
+ * session_list
+ * <p>
+ * Copy every session.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param sessions_get memory in which to copy the sessions; must hold SESSION_TABLE_CAPACITY of them
+ * @param count memory in which to store the number of sessions
+ * @return 0 on success, -1 and set err on failure
+ */
+int session_list(struct core_object *co, struct server_object *so, Session *sessions_get, size_t *count);
+
+/**
+ * session_remove_by_addr
+ * <p>
+ * End the session of a connection, if it has one.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param addr the socket address of the connection
+ * @param session_get memory in which to copy the ended session, or NULL if not required
+ * @return 1 if a session was ended, 0 if there was none, -1 and set err on failure
+ */
+int session_remove_by_addr(struct core_object *co, struct server_object *so, const struct sockaddr_in *addr,
+                           Session *session_get);
+
+/**
+ * session_remove_by_user_id
+ * <p>
+ * End the session of a User, if they have one.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param user_id the ID of the User
+ * @return 0 on success, -1 and set err on failure
+ */
+int session_remove_by_user_id(struct core_object *co, struct server_object *so, int user_id);
+
+#endif //PROCESS_SERVER_SESSION_TABLE_H
@@ -0,0 +1,92 @@
+#ifndef PROCESS_SERVER_SNAPSHOT_H
+#define PROCESS_SERVER_SNAPSHOT_H
+
+#include "storage-engine.h"
+
+#define SNAPSHOT_FILE_NAME "snap_3fda69"          /** The latest complete snapshot. */
+#define SNAPSHOT_TEMP_FILE_NAME "snap_3fda69.tmp" /** A snapshot being written; renamed over the latest once complete. */
+#define SNAPSHOT_MAGIC 0x31504E53U                /** Marks a snapshot file. */
+#define SNAPSHOT_VERSION 1                        /** Version of the file format. */
+#define SNAPSHOT_NAME_SIZE 32                     /** Room for the name of a database or storage engine. */
+
+/**
+ * The header of a snapshot file. An entry for each database follows, then the images of the databases. An image is
+ * whatever the storage engine which took the snapshot copied out of memory, so a snapshot is only loaded by the same
+ * engine.
+ */
+struct snapshot_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t wal_sequence; // Of the active write-ahead log segment when the snapshot was taken.
+    char     engine[SNAPSHOT_NAME_SIZE];
+    uint32_t count;
+    uint32_t reserved;
+};
+
+/**
+ * Locates the image of a database in a snapshot file.
+ */
+struct snapshot_entry
+{
+    char     name[SNAPSHOT_NAME_SIZE];
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * start_snapshot
+ * <p>
+ * Fork a process which writes a snapshot of every database while the parent keeps serving. Does nothing if a snapshot
+ * is already being written, or if the storage engine keeps no records in memory or the write-ahead log is off.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int start_snapshot(struct core_object *co, struct server_object *so);
+
+/**
+ * reap_snapshot
+ * <p>
+ * Collect the process writing a snapshot once it has exited.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param wait whether to wait for the process to exit
+ * @return 0 on success or if the snapshot is still being written, -1 and set err if the snapshot failed
+ */
+int reap_snapshot(struct core_object *co, struct server_object *so, int wait);
+
+/**
+ * write_snapshot
+ * <p>
+ * Write a snapshot of every database in the calling process. The databases are locked for reading only while their
+ * records are copied out of memory, so that the snapshot is consistent with the write-ahead log. Does nothing if the
+ * storage engine keeps no records in memory or the write-ahead log is off.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int write_snapshot(struct core_object *co, struct server_object *so);
+
+/**
+ * load_snapshot_image
+ * <p>
+ * Copy the image of a database out of the latest snapshot. The snapshot is only used if it was taken by the storage
+ * engine of the server and the write-ahead log still holds every write made since it was taken, so that replaying
+ * the log brings the database up to date.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param db the database
+ * @param image memory in which to store the image
+ * @param capacity the size of the memory
+ * @param size memory in which to store the size of the image
+ * @return 1 if the image was loaded, 0 if there is no usable image, -1 and set err on failure
+ */
+int load_snapshot_image(struct core_object *co, struct server_object *so, struct database *db, void *image,
+                        size_t capacity, size_t *size);
+
+#endif //PROCESS_SERVER_SNAPSHOT_H
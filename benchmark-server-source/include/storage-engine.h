@@ -0,0 +1,227 @@
+#ifndef PROCESS_SERVER_STORAGE_ENGINE_H
+#define PROCESS_SERVER_STORAGE_ENGINE_H
+
+#include "objects.h"
+
+#define STORAGE_ENGINE_ENV "CHAT_STORAGE_ENGINE"    /** Names the storage engine; ndbm if unset. */
+#define PERSIST_INTERVAL_ENV "CHAT_PERSIST_INTERVAL_MS" /** Milliseconds between persistence flushes; 0 disables. */
+#define MESSAGE_SHARDS_ENV "CHAT_MESSAGE_SHARDS"        /** Number of Message databases; only read for new data. */
+#define MESSAGE_SHARDS_FILE_NAME "dbms_3fda69"          /** File holding the number of Message databases. */
+
+/**
+ * Visits one record during a scan of a database. Returns 0 to continue the scan, -1 to stop it with an error.
+ */
+typedef int (*record_visitor)(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * The kinds of write which can be batched.
+ */
+enum WriteKind
+{
+    WRITE_STORE,
+    WRITE_REMOVE
+};
+
+/**
+ * One write of a batch. Status is set when the batch is applied, to what store or remove would have returned.
+ */
+struct write_op
+{
+    enum WriteKind kind;
+    int            store_flags; // Only used by stores.
+    datum          key;
+    datum          value;       // Only used by stores.
+    int            status;
+};
+
+/**
+ * A storage engine. Every database is accessed through the engine chosen at startup, so the handlers and the db_*
+ * functions do not depend on how records are stored. All operations but check and apply take the database lock
+ * themselves; those two are called by transactions, which hold the locks of several databases at once.
+ * <p>
+ * Records are serialized objects beginning with an int ID. For databases with a name index, the string following the
+ * ID must be unique across the database; store refuses a record whose name is held by a different record.
+ * </p>
+ */
+struct storage_engine
+{
+    const char *name;
+    
+    /** Prepare a database in the parent, before forking. */
+    int (*open)(struct core_object *co, struct server_object *so, struct database *db);
+    
+    /** Release a database in the calling process. */
+    void (*close)(struct core_object *co, struct server_object *so, struct database *db);
+    
+    /** Store a record. Returns 0 on success, 1 if refused, -1 and set err on failure. */
+    int (*store)(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags);
+    
+    /**
+     * Copy a record into a new buffer, storing its size if size is not NULL. Returns 0 if copied, 1 if not found, -1
+     * and set err on failure.
+     */
+    int (*fetch)(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer, size_t *size);
+    
+    /** Delete a record. Returns 0 on success, -1 and set err on failure or if the record does not exist. */
+    int (*remove)(struct core_object *co, struct database *db, datum *key);
+    
+    /**
+     * Find a record by name, storing its size if it is copied and size is not NULL. Returns 1 if found, 0 if not
+     * found, -1 and set err on failure.
+     */
+    int (*find_by_name)(struct core_object *co, struct database *db, uint8_t **serial_object, size_t *size,
+                        const char *name);
+    
+    /** Call visit on every record, holding the lock for reading. Returns 0 on success, -1 and set err on failure. */
+    int (*for_each)(struct core_object *co, struct database *db, record_visitor visit, void *arg);
+    
+    /**
+     * Apply writes in order under one acquisition of the lock, setting the status of each. The writes are appended to
+     * the write-ahead log before they are applied. If flush is set, force the writes, or the log, to disk before
+     * releasing the lock. Returns 0 if the batch was applied, -1 and set err on failure.
+     */
+    int (*write_batch)(struct core_object *co, struct database *db, struct write_op *ops, size_t count, int flush);
+    
+    /**
+     * Check whether a write would be refused, without applying it. Must be called while holding the lock for writing.
+     * Returns 0 if the write would be applied, 1 if it would be refused, -1 and set err on failure.
+     */
+    int (*check)(struct core_object *co, struct database *db, const struct write_op *op);
+    
+    /**
+     * Apply writes in order without logging them, setting the status of each. Must be called while holding the lock
+     * for writing, after the writes are logged. If flush is set and the writes are not logged, force them to disk.
+     * Returns 0 if the writes were applied, -1 and set err on failure.
+     */
+    int (*apply)(struct core_object *co, struct database *db, struct write_op *ops, size_t count, int flush);
+    
+    /** Force every write applied so far to disk. Called from the parent. Returns 0 on success, -1 and set err. */
+    int (*sync)(struct core_object *co, struct database *db);
+    
+    /** Write changes through to durable storage from the parent, or NULL if the engine is durable itself. */
+    int (*persist)(struct core_object *co, struct database *db);
+    
+    /**
+     * Copy the records kept in memory into a new buffer from which open can restore them, or NULL if the engine keeps
+     * no records in memory. Must be called while holding the database lock. Returns 0 on success, -1 and set err.
+     */
+    int (*snapshot)(struct core_object *co, struct database *db, uint8_t **image, size_t *size);
+};
+
+/** Stores records in ndbm files on disk. */
+extern const struct storage_engine ndbm_storage_engine;
+
+/** Stores records in a hash table in shared memory, optionally persisted to ndbm files in the background. */
+extern const struct storage_engine shm_storage_engine;
+
+/**
+ * select_storage_engine
+ * <p>
+ * Choose the storage engine named by the CHAT_STORAGE_ENGINE environment variable, and read the persistence interval
+ * from CHAT_PERSIST_INTERVAL_MS. Defaults to ndbm.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err if the engine is unknown
+ */
+int select_storage_engine(struct core_object *co, struct server_object *so);
+
+/**
+ * select_message_shards
+ * <p>
+ * Set the number of Message databases. Messages are routed to a shard by Channel ID, so the number is fixed when the
+ * data is created: it is read from CHAT_MESSAGE_SHARDS, or defaults to DEFAULT_MESSAGE_SHARDS, and stored alongside
+ * the databases. Later starts use the stored number, and refuse to start if CHAT_MESSAGE_SHARDS asks for another.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err if the number is invalid or does not match the data
+ */
+int select_message_shards(struct core_object *co, struct server_object *so);
+
+/**
+ * persist_databases
+ * <p>
+ * If the storage engine persists in the background and the persistence interval has passed, write the changes made
+ * since the last flush through to durable storage. Called from the parent.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param force flush even if the interval has not passed
+ * @return 0 on success, -1 and set err on failure
+ */
+int persist_databases(struct core_object *co, struct server_object *so, int force);
+
+/**
+ * check_stored_records
+ * <p>
+ * Refuse to start on data written by an earlier version of the server in a layout this version cannot read, rather
+ * than treat it as malformed and lose it silently: a Message database from before Messages were sharded, any record
+ * of an earlier layout version, such as a Channel listing its Users by name, or a message log holding such records.
+ * Earlier data is not converted. Must be called after the write-ahead log is replayed and the message log is opened.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 if all of the data can be read, -1 and set err if not
+ */
+int check_stored_records(struct core_object *co, struct server_object *so);
+
+/**
+ * list_databases
+ * <p>
+ * List every database: Users, Channels, the Message shards in order, then Auths. Whenever the locks of several
+ * databases are held at once they are acquired in this order, and the position of a database in it identifies the
+ * database in the write-ahead log.
+ * </p>
+ * @param so the server object
+ * @param databases memory in which to store num_databases pointers to the databases
+ */
+void list_databases(struct server_object *so, struct database **databases);
+
+/**
+ * message_shard
+ * <p>
+ * Get the shard of the Message database which holds the Messages of a Channel.
+ * </p>
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @return the shard
+ */
+struct database *message_shard(struct server_object *so, int channel_id);
+
+/**
+ * record_name
+ * <p>
+ * Get the name stored in a serialized record, which is its first field. The returned datum points into the record and
+ * does not include the null terminator, so it can be used as a name index key. A malformed record has an empty name.
+ * </p>
+ * @param record the serialized record
+ * @return the name as a datum
+ */
+datum record_name(const datum *record);
+
+/**
+ * name_to_key
+ * <p>
+ * Copy a name into a buffer and point a key at the copy, so that a const name can be looked up through dbm and the
+ * name indexes, which take keys through non-const pointers. The key does not include the null terminator.
+ * </p>
+ * @param name the name
+ * @param buffer memory of NAME_MAX_SIZE + 1 bytes in which to copy the name
+ * @param key memory in which to store the key
+ * @return 1 if the name was copied, 0 if it is longer than any stored name
+ */
+int name_to_key(const char *name, char *buffer, datum *key);
+
+/**
+ * mark_db_written
+ * <p>
+ * Bump the shared generation of a database after this process has written to it, so that other processes know their
+ * cached state is stale. This process already reflects the write, so its generation follows the shared one. Must be
+ * called while holding the database lock for writing.
+ * </p>
+ * @param db the database
+ */
+void mark_db_written(struct database *db);
+
+#endif //PROCESS_SERVER_STORAGE_ENGINE_H
@@ -0,0 +1,37 @@
+#ifndef PROCESS_SERVER_TRANSACTION_H
+#define PROCESS_SERVER_TRANSACTION_H
+
+#include "storage-engine.h"
+
+/**
+ * One write of a transaction, and the database it goes to.
+ */
+struct transaction_write
+{
+    struct database *db;
+    struct write_op op;
+};
+
+/**
+ * run_transaction
+ * <p>
+ * Apply writes to one or more databases all together or not at all. The lock of every database written is acquired
+ * for writing, in the order in which a checkpoint acquires them, and every write is checked before any is applied; if
+ * any would be refused, none is applied. Otherwise the writes are appended to the write-ahead log as one record and
+ * applied before any lock is released, so other workers never observe some of the writes without the others, and
+ * recovery replays all of them or none.
+ * </p>
+ * <p>
+ * Writes are checked against the records as they were before the transaction, so a transaction must not write two
+ * records holding the same name. If any database written forces its writes to disk, the transaction is forced to disk
+ * before returning; it is not group committed.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param writes the writes; the status of each is set to 1 if it was refused and 0 if not
+ * @param count the number of writes
+ * @return 0 if the writes were applied, 1 if they were refused, -1 and set err on failure
+ */
+int run_transaction(struct core_object *co, struct server_object *so, struct transaction_write *writes, size_t count);
+
+#endif //PROCESS_SERVER_TRANSACTION_H
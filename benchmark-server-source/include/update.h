@@ -0,0 +1,34 @@
+#ifndef SERVER_TEST_SADDLE_UPDATE_H
+#define SERVER_TEST_SADDLE_UPDATE_H
+
+#include "../../include/global-objects.h"
+#include "objects.h"
+
+/**
+ * handle_update
+ * <p>
+ * Switch on the Object of an UPDATE Type Dispatch.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch
+ * @param body_tokens the tokenized dispatch body
+ * @return 0 on success, -1 and set err on failure
+ */
+int handle_update(struct core_object *co, struct server_object *so, struct dispatch *dispatch, char **body_tokens);
+
+/**
+ * handle_update_channel
+ * <p>
+ * Rename a Channel, or add Users to and remove Users from its lists of Users, Administrators and banned Users.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch
+ * @param body_tokens the tokenized dispatch body
+ * @return 0 on success, -1 and set err on failure.
+ */
+int handle_update_channel(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
+                          char **body_tokens);
+
+#endif //SERVER_TEST_SADDLE_UPDATE_H
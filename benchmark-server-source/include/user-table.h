@@ -0,0 +1,109 @@
+#ifndef PROCESS_SERVER_USER_TABLE_H
+#define PROCESS_SERVER_USER_TABLE_H
+
+#include "db.h"
+#include "storage-engine.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#define USER_TABLE_CAPACITY 65536                                                  /** IDs below this have a slot. */
+#define USER_TABLE_HOLDS(user_id) ((unsigned int) (user_id) < USER_TABLE_CAPACITY) /** Whether an ID has a slot. */
+
+/**
+ * A User as held in the user table.
+ */
+struct user_entry
+{
+    int                 id;
+    enum PrivilegeLevel privilege_level;
+    int                 online_status;
+    char                display_name[NAME_MAX_SIZE + 1];
+};
+
+/**
+ * The slot of one User ID. Guarded by a sequence lock: a writer makes the sequence odd before changing the slot and
+ * even again afterwards, and a reader copies the slot and retries if the sequence was odd or changed meanwhile.
+ * Writers take turns by swapping the sequence from even to odd.
+ */
+struct user_slot
+{
+    alignas(CACHE_LINE_SIZE) atomic_uint sequence;
+    int                                  in_use;
+    struct user_entry                    user;
+};
+
+/**
+ * The user table. Lives in shared memory and holds a copy of every User with an ID below USER_TABLE_CAPACITY in the
+ * slot of that ID, so that every worker can read a User by ID without hashing, locking or a system call. It is kept
+ * in step with the User database as writes are applied, while the database lock is held.
+ * <p>
+ * Online status is only held here. It belongs to the sessions, which do not outlive the server, so it is neither
+ * logged nor written to the User database, and every User starts offline. Users whose IDs have no slot keep their
+ * online status in the database.
+ * </p>
+ */
+struct user_table
+{
+    struct user_slot slots[USER_TABLE_CAPACITY];
+};
+
+/**
+ * open_user_table
+ * <p>
+ * Map the user table into shared memory and fill it from the User database. Must be called after the write-ahead log
+ * is replayed and before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_user_table(struct core_object *co, struct server_object *so);
+
+/**
+ * close_user_table
+ * <p>
+ * Unmap the user table.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_user_table(struct core_object *co, struct server_object *so);
+
+/**
+ * user_table_read
+ * <p>
+ * Copy a User out of the user table. The ID must have a slot.
+ * </p>
+ * @param so the server object
+ * @param user_id the ID of the User
+ * @param user memory in which to store the copy
+ * @return 1 if the User exists, 0 if not
+ */
+int user_table_read(struct server_object *so, int user_id, struct user_entry *user);
+
+/**
+ * user_table_set_online
+ * <p>
+ * Set the online status of a User. The ID must have a slot.
+ * </p>
+ * @param so the server object
+ * @param user_id the ID of the User
+ * @param online_status the online status
+ * @return 1 if the User exists, 0 if not
+ */
+int user_table_set_online(struct server_object *so, int user_id, int online_status);
+
+/**
+ * user_table_apply
+ * <p>
+ * Copy a write to the User database into the user table. Does nothing if the database is not the User database or
+ * the ID of the record has no slot. Must be called while holding the database lock for writing, after the write is
+ * applied.
+ * </p>
+ * @param db the database
+ * @param op the write
+ */
+void user_table_apply(struct database *db, const struct write_op *op);
+
+#endif //PROCESS_SERVER_USER_TABLE_H
@@ -0,0 +1,148 @@
+#ifndef PROCESS_SERVER_WRITE_AHEAD_LOG_H
+#define PROCESS_SERVER_WRITE_AHEAD_LOG_H
+
+#include "rw-lock.h"
+#include "transaction.h"
+
+#define WAL_ENV "CHAT_WAL"                             /** off disables the write-ahead log; on if unset. */
+#define WAL_CHECKPOINT_ENV "CHAT_WAL_CHECKPOINT_KB"    /** Size of the active segment which triggers a checkpoint. */
+#define WAL_DEFAULT_CHECKPOINT_KB 4096                 /** Used if CHAT_WAL_CHECKPOINT_KB is unset. */
+#define WAL_FILE_FORMAT "wal_3fda69.%d"                /** Name of each of the two segment files. */
+#define WAL_MAGIC 0x31574C43U                          /** Marks the start of a segment. */
+#define WAL_VERSION 2                                  /** Version of the record format. */
+
+/**
+ * The header at the start of a segment. Segments with a higher sequence were started later.
+ */
+struct wal_segment_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;
+};
+
+/**
+ * The frame of a record. The payload follows; the CRC covers the payload. A record whose frame or CRC does not check
+ * out was torn by a crash, and it and everything after it are ignored.
+ */
+struct wal_record_header
+{
+    uint32_t size;
+    uint32_t crc;
+};
+
+/**
+ * The start of the payload of a record. A record holds a group of writes which are replayed together.
+ */
+struct wal_payload_header
+{
+    uint32_t count;
+    uint32_t reserved;
+};
+
+/**
+ * One write in the payload of a record. The key follows, then the value.
+ */
+struct wal_op_header
+{
+    uint32_t db_id; // Position of the database in list_databases.
+    uint32_t kind;
+    int32_t  store_flags;
+    uint32_t key_size;
+    uint32_t value_size;
+};
+
+/**
+ * The write-ahead log. Lives in shared memory. Every write is appended to the active segment before it is applied,
+ * while holding the lock of its database, so the order of the writes to a database in the log is the order in which
+ * they were applied. A checkpoint switches the active segment while holding every database lock, forces the
+ * databases to disk, then empties the segment it switched away from; recovery therefore only replays the writes made
+ * since the last checkpoint.
+ */
+struct write_ahead_log
+{
+    struct rw_lock append_lock;      // Held while appending a record.
+    int            fds[2];           // Opened for appending before forking, so the same in every process.
+    int            active;           // Only changed while holding every database lock for writing.
+    uint64_t       sequence;         // Of the active segment; only changed by the parent.
+    long           checkpoint_bytes;
+};
+
+/**
+ * open_write_ahead_log
+ * <p>
+ * Replay the writes logged since the last checkpoint, checkpoint, and start logging every write. Must be called after
+ * the databases are opened and before forking.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @return 0 on success, -1 and set err on failure
+ */
+int open_write_ahead_log(struct core_object *co, struct server_object *so);
+
+/**
+ * close_write_ahead_log
+ * <p>
+ * Close the segment files and unmap the write-ahead log.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+void close_write_ahead_log(struct core_object *co, struct server_object *so);
+
+/**
+ * wal_log
+ * <p>
+ * Append a group of writes to a database to the write-ahead log as one record. Does nothing if the database is not
+ * logged. Must be called while holding the database lock for writing, before the writes are applied.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param ops the writes
+ * @param count the number of writes
+ * @param flush whether to force the record to disk before returning
+ * @return 0 on success, -1 and set err on failure
+ */
+int wal_log(struct core_object *co, struct database *db, const struct write_op *ops, size_t count, int flush);
+
+/**
+ * wal_log_transaction
+ * <p>
+ * Append the writes of a transaction, which may go to several databases, to the write-ahead log as one record, so
+ * that recovery replays all of them or none. Does nothing if the databases are not logged. Must be called while
+ * holding the lock of every database written for writing, before the writes are applied.
+ * </p>
+ * @param co the core object
+ * @param writes the writes
+ * @param count the number of writes
+ * @param flush whether to force the record to disk before returning
+ * @return 0 on success, -1 and set err on failure
+ */
+int wal_log_transaction(struct core_object *co, const struct transaction_write *writes, size_t count, int flush);
+
+/**
+ * wal_checkpoint
+ * <p>
+ * If the active segment has grown past the checkpoint size, force every database to disk and empty the log. Called
+ * from the parent.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param force checkpoint even if the active segment is small
+ * @return 0 on success, -1 and set err on failure
+ */
+int wal_checkpoint(struct core_object *co, struct server_object *so, int force);
+
+/**
+ * wal_covers
+ * <p>
+ * Check whether replaying the write-ahead log on disk would apply every write made since a segment was started, so
+ * that state saved during that segment can be brought up to date by replaying. May be called before the log is opened.
+ * </p>
+ * @param co the core object
+ * @param sequence the sequence of the segment
+ * @return 1 if the log covers the segment, 0 if it does not or the log is off, -1 and set err on failure
+ */
+int wal_covers(struct core_object *co, uint64_t sequence);
+
+#endif //PROCESS_SERVER_WRITE_AHEAD_LOG_H
@@ -0,0 +1,393 @@
+#include "../../include/manager.h"
+#include "../include/channel-body-cache.h"
+#include "../include/object-cache.h"
+#include "../include/object-util.h"
+#include "../include/process-server-util.h"
+#include "../include/user-table.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define FNV_OFFSET_BASIS 14695981039346656037UL /** 64 bit FNV-1a offset basis. */
+#define FNV_PRIME 1099511628211UL               /** 64 bit FNV-1a prime. */
+
+#define LIST_SIZE_DIGITS 10                      /** Digits of the largest unsigned int, which counts a list. */
+#define LIST_SIZE_RESERVE (LIST_SIZE_DIGITS + 1) /** Room in front of the names of a list for its size and an ETX. */
+#define CODE_200 "200\x03"                       /** The code in front of every body. */
+
+/**
+ * hash_channel_name
+ * <p>
+ * Choose the slot of a Channel.
+ * </p>
+ * @param channel_name the name of the Channel
+ * @return the position of the slot
+ */
+static size_t hash_channel_name(const char *channel_name);
+
+/**
+ * is_current
+ * <p>
+ * Check whether a slot holds the body of a Channel as it is now. Must be called while holding the lock of the slot.
+ * </p>
+ * @param so the server object
+ * @param slot the slot
+ * @param channel_name the name of the Channel
+ * @return 1 if it does, 0 if not
+ */
+static int is_current(struct server_object *so, const struct channel_body *slot, const char *channel_name);
+
+/**
+ * encode_channel
+ * <p>
+ * Read a Channel and encode every section of its body into a slot. The slot is only tagged for reuse if no write to
+ * the Channel database landed while the Channel was read. Must be called while holding the lock of the slot for
+ * writing.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param slot the slot
+ * @param channel_name the name of the Channel
+ * @return 1 if the Channel was encoded, 0 if it does not exist, -1 and set err on failure
+ */
+static int encode_channel(struct core_object *co, struct server_object *so, struct channel_body *slot,
+                          const char *channel_name);
+
+/**
+ * encode_list
+ * <p>
+ * Encode a list of Users of a Channel as a display-name-list into the section of a slot following the previous one.
+ * Users which no longer exist are left out. If the list does not fit in a section, the section is left empty and
+ * marked oversized.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param slot the slot
+ * @param section the section
+ * @param record the serialized Channel
+ * @param ids the list of User IDs in the record
+ * @return 0 on success, -1 and set err on failure
+ */
+static int encode_list(struct core_object *co, struct server_object *so, struct channel_body *slot,
+                       enum ChannelBodySection section, const struct channel_record *record,
+                       const struct record_ids *ids);
+
+/**
+ * copy_body
+ * <p>
+ * Assemble a body from the code and the sections of a slot asked for.
+ * </p>
+ * @param co the core object
+ * @param slot the slot
+ * @param get_flags the lists to include, as CHANNEL_BODY_GET flags
+ * @param body_get memory in which to store the body; must be freed
+ * @param body_size memory in which to store the size of the body
+ * @return 1 if the body was copied, CHANNEL_BODY_TOO_LARGE if it would not fit in a dispatch, -1 and set err on
+ * failure
+ */
+static int copy_body(struct core_object *co, const struct channel_body *slot, int get_flags, char **body_get,
+                     size_t *body_size);
+
+int open_channel_body_cache(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    // A new shared memory object is zero filled, so every slot starts out empty.
+    so->channel_bodies = map_shared_memory(co, CHANNEL_BODY_SHM_NAME, sizeof(struct channel_body_cache));
+    if (!so->channel_bodies)
+    {
+        return -1;
+    }
+    
+    for (size_t s = 0; s < CHANNEL_BODY_SLOTS; ++s)
+    {
+        if (rw_lock_init(co, &so->channel_bodies->slots[s].lock) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+void close_channel_body_cache(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->channel_bodies)
+    {
+        munmap(so->channel_bodies, sizeof(struct channel_body_cache));
+        so->channel_bodies = NULL;
+    }
+}
+
+void print_channel_body_stats(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (!so->channel_bodies)
+    {
+        return;
+    }
+    
+    (void) fprintf(stdout, "Channel bodies: %lu reads, %lu encodes\n",
+                   atomic_load_explicit(&so->channel_bodies->reads, memory_order_relaxed),
+                   atomic_load_explicit(&so->channel_bodies->encodes, memory_order_relaxed));
+}
+
+int channel_body_read(struct core_object *co, struct server_object *so, const char *channel_name, int get_flags,
+                      char **body_get, size_t *body_size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct channel_body *slot;
+    int                 ret_val;
+    
+    atomic_fetch_add_explicit(&so->channel_bodies->reads, 1, memory_order_relaxed);
+    slot = &so->channel_bodies->slots[hash_channel_name(channel_name)];
+    if (rw_lock_read(co, &slot->lock) == -1)
+    {
+        return -1;
+    }
+    if (!is_current(so, slot, channel_name))
+    {
+        // Encoding writes the slot, so it needs the lock for writing. Readers of the same Channel wait here and then
+        // find the body another worker has just encoded.
+        rw_lock_unlock(&slot->lock);
+        if (rw_lock_write(co, &slot->lock) == -1)
+        {
+            return -1;
+        }
+        if (!is_current(so, slot, channel_name))
+        {
+            ret_val = encode_channel(co, so, slot, channel_name);
+            if (ret_val != 1)
+            {
+                rw_lock_unlock(&slot->lock);
+                return ret_val;
+            }
+        }
+    }
+    
+    ret_val = copy_body(co, slot, get_flags, body_get, body_size);
+    rw_lock_unlock(&slot->lock);
+    
+    return ret_val;
+}
+
+static size_t hash_channel_name(const char *channel_name)
+{
+    uint64_t hash;
+    
+    hash = FNV_OFFSET_BASIS;
+    for (const char *c = channel_name; *c; ++c)
+    {
+        hash = (hash ^ (uint8_t) *c) * FNV_PRIME;
+    }
+    
+    return hash & (CHANNEL_BODY_SLOTS - 1);
+}
+
+static int is_current(struct server_object *so, const struct channel_body *slot, const char *channel_name)
+{
+    // A current slot still holds the name, so no other Channel can have taken it.
+    return slot->in_use && strcmp(slot->channel_name, channel_name) == 0
+           && object_cache_generation(&so->channel_db, slot->channel_id) == slot->generation;
+}
+
+static int encode_channel(struct core_object *co, struct server_object *so, struct channel_body *slot,
+                          const char *channel_name)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct channel_record *record;
+    uint8_t                     *serial_channel;
+    unsigned long               writes;
+    int                         read_status;
+    int                         ret_val;
+    
+    writes      = object_cache_writes(&so->channel_db);
+    read_status = find_by_name(co, &so->channel_db, &serial_channel, channel_name);
+    if (read_status != 1)
+    {
+        return read_status;
+    }
+    record = view_channel(serial_channel);
+    if (!record)
+    {
+        mm_free(co->mm, serial_channel);
+        errno = EIO;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    atomic_fetch_add_explicit(&so->channel_bodies->encodes, 1, memory_order_relaxed);
+    
+    // The ID is only known from the record, so its generation is read afterwards; see object_cache_find_by_name.
+    slot->in_use     = 0;
+    slot->oversized  = 0;
+    slot->channel_id = record->header.id;
+    slot->generation = object_cache_generation(&so->channel_db, slot->channel_id);
+    strcpy(slot->channel_name, channel_name); // NOLINT(clang-analyzer-security.insecureAPI.strcpy) : Validated
+    
+    // Private Channels are not supported, so the publicity is always 0.
+    slot->offsets[CHANNEL_BODY_INFO]  = 0;
+    slot->offsets[CHANNEL_BODY_USERS] = (size_t) sprintf(slot->data, "%s\x03%s\x03%d\x03", // NOLINT(cert-err33-c)
+                                                         record_string(record, &record->channel_name),
+                                                         record_string(record, &record->creator), 0);
+    
+    ret_val = encode_list(co, so, slot, CHANNEL_BODY_USERS, record, &record->users);
+    if (ret_val == 0)
+    {
+        ret_val = encode_list(co, so, slot, CHANNEL_BODY_ADMINS, record, &record->administrators);
+    }
+    if (ret_val == 0)
+    {
+        ret_val = encode_list(co, so, slot, CHANNEL_BODY_BANNED, record, &record->banned_users);
+    }
+    mm_free(co->mm, serial_channel);
+    if (ret_val == -1)
+    {
+        return -1;
+    }
+    
+    slot->in_use = object_cache_writes(&so->channel_db) == writes;
+    
+    return 1;
+}
+
+static int encode_list(struct core_object *co, struct server_object *so, struct channel_body *slot,
+                       enum ChannelBodySection section, const struct channel_record *record,
+                       const struct record_ids *ids)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct user_entry entry;
+    User              user;
+    const char        *display_name;
+    int               *user_ids;
+    char              size_buffer[LIST_SIZE_RESERVE + 1]; // And a null terminator.
+    size_t            count;
+    unsigned int      listed;
+    size_t            start;
+    size_t            offset;
+    size_t            limit;
+    size_t            name_size;
+    size_t            size_size;
+    int               read_status;
+    
+    user_ids = mm_malloc((ids->count + 1) * sizeof(int), co->mm);
+    if (!user_ids)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    count = record_copy_ids(record, ids, user_ids);
+    
+    // The size is only known once the names are listed, so the names are written past room left for it.
+    start  = slot->offsets[section];
+    limit  = start + CHANNEL_BODY_SECTION_MAX_SIZE;
+    offset = start + LIST_SIZE_RESERVE;
+    listed = 0;
+    for (size_t u = 0; u < count && offset <= limit; ++u)
+    {
+        user.display_name = NULL;
+        if (USER_TABLE_HOLDS(user_ids[u]))
+        {
+            read_status  = user_table_read(so, user_ids[u], &entry) ? 0 : 1;
+            display_name = entry.display_name;
+        } else
+        {
+            read_status  = read_user_by_id(co, so, user_ids[u], &user);
+            display_name = user.display_name;
+        }
+        if (read_status == -1)
+        {
+            mm_free(co->mm, user_ids);
+            return -1;
+        }
+        if (read_status == 1) // The User no longer exists.
+        {
+            continue;
+        }
+        
+        name_size = strlen(display_name);
+        if (offset + name_size + 1 <= limit)
+        {
+            memcpy(slot->data + offset, display_name, name_size);
+            slot->data[offset + name_size] = '\x03';
+            ++listed;
+        }
+        offset += name_size + 1;
+        if (user.display_name)
+        {
+            mm_free(co->mm, user.display_name);
+        }
+    }
+    mm_free(co->mm, user_ids);
+    
+    if (offset > limit)
+    {
+        slot->oversized            |= 1 << (section - CHANNEL_BODY_USERS);
+        slot->offsets[section + 1] = start;
+        return 0;
+    }
+    
+    size_size = (size_t) sprintf(size_buffer, "%u\x03", listed); // NOLINT(cert-err33-c) : Sized for any unsigned int
+    memmove(slot->data + start + size_size, slot->data + start + LIST_SIZE_RESERVE,
+            offset - start - LIST_SIZE_RESERVE);
+    memcpy(slot->data + start, size_buffer, size_size);
+    slot->offsets[section + 1] = offset - LIST_SIZE_RESERVE + size_size;
+    
+    return 0;
+}
+
+static int copy_body(struct core_object *co, const struct channel_body *slot, int get_flags, char **body_get,
+                     size_t *body_size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    size_t section_size;
+    size_t size;
+    int    included;
+    
+    if (get_flags & slot->oversized)
+    {
+        return CHANNEL_BODY_TOO_LARGE;
+    }
+    
+    size = strlen(CODE_200);
+    for (int s = CHANNEL_BODY_INFO; s < CHANNEL_BODY_SECTIONS; ++s)
+    {
+        included = s == CHANNEL_BODY_INFO || (get_flags & (1 << (s - CHANNEL_BODY_USERS)));
+        size     += included ? slot->offsets[s + 1] - slot->offsets[s] : 0;
+    }
+    if (size > UINT16_MAX)
+    {
+        return CHANNEL_BODY_TOO_LARGE;
+    }
+    
+    *body_get = mm_malloc(size + 1, co->mm);
+    if (!*body_get)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    size = strlen(CODE_200);
+    memcpy(*body_get, CODE_200, size);
+    for (int s = CHANNEL_BODY_INFO; s < CHANNEL_BODY_SECTIONS; ++s)
+    {
+        if (s == CHANNEL_BODY_INFO || (get_flags & (1 << (s - CHANNEL_BODY_USERS))))
+        {
+            section_size = slot->offsets[s + 1] - slot->offsets[s];
+            memcpy(*body_get + size, slot->data + slot->offsets[s], section_size);
+            size += section_size;
+        }
+    }
+    (*body_get)[size] = '\0';
+    *body_size        = size;
+    
+    return 1;
+}
@@ -2,28 +2,8 @@
 #include "../include/create.h"
 #include "../include/db.h"
 #include "../include/destroy.h"
-
-/**
- * handle_read
- * <p>
- * Switch on the Object of a READ Type Dispatch.
- * </p>
- * @param co the core object
- * @param dispatch the dispatch
- * @return 0 on success, -1 and set err on failure
- */
-static int handle_read(struct core_object *co, struct dispatch *dispatch);
-
-/**
- * handle_update
- * <p>
- * Switch on the Object of an UPDATE Type Dispatch.
- * </p>
- * @param co the core object
- * @param dispatch the dispatch
- * @return 0 on success, -1 and set err on failure
- */
-static int handle_update(struct core_object *co, struct dispatch *dispatch);
+#include "../include/read.h"
+#include "../include/update.h"
 
 /**
  * handle_ping
@@ -52,12 +32,12 @@ int perform_dispatch_operation(struct core_object *co, struct server_object *so,
         }
         case READ:
         {
-            ret_val = handle_read(co, dispatch);
+            ret_val = handle_read(co, so, dispatch, body_tokens);
             break;
         }
         case UPDATE:
         {
-            ret_val = handle_update(co, dispatch);
+            ret_val = handle_update(co, so, dispatch, body_tokens);
             break;
         }
         case DESTROY:
@@ -80,26 +60,6 @@ int perform_dispatch_operation(struct core_object *co, struct server_object *so,
     return ret_val;
 }
 
-static int handle_read(struct core_object *co, struct dispatch *dispatch)
-{
-    PRINT_STACK_TRACE(co->tracer);
-    
-    dispatch->body      = mm_strdup("501\x03Not implemented\x03", co->mm);
-    dispatch->body_size = strlen(dispatch->body);
-    
-    return 0;
-}
-
-static int handle_update(struct core_object *co, struct dispatch *dispatch)
-{
-    PRINT_STACK_TRACE(co->tracer);
-    
-    dispatch->body      = mm_strdup("501\x03Not implemented\x03", co->mm);
-    dispatch->body_size = strlen(dispatch->body);
-    
-    return 0;
-}
-
 static int handle_ping(struct core_object *co, struct dispatch *dispatch)
 {
     PRINT_STACK_TRACE(co->tracer);
@@ -1,12 +1,18 @@
 #include "../../include/util.h"
 #include "../include/create.h"
 #include "../include/db.h"
+#include "../include/fanout.h"
+#include "../include/id-allocator.h"
+#include "../include/membership-index.h"
 #include "../include/object-util.h"
+#include "../include/presence.h"
+#include "../include/session-table.h"
 
 #include <stdlib.h>
 
 // NOLINTBEGIN(modernize-macro-to-enum)
 #define HEX_BASE 16
+#define RESPONSE_CODE_SIZE 3 /** Digits of a response code. */
 // NOLINTEND(modernize-macro-to-enum)
 
 /** Number of tokens that should be present in Create Type Dispatches. */
@@ -18,78 +24,59 @@ enum BodyTokenSizes
     CREATE_AUTH_BODY_TOKEN_SIZE    = 2
 };
 
-/**
- * generate_user_id
- * <p>
- * Generate a unique ID for a new User.
- * </p>
- * @param tracer tracer function
- * @return a unique ID
- */
-static int generate_user_id(TRACER_FUNCTION_AS(tracer));
 
 /**
- * generate_channel_id
- * <p>
- * Generate a unique ID for a new Channel.
- * </p>
- * @param tracer tracer function
- * @return a unique ID
- */
-static int generate_channel_id(TRACER_FUNCTION_AS(tracer));
-
-
-/**
- * create_name_list
+ * assemble_200_create_auth_response
  * <p>
- * Allocate memory for a list of count names. Fill the list with names from src_list up to count. Add a NULL
- * terminating element. Record the number of bytes in the destination list.
+ * Assemble a 200 create auth response with the user information in the body.
  * </p>
  * @param co the core object
- * @param dst_list the destination list
- * @param src_list the source list
- * @param count the number of items to copy
- * @param byte_count the number of bytes copied
+ * @param dispatch the dispatch in which to assemble the body
+ * @param user the user of which to send information
  * @return 0 on success, -1 and set err on failure
  */
-static int create_name_list(struct core_object *co, const char ***dst_list, char **src_list,
-                            size_t count, size_t *byte_count);
+static int assemble_200_create_auth_response(struct core_object *co, struct dispatch *dispatch, const User *user);
 
 /**
- * generate_message_id
+ * log_in_user
  * <p>
- * Generate a unique ID for a new Message.
+ * Update a user's online status to 1 and update the user in the database, and add them to the presence set. Start a
+ * session for the user on the connection. If the user is already logged in, their session on the previous socket
+ * address is replaced by a session on the new socket address.
  * </p>
- * @param tracer tracer function
- * @return a unique ID
+ * @param co the core object
+ * @param so the server object
+ * @param user the user to log in
+ * @return 0 on success, -1 and set err on failure.
  */
-static int generate_message_id(TRACER_FUNCTION_AS(tracer));
+static int log_in_user(struct core_object *co, struct server_object *so, User *user);
 
 /**
- * assemble_200_create_auth_response
+ * is_forward_response
  * <p>
- * Assemble a 200 create auth response with the user information in the body.
+ * Check whether the body of a Create-Message dispatch is a lone response code, which a Client sends to acknowledge a
+ * forwarded Message rather than to create one.
  * </p>
- * @param co the core object
- * @param dispatch the dispatch in which to assemble the body
- * @param user the user of which to send information
- * @return 0 on success, -1 and set err on failure
+ * @param body_tokens the tokenized dispatch body, which holds at least one token
+ * @return 1 if it is, 0 if not
  */
-static int assemble_200_create_auth_response(struct core_object *co, struct dispatch *dispatch, const User *user);
+static int is_forward_response(char **body_tokens);
 
 /**
- * log_in_user
+ * forward_message
  * <p>
- * Update a user's online status to 1 and update the user in the database. Add the user to the list of active users.
- * If the user is already logged in, remove the disconnect the currently connected socket address and replace it with
- * the new socket address.
+ * Forward a Create-Message request, as the Client sent it, to the online members of its Channel once the response is
+ * sent.
  * </p>
  * @param co the core object
  * @param so the server object
- * @param user the user to log in
- * @return 0 on success, -1 and set err on failure.
+ * @param dispatch the request
+ * @param body_tokens the tokenized request body
+ * @param channel_id the ID of the Channel
+ * @return 0 on success, -1 and set err on failure
  */
-static int log_in_user(struct core_object *co, struct server_object *so, User *user);
+static int forward_message(struct core_object *co, struct server_object *so, const struct dispatch *dispatch,
+                           char **body_tokens, int channel_id);
 
 int handle_create(struct core_object *co, struct server_object *so, struct dispatch *dispatch, char **body_tokens)
 {
@@ -142,8 +129,7 @@ int handle_create_user(struct core_object *co, struct server_object *so, struct
     User   new_user;
     Auth   new_auth;
     size_t offset;
-    int    insert_status_user;
-    int    insert_status_auth;
+    int    insert_status;
     size_t count;
     char   **body_tokens_cpy;
     
@@ -174,36 +160,31 @@ int handle_create_user(struct core_object *co, struct server_object *so, struct
     }
     
     // Create ID once the fields are validated.
-    new_user.id              = generate_user_id(co->tracer);
+    if (allocate_id(co, so, USER_ID, &new_user.id) == -1)
+    {
+        return -1;
+    }
     new_auth.user_id         = new_user.id;
     new_user.privilege_level = 0;
     new_user.online_status   = 0;
     
-    insert_status_user = db_create(co, so, USER, &new_user);
-    insert_status_auth = db_create(co, so, AUTH, &new_auth);
-    if (insert_status_user == -1 || insert_status_auth == -1)
+    // The User and its Auth are inserted together, so no worker ever sees one without the other.
+    insert_status = db_create_account(co, so, &new_user, &new_auth);
+    if (insert_status == -1)
     {
         return -1;
     }
     
-    if (insert_status_user == 1 && insert_status_auth == 1)
+    if (insert_status == (ACCOUNT_LOGIN_TOKEN_TAKEN | ACCOUNT_DISPLAY_NAME_TAKEN))
     {
         dispatch->body      = mm_strdup("409\x03""3\x03Login token and display name already taken.\x03", co->mm);
         dispatch->body_size = strlen(dispatch->body);
-    } else if (insert_status_user == 1)
+    } else if (insert_status == ACCOUNT_DISPLAY_NAME_TAKEN)
     {
-        if (db_destroy(co, so, AUTH, &new_auth) == -1) // Remove the Auth from the database.
-        {
-            return -1;
-        }
         dispatch->body      = mm_strdup("409\x03""2\x03Display name already taken.\x03", co->mm);
         dispatch->body_size = strlen(dispatch->body);
-    } else if (insert_status_auth == 1)
+    } else if (insert_status == ACCOUNT_LOGIN_TOKEN_TAKEN)
     {
-        if (db_destroy(co, so, USER, &new_user) == -1) // Remove the User from the database.
-        {
-            return -1;
-        }
         dispatch->body      = mm_strdup("409\x03""1\x03Login token already taken.\x03", co->mm);
         dispatch->body_size = strlen(dispatch->body);
     } else
@@ -215,13 +196,6 @@ int handle_create_user(struct core_object *co, struct server_object *so, struct
     return 0;
 }
 
-static int generate_user_id(TRACER_FUNCTION_AS(tracer))
-{
-    PRINT_STACK_TRACE(tracer);
-    static int user_id = 1;
-    return user_id++;
-}
-
 int handle_create_channel(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
                           char **body_tokens)
 {
@@ -245,8 +219,12 @@ int handle_create_channel(struct core_object *co, struct server_object *so, stru
     
     size_t offset;
     
+    if (allocate_id(co, so, CHANNEL_ID, &new_channel.id) == -1)
+    {
+        return -1;
+    }
+    
     offset = 0;
-    new_channel.id           = generate_channel_id(co->tracer);
     new_channel.channel_name = *(body_tokens);
     new_channel.creator      = *(body_tokens + ++offset);
     if (**(body_tokens + ++offset) == '1') // Publicity is set to 1 in the dispatch.
@@ -268,12 +246,16 @@ int handle_create_channel(struct core_object *co, struct server_object *so, stru
         return -1;
     }
     
+    int creator_id;
+    
+    creator_id = request_sender.id;
     if (request_sender.privilege_level == GLOBAL_ADMIN)
     {
         // does the user exist?
-        int read_status;
+        int     read_status;
+        uint8_t *serial_creator;
         
-        read_status = db_read(co, so, USER, NULL, new_channel.creator);
+        read_status = find_by_name(co, &so->user_db, &serial_creator, new_channel.creator);
         if (read_status == -1)
         {
             return -1;
@@ -284,6 +266,8 @@ int handle_create_channel(struct core_object *co, struct server_object *so, stru
             dispatch->body_size = strlen(dispatch->body);
             return 0;
         }
+        memcpy(&creator_id, serial_creator, sizeof(creator_id));
+        mm_free(co->mm, serial_creator);
     } else
     { // is it the request sender?
         if (strcmp(request_sender.display_name, new_channel.creator) != 0)
@@ -296,26 +280,13 @@ int handle_create_channel(struct core_object *co, struct server_object *so, stru
     
     int insert_status;
     
-    // need to add the user to the list off users in channel
-    new_channel.users_count = 1;
-    if (create_name_list(co, &new_channel.users, &new_channel.creator,
-                         new_channel.users_count,
-                         &new_channel.users_size_bytes) == -1)
-    {
-        return -1;
-    }
-    // need to add the user to the list off admins in channel
+    // The creator is the only user and administrator of the channel, and no one is banned.
+    new_channel.users_count          = 1;
+    new_channel.users                = &creator_id;
     new_channel.administrators_count = 1;
-    if (create_name_list(co, &new_channel.administrators, &new_channel.creator,
-                         new_channel.administrators_count,
-                         &new_channel.administrators_size_bytes) == -1)
-    {
-        return -1;
-    }
-    // need to set the banned user list to null
-    new_channel.banned_users_count      = 0;
-    new_channel.banned_users            = NULL;
-    new_channel.banned_users_size_bytes = 0;
+    new_channel.administrators       = &creator_id;
+    new_channel.banned_users_count   = 0;
+    new_channel.banned_users         = NULL;
     
     insert_status = db_create(co, so, CHANNEL, &new_channel);
     if (insert_status == -1)
@@ -328,44 +299,15 @@ int handle_create_channel(struct core_object *co, struct server_object *so, stru
         dispatch->body_size = strlen(dispatch->body);
     } else if (insert_status == 0)
     {
+        // The creator is the first member of the channel.
+        if (membership_add(co, so, new_channel.id, creator_id) == -1)
+        {
+            return -1;
+        }
         dispatch->body      = mm_strdup("201\x03Channel created.\x03", co->mm);
         dispatch->body_size = strlen(dispatch->body);
     }
     
-    // free the memory of the lists.
-    mm_free(co->mm, new_channel.users);
-    mm_free(co->mm, new_channel.administrators);
-    
-    return 0;
-}
-
-static int generate_channel_id(TRACER_FUNCTION_AS(tracer))
-{
-    PRINT_STACK_TRACE(tracer);
-    static int channel_id = 1;
-    return channel_id++;
-}
-
-static int create_name_list(struct core_object *co, const char ***dst_list, char **src_list,
-                            size_t count, size_t *byte_count)
-{
-    PRINT_STACK_TRACE(co->tracer);
-    
-    *dst_list = mm_malloc((count + 1) * sizeof(const char *), co->mm);
-    if (!*dst_list)
-    {
-        SET_ERROR(co->err);
-        return -1;
-    }
-    
-    *byte_count = 0;
-    for (size_t i = 0; i < count; ++i)
-    {
-        *(*dst_list + i) = *(src_list + i);
-        *byte_count += strlen(*(src_list + i)) + 1;
-    }
-    
-    *(*dst_list + count) = NULL;
     return 0;
 }
 
@@ -383,6 +325,19 @@ int handle_create_message(struct core_object *co, struct server_object *so, stru
     size_t count;
     char   **body_tokens_cpy;
     
+    if (!body_tokens || !*body_tokens)
+    {
+        dispatch->body      = mm_strdup("400\x03Invalid number of fields\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    if (is_forward_response(body_tokens))
+    {
+        dispatch->body      = NULL; // Not answered.
+        dispatch->body_size = 0;
+        return 0;
+    }
+    
     count           = 0;
     body_tokens_cpy = body_tokens;
     COUNT_TOKENS(count, body_tokens_cpy);
@@ -412,7 +367,7 @@ int handle_create_message(struct core_object *co, struct server_object *so, stru
     int     channel_read_status;
     int     user_read_status;
     
-    channel_read_status = find_by_name(co, CHANNEL_DB_NAME, so->channel_db_sem, &serial_channel_buffer,
+    channel_read_status = find_by_name(co, &so->channel_db, &serial_channel_buffer,
                                        channel_name_in_dispatch);
     if (channel_read_status == -1)
     {
@@ -431,7 +386,7 @@ int handle_create_message(struct core_object *co, struct server_object *so, stru
         return -1;
     }
     
-    user_read_status = find_by_name(co, USER_DB_NAME, so->user_db_sem, &serial_user_buffer, display_name_in_dispatch);
+    user_read_status = find_by_name(co, &so->user_db, &serial_user_buffer, display_name_in_dispatch);
     if (user_read_status == -1)
     {
         mm_free(co->mm, serial_channel_buffer);
@@ -459,7 +414,12 @@ int handle_create_message(struct core_object *co, struct server_object *so, stru
         }
     }
     
-    new_message.id         = generate_message_id(co->tracer);
+    if (allocate_id(co, so, MESSAGE_ID, &new_message.id) == -1)
+    {
+        mm_free(co->mm, serial_channel_buffer);
+        mm_free(co->mm, serial_user_buffer);
+        return -1;
+    }
     // NOLINTBEGIN(clang-diagnostic-cast-align): Intentional cast.
     new_message.user_id    = *(int *) serial_user_buffer;
     new_message.channel_id = *(int *) serial_channel_buffer;
@@ -472,6 +432,13 @@ int handle_create_message(struct core_object *co, struct server_object *so, stru
         return -1;
     }
     
+    if (forward_message(co, so, dispatch, body_tokens, new_message.channel_id) == -1)
+    {
+        mm_free(co->mm, serial_channel_buffer);
+        mm_free(co->mm, serial_user_buffer);
+        return -1;
+    }
+    
     dispatch->body      = mm_strdup("201\x03", co->mm); // need to send this to the sender.
     dispatch->body_size = strlen(dispatch->body);
     mm_free(co->mm, serial_channel_buffer);
@@ -479,13 +446,6 @@ int handle_create_message(struct core_object *co, struct server_object *so, stru
     return 0;
 }
 
-static int generate_message_id(TRACER_FUNCTION_AS(tracer))
-{
-    PRINT_STACK_TRACE(tracer);
-    static int message_id = 1;
-    return message_id++;
-}
-
 int handle_create_auth(struct core_object *co, struct server_object *so, struct dispatch *dispatch, char **body_tokens)
 {
     PRINT_STACK_TRACE(co->tracer);
@@ -537,16 +497,20 @@ int handle_create_auth(struct core_object *co, struct server_object *so, struct
         return 0;
     }
     
-    int     ret_val;
-    uint8_t *serial_user;
-    datum   user_key;
+    int  ret_val;
+    int  user_id;
+    User *user;
     
-    // get user_id, get user with id
-    user_key.dptr  = (void *) &auth->user_id;
-    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
-    user_key.dsize = sizeof(auth->user_id);
+    user = mm_malloc(sizeof(User), co->mm);
+    if (!user)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
     
-    ret_val = safe_dbm_fetch(co, USER_DB_NAME, so->user_db_sem, &user_key, &serial_user);
+    // get user_id, get user with id
+    user_id = auth->user_id;
+    ret_val = read_user_by_id(co, so, user_id, user);
     free_auth(co, auth);
     if (ret_val == -1)
     {
@@ -554,22 +518,13 @@ int handle_create_auth(struct core_object *co, struct server_object *so, struct
     }
     if (ret_val == 1) // This should never happen, but just in case.
     {
-        (void) fprintf(stdout, "Create-Auth: User with id \"%d\" not found in User database.\n", auth->user_id);
+        (void) fprintf(stdout, "Create-Auth: User with id \"%d\" not found in User database.\n", user_id);
         dispatch->body      = mm_strdup("500\x03""Database Error: Auth exists with no existing referenced User.\x03",
                                         co->mm);
         dispatch->body_size = strlen(dispatch->body);
         return 0;
     }
     
-    User *user;
-    
-    user = mm_malloc(sizeof(User), co->mm);
-    if (!user)
-    {
-        SET_ERROR(co->err);
-        return -1;
-    }
-    deserialize_user(co, &user, serial_user);
     if (log_in_user(co, so, user) == -1)
     {
         return -1;
@@ -587,43 +542,22 @@ static int log_in_user(struct core_object *co, struct server_object *so, User *u
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    int     status;
-    uint8_t *addr_id;
-    size_t  addr_id_size;
-    
-    addr_id_size = serialize_addr_id_pair(co, &addr_id, &so->child->client_addr, &user->id);
-    if (addr_id_size == 0)
-    {
-        return -1;
-    }
-    
-    datum key;
-    datum value;
-    
-    key.dptr    = (void *) addr_id;
-    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
-    key.dsize   = SOCKET_ADDR_SIZE; // The first thing in here is a socket address.
-    value.dptr  = (void *) addr_id;
-    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
-    value.dsize = addr_id_size;
-    
-    // If the user is not logged in, just log them in and add them to the name-addr database.
+    // If the user is not logged in, mark them online, and let every Client know.
     if (user->online_status == 0)
     {
-        user->online_status = 1;
-        if (db_update(co, so, USER, user) == -1)
+        if (set_online_status(co, so, user, 1) == -1)
         {
             return -1;
         }
-        
-        status = safe_dbm_store(co, ADDR_ID_DB_NAME, so->addr_id_db_sem, &key, &value, DBM_INSERT);
-        
-    } else // If the user is already logged in, update the name-addr database. The last connected user will be refused on all routes.
+        fanout_ping(so, PINGUSER, user->display_name);
+    }
+    if (presence_add(co, so, user) == -1)
     {
-        status = safe_dbm_store(co, ADDR_ID_DB_NAME, so->addr_id_db_sem, &key, &value, DBM_REPLACE);
+        return -1;
     }
     
-    return status;
+    // Start a session on this connection. If the user is already logged in elsewhere, that session ends.
+    return session_insert(co, so, &so->child->client_addr, user);
 }
 
 
@@ -632,38 +566,83 @@ static int assemble_200_create_auth_response(struct core_object *co, struct disp
     PRINT_STACK_TRACE(co->tracer);
     
     // assemble body with user info
-    char   *body_buffer;
-    int    id_size;
-    int    privilege_size;
-    size_t body_size;
+    const char *status;
+    char       *body_buffer;
+    size_t     status_size;
+    size_t     body_size;
     
-    id_size        = snprintf(NULL, 0, "%d", user->id);
-    privilege_size = snprintf(NULL, 0, "%d", user->privilege_level);
-    if (id_size == -1 || privilege_size == -1)
+    status      = "200\x03";
+    status_size = strlen(status);
+    body_size   = status_size + format_user(NULL, 0, user);
+    
+    body_buffer = mm_malloc(body_size + 1, co->mm);
+    if (!body_buffer)
     {
         SET_ERROR(co->err);
         return -1;
     }
     
-    // 9 is the 3 digit status code, the online status, and the 5 terminating ETXs
-    body_size = id_size + strlen(user->display_name) + privilege_size + 9; // NOLINT : Magic number contained
+    memcpy(body_buffer, status, status_size);
+    (void) format_user(body_buffer + status_size, body_size + 1 - status_size, user);
     
-    body_buffer = mm_malloc(body_size + 1, co->mm);
-    if (!body_buffer)
+    dispatch->body      = body_buffer;
+    dispatch->body_size = body_size;
+    
+    return 0;
+}
+
+static int is_forward_response(char **body_tokens)
+{
+    if (*(body_tokens + 1))
     {
-        SET_ERROR(co->err);
-        return -1;
+        return 0;
+    }
+    
+    return strlen(*body_tokens) == RESPONSE_CODE_SIZE && strspn(*body_tokens, "0123456789") == RESPONSE_CODE_SIZE;
+}
+
+static int forward_message(struct core_object *co, struct server_object *so, const struct dispatch *dispatch,
+                           char **body_tokens, int channel_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct dispatch forward;
+    char            *body;
+    size_t          body_size;
+    size_t          token_size;
+    int             status;
+    
+    body_size = 0;
+    for (char **token = body_tokens; *token; ++token)
+    {
+        body_size += strlen(*token) + 1;
     }
     
-    if (snprintf(body_buffer, body_size, "200\x03%d\x03%s\x03%d\x03%d\x03",
-                 user->id, user->display_name, user->privilege_level, user->online_status) == -1)
+    body = mm_malloc(body_size + 1, co->mm);
+    if (!body)
     {
         SET_ERROR(co->err);
         return -1;
     }
     
-    dispatch->body      = body_buffer;
-    dispatch->body_size = body_size;
+    body_size = 0;
+    for (char **token = body_tokens; *token; ++token)
+    {
+        token_size = strlen(*token);
+        memcpy(body + body_size, *token, token_size);
+        body_size         += token_size;
+        body[body_size++] = '\x03';
+    }
+    body[body_size] = '\0';
     
-    return 0;
+    forward.version   = dispatch->version;
+    forward.type      = dispatch->type;
+    forward.object    = dispatch->object;
+    forward.body      = body;
+    forward.body_size = (uint16_t) body_size; // No longer than the request.
+    
+    status = fanout_to_channel(co, so, &forward, channel_id);
+    mm_free(co->mm, body);
+    
+    return status;
 }
@@ -1,6 +1,15 @@
 #include "../../include/global-objects.h"
 #include "../include/db.h"
+#include "../include/group-commit.h"
+#include "../include/message-log.h"
+#include "../include/name-filter.h"
+#include "../include/object-cache.h"
 #include "../include/object-util.h"
+#include "../include/presence.h"
+#include "../include/session-table.h"
+#include "../include/storage-engine.h"
+#include "../include/transaction.h"
+#include "../include/user-table.h"
 
 #include <fcntl.h>
 
@@ -36,7 +45,7 @@ static int insert_channel(struct core_object *co, struct server_object *so, Chan
 /**
  * insert_message
  * <p>
- * Insert a new Message into the Message database.
+ * Insert a new Message into the Message database, and append it to the message log of its Channel.
  * </p>
  * @param co the core object
  * @param so the server object
@@ -74,12 +83,13 @@ static int read_user(struct core_object *co, struct server_object *so, User **us
 /**
  * read_online_users
  * <p>
- * Read all online Users from the database into the memory pointed to by user_get.
+ * Read all online Users from the presence set into the memory pointed to by users_get, without scanning the User
+ * database. Only the ID, display name and online status of each User are filled in.
  * </p>
  * @param co the core object
  * @param so the server object
- * @param users_get memory in which to store pointers to read Users
- * @return 0 on success, -1 and set err on failure
+ * @param users_get memory in which to store a NULL terminated array of pointers to read Users
+ * @return the number of Users read on success, -1 and set err on failure
  */
 static int read_online_users(struct core_object *co, struct server_object *so, User ***users_get);
 
@@ -101,14 +111,15 @@ static int read_channel(struct core_object *co, struct server_object *so, Channe
 /**
  * read_messages
  * <p>
- * Read a number of messages up to num_messages from the channel with channel_id.
+ * Read the most recent messages, up to num_messages, from the channel with channel_id. The messages are read from the
+ * channel's message log, oldest first.
  * </p>
  * @param co the core object
  * @param so the server object
- * @param messages_get the memory in which to store pointers to the Messages
+ * @param messages_get the memory in which to store a NULL terminated list of pointers to the Messages
  * @param num_messages the number of messages to read
  * @param channel_id the channel in which to search for messages
- * @return 0 on success, -1 and set err on failure
+ * @return the number of Messages read on success, -1 and set err on failure
  */
 static int read_messages(struct core_object *co, struct server_object *so, Message ***messages_get,
                          int num_messages, int channel_id);
@@ -142,12 +153,13 @@ static int update_user(struct core_object *co, struct server_object *so, User *u
 /**
  * update_channel
  * <p>
- * Update a channel. Not implemented.
+ * Overwrite a Channel record with the Channel of the same ID. Refused if the Channel was renamed to the name of
+ * another Channel.
  * </p>
  * @param co the core object
  * @param so the server object
- * @param channel the channel to update
- * @return 0 on success, -1 and set err on failure
+ * @param channel the updated Channel; id will be used for query
+ * @return 0 on success, 1 if the name is taken, -1 and set err on failure
  */
 static int update_channel(struct core_object *co, struct server_object *so, Channel *channel);
 
@@ -223,20 +235,6 @@ static int delete_message(struct core_object *co, struct server_object *so, Mess
  */
 static int delete_auth(struct core_object *co, struct server_object *so, Auth *auth);
 
-/**
- * save_dptr_to_serial_object
- * <p>
- * Return 1 if value->dptr exists and 0 if value.dptr does not exist.
- * If a byte array is provided and value->dptr exists, copy the value in a value->dptr into a byte array.
- * Otherwise if a byte array is provide and value->dptr does not exist, set the byte array to NULL.
- * </p>
- * @param co the core object
- * @param serial_object the byte array into which to copy value->dptr
- * @param value the datum to copy
- * @return 1 if value->dptr exists and 0 if value.dptr does not exist, -1 and set err on failure.
- */
-static int save_dptr_to_serial_object(struct core_object *co, uint8_t **serial_object, datum *value);
-
 int db_create(struct core_object *co, struct server_object *so, int type, void *object)
 {
     PRINT_STACK_TRACE(co->tracer);
@@ -284,19 +282,6 @@ static int insert_user(struct core_object *co, struct server_object *so, User *u
     datum         key;
     datum         value;
     
-    // Determine if a user with the username already exists in the database.
-    status = find_by_name(co, USER_DB_NAME, so->user_db_sem, NULL, user->display_name);
-    if (status == -1)
-    {
-        return -1;
-    }
-    if (status == 1)
-    {
-        (void) fprintf(stdout, "Database error occurred: User with name \"%s\" already exists in User database.\n",
-                       user->display_name);
-        return 1;
-    }
-    
     serial_user_size = serialize_user(co, &serial_user, user);
     if (serial_user_size == 0)
     {
@@ -312,12 +297,13 @@ static int insert_user(struct core_object *co, struct server_object *so, User *u
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     value.dsize = serial_user_size;
     
-    status = safe_dbm_store(co, USER_DB_NAME, so->user_db_sem, &key, &value, DBM_INSERT);
+    status = safe_dbm_store(co, &so->user_db, &key, &value, DBM_INSERT);
     
     if (status == 1)
     {
-        (void) fprintf(stdout, "Database error occurred: User with ID \"%d\" already exists in User database.\n",
-                       *(int *) key.dptr); // NOLINT(clang-diagnostic-cast-align): Intentional cast.
+        (void) fprintf(stdout,
+                       "Database error occurred: User with ID \"%d\" or name \"%s\" already exists in User database.\n",
+                       user->id, user->display_name);
         return 1;
     }
     if (status == -1)
@@ -339,20 +325,6 @@ static int insert_channel(struct core_object *co, struct server_object *so, Chan
     datum         key;
     datum         value;
     
-    // Determine if a channel with the channel name already exists in the database.
-    status = find_by_name(co, CHANNEL_DB_NAME, so->channel_db_sem, NULL, channel->channel_name);
-    if (status == -1)
-    {
-        return -1;
-    }
-    if (status == 1)
-    {
-        (void) fprintf(stdout,
-                       "Database error occurred: Channel with name \"%s\" already exists in Channel database.\n",
-                       channel->channel_name);
-        return 1;
-    }
-    
     serial_channel_size = serialize_channel(co, &serial_channel, channel);
     if (serial_channel_size == 0)
     {
@@ -366,13 +338,16 @@ static int insert_channel(struct core_object *co, struct server_object *so, Chan
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     value.dsize = serial_channel_size;
     
-    status = safe_dbm_store(co, CHANNEL_DB_NAME, so->channel_db_sem, &key, &value, DBM_INSERT);
+    status = safe_dbm_store(co, &so->channel_db, &key, &value, DBM_INSERT);
     
     if (status == 1)
     {
-        (void) fprintf(stdout, "Database error occurred: Channel with ID \"%d\" already exists in Channel database.\n",
-                       *(int *) key.dptr); // NOLINT(clang-diagnostic-cast-align): Intentional cast.
-    } else if (status == -1)
+        (void) fprintf(stdout,
+                       "Database error occurred: Channel with ID \"%d\" or name \"%s\" already exists in Channel database.\n",
+                       channel->id, channel->channel_name);
+        return 1;
+    }
+    if (status == -1)
     {
         SET_ERROR(co->err);
         return -1;
@@ -404,19 +379,22 @@ static int insert_message(struct core_object *co, struct server_object *so, Mess
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     value.dsize = serial_message_size;
     
-    status = safe_dbm_store(co, MESSAGE_DB_NAME, so->message_db_sem, &key, &value, DBM_INSERT);
+    status = safe_dbm_store(co, message_shard(so, message->channel_id), &key, &value, DBM_INSERT);
+    mm_free(co->mm, serial_message);
     
     if (status == 1)
     {
         (void) fprintf(stdout, "Database error occurred: Message with ID \"%d\" already exists in Message database.\n",
-                       *(int *) key.dptr);  // NOLINT(clang-diagnostic-cast-align): Intentional cast.
-    } else if (status == -1)
+                       message->id);
+        return 1;
+    }
+    if (status == -1)
     {
         SET_ERROR(co->err);
         return -1;
     }
     
-    return 0;
+    return message_log_append(co, so, message);
 }
 
 static int insert_auth(struct core_object *co, struct server_object *so, Auth *auth)
@@ -429,19 +407,6 @@ static int insert_auth(struct core_object *co, struct server_object *so, Auth *a
     datum         key;
     datum         value;
     
-    // Determine if an auth with the login token already exists in the database.
-    status = find_by_name(co, AUTH_DB_NAME, so->auth_db_sem, NULL, auth->login_token);
-    if (status == -1)
-    {
-        return -1;
-    }
-    if (status == 1)
-    {
-        (void) fprintf(stdout, "Database error occurred: Auth with token \"%s\" already exists in Auth database.\n",
-                       auth->login_token);
-        return 1;
-    }
-    
     serial_auth_size = serialize_auth(co, &serial_auth, auth);
     if (serial_auth_size == 0)
     {
@@ -457,12 +422,13 @@ static int insert_auth(struct core_object *co, struct server_object *so, Auth *a
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     value.dsize = serial_auth_size;
     
-    status = safe_dbm_store(co, AUTH_DB_NAME, so->auth_db_sem, &key, &value, DBM_INSERT);
+    status = safe_dbm_store(co, &so->auth_db, &key, &value, DBM_INSERT);
     
     if (status == 1)
     {
-        (void) fprintf(stdout, "Database error occurred: Auth with ID \"%d\" already exists in Auth database.\n",
-                       *(int *) key.dptr);  // NOLINT(clang-diagnostic-cast-align): Intentional cast.
+        (void) fprintf(stdout,
+                       "Database error occurred: Auth with ID \"%d\" or token \"%s\" already exists in Auth database.\n",
+                       auth->user_id, auth->login_token);
         return 1;
     }
     if (status == -1)
@@ -528,21 +494,25 @@ static int read_user(struct core_object *co, struct server_object *so, User **us
     {
         uint8_t *serial_user;
         
-        read_status = find_by_name(co, USER_DB_NAME, so->user_db_sem, &serial_user, display_name);
+        read_status = find_by_name(co, &so->user_db, &serial_user, display_name);
         if (read_status == -1) // Error
         {
             return -1;
         }
         if (read_status == 1) // User found.
         {
-            deserialize_user(co, user_get, serial_user);
+            if (deserialize_user(co, user_get, serial_user) == -1)
+            {
+                read_status = -1;
+            }
+            mm_free(co->mm, serial_user);
         } else if (read_status == 0) // User not found.
         {
             *user_get = NULL;
         }
     } else // if the query is merely a check.
     {
-        read_status = find_by_name(co, USER_DB_NAME, so->user_db_sem, NULL, display_name);
+        read_status = find_by_name(co, &so->user_db, NULL, display_name);
         if (read_status == -1) // Error
         {
             return -1;
@@ -557,7 +527,44 @@ static int read_online_users(struct core_object *co, struct server_object *so, U
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    return 0;
+    struct presence_entry entries[PRESENCE_CAPACITY];
+    size_t                count;
+    User                  **users;
+    
+    if (presence_list(co, so, entries, &count) == -1)
+    {
+        return -1;
+    }
+    
+    users = mm_calloc(count + 1, sizeof(User *), co->mm);
+    if (!users)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    for (size_t u = 0; u < count; ++u)
+    {
+        users[u] = mm_calloc(1, sizeof(User), co->mm);
+        if (users[u])
+        {
+            users[u]->id            = entries[u].user_id;
+            users[u]->display_name  = mm_strdup(entries[u].display_name, co->mm);
+            users[u]->online_status = 1;
+        }
+        if (!users[u] || !users[u]->display_name)
+        {
+            SET_ERROR(co->err);
+            for (size_t f = 0; users[f]; ++f)
+            {
+                free_user(co, users[f]);
+            }
+            mm_free(co->mm, users);
+            return -1;
+        }
+    }
+    *users_get = users;
+    
+    return (int) count;
 }
 
 static int read_channel(struct core_object *co, struct server_object *so, Channel **channel_get,
@@ -569,23 +576,27 @@ static int read_channel(struct core_object *co, struct server_object *so, Channe
     
     if (channel_get) // If the query must return something, return something.
     {
-        uint8_t *serial_user;
+        uint8_t *serial_channel;
         
-        read_status = find_by_name(co, CHANNEL_DB_NAME, so->channel_db_sem, &serial_user, channel_name);
+        read_status = find_by_name(co, &so->channel_db, &serial_channel, channel_name);
         if (read_status == -1) // Error
         {
             return -1;
         }
         if (read_status == 1) // Channel found.
         {
-//            deserialize_channel(co, channel_get, serial_user);
+            if (deserialize_channel(co, channel_get, serial_channel) == -1)
+            {
+                read_status = -1;
+            }
+            mm_free(co->mm, serial_channel);
         } else if (read_status == 0) // User not found.
         {
             *channel_get = NULL;
         }
     } else // if the query is merely a check.
     {
-        read_status = find_by_name(co, CHANNEL_DB_NAME, so->channel_db_sem, NULL, channel_name);
+        read_status = find_by_name(co, &so->channel_db, NULL, channel_name);
         if (read_status == -1) // Error
         {
             return -1;
@@ -600,7 +611,7 @@ static int read_messages(struct core_object *co, struct server_object *so, Messa
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    return 0;
+    return (int) message_log_read_latest(co, so, channel_id, (size_t) num_messages, messages_get);
 }
 
 static int read_auth(struct core_object *co, struct server_object *so, Auth **auth_get, const char *login_token)
@@ -613,21 +624,25 @@ static int read_auth(struct core_object *co, struct server_object *so, Auth **au
     {
         uint8_t *serial_auth;
         
-        read_status = find_by_name(co, AUTH_DB_NAME, so->auth_db_sem, &serial_auth, login_token);
+        read_status = find_by_name(co, &so->auth_db, &serial_auth, login_token);
         if (read_status == -1) // Error
         {
             return -1;
         }
         if (read_status == 1) // User found.
         {
-            deserialize_auth(co, auth_get, serial_auth);
+            if (deserialize_auth(co, auth_get, serial_auth) == -1)
+            {
+                read_status = -1;
+            }
+            mm_free(co->mm, serial_auth);
         } else if (read_status == 0) // User not found.
         {
             *auth_get = NULL;
         }
     } else // if the query is merely a check.
     {
-        read_status = find_by_name(co, AUTH_DB_NAME, so->auth_db_sem, NULL, login_token);
+        read_status = find_by_name(co, &so->auth_db, NULL, login_token);
         if (read_status == -1) // Error
         {
             return -1;
@@ -642,44 +657,37 @@ int db_update(struct core_object *co, struct server_object *so, int type, void *
 {
     PRINT_STACK_TRACE(co->tracer);
     
+    int update_status;
+    
     switch (type)
     {
         case USER:
         {
-            if (update_user(co, so, (User *) object_src) == -1)
-            {
-                return -1;
-            }
+            update_status = update_user(co, so, (User *) object_src);
             break;
         }
         case CHANNEL:
         {
-            if (update_channel(co, so, (Channel *) object_src) == -1)
-            {
-                return -1;
-            }
+            update_status = update_channel(co, so, (Channel *) object_src);
             break;
         }
         case MESSAGE:
         {
-            if (update_message(co, so, (Message *) object_src) == -1)
-            {
-                return -1;
-            }
+            update_status = update_message(co, so, (Message *) object_src);
             break;
         }
         case AUTH:
         {
-            if (update_auth(co, so, (Auth *) object_src) == -1)
-            {
-                return -1;
-            }
+            update_status = update_auth(co, so, (Auth *) object_src);
             break;
         }
-        default:;
+        default:
+        {
+            update_status = 0;
+        }
     }
     
-    return 0;
+    return update_status;
 }
 
 static int update_user(struct core_object *co, struct server_object *so, User *user)
@@ -706,7 +714,7 @@ static int update_user(struct core_object *co, struct server_object *so, User *u
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     value.dsize = serial_user_size;
     
-    status = safe_dbm_store(co, USER_DB_NAME, so->user_db_sem, &key, &value, DBM_REPLACE);
+    status = safe_dbm_store(co, &so->user_db, &key, &value, DBM_REPLACE);
     
     return status;
 }
@@ -715,7 +723,29 @@ static int update_channel(struct core_object *co, struct server_object *so, Chan
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    return 0;
+    uint8_t       *serial_channel;
+    unsigned long serial_channel_size;
+    int           status;
+    datum         key;
+    datum         value;
+    
+    serial_channel_size = serialize_channel(co, &serial_channel, channel);
+    if (serial_channel_size == 0)
+    {
+        return -1;
+    }
+    
+    key.dptr    = (void *) serial_channel;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    key.dsize   = sizeof(channel->id);
+    value.dptr  = (void *) serial_channel;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    value.dsize = serial_channel_size;
+    
+    status = safe_dbm_store(co, &so->channel_db, &key, &value, DBM_REPLACE);
+    mm_free(co->mm, serial_channel);
+    
+    return status;
 }
 
 static int update_message(struct core_object *co, struct server_object *so, Message *message)
@@ -779,7 +809,7 @@ static int delete_user(struct core_object *co, struct server_object *so, User *u
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     key.dsize = sizeof(user->id);
     
-    if (safe_dbm_delete(co, USER_DB_NAME, so->user_db_sem, &key) == -1)
+    if (safe_dbm_delete(co, &so->user_db, &key) == -1)
     {
         return -1;
     }
@@ -797,7 +827,7 @@ static int delete_channel(struct core_object *co, struct server_object *so, Chan
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     key.dsize = sizeof(channel->id);
     
-    if (safe_dbm_delete(co, CHANNEL_DB_NAME, so->channel_db_sem, &key) == -1)
+    if (safe_dbm_delete(co, &so->channel_db, &key) == -1)
     {
         return -1;
     }
@@ -815,7 +845,7 @@ static int delete_message(struct core_object *co, struct server_object *so, Mess
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     key.dsize = sizeof(message->id);
     
-    if (safe_dbm_delete(co, MESSAGE_DB_NAME, so->message_db_sem, &key) == -1)
+    if (safe_dbm_delete(co, message_shard(so, message->channel_id), &key) == -1)
     {
         return -1;
     }
@@ -832,7 +862,7 @@ static int delete_auth(struct core_object *co, struct server_object *so, Auth *a
     // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
     key.dsize = sizeof(auth->user_id);
     
-    if (safe_dbm_delete(co, AUTH_DB_NAME, so->auth_db_sem, &key) == -1)
+    if (safe_dbm_delete(co, &so->auth_db, &key) == -1)
     {
         return -1;
     }
@@ -840,248 +870,184 @@ static int delete_auth(struct core_object *co, struct server_object *so, Auth *a
     return 0;
 }
 
-int safe_dbm_store(struct core_object *co, const char *db_name, sem_t *sem, datum *key, datum *value, int store_flags)
+int db_create_account(struct core_object *co, struct server_object *so, User *user, Auth *auth)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    DBM *db;
-    int status;
+    struct transaction_write writes[2];
+    uint8_t                  *serial_user;
+    uint8_t                  *serial_auth;
+    unsigned long            serial_user_size;
+    unsigned long            serial_auth_size;
+    int                      status;
     
-    if (sem_wait(sem) == -1)
+    serial_user_size = serialize_user(co, &serial_user, user);
+    if (serial_user_size == 0)
     {
-        SET_ERROR(co->err);
         return -1;
     }
-    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
-    // NOLINTNEXTLINE(clang-diagnostic-incompatible-pointer-types-discards-qualifiers): implementation
-    db = dbm_open(db_name, DB_FLAGS, DB_FILE_MODE);
-    if (db == (DBM *) 0)
+    serial_auth_size = serialize_auth(co, &serial_auth, auth);
+    if (serial_auth_size == 0)
     {
-        SET_ERROR(co->err);
-        sem_post(sem);
+        mm_free(co->mm, serial_user);
         return -1;
     }
-    status = dbm_store(db, *key, *value, store_flags);
-    if (!key->dptr && dbm_error(db)) // NOLINT(concurrency-mt-unsafe) : No threads here
-    {
-        print_db_error(db);
-    }
-    dbm_close(db);
-    // NOLINTEND(concurrency-mt-unsafe)
-    sem_post(sem);
     
-    return status;
-}
-
-int safe_dbm_fetch(struct core_object *co, const char *db_name, sem_t *sem, datum *key, uint8_t **serial_buffer)
-{
-    PRINT_STACK_TRACE(co->tracer);
+    writes[0].db             = &so->user_db;
+    writes[0].op.kind        = WRITE_STORE;
+    writes[0].op.store_flags = DBM_INSERT;
+    writes[0].op.key.dptr    = (void *) serial_user;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    writes[0].op.key.dsize   = sizeof(user->id);
+    writes[0].op.value.dptr  = (void *) serial_user;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    writes[0].op.value.dsize = serial_user_size;
     
-    int   ret_val;
-    DBM   *db;
-    datum value;
+    writes[1].db             = &so->auth_db;
+    writes[1].op.kind        = WRITE_STORE;
+    writes[1].op.store_flags = DBM_INSERT;
+    writes[1].op.key.dptr    = (void *) serial_auth;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    writes[1].op.key.dsize   = sizeof(auth->user_id);
+    writes[1].op.value.dptr  = (void *) serial_auth;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    writes[1].op.value.dsize = serial_auth_size;
     
-    if (sem_wait(sem) == -1)
+    status = run_transaction(co, so, writes, 2);
+    mm_free(co->mm, serial_user);
+    mm_free(co->mm, serial_auth);
+    if (status != 1)
     {
-        SET_ERROR(co->err);
-        return -1;
+        return status;
     }
-    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
-    // NOLINTNEXTLINE(clang-diagnostic-incompatible-pointer-types-discards-qualifiers): implementation
-    db = dbm_open(db_name, DB_FLAGS, DB_FILE_MODE);
-    if (db == (DBM *) 0)
+    
+    (void) fprintf(stdout, "Database error occurred: Token \"%s\" or name \"%s\" already exists in the Auth or User "
+                           "database.\n", auth->login_token, user->display_name);
+    status = 0;
+    if (writes[1].op.status == 1)
     {
-        SET_ERROR(co->err);
-        sem_post(sem);
-        return -1;
+        status |= ACCOUNT_LOGIN_TOKEN_TAKEN;
     }
-    value = dbm_fetch(db, (*key));
-    if (!value.dptr && dbm_error(db))
+    if (writes[0].op.status == 1)
     {
-        print_db_error(db);
+        status |= ACCOUNT_DISPLAY_NAME_TAKEN;
     }
-    ret_val = copy_dptr_to_buffer(co, serial_buffer, &value);
-    dbm_close(db);
-    // NOLINTEND(concurrency-mt-unsafe) : Protected
-    sem_post(sem);
     
-    return ret_val;
+    return status;
 }
 
-int safe_dbm_delete(struct core_object *co, const char *db_name, sem_t *sem, datum *key)
+int read_user_by_id(struct core_object *co, struct server_object *so, int user_id, User *user)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    DBM *db;
+    struct user_entry entry;
+    uint8_t           *serial_user;
+    datum             key;
+    int               ret_val;
     
-    if (sem_wait(sem) == -1)
-    {
-        SET_ERROR(co->err);
-        return -1;
-    }
-    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
-    // NOLINTNEXTLINE(clang-diagnostic-incompatible-pointer-types-discards-qualifiers): implementation
-    db = dbm_open(db_name, DB_FLAGS, DB_FILE_MODE);
-    if (db == (DBM *) 0)
+    if (USER_TABLE_HOLDS(user_id))
     {
-        SET_ERROR(co->err);
-        sem_post(sem);
-        return -1;
-    }
-    if (dbm_delete(db, *key) == -1)
-    {
-        SET_ERROR(co->err);
-        print_db_error(db);
-        dbm_close(db);
-        sem_post(sem);
-        return -1;
+        if (!user_table_read(so, user_id, &entry))
+        {
+            return 1;
+        }
+        user->display_name = mm_strdup(entry.display_name, co->mm);
+        if (!user->display_name)
+        {
+            SET_ERROR(co->err);
+            return -1;
+        }
+        user->id              = entry.id;
+        user->privilege_level = entry.privilege_level;
+        user->online_status   = entry.online_status;
+        return 0;
     }
-    if (!(*key).dptr && dbm_error(db))
+    
+    key.dptr  = (void *) &user_id;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    key.dsize = sizeof(user_id);
+    ret_val   = safe_dbm_fetch(co, &so->user_db, &key, &serial_user);
+    if (ret_val == 0)
     {
-        print_db_error(db);
+        ret_val = deserialize_user(co, &user, serial_user);
+        mm_free(co->mm, serial_user);
     }
-    dbm_close(db);
-    // NOLINTEND(concurrency-mt-unsafe)
-    sem_post(sem);
-    return 0;
+    
+    return ret_val;
 }
 
-
-int find_by_name(struct core_object *co, const char *db_name, sem_t *db_sem,
-                 uint8_t **serial_object, const char *name)
+int set_online_status(struct core_object *co, struct server_object *so, User *user, int online_status)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    DBM   *db;
-    datum key;
-    datum value;
-    
-    // Get first thing in the db
-    if (sem_wait(db_sem) == -1)
+    user->online_status = online_status;
+    if (USER_TABLE_HOLDS(user->id))
     {
-        SET_ERROR(co->err);
-        return -1;
+        (void) user_table_set_online(so, user->id, online_status); // A User deleted meanwhile has no status to set.
+        return 0;
     }
-    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
-    // NOLINTNEXTLINE(clang-diagnostic-incompatible-pointer-types-discards-qualifiers): implementation
-    db = dbm_open(db_name, DB_FLAGS, DB_FILE_MODE);
-    if (db == (DBM *) 0)
-    {
-        SET_ERROR(co->err);
-        return -1;
-    }
-    key   = dbm_firstkey(db);
-    value = dbm_fetch(db, key);
-    if (!key.dptr && dbm_error(db))
-    {
-        print_db_error(db);
-    }
-    
-    // Compare the display name to the name in the db
-    // NOLINTNEXTLINE(clang-diagnostic-cast-align): Intentional cast.
-    while (key.dptr && strcmp((char *) (((int *) value.dptr) + 1), name) != 0)
-    {
-        key   = dbm_nextkey(db);
-        value = dbm_fetch(db, key);
-        if (!key.dptr && dbm_error(db))
-        {
-            print_db_error(db);
-        }
-    }
-    
-    // Returns 0 if no value.dptr, returns 1 if value.dptr, returns -1 if error.
-    int ret_val = save_dptr_to_serial_object(co, serial_object, &value);
     
-    dbm_close(db);
-    // NOLINTEND(concurrency-mt-unsafe) : Protected
-    sem_post(db_sem);
-    
-    return ret_val;
+    return db_update(co, so, USER, user);
 }
 
-int find_addr_id_pair_by_id(struct core_object *co, struct server_object *so, AddrIdPair **addr_id_pair, int id)
+int safe_dbm_store(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    DBM   *db;
-    datum key;
-    datum value;
-    
-    // Get first thing in the db
-    if (sem_wait(so->addr_id_db_sem) == -1)
-    {
-        SET_ERROR(co->err);
-        return -1;
-    }
-    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
-    // NOLINTNEXTLINE(clang-diagnostic-incompatible-pointer-types-discards-qualifiers): implementation
-    db = dbm_open(ADDR_ID_DB_NAME, DB_FLAGS, DB_FILE_MODE);
-    if (db == (DBM *) 0)
+    if (db->flush_writes)
     {
-        SET_ERROR(co->err);
-        return -1;
-    }
-    key   = dbm_firstkey(db);
-    value = dbm_fetch(db, key);
-    if (!key.dptr && dbm_error(db))
-    {
-        print_db_error(db);
+        return commit_write(co, db, WRITE_STORE, key, value, store_flags);
     }
     
-    // Compare the ID to the name in the db
-    // NOLINTNEXTLINE(clang-diagnostic-cast-align): Intentional
-    while (key.dptr && *(int *) ((uint8_t *) value.dptr + SOCKET_ADDR_SIZE) != id)
+    return db->engine->store(co, db, key, value, store_flags);
+}
+
+int safe_dbm_fetch(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (db->object_cache)
     {
-        key   = dbm_nextkey(db);
-        value = dbm_fetch(db, key);
-        if (!key.dptr && dbm_error(db))
-        {
-            print_db_error(db);
-        }
+        return object_cache_fetch(co, db, key, serial_buffer);
     }
     
-    uint8_t *serial_object;
-    // Returns 0 if no value.dptr, returns 1 if value.dptr, returns -1 if error.
-    int     ret_val = save_dptr_to_serial_object(co, &serial_object, &value);
+    return db->engine->fetch(co, db, key, serial_buffer, NULL);
+}
+
+int safe_dbm_delete(struct core_object *co, struct database *db, datum *key)
+{
+    PRINT_STACK_TRACE(co->tracer);
     
-    dbm_close(db);
-    // NOLINTEND(concurrency-mt-unsafe) : Protected
-    sem_post(so->addr_id_db_sem);
-    if (ret_val == 1)
+    if (db->flush_writes)
     {
-        deserialize_addr_id_pair(co, addr_id_pair, serial_object);
-        mm_free(co->mm, serial_object);
+        return commit_write(co, db, WRITE_REMOVE, key, NULL, 0);
     }
     
-    return ret_val;
+    return db->engine->remove(co, db, key);
 }
 
-static int save_dptr_to_serial_object(struct core_object *co, uint8_t **serial_object, datum *value)
+int find_by_name(struct core_object *co, struct database *db, uint8_t **serial_object, const char *name)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    int ret_val;
+    char  name_buffer[NAME_MAX_SIZE + 1];
+    datum name_key;
     
-    if (value->dptr)
-    {
-        ret_val = 1;
-        if (serial_object)
-        {
-            if (copy_dptr_to_buffer(co, serial_object, value) == -1)
-            {
-                return -1;
-            }
-        }
-    } else
+    if (!name_to_key(name, name_buffer, &name_key) || !name_filter_may_contain(db, &name_key))
     {
-        ret_val = 0;
         if (serial_object)
         {
             *serial_object = NULL;
         }
+        return 0;
     }
     
-    return ret_val;
+    if (db->object_cache)
+    {
+        return object_cache_find_by_name(co, db, serial_object, name);
+    }
+    
+    return db->engine->find_by_name(co, db, serial_object, NULL, name);
 }
 
 int copy_dptr_to_buffer(struct core_object *co, uint8_t **buffer, datum *value)
@@ -1117,55 +1083,31 @@ int determine_request_sender(struct core_object *co, struct server_object *so, U
     // The Request Sender Name is determinable by the Server retrieving the
     // Name of the User associated with the Socket Address from which the Request was sent.
     
-    AddrIdPair         *addr_id_pair;
-    struct sockaddr_in client_addr;
-    uint8_t            *addr_buffer;
-    uint8_t            *addr_id_buffer;
-    uint8_t            *user_buffer;
-    datum              addr_id_key;
-    datum              user_key;
+    Session           session;
+    struct user_entry entry;
+    int               status;
     
-    addr_buffer = mm_malloc(SOCKET_ADDR_SIZE, co->mm);
-    if (!addr_buffer)
+    status = session_find_by_addr(co, so, &so->child->client_addr, &session);
+    if (status != 1) // An error occurred, or the connection is not logged in.
     {
-        SET_ERROR(co->err);
         return -1;
     }
     
-    // Create the addr_id_key, which is [in_addr_t, in_port_t]
-    client_addr = so->child->client_addr;
-    memcpy(addr_buffer, &client_addr.sin_addr.s_addr, sizeof(client_addr.sin_addr.s_addr));
-    memcpy(addr_buffer + sizeof(client_addr.sin_addr.s_addr), &client_addr.sin_port, sizeof(client_addr.sin_port));
-    
-    addr_id_key.dptr  = (void *) addr_buffer;
-    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
-    addr_id_key.dsize = SOCKET_ADDR_SIZE;
-    
-    // Get the user id associated with the socket addr
-    int ret_val = safe_dbm_fetch(co, ADDR_ID_DB_NAME, so->addr_id_db_sem, &addr_id_key, &addr_id_buffer);
-    if (ret_val == -1 || ret_val == 1)
+    // The session holds the privilege level at login; the user table holds the current one.
+    if (USER_TABLE_HOLDS(session.user_id) && user_table_read(so, session.user_id, &entry))
     {
-        return -1;
+        session.privilege_level = entry.privilege_level;
     }
     
-    addr_id_pair = mm_malloc(sizeof(AddrIdPair), co->mm);
-    deserialize_addr_id_pair(co, &addr_id_pair, addr_id_buffer);
-    mm_free(co->mm, addr_buffer);
-    mm_free(co->mm, addr_id_buffer);
-    
-    // Find the user associated with the id in the addr_id_buffer
-    user_key.dptr  = (void *) &addr_id_pair->id;
-    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
-    user_key.dsize = sizeof(int);
-    
-    ret_val = safe_dbm_fetch(co, USER_DB_NAME, so->user_db_sem, &user_key, &user_buffer);
-    if (ret_val == -1 || ret_val == 1)
+    request_sender->display_name = mm_strdup(session.display_name, co->mm);
+    if (!request_sender->display_name)
     {
+        SET_ERROR(co->err);
         return -1;
     }
-    deserialize_user(co, &request_sender, user_buffer);
-    mm_free(co->mm, addr_id_pair);
-    mm_free(co->mm, user_buffer);
+    request_sender->id              = session.user_id;
+    request_sender->privilege_level = session.privilege_level;
+    request_sender->online_status   = 1;
     
     return 0;
 }
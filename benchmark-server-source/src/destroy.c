@@ -1,13 +1,16 @@
 #include "../include/db.h"
 #include "../include/destroy.h"
+#include "../include/fanout.h"
 #include "../include/object-util.h"
+#include "../include/presence.h"
+#include "../include/session-table.h"
 
 #include <stdlib.h>
 
 /**
  * log_out_user
  * <p>
- * Log a user out by destroying the addr id pair associated with that user.
+ * Log a user out by marking them offline, removing them from the presence set, and ending their session.
  * </p>
  * @param co the core object
  * @param so the server object
@@ -51,7 +54,7 @@ int handle_destroy_auth(struct core_object *co, struct server_object *so, struct
     {
         dispatch->body      = mm_strdup("400\x03Invalid fields.\x03", co->mm);
         dispatch->body_size = strlen(dispatch->body);
-        return -1;
+        return 0;
     }
     
     if (determine_request_sender(co, so, &request_sender) == -1)
@@ -102,44 +105,15 @@ static int log_out_user(struct core_object *co, struct server_object *so, User *
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    datum      key;
-    AddrIdPair *addr_id_pair;
-    uint8_t    *addr_key;
-    int        status;
-    
-    user->online_status = 0;
-    if (db_update(co, so, USER, user) == -1)
-    {
-        return -1;
-    }
-    
-    addr_id_pair = mm_calloc(1, sizeof(AddrIdPair), co->mm);
-    if (!addr_id_pair)
-    {
-        SET_ERROR(co->err);
-        return -1;
-    }
-    if (find_addr_id_pair_by_id(co, so, &addr_id_pair, user->id) == -1)
+    if (set_online_status(co, so, user, 0) == -1)
     {
         return -1;
     }
-    
-    addr_key = malloc(sizeof(in_addr_t) + sizeof(in_port_t));
-    if (!addr_key)
+    fanout_ping(so, PINGUSER, user->display_name);
+    if (presence_remove(co, so, user->id) == -1)
     {
-        SET_ERROR(co->err);
         return -1;
     }
     
-    memcpy(addr_key, &addr_id_pair->socket_ip, sizeof(in_addr_t));
-    memcpy(addr_key + sizeof(in_addr_t), &addr_id_pair->socket_port, sizeof(in_port_t));
-    
-    key.dptr  = (void *) addr_key;
-    key.dsize = SOCKET_ADDR_SIZE;
-
-    status = safe_dbm_delete(co, ADDR_ID_DB_NAME, so->addr_id_db_sem, &key);
-    
-    free(addr_key);
-    
-    return status;
+    return session_remove_by_user_id(co, so, user->id);
 }
@@ -0,0 +1,585 @@
+#include "../include/fanout.h"
+#include "../include/membership-index.h"
+#include "../include/process-server-util.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#define FANOUT_SHM_NAME "/fo_3fda69" /** Fan-out frames shared memory name. */
+#define VERSION_SHIFT 4U             /** The version is packed above the type in the first byte of a dispatch. */
+#define FIRST_CONNECTION_POLLFD 2    /** Pollfds of connections follow the listen socket and the pipe. */
+#define PROTOCOL_VERSION 1           /** The version of the protocol sent in Pings. */
+#define PING_HEADER_SIZE 1           /** Version and subtype; a Ping has no object and no body size. */
+#define MS_PER_S 1000L               /** Milliseconds per second. */
+#define NS_PER_MS 1000000L           /** Nanoseconds per millisecond. */
+
+/**
+ * claim_frame
+ * <p>
+ * Find a free frame and take a reference to it.
+ * </p>
+ * @param fanout the fan-out frames
+ * @return the frame, or FANOUT_NONE if every frame is in flight
+ */
+static int claim_frame(struct fanout *fanout);
+
+/**
+ * release_frame
+ * <p>
+ * Drop a reference to a frame, freeing it if it was the last.
+ * </p>
+ * @param frame the frame
+ */
+static void release_frame(struct fanout_frame *frame);
+
+/**
+ * encode_frame
+ * <p>
+ * Encode a dispatch into a frame, as it is sent on the network.
+ * </p>
+ * @param frame the frame
+ * @param dispatch the dispatch
+ */
+static void encode_frame(struct fanout_frame *frame, const struct dispatch *dispatch);
+
+/**
+ * encode_ping
+ * <p>
+ * Encode a Ping into a frame, as it is sent on the network: the version and subtype, then the name terminated by an
+ * ETX, since a Ping carries neither an object nor a body size.
+ * </p>
+ * @param frame the frame
+ * @param ping the Ping
+ */
+static void encode_ping(struct fanout_frame *frame, const struct ping *ping);
+
+/**
+ * find_connection
+ * <p>
+ * Find the connection of the parent with a socket address.
+ * </p>
+ * @param parent the parent struct
+ * @param addr the socket address
+ * @return the index of the connection in the array of client_addrs, or -1 if it is not connected
+ */
+static long find_connection(const struct parent *parent, const struct sockaddr_in *addr);
+
+/**
+ * queue_frame
+ * <p>
+ * Take a reference to a frame for the queue of a connection, and send it at once if the connection is idle.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param conn_index the index of the connection in the array of client_addrs
+ * @param frame the frame
+ */
+static void queue_frame(struct core_object *co, struct server_object *so, size_t conn_index, int frame);
+
+/**
+ * broadcast_ping
+ * <p>
+ * Encode a Ping once and queue it on every connection.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param ping the Ping
+ */
+static void broadcast_ping(struct core_object *co, struct server_object *so, const struct ping *ping);
+
+/**
+ * ms_until
+ * <p>
+ * Get the number of milliseconds from one time until another, rounded up.
+ * </p>
+ * @param now the earlier time
+ * @param due the later time
+ * @return the milliseconds, or 0 if due is not later than now
+ */
+static long ms_until(const struct timespec *now, const struct timespec *due);
+
+/**
+ * pop_frame
+ * <p>
+ * Remove the oldest frame of a queue and release it.
+ * </p>
+ * @param so the server object
+ * @param queue the queue
+ */
+static void pop_frame(struct server_object *so, struct fanout_queue *queue);
+
+/**
+ * forward_to_members
+ * <p>
+ * Forward a dispatch or a Ping to the online members of a Channel, and to the online Users listed, once the response
+ * to the current request is sent. See fanout_to_channel.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch to forward, or NULL to forward the Ping
+ * @param ping the Ping to forward if there is no dispatch
+ * @param channel_id the ID of the Channel
+ * @param user_ids the IDs of the Users, sorted
+ * @param user_count the number of Users
+ * @return 0 on success, -1 and set err on failure
+ */
+static int forward_to_members(struct core_object *co, struct server_object *so, const struct dispatch *dispatch,
+                              const struct ping *ping, int channel_id, const int *user_ids, size_t user_count);
+
+/**
+ * compare_ids
+ * <p>
+ * Order two IDs for bsearch.
+ * </p>
+ * @param a the first ID
+ * @param b the second ID
+ * @return less than, equal to, or greater than 0 as the first ID is less than, equal to, or greater than the second
+ */
+static int compare_ids(const void *a, const void *b);
+
+int open_fanout(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const char *window;
+    char       *end;
+    
+    so->ping_window_ms = PING_DEFAULT_WINDOW_MS;
+    window             = getenv(PING_WINDOW_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (window)
+    {
+        errno              = 0;
+        so->ping_window_ms = strtol(window, &end, 10); // NOLINT(readability-magic-numbers) : Base 10
+        if (errno != 0 || end == window || *end != '\0' || so->ping_window_ms < 0 || so->ping_window_ms > INT_MAX)
+        {
+            (void) fprintf(stderr, "Invalid Ping window \"%s\"\n", window);
+            errno = EINVAL;
+            SET_ERROR(co->err);
+            return -1;
+        }
+    }
+    
+    so->fanout = map_shared_memory(co, FANOUT_SHM_NAME, sizeof(struct fanout));
+    if (!so->fanout)
+    {
+        return -1;
+    }
+    
+    return 0;
+}
+
+void close_fanout(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->fanout)
+    {
+        munmap(so->fanout, sizeof(struct fanout));
+        so->fanout = NULL;
+    }
+}
+
+int fanout_to_channel(struct core_object *co, struct server_object *so, const struct dispatch *dispatch,
+                      int channel_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    return forward_to_members(co, so, dispatch, NULL, channel_id, NULL, 0);
+}
+
+int fanout_ping_channel(struct core_object *co, struct server_object *so, const char *channel_name, int channel_id,
+                        const int *user_ids, size_t user_count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct ping ping;
+    
+    ping.type = PINGCHANNEL;
+    strncpy(ping.name, channel_name, PING_NAME_MAX_SIZE);
+    ping.name[PING_NAME_MAX_SIZE] = '\0';
+    
+    return forward_to_members(co, so, NULL, &ping, channel_id, user_ids, user_count);
+}
+
+void fanout_deliver(struct core_object *co, struct server_object *so, int frame)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct fanout_frame *delivered;
+    long                conn_index;
+    
+    if (frame < 0 || frame >= FANOUT_FRAMES)
+    {
+        return;
+    }
+    delivered = &so->fanout->frames[frame];
+    
+    for (size_t r = 0; r < delivered->recipient_count; ++r)
+    {
+        conn_index = find_connection(so->parent, &delivered->recipients[r]);
+        if (conn_index != -1)
+        {
+            queue_frame(co, so, (size_t) conn_index, frame);
+        }
+    }
+    
+    release_frame(delivered); // The reference of the worker.
+}
+
+void fanout_flush(struct core_object *co, struct server_object *so, size_t conn_index)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct fanout_queue *queue;
+    struct pollfd       *pollfd;
+    struct fanout_frame *frame;
+    ssize_t             bytes_sent;
+    
+    queue  = &so->parent->fanout_queues[conn_index];
+    pollfd = &so->parent->pollfds[FIRST_CONNECTION_POLLFD + conn_index];
+    
+    while (queue->count > 0)
+    {
+        frame      = &so->fanout->frames[queue->frames[queue->head]];
+        bytes_sent = send(pollfd->fd, frame->data + queue->offset, frame->size - queue->offset,
+                          MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (bytes_sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                pollfd->events = POLLOUT; // Read no requests until the frame is out.
+                return;
+            }
+            
+            // The connection is broken; poll reports it, and the connection is closed then.
+            fanout_drop(so, conn_index);
+            break;
+        }
+        
+        queue->offset += (size_t) bytes_sent;
+        if (queue->offset == frame->size)
+        {
+            pop_frame(so, queue);
+        }
+    }
+    
+    pollfd->events = POLLIN;
+}
+
+void fanout_drop(struct server_object *so, size_t conn_index)
+{
+    struct fanout_queue *queue;
+    
+    queue = &so->parent->fanout_queues[conn_index];
+    while (queue->count > 0)
+    {
+        pop_frame(so, queue);
+    }
+}
+
+void fanout_ping(struct server_object *so, enum Type type, const char *name)
+{
+    so->child->ping.type = (uint8_t) type;
+    strncpy(so->child->ping.name, name, PING_NAME_MAX_SIZE);
+    so->child->ping.name[PING_NAME_MAX_SIZE] = '\0';
+}
+
+void fanout_schedule_ping(struct core_object *co, struct server_object *so, const struct ping *ping)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct pending_ping *pending;
+    struct pending_ping *free_slot;
+    
+    free_slot = NULL;
+    for (size_t p = 0; p < PENDING_PINGS; ++p)
+    {
+        pending = &so->parent->pending_pings[p];
+        if (pending->ping.type == 0)
+        {
+            free_slot = free_slot ? free_slot : pending;
+        } else if (pending->ping.type == ping->type && strcmp(pending->ping.name, ping->name) == 0)
+        {
+            return; // Coalesced into the Ping already waiting.
+        }
+    }
+    
+    if (so->ping_window_ms == 0 || !free_slot)
+    {
+        broadcast_ping(co, so, ping);
+        return;
+    }
+    
+    free_slot->ping = *ping;
+    clock_gettime(CLOCK_MONOTONIC, &free_slot->due);
+    free_slot->due.tv_sec  += so->ping_window_ms / MS_PER_S;
+    free_slot->due.tv_nsec += (so->ping_window_ms % MS_PER_S) * NS_PER_MS;
+    if (free_slot->due.tv_nsec >= MS_PER_S * NS_PER_MS)
+    {
+        ++free_slot->due.tv_sec;
+        free_slot->due.tv_nsec -= MS_PER_S * NS_PER_MS;
+    }
+}
+
+int fanout_ping_timeout(struct server_object *so, int timeout)
+{
+    struct timespec now;
+    long            wait_ms;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (size_t p = 0; p < PENDING_PINGS; ++p)
+    {
+        if (so->parent->pending_pings[p].ping.type == 0)
+        {
+            continue;
+        }
+        
+        wait_ms = ms_until(&now, &so->parent->pending_pings[p].due);
+        if (timeout == -1 || wait_ms < timeout)
+        {
+            timeout = (int) wait_ms; // No longer than the window.
+        }
+    }
+    
+    return timeout;
+}
+
+void fanout_send_due_pings(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct pending_ping *pending;
+    struct timespec     now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (size_t p = 0; p < PENDING_PINGS; ++p)
+    {
+        pending = &so->parent->pending_pings[p];
+        if (pending->ping.type != 0 && ms_until(&now, &pending->due) == 0)
+        {
+            broadcast_ping(co, so, &pending->ping);
+            pending->ping.type = 0;
+        }
+    }
+}
+
+static int claim_frame(struct fanout *fanout)
+{
+    unsigned int expected;
+    
+    for (int f = 0; f < FANOUT_FRAMES; ++f)
+    {
+        expected = 0;
+        if (atomic_compare_exchange_strong(&fanout->frames[f].refs, &expected, 1))
+        {
+            return f;
+        }
+    }
+    
+    return FANOUT_NONE;
+}
+
+static void release_frame(struct fanout_frame *frame)
+{
+    atomic_fetch_sub(&frame->refs, 1);
+}
+
+static void encode_frame(struct fanout_frame *frame, const struct dispatch *dispatch)
+{
+    uint16_t body_size_network_order;
+    
+    frame->data[0]          = (uint8_t) ((unsigned int) dispatch->version << VERSION_SHIFT | dispatch->type);
+    frame->data[1]          = dispatch->object;
+    body_size_network_order = htons(dispatch->body_size);
+    memcpy(frame->data + 2, &body_size_network_order, sizeof(body_size_network_order));
+    memcpy(frame->data + DISPATCH_HEADER_SIZE, dispatch->body, dispatch->body_size);
+    frame->size = DISPATCH_HEADER_SIZE + dispatch->body_size;
+}
+
+static void encode_ping(struct fanout_frame *frame, const struct ping *ping)
+{
+    size_t name_size;
+    
+    name_size      = strlen(ping->name);
+    frame->data[0] = (uint8_t) (PROTOCOL_VERSION << VERSION_SHIFT | ping->type);
+    memcpy(frame->data + PING_HEADER_SIZE, ping->name, name_size);
+    frame->data[PING_HEADER_SIZE + name_size] = '\x03';
+    frame->size                               = (uint32_t) (PING_HEADER_SIZE + name_size + 1);
+}
+
+static long find_connection(const struct parent *parent, const struct sockaddr_in *addr)
+{
+    for (size_t c = 0; c < MAX_CONNECTIONS; ++c)
+    {
+        if (parent->pollfds[FIRST_CONNECTION_POLLFD + c].fd != 0
+            && parent->client_addrs[c].sin_addr.s_addr == addr->sin_addr.s_addr
+            && parent->client_addrs[c].sin_port == addr->sin_port)
+        {
+            return (long) c;
+        }
+    }
+    
+    return -1;
+}
+
+static void queue_frame(struct core_object *co, struct server_object *so, size_t conn_index, int frame)
+{
+    struct fanout_queue *queue;
+    
+    queue = &so->parent->fanout_queues[conn_index];
+    if (queue->count == FANOUT_QUEUE_LENGTH)
+    {
+        // NOLINTNEXTLINE(concurrency-mt-unsafe): No threads here
+        (void) fprintf(stderr, "Frames to %s:%d are backed up; one was dropped.\n",
+                       inet_ntoa(so->parent->client_addrs[conn_index].sin_addr),
+                       ntohs(so->parent->client_addrs[conn_index].sin_port));
+        return;
+    }
+    
+    atomic_fetch_add(&so->fanout->frames[frame].refs, 1);
+    queue->frames[(queue->head + queue->count) % FANOUT_QUEUE_LENGTH] = frame;
+    ++queue->count;
+    
+    // A connection lent to a worker is flushed once the worker gives it back.
+    if (so->parent->pollfds[FIRST_CONNECTION_POLLFD + conn_index].fd > 0)
+    {
+        fanout_flush(co, so, conn_index);
+    }
+}
+
+static void broadcast_ping(struct core_object *co, struct server_object *so, const struct ping *ping)
+{
+    int frame;
+    
+    frame = claim_frame(so->fanout);
+    if (frame == FANOUT_NONE)
+    {
+        (void) fprintf(stderr, "Every fan-out frame is in flight; a Ping was dropped.\n");
+        return;
+    }
+    
+    encode_ping(&so->fanout->frames[frame], ping);
+    so->fanout->frames[frame].recipient_count = 0; // Every connection.
+    
+    for (size_t c = 0; c < MAX_CONNECTIONS; ++c)
+    {
+        if (so->parent->pollfds[FIRST_CONNECTION_POLLFD + c].fd != 0)
+        {
+            queue_frame(co, so, c, frame);
+        }
+    }
+    
+    release_frame(&so->fanout->frames[frame]); // The reference taken when claiming it.
+}
+
+static long ms_until(const struct timespec *now, const struct timespec *due)
+{
+    long ns;
+    
+    ns = (due->tv_sec - now->tv_sec) * MS_PER_S * NS_PER_MS + (due->tv_nsec - now->tv_nsec);
+    
+    return (ns <= 0) ? 0 : (ns + NS_PER_MS - 1) / NS_PER_MS;
+}
+
+static void pop_frame(struct server_object *so, struct fanout_queue *queue)
+{
+    release_frame(&so->fanout->frames[queue->frames[queue->head]]);
+    queue->head   = (queue->head + 1) % FANOUT_QUEUE_LENGTH;
+    queue->offset = 0;
+    --queue->count;
+}
+
+static int forward_to_members(struct core_object *co, struct server_object *so, const struct dispatch *dispatch,
+                              const struct ping *ping, int channel_id, const int *user_ids, size_t user_count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    Session             sessions[SESSION_TABLE_CAPACITY];
+    size_t              session_count;
+    size_t              recipient_count;
+    int                 member;
+    int                 index;
+    struct fanout_frame *frame;
+    
+    if (session_list(co, so, sessions, &session_count) == -1)
+    {
+        return -1;
+    }
+    
+    // Keep the sessions of members and of the Users listed, in place.
+    recipient_count = 0;
+    for (size_t s = 0; s < session_count; ++s)
+    {
+        member = user_count > 0 && bsearch(&sessions[s].user_id, user_ids, user_count, sizeof(int), compare_ids);
+        if (!member)
+        {
+            member = membership_contains(co, so, channel_id, sessions[s].user_id);
+        }
+        if (member == -1)
+        {
+            return -1;
+        }
+        if (member)
+        {
+            sessions[recipient_count++] = sessions[s];
+        }
+    }
+    if (recipient_count == 0)
+    {
+        return 0;
+    }
+    
+    index = claim_frame(so->fanout);
+    if (index == FANOUT_NONE)
+    {
+        (void) fprintf(stderr, "Every fan-out frame is in flight; a forward was dropped.\n");
+        return 0;
+    }
+    
+    frame = &so->fanout->frames[index];
+    if (dispatch)
+    {
+        encode_frame(frame, dispatch);
+    } else
+    {
+        encode_ping(frame, ping);
+    }
+    for (size_t r = 0; r < recipient_count; ++r)
+    {
+        memset(&frame->recipients[r], 0, sizeof(struct sockaddr_in));
+        frame->recipients[r].sin_family      = AF_INET;
+        frame->recipients[r].sin_addr.s_addr = sessions[r].socket_ip;
+        frame->recipients[r].sin_port        = sessions[r].socket_port;
+    }
+    frame->recipient_count = recipient_count;
+    
+    // A worker passes one frame per request, so a later forward replaces an earlier one, whose frame is freed.
+    if (so->child->fanout_frame != FANOUT_NONE)
+    {
+        release_frame(&so->fanout->frames[so->child->fanout_frame]);
+    }
+    so->child->fanout_frame = index;
+    
+    return 0;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    int left;
+    int right;
+    
+    left  = *(const int *) a;
+    right = *(const int *) b;
+    
+    return (left > right) - (left < right);
+}
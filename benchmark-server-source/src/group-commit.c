@@ -0,0 +1,420 @@
+#include "../include/group-commit.h"
+#include "../include/process-server-util.h"
+#include "../include/write-ahead-log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define COMMIT_QUEUES_SHM_NAME "/gc_3fda69" /** Commit queues shared memory name. */
+#define US_PER_S 1000000L                   /** Microseconds per second. */
+#define NS_PER_US 1000L                     /** Nanoseconds per microsecond. */
+
+/**
+ * init_commit_queue
+ * <p>
+ * Initialize the process shared mutex and condition of a commit queue, and open its batches.
+ * </p>
+ * @param co the core object
+ * @param queue the commit queue, in shared memory
+ * @param window_us microseconds a batch stays open for more writes
+ * @return 0 on success, -1 and set err on failure
+ */
+static int init_commit_queue(struct core_object *co, struct commit_queue *queue, long window_us);
+
+/**
+ * write_directly
+ * <p>
+ * Apply a single write and force it to disk, without queueing it.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param op the write
+ * @return the status of the write
+ */
+static int write_directly(struct core_object *co, struct database *db, struct write_op *op);
+
+/**
+ * enqueue_write
+ * <p>
+ * Add a write to the filling batch of a commit queue, waiting while there is no room. Must be called while holding the
+ * mutex of the queue.
+ * </p>
+ * @param queue the commit queue
+ * @param op the write
+ * @param batch_get memory in which to store the index of the batch
+ * @param slot_get memory in which to store the index of the write in the batch
+ */
+static void enqueue_write(struct commit_queue *queue, const struct write_op *op, size_t *batch_get, size_t *slot_get);
+
+/**
+ * lead_batch
+ * <p>
+ * Wait for a batch to fill or for the window to pass, then apply it and wake its writers. Called by the first writer
+ * of the batch while holding the mutex of the queue; the mutex is released while the batch is applied.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param queue the commit queue
+ * @param batch_index the index of the batch
+ */
+static void lead_batch(struct core_object *co, struct database *db, struct commit_queue *queue, size_t batch_index);
+
+/**
+ * apply_batch
+ * <p>
+ * Apply every write of a batch under one acquisition of the database lock, force them to disk, and store the status
+ * of each in the batch.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param batch the batch
+ */
+static void apply_batch(struct core_object *co, struct database *db, struct commit_batch *batch);
+
+/**
+ * collect_status
+ * <p>
+ * Take the status of a write from a committed batch. The last writer to collect opens the batch again. Must be called
+ * while holding the mutex of the queue.
+ * </p>
+ * @param queue the commit queue
+ * @param batch_index the index of the batch
+ * @param slot the index of the write in the batch
+ * @return the status of the write
+ */
+static int collect_status(struct commit_queue *queue, size_t batch_index, size_t slot);
+
+int open_commit_queues(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database     *databases[MAX_DATABASES];
+    enum DurabilityMode mode;
+    const char          *mode_name;
+    const char          *window;
+    char                *end;
+    long                window_us;
+    
+    mode_name = getenv(DURABILITY_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (!mode_name || strcmp(mode_name, "async") == 0)
+    {
+        mode = DURABILITY_ASYNC;
+    } else if (strcmp(mode_name, "request") == 0)
+    {
+        mode = DURABILITY_REQUEST;
+    } else if (strcmp(mode_name, "batch") == 0)
+    {
+        mode = DURABILITY_BATCH;
+    } else
+    {
+        (void) fprintf(stderr, "Unknown durability mode \"%s\"\n", mode_name);
+        errno = EINVAL;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    window_us = GROUP_COMMIT_DEFAULT_WINDOW_US;
+    window    = getenv(GROUP_COMMIT_WINDOW_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (window)
+    {
+        errno     = 0;
+        window_us = strtol(window, &end, 10); // NOLINT(readability-magic-numbers) : Base 10
+        if (errno != 0 || end == window || *end != '\0' || window_us < 0)
+        {
+            (void) fprintf(stderr, "Invalid group commit window \"%s\"\n", window);
+            errno = EINVAL;
+            SET_ERROR(co->err);
+            return -1;
+        }
+    }
+    
+    if (mode != DURABILITY_ASYNC && so->engine->persist && !so->wal)
+    {
+        (void) fprintf(stdout, "Note: The %s storage engine reaches disk through %s; %s only batches its writes.\n",
+                       so->engine->name, PERSIST_INTERVAL_ENV, DURABILITY_ENV);
+    }
+    
+    if (mode == DURABILITY_BATCH)
+    {
+        so->commit_queues = map_shared_memory(co, COMMIT_QUEUES_SHM_NAME,
+                                              so->num_databases * sizeof(struct commit_queue));
+        if (!so->commit_queues)
+        {
+            return -1;
+        }
+    }
+    
+    list_databases(so, databases);
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        databases[d]->flush_writes = mode != DURABILITY_ASYNC;
+        if (so->commit_queues)
+        {
+            if (init_commit_queue(co, &so->commit_queues[d], window_us) == -1)
+            {
+                return -1;
+            }
+            databases[d]->commit_queue = &so->commit_queues[d];
+        }
+    }
+    
+    return 0;
+}
+
+void close_commit_queues(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->commit_queues)
+    {
+        munmap(so->commit_queues, so->num_databases * sizeof(struct commit_queue));
+        so->commit_queues = NULL;
+    }
+}
+
+int commit_write(struct core_object *co, struct database *db, enum WriteKind kind, datum *key, datum *value,
+                 int store_flags)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct commit_queue *queue;
+    struct write_op     op;
+    size_t              batch_index;
+    size_t              slot;
+    int                 status;
+    
+    op.kind        = kind;
+    op.store_flags = store_flags;
+    op.key         = *key;
+    op.value.dptr  = NULL;
+    op.value.dsize = 0;
+    if (value)
+    {
+        op.value = *value;
+    }
+    
+    queue = db->commit_queue;
+    if (!queue || (size_t) op.key.dsize + (size_t) op.value.dsize > GROUP_COMMIT_BUFFER_SIZE)
+    {
+        return write_directly(co, db, &op);
+    }
+    
+    pthread_mutex_lock(&queue->mutex);
+    enqueue_write(queue, &op, &batch_index, &slot);
+    if (slot == 0)
+    {
+        lead_batch(co, db, queue, batch_index);
+    }
+    while (queue->batches[batch_index].state != BATCH_DONE)
+    {
+        pthread_cond_wait(&queue->changed, &queue->mutex);
+    }
+    status = collect_status(queue, batch_index, slot);
+    pthread_mutex_unlock(&queue->mutex);
+    
+    // The leader recorded the cause of a failure in its own error saver.
+    if (status == -1)
+    {
+        errno = EIO;
+        SET_ERROR(co->err);
+    }
+    
+    return status;
+}
+
+static int init_commit_queue(struct core_object *co, struct commit_queue *queue, long window_us)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    pthread_mutexattr_t mutex_attr;
+    pthread_condattr_t  cond_attr;
+    int                 status;
+    
+    status = pthread_mutexattr_init(&mutex_attr);
+    if (status == 0)
+    {
+        status = pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+        if (status == 0)
+        {
+            status = pthread_mutex_init(&queue->mutex, &mutex_attr);
+        }
+        pthread_mutexattr_destroy(&mutex_attr);
+    }
+    if (status == 0)
+    {
+        status = pthread_condattr_init(&cond_attr);
+    }
+    if (status == 0)
+    {
+        status = pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+        if (status == 0)
+        {
+            status = pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+        }
+        if (status == 0)
+        {
+            status = pthread_cond_init(&queue->changed, &cond_attr);
+        }
+        pthread_condattr_destroy(&cond_attr);
+    }
+    if (status != 0)
+    {
+        errno = status;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    queue->window_us = window_us;
+    queue->filling   = 0;
+    for (size_t b = 0; b < 2; ++b)
+    {
+        queue->batches[b].state = BATCH_OPEN;
+    }
+    
+    return 0;
+}
+
+static int write_directly(struct core_object *co, struct database *db, struct write_op *op)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (db->engine->write_batch(co, db, op, 1, 1) == -1)
+    {
+        return -1;
+    }
+    
+    return op->status;
+}
+
+static void enqueue_write(struct commit_queue *queue, const struct write_op *op, size_t *batch_get, size_t *slot_get)
+{
+    struct commit_batch *batch;
+    struct queued_write *write;
+    size_t              size;
+    
+    size = (size_t) op->key.dsize + (size_t) op->value.dsize;
+    for (;;)
+    {
+        batch = &queue->batches[queue->filling];
+        if (batch->state == BATCH_OPEN && batch->count < GROUP_COMMIT_MAX_WRITES
+            && batch->used + size <= GROUP_COMMIT_BUFFER_SIZE)
+        {
+            break;
+        }
+        if (batch->state == BATCH_OPEN && !batch->full) // Out of room; tell the leader not to wait out the window.
+        {
+            batch->full = 1;
+            pthread_cond_broadcast(&queue->changed);
+        }
+        pthread_cond_wait(&queue->changed, &queue->mutex);
+    }
+    
+    write               = &batch->writes[batch->count];
+    write->kind         = op->kind;
+    write->store_flags  = op->store_flags;
+    write->key_offset   = batch->used;
+    write->key_size     = (size_t) op->key.dsize;
+    write->value_offset = batch->used + write->key_size;
+    write->value_size   = (size_t) op->value.dsize;
+    memcpy(batch->data + write->key_offset, op->key.dptr, write->key_size);
+    if (write->value_size > 0)
+    {
+        memcpy(batch->data + write->value_offset, op->value.dptr, write->value_size);
+    }
+    batch->used += size;
+    
+    *batch_get = queue->filling;
+    *slot_get  = batch->count++;
+    if (batch->count == GROUP_COMMIT_MAX_WRITES)
+    {
+        pthread_cond_broadcast(&queue->changed);
+    }
+}
+
+static void lead_batch(struct core_object *co, struct database *db, struct commit_queue *queue, size_t batch_index)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct commit_batch *batch;
+    struct timespec     deadline;
+    int                 status;
+    
+    batch = &queue->batches[batch_index];
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec  += (deadline.tv_nsec + queue->window_us * NS_PER_US) / (US_PER_S * NS_PER_US);
+    deadline.tv_nsec  = (deadline.tv_nsec + queue->window_us * NS_PER_US) % (US_PER_S * NS_PER_US);
+    status            = 0;
+    while (status != ETIMEDOUT && !batch->full && batch->count < GROUP_COMMIT_MAX_WRITES)
+    {
+        status = pthread_cond_timedwait(&queue->changed, &queue->mutex, &deadline);
+    }
+    
+    // Later writers go to the other batch if it is free; otherwise they wait until it is.
+    batch->state = BATCH_COMMITTING;
+    if (queue->batches[1 - batch_index].state == BATCH_OPEN)
+    {
+        queue->filling = 1 - batch_index;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    
+    apply_batch(co, db, batch);
+    
+    pthread_mutex_lock(&queue->mutex);
+    batch->state       = BATCH_DONE;
+    batch->uncollected = batch->count;
+    pthread_cond_broadcast(&queue->changed);
+}
+
+static void apply_batch(struct core_object *co, struct database *db, struct commit_batch *batch)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct write_op     ops[GROUP_COMMIT_MAX_WRITES];
+    struct queued_write *write;
+    int                 status;
+    
+    for (size_t w = 0; w < batch->count; ++w)
+    {
+        write = &batch->writes[w];
+        ops[w].kind        = write->kind;
+        ops[w].store_flags = write->store_flags;
+        ops[w].key.dptr    = (void *) (batch->data + write->key_offset);
+        ops[w].value.dptr  = (void *) (batch->data + write->value_offset);
+        // NOLINTBEGIN(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+        ops[w].key.dsize   = write->key_size;
+        ops[w].value.dsize = write->value_size;
+        // NOLINTEND(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions)
+    }
+    
+    status = db->engine->write_batch(co, db, ops, batch->count, 1);
+    for (size_t w = 0; w < batch->count; ++w)
+    {
+        batch->writes[w].status = (status == -1) ? -1 : ops[w].status;
+    }
+}
+
+static int collect_status(struct commit_queue *queue, size_t batch_index, size_t slot)
+{
+    struct commit_batch *batch;
+    int                 status;
+    
+    batch  = &queue->batches[batch_index];
+    status = batch->writes[slot].status;
+    if (--batch->uncollected == 0)
+    {
+        batch->count = 0;
+        batch->used  = 0;
+        batch->full  = 0;
+        batch->state = BATCH_OPEN;
+        if (queue->batches[queue->filling].state != BATCH_OPEN)
+        {
+            queue->filling = batch_index;
+        }
+        pthread_cond_broadcast(&queue->changed);
+    }
+    
+    return status;
+}
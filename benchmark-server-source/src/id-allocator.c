@@ -0,0 +1,306 @@
+#include "../include/id-allocator.h"
+#include "../include/process-server-util.h"
+#include "../include/storage-engine.h"
+#include "../include/user-table.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define ID_ALLOCATOR_SHM_NAME "/id_3fda69" /** ID allocator shared memory name. */
+
+static_assert(USER_ID_RESERVE_SIZE >= ID_LEASE_SIZE && USER_ID_RESERVE_SIZE <= USER_TABLE_CAPACITY / 64,
+              "The User IDs skipped by a crash must be a small part of the user table");
+
+/**
+ * The blocks of IDs leased by this process. Private to each worker; every worker starts with empty leases when it is
+ * forked.
+ */
+static struct id_lease leases[NUM_ID_KINDS];
+
+/**
+ * find_max_id
+ * <p>
+ * Record visitor which keeps the greatest ID of the records visited. Every record starts with its int ID.
+ * </p>
+ * @param co the core object
+ * @param arg the greatest ID so far, a long
+ * @param key the key of the record
+ * @param value the record
+ * @return 0
+ */
+static int find_max_id(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * reserve_size
+ * <p>
+ * Get the number of IDs of a kind to reserve on disk at once. A restart after a crash skips the IDs reserved but not
+ * yet handed out, and the user table only holds User IDs below its capacity, so User IDs are reserved in much smaller
+ * steps than other IDs. That costs a write to disk every USER_ID_RESERVE_SIZE Users.
+ * </p>
+ * @param kind the kind of ID
+ * @return the number of IDs
+ */
+static long reserve_size(enum IdKind kind);
+
+/**
+ * write_ceilings
+ * <p>
+ * Record the ceiling of every kind of ID on disk, and wait for the write to reach the disk. Must be called before
+ * forking or while holding the allocator lock for writing.
+ * </p>
+ * @param co the core object
+ * @param allocator the ID allocator
+ * @param ceilings the ceilings to record
+ * @return 0 on success, -1 and set err on failure
+ */
+static int write_ceilings(struct core_object *co, struct id_allocator *allocator, const int64_t *ceilings);
+
+/**
+ * reserve_ids
+ * <p>
+ * Raise the ceiling of a kind of ID to at least end, recording it on disk before any ID below it is handed out.
+ * </p>
+ * @param co the core object
+ * @param allocator the ID allocator
+ * @param kind the kind of ID
+ * @param end the ID up to which IDs must be reserved
+ * @return 0 on success, -1 and set err on failure
+ */
+static int reserve_ids(struct core_object *co, struct id_allocator *allocator, enum IdKind kind, long end);
+
+/**
+ * lease_ids
+ * <p>
+ * Take the next block of IDs of a kind from its shared counter.
+ * </p>
+ * @param co the core object
+ * @param allocator the ID allocator
+ * @param kind the kind of ID
+ * @param lease memory in which to store the block
+ * @return 0 on success, -1 and set err on failure
+ */
+static int lease_ids(struct core_object *co, struct id_allocator *allocator, enum IdKind kind, struct id_lease *lease);
+
+int open_id_allocator(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int64_t ceilings[NUM_ID_KINDS];
+    long    max_ids[NUM_ID_KINDS];
+    ssize_t bytes_read;
+    long    next;
+    
+    so->id_allocator = map_shared_memory(co, ID_ALLOCATOR_SHM_NAME, sizeof(struct id_allocator));
+    if (!so->id_allocator)
+    {
+        return -1;
+    }
+    so->id_allocator->fd = -1;
+    if (rw_lock_init(co, &so->id_allocator->lock) == -1)
+    {
+        return -1;
+    }
+    
+    so->id_allocator->fd = open(ID_FILE_NAME, O_RDWR | O_CREAT, DB_FILE_MODE); // NOLINT(hicpp-signed-bitwise)
+    if (so->id_allocator->fd == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    // A missing or short file leaves the remaining ceilings at 0; the databases still bound the IDs in use.
+    memset(ceilings, 0, sizeof(ceilings));
+    bytes_read = pread(so->id_allocator->fd, ceilings, sizeof(ceilings), 0);
+    if (bytes_read == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    memset(max_ids, 0, sizeof(max_ids));
+    if (so->user_db.engine->for_each(co, &so->user_db, find_max_id, &max_ids[USER_ID]) == -1
+        || so->channel_db.engine->for_each(co, &so->channel_db, find_max_id, &max_ids[CHANNEL_ID]) == -1)
+    {
+        return -1;
+    }
+    for (size_t s = 0; s < so->num_message_shards; ++s)
+    {
+        if (so->message_dbs[s].engine->for_each(co, &so->message_dbs[s], find_max_id, &max_ids[MESSAGE_ID]) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    for (size_t k = 0; k < NUM_ID_KINDS; ++k)
+    {
+        next = (ceilings[k] > max_ids[k]) ? (long) ceilings[k] : max_ids[k] + 1;
+        ceilings[k] = next + reserve_size((enum IdKind) k);
+        atomic_init(&so->id_allocator->counters[k].next, next);
+        atomic_init(&so->id_allocator->counters[k].ceiling, (long) ceilings[k]);
+    }
+    
+    return write_ceilings(co, so->id_allocator, ceilings);
+}
+
+void close_id_allocator(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->id_allocator)
+    {
+        if (so->id_allocator->fd != -1)
+        {
+            (void) close(so->id_allocator->fd);
+        }
+        munmap(so->id_allocator, sizeof(struct id_allocator));
+        so->id_allocator = NULL;
+    }
+}
+
+int release_unused_ids(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int64_t ceilings[NUM_ID_KINDS];
+    
+    if (!so->id_allocator)
+    {
+        return 0;
+    }
+    
+    for (size_t k = 0; k < NUM_ID_KINDS; ++k)
+    {
+        ceilings[k] = atomic_load_explicit(&so->id_allocator->counters[k].next, memory_order_relaxed);
+    }
+    
+    return write_ceilings(co, so->id_allocator, ceilings);
+}
+
+int allocate_id(struct core_object *co, struct server_object *so, enum IdKind kind, int *id_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct id_lease *lease;
+    
+    lease = &leases[kind];
+    if (lease->next == lease->end && lease_ids(co, so->id_allocator, kind, lease) == -1)
+    {
+        return -1;
+    }
+    
+    *id_get = (int) lease->next++;
+    
+    return 0;
+}
+
+static int find_max_id(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    long *max_id;
+    int  id;
+    
+    (void) key;
+    max_id = (long *) arg;
+    memcpy(&id, value->dptr, sizeof(id));
+    if (id > *max_id)
+    {
+        *max_id = id;
+    }
+    
+    return 0;
+}
+
+static long reserve_size(enum IdKind kind)
+{
+    return (kind == USER_ID) ? USER_ID_RESERVE_SIZE : ID_RESERVE_SIZE;
+}
+
+static int write_ceilings(struct core_object *co, struct id_allocator *allocator, const int64_t *ceilings)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    size_t  size;
+    ssize_t bytes_written;
+    
+    size          = NUM_ID_KINDS * sizeof(int64_t);
+    bytes_written = pwrite(allocator->fd, ceilings, size, 0);
+    if (bytes_written == -1 || fdatasync(allocator->fd) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if ((size_t) bytes_written != size)
+    {
+        errno = EIO;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int reserve_ids(struct core_object *co, struct id_allocator *allocator, enum IdKind kind, long end)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int64_t ceilings[NUM_ID_KINDS];
+    int     ret_val;
+    
+    if (rw_lock_write(co, &allocator->lock) == -1)
+    {
+        return -1;
+    }
+    
+    ret_val = 0;
+    // Another worker may have raised the ceiling while this one waited for the lock.
+    if (atomic_load_explicit(&allocator->counters[kind].ceiling, memory_order_relaxed) < end)
+    {
+        for (size_t k = 0; k < NUM_ID_KINDS; ++k)
+        {
+            ceilings[k] = atomic_load_explicit(&allocator->counters[k].ceiling, memory_order_relaxed);
+        }
+        ceilings[kind] = end + reserve_size(kind);
+        ret_val = write_ceilings(co, allocator, ceilings);
+        if (ret_val == 0)
+        {
+            atomic_store_explicit(&allocator->counters[kind].ceiling, (long) ceilings[kind], memory_order_release);
+        }
+    }
+    rw_lock_unlock(&allocator->lock);
+    
+    return ret_val;
+}
+
+static int lease_ids(struct core_object *co, struct id_allocator *allocator, enum IdKind kind, struct id_lease *lease)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    long start;
+    long end;
+    
+    start = atomic_fetch_add_explicit(&allocator->counters[kind].next, ID_LEASE_SIZE, memory_order_relaxed);
+    if (start > (long) INT_MAX - ID_LEASE_SIZE + 1) // The last ID of the lease would not fit in an int.
+    {
+        errno = EOVERFLOW;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    end = start + ID_LEASE_SIZE;
+    
+    if (end > atomic_load_explicit(&allocator->counters[kind].ceiling, memory_order_acquire)
+        && reserve_ids(co, allocator, kind, end) == -1)
+    {
+        return -1;
+    }
+    
+    lease->next = start;
+    lease->end  = end;
+    
+    return 0;
+}
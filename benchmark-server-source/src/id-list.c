@@ -0,0 +1,424 @@
+#include "../include/id-list.h"
+
+#include <string.h>
+
+#define WORD_BITS 64      /** Bits per word of a bitmap container. */
+#define VARINT_BITS 7     /** Bits of a difference held by each byte of a variable length integer. */
+#define VARINT_MORE 0x80U /** Set in every byte of a variable length integer but the last. */
+#define VARINT_MAX_SIZE 5 /** Bytes taken by the largest 32 bit variable length integer. */
+
+/**
+ * block_count
+ * <p>
+ * Get the number of blocks of an array container.
+ * </p>
+ * @param count the number of IDs
+ * @return the number of blocks
+ */
+static size_t block_count(size_t count);
+
+/**
+ * block_length
+ * <p>
+ * Get the number of IDs in a block of an array container. Every block is full but the last.
+ * </p>
+ * @param count the number of IDs
+ * @param block the block
+ * @return the number of IDs in the block
+ */
+static size_t block_length(size_t count, size_t block);
+
+/**
+ * varint_size
+ * <p>
+ * Get the number of bytes taken by a variable length integer.
+ * </p>
+ * @param value the integer
+ * @return the number of bytes
+ */
+static size_t varint_size(uint32_t value);
+
+/**
+ * put_varint
+ * <p>
+ * Write a variable length integer.
+ * </p>
+ * @param list the encoded list
+ * @param offset the offset at which to write the integer, moved past it
+ * @param value the integer
+ */
+static void put_varint(uint8_t *list, size_t *offset, uint32_t value);
+
+/**
+ * get_varint
+ * <p>
+ * Read a variable length integer, without reading past the end of the list.
+ * </p>
+ * @param list the encoded list
+ * @param size the size of the list in bytes
+ * @param offset the offset of the integer, moved past it
+ * @param value memory in which to store the integer
+ * @return 0 on success, -1 if the integer is cut off or too long
+ */
+static int get_varint(const uint8_t *list, size_t size, size_t *offset, uint32_t *value);
+
+/**
+ * get_block
+ * <p>
+ * Read an entry of the table of blocks of an array container.
+ * </p>
+ * @param list the encoded list
+ * @param block the block
+ * @return the entry
+ */
+static struct id_list_block get_block(const uint8_t *list, size_t block);
+
+/**
+ * get_word
+ * <p>
+ * Read a word of a bitmap container.
+ * </p>
+ * @param list the encoded list
+ * @param word the word
+ * @return the word
+ */
+static uint64_t get_word(const uint8_t *list, size_t word);
+
+/**
+ * set_bit
+ * <p>
+ * Set a bit of a bitmap container.
+ * </p>
+ * @param list the encoded list
+ * @param bit the bit, from the first bit of the first word
+ */
+static void set_bit(uint8_t *list, size_t bit);
+
+/**
+ * find_block
+ * <p>
+ * Find the last block of an array container whose first ID is not after an ID.
+ * </p>
+ * @param list the encoded list
+ * @param blocks_count the number of blocks
+ * @param id the ID
+ * @return the block, or -1 if every block starts after the ID
+ */
+static long find_block(const uint8_t *list, size_t blocks_count, int id);
+
+size_t id_list_size(const int *ids, size_t count, enum id_list_container *container)
+{
+    size_t array_size;
+    size_t bitmap_size;
+    
+    *container = ID_LIST_ARRAY;
+    if (count == 0)
+    {
+        return 0;
+    }
+    
+    array_size = block_count(count) * sizeof(struct id_list_block);
+    for (size_t i = 1; i < count; ++i)
+    {
+        if (i % ID_LIST_BLOCK != 0)
+        {
+            array_size += varint_size((uint32_t) (ids[i] - ids[i - 1]));
+        }
+    }
+    bitmap_size = sizeof(struct id_list_bitmap)
+                  + ((size_t) ids[count - 1] / WORD_BITS - (size_t) ids[0] / WORD_BITS + 1) * sizeof(uint64_t);
+    
+    if (bitmap_size < array_size)
+    {
+        *container = ID_LIST_BITMAP;
+        return bitmap_size;
+    }
+    
+    return array_size;
+}
+
+void id_list_encode(uint8_t *list, const int *ids, size_t count, enum id_list_container container)
+{
+    struct id_list_block  block;
+    struct id_list_bitmap bitmap;
+    size_t                offset;
+    
+    if (count == 0)
+    {
+        return;
+    }
+    
+    if (container == ID_LIST_BITMAP)
+    {
+        bitmap.base       = ids[0] / WORD_BITS * WORD_BITS;
+        bitmap.word_count = (uint32_t) ((ids[count - 1] - bitmap.base) / WORD_BITS + 1);
+        memcpy(list, &bitmap, sizeof(bitmap));
+        for (size_t i = 0; i < count; ++i)
+        {
+            set_bit(list, (size_t) (ids[i] - bitmap.base));
+        }
+        return;
+    }
+    
+    offset = block_count(count) * sizeof(struct id_list_block);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i % ID_LIST_BLOCK == 0)
+        {
+            block.first  = ids[i];
+            block.offset = (uint32_t) offset;
+            memcpy(list + i / ID_LIST_BLOCK * sizeof(block), &block, sizeof(block));
+        } else
+        {
+            put_varint(list, &offset, (uint32_t) (ids[i] - ids[i - 1]));
+        }
+    }
+}
+
+int id_list_check(const uint8_t *list, size_t size, size_t count, enum id_list_container container)
+{
+    struct id_list_block  block;
+    struct id_list_bitmap bitmap;
+    size_t                table_size;
+    
+    if (count == 0)
+    {
+        return 1;
+    }
+    
+    switch (container)
+    {
+        case ID_LIST_ARRAY:
+        {
+            table_size = block_count(count) * sizeof(struct id_list_block);
+            if (table_size > size)
+            {
+                return 0;
+            }
+            for (size_t b = 0; b < block_count(count); ++b)
+            {
+                block = get_block(list, b);
+                if (block.offset < table_size || block.offset > size)
+                {
+                    return 0;
+                }
+            }
+            return 1;
+        }
+        case ID_LIST_BITMAP:
+        {
+            if (size < sizeof(bitmap))
+            {
+                return 0;
+            }
+            memcpy(&bitmap, list, sizeof(bitmap));
+            return bitmap.base >= 0 && (size - sizeof(bitmap)) / sizeof(uint64_t) >= bitmap.word_count;
+        }
+        default:
+        {
+            return 0;
+        }
+    }
+}
+
+int id_list_contains(const uint8_t *list, size_t size, size_t count, enum id_list_container container, int id)
+{
+    struct id_list_block  entry;
+    struct id_list_bitmap bitmap;
+    long                  block;
+    size_t                offset;
+    size_t                bit;
+    uint32_t              difference;
+    int64_t               value;
+    
+    if (count == 0)
+    {
+        return 0;
+    }
+    
+    if (container == ID_LIST_BITMAP)
+    {
+        memcpy(&bitmap, list, sizeof(bitmap));
+        if (id < bitmap.base)
+        {
+            return 0;
+        }
+        bit = (size_t) id - (size_t) bitmap.base;
+        
+        return bit / WORD_BITS < bitmap.word_count && (get_word(list, bit / WORD_BITS) >> (bit % WORD_BITS) & 1U);
+    }
+    
+    block = find_block(list, block_count(count), id);
+    if (block == -1)
+    {
+        return 0;
+    }
+    
+    entry  = get_block(list, (size_t) block);
+    value  = entry.first;
+    offset = entry.offset;
+    for (size_t i = 1; value < id && i < block_length(count, (size_t) block); ++i)
+    {
+        if (get_varint(list, size, &offset, &difference) == -1)
+        {
+            return 0;
+        }
+        value += difference;
+    }
+    
+    return value == id;
+}
+
+size_t id_list_decode(const uint8_t *list, size_t size, size_t count, enum id_list_container container, int *ids)
+{
+    struct id_list_block  entry;
+    struct id_list_bitmap bitmap;
+    uint64_t              word;
+    size_t                decoded;
+    size_t                offset;
+    uint32_t              difference;
+    int64_t               value;
+    
+    decoded = 0;
+    if (count == 0)
+    {
+        return 0;
+    }
+    
+    if (container == ID_LIST_BITMAP)
+    {
+        memcpy(&bitmap, list, sizeof(bitmap));
+        for (uint32_t w = 0; w < bitmap.word_count && decoded < count; ++w)
+        {
+            word = get_word(list, w);
+            for (unsigned int b = 0; b < WORD_BITS && decoded < count; ++b)
+            {
+                if (word >> b & 1U)
+                {
+                    ids[decoded++] = (int) (bitmap.base + (int64_t) w * WORD_BITS + b);
+                }
+            }
+        }
+        return decoded;
+    }
+    
+    for (size_t block = 0; block < block_count(count); ++block)
+    {
+        entry          = get_block(list, block);
+        value          = entry.first;
+        offset         = entry.offset;
+        ids[decoded++] = (int) value;
+        for (size_t i = 1; i < block_length(count, block); ++i)
+        {
+            if (get_varint(list, size, &offset, &difference) == -1)
+            {
+                return decoded;
+            }
+            value          += difference;
+            ids[decoded++] = (int) value;
+        }
+    }
+    
+    return decoded;
+}
+
+static size_t block_count(size_t count)
+{
+    return (count + ID_LIST_BLOCK - 1) / ID_LIST_BLOCK;
+}
+
+static size_t block_length(size_t count, size_t block)
+{
+    return (block + 1) * ID_LIST_BLOCK <= count ? ID_LIST_BLOCK : count - block * ID_LIST_BLOCK;
+}
+
+static size_t varint_size(uint32_t value)
+{
+    size_t size;
+    
+    for (size = 1; value >> VARINT_BITS; ++size)
+    {
+        value >>= VARINT_BITS;
+    }
+    
+    return size;
+}
+
+static void put_varint(uint8_t *list, size_t *offset, uint32_t value)
+{
+    while (value >> VARINT_BITS)
+    {
+        list[(*offset)++] = (uint8_t) (value | VARINT_MORE);
+        value >>= VARINT_BITS;
+    }
+    list[(*offset)++] = (uint8_t) value;
+}
+
+static int get_varint(const uint8_t *list, size_t size, size_t *offset, uint32_t *value)
+{
+    *value = 0;
+    for (unsigned int shift = 0; shift < VARINT_MAX_SIZE * VARINT_BITS; shift += VARINT_BITS)
+    {
+        if (*offset >= size)
+        {
+            return -1;
+        }
+        *value |= (uint32_t) (list[*offset] & ~VARINT_MORE) << shift;
+        if (!(list[(*offset)++] & VARINT_MORE))
+        {
+            return 0;
+        }
+    }
+    
+    return -1;
+}
+
+static struct id_list_block get_block(const uint8_t *list, size_t block)
+{
+    struct id_list_block entry;
+    
+    memcpy(&entry, list + block * sizeof(entry), sizeof(entry));
+    
+    return entry;
+}
+
+static uint64_t get_word(const uint8_t *list, size_t word)
+{
+    uint64_t value;
+    
+    memcpy(&value, list + sizeof(struct id_list_bitmap) + word * sizeof(value), sizeof(value));
+    
+    return value;
+}
+
+static void set_bit(uint8_t *list, size_t bit)
+{
+    uint64_t word;
+    
+    word = get_word(list, bit / WORD_BITS) | (uint64_t) 1 << (bit % WORD_BITS);
+    memcpy(list + sizeof(struct id_list_bitmap) + bit / WORD_BITS * sizeof(word), &word, sizeof(word));
+}
+
+static long find_block(const uint8_t *list, size_t blocks_count, int id)
+{
+    size_t low;
+    size_t high;
+    size_t middle;
+    
+    // Find the first block starting after the ID; the one before it is the last not starting after it.
+    low  = 0;
+    high = blocks_count;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (get_block(list, middle).first <= id)
+        {
+            low = middle + 1;
+        } else
+        {
+            high = middle;
+        }
+    }
+    
+    return (long) low - 1;
+}
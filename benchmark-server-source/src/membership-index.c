@@ -0,0 +1,912 @@
+#include "../../include/manager.h"
+#include "../include/db.h"
+#include "../include/membership-index.h"
+#include "../include/object-util.h"
+#include "../include/process-server-util.h"
+#include "../include/storage-engine.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MEMBERSHIP_INDEX_SHM_NAME "/mi_3fda69" /** Membership index shared memory name. */
+#define HASH_MULTIPLIER 2654435761U            /** Knuth's multiplicative hashing constant. */
+#define PAIR_MULTIPLIER 2246822519U            /** Mixes the User ID into the hash of a membership. */
+#define HASH_SHIFT 16                          /** Fold the high bits of a hash into the low bits. */
+
+/**
+ * hash_id
+ * <p>
+ * Hash a Channel or User ID.
+ * </p>
+ * @param id the ID
+ * @return the hash
+ */
+static size_t hash_id(int id);
+
+/**
+ * channel_lock
+ * <p>
+ * Get the update lock of a Channel. Channels whose IDs share a lock serialize their updates.
+ * </p>
+ * @param channel_id the ID of the Channel
+ * @return the position of the lock
+ */
+static size_t channel_lock(int channel_id);
+
+/**
+ * hash_pair
+ * <p>
+ * Hash a membership.
+ * </p>
+ * @param channel_id the ID of the Channel
+ * @param user_id the ID of the User
+ * @return the hash
+ */
+static size_t hash_pair(int channel_id, int user_id);
+
+/**
+ * pair_home
+ * <p>
+ * Get the home bucket of the membership in a slot, keyed by Channel and User.
+ * </p>
+ * @param index the membership index
+ * @param slot the slot
+ * @return the home bucket
+ */
+static size_t pair_home(const struct membership_index *index, int slot);
+
+/**
+ * channel_home
+ * <p>
+ * Get the home bucket of the membership in a slot, keyed by Channel.
+ * </p>
+ * @param index the membership index
+ * @param slot the slot
+ * @return the home bucket
+ */
+static size_t channel_home(const struct membership_index *index, int slot);
+
+/**
+ * user_home
+ * <p>
+ * Get the home bucket of the membership in a slot, keyed by User.
+ * </p>
+ * @param index the membership index
+ * @param slot the slot
+ * @return the home bucket
+ */
+static size_t user_home(const struct membership_index *index, int slot);
+
+/**
+ * find_pair_bucket
+ * <p>
+ * Find the bucket holding the membership of a User in a Channel.
+ * </p>
+ * @param index the membership index
+ * @param channel_id the ID of the Channel
+ * @param user_id the ID of the User
+ * @return the bucket, or -1 if the User is not a member
+ */
+static int find_pair_bucket(const struct membership_index *index, int channel_id, int user_id);
+
+/**
+ * find_list_bucket
+ * <p>
+ * Find the bucket holding the first membership of a Channel or of a User.
+ * </p>
+ * @param index the membership index
+ * @param buckets channel_buckets or user_buckets
+ * @param id the ID of the Channel or User
+ * @return the bucket, or -1 if the Channel or User has no memberships
+ */
+static int find_list_bucket(const struct membership_index *index, const int *buckets, int id);
+
+/**
+ * list_key
+ * <p>
+ * Get the ID by which the membership in a slot is keyed in channel_buckets or user_buckets.
+ * </p>
+ * @param index the membership index
+ * @param buckets channel_buckets or user_buckets
+ * @param slot the slot
+ * @return the ID of the Channel or User
+ */
+static int list_key(const struct membership_index *index, const int *buckets, int slot);
+
+/**
+ * insert_bucket
+ * <p>
+ * Insert a slot into a hash table.
+ * </p>
+ * @param index the membership index
+ * @param buckets the hash table
+ * @param home the home bucket of the slot
+ * @param slot the slot
+ */
+static void insert_bucket(const struct membership_index *index, int *buckets, size_t home, int slot);
+
+/**
+ * remove_bucket
+ * <p>
+ * Empty a bucket of a hash table, moving later entries of the probe sequence back so that they stay reachable.
+ * </p>
+ * @param index the membership index
+ * @param buckets the hash table
+ * @param bucket the bucket
+ * @param home gets the home bucket of a slot in the hash table
+ */
+static void remove_bucket(const struct membership_index *index, int *buckets, size_t bucket,
+                          size_t (*home)(const struct membership_index *, int));
+
+/**
+ * next_in_list
+ * <p>
+ * Get the slot after a slot in the list of its Channel or of its User.
+ * </p>
+ * @param index the membership index
+ * @param by_channel whether to follow the list of the Channel rather than the list of the User
+ * @param slot the slot
+ * @return the next slot, or MEMBERSHIP_NONE at the end of the list
+ */
+static int next_in_list(const struct membership_index *index, int by_channel, int slot);
+
+/**
+ * collect_ids
+ * <p>
+ * Copy the IDs at the other end of the memberships of a list into a new array.
+ * </p>
+ * @param co the core object
+ * @param index the membership index
+ * @param buckets channel_buckets to list the Users of a Channel, or user_buckets to list the Channels of a User
+ * @param id the ID of the Channel or User
+ * @param ids memory in which to store the new array, or NULL if there are no memberships
+ * @param count memory in which to store the number of IDs
+ * @return 0 on success, -1 and set err on failure
+ */
+static int collect_ids(struct core_object *co, const struct membership_index *index, const int *buckets, int id,
+                       int **ids, size_t *count);
+
+/**
+ * insert_membership
+ * <p>
+ * Record that a User is a member of a Channel. Does nothing if they already are. Must be called while holding the
+ * lock for writing.
+ * </p>
+ * @param index the membership index
+ * @param channel_id the ID of the Channel
+ * @param user_id the ID of the User
+ * @return 0 on success, -1 if every slot is in use
+ */
+static int insert_membership(struct membership_index *index, int channel_id, int user_id);
+
+/**
+ * delete_membership
+ * <p>
+ * Record that a User is no longer a member of a Channel. Does nothing if they were not. Must be called while holding
+ * the lock for writing.
+ * </p>
+ * @param index the membership index
+ * @param channel_id the ID of the Channel
+ * @param user_id the ID of the User
+ */
+static void delete_membership(struct membership_index *index, int channel_id, int user_id);
+
+/**
+ * index_channel
+ * <p>
+ * Visitor which adds the memberships of a Channel record to the index.
+ * </p>
+ * @param co the core object
+ * @param arg the server object
+ * @param key the key of the record
+ * @param value the record
+ * @return 0 on success, -1 and set err on failure
+ */
+static int index_channel(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * count_memberships
+ * <p>
+ * Visitor which adds the number of Users of a Channel record to a count.
+ * </p>
+ * @param co the core object
+ * @param arg the count, a size_t
+ * @param key the key of the record
+ * @param value the record
+ * @return 0
+ */
+static int count_memberships(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * read_channel
+ * <p>
+ * Fetch a Channel record, for answering a query while the index is not complete.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @param serial_channel memory in which to store the record, which must be freed if it exists
+ * @param record memory in which to store the view of the record
+ * @return 1 if the Channel exists, 0 if not, -1 and set err on failure
+ */
+static int read_channel(struct core_object *co, struct server_object *so, int channel_id, uint8_t **serial_channel,
+                        const struct channel_record **record);
+
+/**
+ * collect_user_channel
+ * <p>
+ * Visitor which adds the ID of a Channel record to a list if a User is a member, for answering
+ * membership_user_channels while the index is not complete.
+ * </p>
+ * @param co the core object
+ * @param arg the list, a struct user_channels
+ * @param key the key of the record
+ * @param value the record
+ * @return 0 on success, -1 and set err on failure
+ */
+static int collect_user_channel(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * The Channels of a User found by scanning the Channel records.
+ */
+struct user_channels
+{
+    int    user_id;
+    int    *channel_ids;
+    size_t count;
+    size_t capacity;
+};
+
+int open_membership_index(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct membership_index *index;
+    size_t                  existing;
+    size_t                  capacity;
+    size_t                  mapping_size;
+    
+    // Leave room for the memberships of the existing Channels to double before the index is bypassed.
+    existing = 0;
+    if (so->channel_db.engine->for_each(co, &so->channel_db, count_memberships, &existing) == -1)
+    {
+        return -1;
+    }
+    capacity = MEMBERSHIP_CAPACITY;
+    while (capacity < 2 * existing && capacity < MEMBERSHIP_MAX_CAPACITY)
+    {
+        capacity *= 2;
+    }
+    
+    mapping_size = sizeof(struct membership_index) + capacity * sizeof(struct membership)
+                   + 3 * 2 * capacity * sizeof(int);
+    so->membership_index = map_shared_memory(co, MEMBERSHIP_INDEX_SHM_NAME, mapping_size);
+    if (!so->membership_index)
+    {
+        return -1;
+    }
+    
+    index                  = so->membership_index;
+    index->mapping_size    = mapping_size;
+    index->capacity        = capacity;
+    index->bucket_mask     = 2 * capacity - 1;
+    index->complete        = 1;
+    index->pair_buckets    = (int *) (index->memberships + capacity);
+    index->channel_buckets = index->pair_buckets + 2 * capacity;
+    index->user_buckets    = index->channel_buckets + 2 * capacity;
+    if (rw_lock_init(co, &index->lock) == -1)
+    {
+        return -1;
+    }
+    for (size_t l = 0; l < MEMBERSHIP_CHANNEL_LOCKS; ++l)
+    {
+        if (rw_lock_init(co, &index->channel_locks[l]) == -1)
+        {
+            return -1;
+        }
+    }
+    for (size_t s = 0; s < capacity; ++s)
+    {
+        index->memberships[s].user_next = (s + 1 < capacity) ? (int) (s + 1) : MEMBERSHIP_NONE;
+    }
+    index->free_slot = 0;
+    for (size_t b = 0; b <= index->bucket_mask; ++b)
+    {
+        index->pair_buckets[b]    = MEMBERSHIP_NONE;
+        index->channel_buckets[b] = MEMBERSHIP_NONE;
+        index->user_buckets[b]    = MEMBERSHIP_NONE;
+    }
+    
+    return so->channel_db.engine->for_each(co, &so->channel_db, index_channel, so);
+}
+
+void close_membership_index(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->membership_index)
+    {
+        munmap(so->membership_index, so->membership_index->mapping_size);
+        so->membership_index = NULL;
+    }
+}
+
+int membership_add(struct core_object *co, struct server_object *so, int channel_id, int user_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    return membership_apply(co, so, channel_id, &user_id, 1, NULL, 0);
+}
+
+int membership_remove(struct core_object *co, struct server_object *so, int channel_id, int user_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    return membership_apply(co, so, channel_id, NULL, 0, &user_id, 1);
+}
+
+int membership_apply(struct core_object *co, struct server_object *so, int channel_id, const int *added,
+                     size_t added_count, const int *removed, size_t removed_count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (membership_begin_apply(co, so) == -1)
+    {
+        return -1;
+    }
+    membership_end_apply(so, channel_id, added, added_count, removed, removed_count);
+    
+    return 0;
+}
+
+int membership_begin_apply(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    return rw_lock_write(co, &so->membership_index->lock);
+}
+
+void membership_end_apply(struct server_object *so, int channel_id, const int *added, size_t added_count,
+                          const int *removed, size_t removed_count)
+{
+    struct membership_index *index;
+    int                     was_complete;
+    
+    index        = so->membership_index;
+    was_complete = index->complete;
+    for (size_t a = 0; a < added_count && index->complete; ++a)
+    {
+        index->complete = insert_membership(index, channel_id, added[a]) == 0;
+    }
+    for (size_t r = 0; r < removed_count && index->complete; ++r)
+    {
+        delete_membership(index, channel_id, removed[r]);
+    }
+    rw_lock_unlock(&index->lock);
+    
+    if (was_complete && !index->complete)
+    {
+        (void) fprintf(stderr, "The membership index is full; Channel records are read instead until restart.\n");
+    }
+}
+
+int membership_lock_channel(struct core_object *co, struct server_object *so, int channel_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    return rw_lock_write(co, &so->membership_index->channel_locks[channel_lock(channel_id)]);
+}
+
+void membership_unlock_channel(struct server_object *so, int channel_id)
+{
+    rw_lock_unlock(&so->membership_index->channel_locks[channel_lock(channel_id)]);
+}
+
+int membership_contains(struct core_object *co, struct server_object *so, int channel_id, int user_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct channel_record *record;
+    uint8_t                     *serial_channel;
+    int                         complete;
+    int                         found;
+    
+    if (rw_lock_read(co, &so->membership_index->lock) == -1)
+    {
+        return -1;
+    }
+    complete = so->membership_index->complete;
+    found    = complete && find_pair_bucket(so->membership_index, channel_id, user_id) != -1;
+    rw_lock_unlock(&so->membership_index->lock);
+    if (complete)
+    {
+        return found;
+    }
+    
+    found = read_channel(co, so, channel_id, &serial_channel, &record);
+    if (found == 1)
+    {
+        found = record_has_id(record, &record->users, user_id);
+        mm_free(co->mm, serial_channel);
+    }
+    
+    return found;
+}
+
+int membership_channel_users(struct core_object *co, struct server_object *so, int channel_id, int **user_ids,
+                             size_t *count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct channel_record *record;
+    uint8_t                     *serial_channel;
+    int                         complete;
+    int                         ret_val;
+    
+    if (rw_lock_read(co, &so->membership_index->lock) == -1)
+    {
+        return -1;
+    }
+    complete = so->membership_index->complete;
+    ret_val  = complete ? collect_ids(co, so->membership_index, so->membership_index->channel_buckets, channel_id,
+                                      user_ids, count) : 0;
+    rw_lock_unlock(&so->membership_index->lock);
+    if (complete)
+    {
+        return ret_val;
+    }
+    
+    *user_ids = NULL;
+    *count    = 0;
+    ret_val   = read_channel(co, so, channel_id, &serial_channel, &record);
+    if (ret_val != 1)
+    {
+        return ret_val;
+    }
+    ret_val = 0;
+    if (record->users.count > 0)
+    {
+        *user_ids = mm_malloc(record->users.count * sizeof(int), co->mm);
+        if (*user_ids)
+        {
+            *count = record_copy_ids(record, &record->users, *user_ids);
+        } else
+        {
+            SET_ERROR(co->err);
+            ret_val = -1;
+        }
+    }
+    mm_free(co->mm, serial_channel);
+    
+    return ret_val;
+}
+
+int membership_user_channels(struct core_object *co, struct server_object *so, int user_id, int **channel_ids,
+                             size_t *count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct user_channels found;
+    int                  complete;
+    int                  ret_val;
+    
+    if (rw_lock_read(co, &so->membership_index->lock) == -1)
+    {
+        return -1;
+    }
+    complete = so->membership_index->complete;
+    ret_val  = complete ? collect_ids(co, so->membership_index, so->membership_index->user_buckets, user_id,
+                                      channel_ids, count) : 0;
+    rw_lock_unlock(&so->membership_index->lock);
+    if (complete)
+    {
+        return ret_val;
+    }
+    
+    memset(&found, 0, sizeof(found));
+    found.user_id = user_id;
+    ret_val       = so->channel_db.engine->for_each(co, &so->channel_db, collect_user_channel, &found);
+    if (ret_val == -1 && found.channel_ids)
+    {
+        mm_free(co->mm, found.channel_ids);
+        found.channel_ids = NULL;
+        found.count       = 0;
+    }
+    *channel_ids = found.channel_ids;
+    *count       = found.count;
+    
+    return ret_val;
+}
+
+static size_t hash_id(int id)
+{
+    uint32_t hash;
+    
+    hash = (uint32_t) id * HASH_MULTIPLIER;
+    
+    return hash ^ (hash >> HASH_SHIFT);
+}
+
+static size_t channel_lock(int channel_id)
+{
+    return hash_id(channel_id) & (MEMBERSHIP_CHANNEL_LOCKS - 1);
+}
+
+static size_t hash_pair(int channel_id, int user_id)
+{
+    uint32_t hash;
+    
+    hash = (uint32_t) channel_id * HASH_MULTIPLIER ^ (uint32_t) user_id * PAIR_MULTIPLIER;
+    
+    return hash ^ (hash >> HASH_SHIFT);
+}
+
+static size_t pair_home(const struct membership_index *index, int slot)
+{
+    return hash_pair(index->memberships[slot].channel_id, index->memberships[slot].user_id) & index->bucket_mask;
+}
+
+static size_t channel_home(const struct membership_index *index, int slot)
+{
+    return hash_id(index->memberships[slot].channel_id) & index->bucket_mask;
+}
+
+static size_t user_home(const struct membership_index *index, int slot)
+{
+    return hash_id(index->memberships[slot].user_id) & index->bucket_mask;
+}
+
+static int find_pair_bucket(const struct membership_index *index, int channel_id, int user_id)
+{
+    const struct membership *membership;
+    size_t                  bucket;
+    
+    for (bucket = hash_pair(channel_id, user_id) & index->bucket_mask;
+         index->pair_buckets[bucket] != MEMBERSHIP_NONE; bucket = (bucket + 1) & index->bucket_mask)
+    {
+        membership = &index->memberships[index->pair_buckets[bucket]];
+        if (membership->channel_id == channel_id && membership->user_id == user_id)
+        {
+            return (int) bucket;
+        }
+    }
+    
+    return -1;
+}
+
+static int find_list_bucket(const struct membership_index *index, const int *buckets, int id)
+{
+    size_t bucket;
+    
+    for (bucket = hash_id(id) & index->bucket_mask; buckets[bucket] != MEMBERSHIP_NONE;
+         bucket = (bucket + 1) & index->bucket_mask)
+    {
+        if (list_key(index, buckets, buckets[bucket]) == id)
+        {
+            return (int) bucket;
+        }
+    }
+    
+    return -1;
+}
+
+static int list_key(const struct membership_index *index, const int *buckets, int slot)
+{
+    return (buckets == index->channel_buckets) ? index->memberships[slot].channel_id
+                                               : index->memberships[slot].user_id;
+}
+
+static void insert_bucket(const struct membership_index *index, int *buckets, size_t home, int slot)
+{
+    size_t bucket;
+    
+    // There are twice as many buckets as slots, so an empty bucket always exists.
+    for (bucket = home; buckets[bucket] != MEMBERSHIP_NONE; bucket = (bucket + 1) & index->bucket_mask);
+    buckets[bucket] = slot;
+}
+
+static void remove_bucket(const struct membership_index *index, int *buckets, size_t bucket,
+                          size_t (*home)(const struct membership_index *, int))
+{
+    size_t next;
+    size_t next_home;
+    
+    for (next = (bucket + 1) & index->bucket_mask; buckets[next] != MEMBERSHIP_NONE;
+         next = (next + 1) & index->bucket_mask)
+    {
+        next_home = home(index, buckets[next]);
+        
+        // The entry may fill the hole only if its home does not lie cyclically in (bucket, next].
+        if (((next - next_home) & index->bucket_mask) >= ((next - bucket) & index->bucket_mask))
+        {
+            buckets[bucket] = buckets[next];
+            bucket = next;
+        }
+    }
+    buckets[bucket] = MEMBERSHIP_NONE;
+}
+
+static int next_in_list(const struct membership_index *index, int by_channel, int slot)
+{
+    return by_channel ? index->memberships[slot].channel_next : index->memberships[slot].user_next;
+}
+
+static int collect_ids(struct core_object *co, const struct membership_index *index, const int *buckets, int id,
+                       int **ids, size_t *count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int by_channel;
+    int bucket;
+    int first;
+    
+    *ids   = NULL;
+    *count = 0;
+    bucket = find_list_bucket(index, buckets, id);
+    if (bucket == -1)
+    {
+        return 0;
+    }
+    
+    // Walk the list twice, once to size the array and once to fill it; both walks only visit the result.
+    by_channel = buckets == index->channel_buckets;
+    first      = buckets[bucket];
+    for (int s = first; s != MEMBERSHIP_NONE; s = next_in_list(index, by_channel, s))
+    {
+        ++*count;
+    }
+    
+    *ids = mm_malloc(*count * sizeof(int), co->mm);
+    if (!*ids)
+    {
+        SET_ERROR(co->err);
+        *count = 0;
+        return -1;
+    }
+    *count = 0;
+    for (int s = first; s != MEMBERSHIP_NONE; s = next_in_list(index, by_channel, s))
+    {
+        (*ids)[(*count)++] = by_channel ? index->memberships[s].user_id : index->memberships[s].channel_id;
+    }
+    
+    return 0;
+}
+
+static int insert_membership(struct membership_index *index, int channel_id, int user_id)
+{
+    struct membership *membership;
+    int               bucket;
+    int               slot;
+    
+    if (find_pair_bucket(index, channel_id, user_id) != -1)
+    {
+        return 0;
+    }
+    if (index->free_slot == MEMBERSHIP_NONE)
+    {
+        return -1;
+    }
+    
+    slot             = index->free_slot;
+    membership       = &index->memberships[slot];
+    index->free_slot = membership->user_next;
+    
+    membership->channel_id = channel_id;
+    membership->user_id    = user_id;
+    insert_bucket(index, index->pair_buckets, pair_home(index, slot), slot);
+    
+    // The new membership goes at the front of both lists, replacing the old front in its bucket.
+    membership->channel_prev = MEMBERSHIP_NONE;
+    bucket = find_list_bucket(index, index->channel_buckets, channel_id);
+    if (bucket == -1)
+    {
+        membership->channel_next = MEMBERSHIP_NONE;
+        insert_bucket(index, index->channel_buckets, channel_home(index, slot), slot);
+    } else
+    {
+        membership->channel_next = index->channel_buckets[bucket];
+        index->memberships[membership->channel_next].channel_prev = slot;
+        index->channel_buckets[bucket] = slot;
+    }
+    
+    membership->user_prev = MEMBERSHIP_NONE;
+    bucket = find_list_bucket(index, index->user_buckets, user_id);
+    if (bucket == -1)
+    {
+        membership->user_next = MEMBERSHIP_NONE;
+        insert_bucket(index, index->user_buckets, user_home(index, slot), slot);
+    } else
+    {
+        membership->user_next = index->user_buckets[bucket];
+        index->memberships[membership->user_next].user_prev = slot;
+        index->user_buckets[bucket] = slot;
+    }
+    
+    return 0;
+}
+
+static void delete_membership(struct membership_index *index, int channel_id, int user_id)
+{
+    struct membership *membership;
+    int               bucket;
+    int               slot;
+    
+    bucket = find_pair_bucket(index, channel_id, user_id);
+    if (bucket == -1)
+    {
+        return;
+    }
+    slot       = index->pair_buckets[bucket];
+    membership = &index->memberships[slot];
+    remove_bucket(index, index->pair_buckets, (size_t) bucket, pair_home);
+    
+    // Unlink from the list of the Channel. If it was the front, the next membership takes its place in the bucket.
+    if (membership->channel_prev != MEMBERSHIP_NONE)
+    {
+        index->memberships[membership->channel_prev].channel_next = membership->channel_next;
+    } else
+    {
+        bucket = find_list_bucket(index, index->channel_buckets, channel_id);
+        if (membership->channel_next == MEMBERSHIP_NONE)
+        {
+            remove_bucket(index, index->channel_buckets, (size_t) bucket, channel_home);
+        } else
+        {
+            index->channel_buckets[bucket] = membership->channel_next;
+        }
+    }
+    if (membership->channel_next != MEMBERSHIP_NONE)
+    {
+        index->memberships[membership->channel_next].channel_prev = membership->channel_prev;
+    }
+    
+    if (membership->user_prev != MEMBERSHIP_NONE)
+    {
+        index->memberships[membership->user_prev].user_next = membership->user_next;
+    } else
+    {
+        bucket = find_list_bucket(index, index->user_buckets, user_id);
+        if (membership->user_next == MEMBERSHIP_NONE)
+        {
+            remove_bucket(index, index->user_buckets, (size_t) bucket, user_home);
+        } else
+        {
+            index->user_buckets[bucket] = membership->user_next;
+        }
+    }
+    if (membership->user_next != MEMBERSHIP_NONE)
+    {
+        index->memberships[membership->user_next].user_prev = membership->user_prev;
+    }
+    
+    membership->user_next = index->free_slot;
+    index->free_slot      = slot;
+}
+
+static int index_channel(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct channel_record *record;
+    const uint8_t               *bytes;
+    struct server_object        *so;
+    uint8_t                     *serial_user;
+    int                         *user_ids;
+    size_t                      users_count;
+    datum                       user_key;
+    int                         status;
+    
+    (void) key;
+    so     = (struct server_object *) arg;
+    bytes  = datum_record(value);
+    record = bytes ? view_channel(bytes) : NULL;
+    if (!record || record->users.count == 0)
+    {
+        return 0;
+    }
+    
+    user_ids = mm_malloc(record->users.count * sizeof(int), co->mm);
+    if (!user_ids)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    users_count = record_copy_ids(record, &record->users, user_ids);
+    
+    status = 0;
+    for (size_t u = 0; u < users_count && status != -1; ++u)
+    {
+        user_key.dptr  = (void *) &user_ids[u];
+        user_key.dsize = sizeof(int);
+        status         = safe_dbm_fetch(co, &so->user_db, &user_key, &serial_user);
+        if (status == 0)
+        {
+            mm_free(co->mm, serial_user);
+            status = membership_add(co, so, record->header.id, user_ids[u]);
+        }
+        // A member which no longer exists is skipped.
+    }
+    mm_free(co->mm, user_ids);
+    
+    return status == -1 ? -1 : 0;
+}
+
+static int count_memberships(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    const uint8_t               *bytes;
+    const struct channel_record *record;
+    
+    (void) co;
+    (void) key;
+    bytes  = datum_record(value);
+    record = bytes ? view_channel(bytes) : NULL;
+    if (record)
+    {
+        *(size_t *) arg += record->users.count;
+    }
+    
+    return 0;
+}
+
+static int read_channel(struct core_object *co, struct server_object *so, int channel_id, uint8_t **serial_channel,
+                        const struct channel_record **record)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    datum key;
+    int   status;
+    
+    key.dptr  = (void *) &channel_id;
+    key.dsize = sizeof(channel_id);
+    status    = safe_dbm_fetch(co, &so->channel_db, &key, serial_channel);
+    if (status != 0)
+    {
+        return status == -1 ? -1 : 0;
+    }
+    
+    *record = view_channel(*serial_channel);
+    if (!*record) // Malformed records have no members.
+    {
+        mm_free(co->mm, *serial_channel);
+        return 0;
+    }
+    
+    return 1;
+}
+
+static int collect_user_channel(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const uint8_t               *bytes;
+    const struct channel_record *record;
+    struct user_channels        *found;
+    int                         *channel_ids;
+    
+    (void) key;
+    found  = (struct user_channels *) arg;
+    bytes  = datum_record(value);
+    record = bytes ? view_channel(bytes) : NULL;
+    if (!record || !record_has_id(record, &record->users, found->user_id))
+    {
+        return 0;
+    }
+    
+    if (found->count == found->capacity)
+    {
+        found->capacity = found->capacity ? 2 * found->capacity : 8; // NOLINT(readability-magic-numbers) : First size
+        channel_ids     = found->channel_ids ? mm_realloc(found->channel_ids, found->capacity * sizeof(int), co->mm)
+                                             : mm_malloc(found->capacity * sizeof(int), co->mm);
+        if (!channel_ids)
+        {
+            SET_ERROR(co->err);
+            return -1;
+        }
+        found->channel_ids = channel_ids;
+    }
+    found->channel_ids[found->count++] = record->header.id;
+    
+    return 0;
+}
@@ -0,0 +1,831 @@
+#include "../../include/manager.h"
+#include "../include/message-log.h"
+#include "../include/message-tree.h"
+#include "../include/object-util.h"
+#include "../include/process-server-util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MESSAGE_LOG_SHM_NAME "/ml_3fda69" /** Message log locks shared memory name. */
+#define LOG_PATH_SIZE 64                  /** Size of a buffer holding the path of a log file. */
+#define LOG_DIR_MODE S_IRWXU              /** File mode for creating the log directory. */
+#define REBUILD_BATCH 256                 /** Sequence index entries read at once while rebuilding a tree. */
+
+/**
+ * Precedes every Message in a segment, so that a segment can be read without its index. Its size, like that of every
+ * serialized Message, is a multiple of RECORD_ALIGNMENT, so every Message in a segment is aligned.
+ */
+struct segment_header
+{
+    uint32_t size;
+    uint32_t sequence;
+};
+
+/**
+ * An entry of the sequence index. The n-th entry locates the n-th Message of the Channel.
+ */
+struct sequence_entry
+{
+    uint32_t segment;
+    uint32_t offset;
+    uint32_t size;
+    int32_t  message_id; // 0 in logs written before Message IDs were recorded.
+    int64_t  timestamp;
+};
+
+/**
+ * channel_lock
+ * <p>
+ * Get the lock guarding the log of a Channel.
+ * </p>
+ * @param so the server object
+ * @param channel_id the ID of the Channel
+ * @return the lock
+ */
+static struct rw_lock *channel_lock(struct server_object *so, int channel_id);
+
+/**
+ * open_log_file
+ * <p>
+ * Open a file of the log of a Channel.
+ * </p>
+ * @param co the core object
+ * @param channel_id the ID of the Channel
+ * @param suffix the suffix naming the file
+ * @param segment the segment number, if the file is a segment
+ * @param flags the flags with which to open the file
+ * @return the file descriptor on success, -1 and set err on failure
+ */
+static int open_log_file(struct core_object *co, int channel_id, const char *suffix, uint32_t segment, int flags);
+
+/**
+ * read_at
+ * <p>
+ * Read exactly size bytes at an offset of a file.
+ * </p>
+ * @param co the core object
+ * @param fd the file
+ * @param buffer the buffer into which to read
+ * @param size the number of bytes to read
+ * @param offset the offset at which to read
+ * @return 0 on success, -1 and set err on failure or if the file is too short
+ */
+static int read_at(struct core_object *co, int fd, void *buffer, size_t size, off_t offset);
+
+/**
+ * write_at
+ * <p>
+ * Write exactly size bytes at an offset of a file.
+ * </p>
+ * @param co the core object
+ * @param fd the file
+ * @param buffer the bytes to write
+ * @param size the number of bytes to write
+ * @param offset the offset at which to write
+ * @return 0 on success, -1 and set err on failure
+ */
+static int write_at(struct core_object *co, int fd, const void *buffer, size_t size, off_t offset);
+
+/**
+ * count_entries
+ * <p>
+ * Get the number of whole entries in an index file.
+ * </p>
+ * @param co the core object
+ * @param fd the index file
+ * @param entry_size the size of an entry
+ * @return the number of entries on success, -1 and set err on failure
+ */
+static long count_entries(struct core_object *co, int fd, size_t entry_size);
+
+/**
+ * append_locked
+ * <p>
+ * Write a serialized Message to the end of the log of its Channel and index it. Must be called while holding the lock
+ * of the Channel for writing.
+ * </p>
+ * @param co the core object
+ * @param seq_fd the sequence index of the Channel
+ * @param message the Message
+ * @param serial_message the serialized Message
+ * @param serial_message_size the size of the serialized Message
+ * @return 0 on success, -1 and set err on failure
+ */
+static int append_locked(struct core_object *co, int seq_fd, const Message *message, const uint8_t *serial_message,
+                         unsigned long serial_message_size);
+
+/**
+ * index_tree
+ * <p>
+ * Add an entry for a Message to the tree of its Channel, first rebuilding the tree from the sequence index if it does
+ * not hold every Message before this one. Must be called while holding the lock of the Channel for writing.
+ * </p>
+ * @param co the core object
+ * @param seq_fd the sequence index of the Channel
+ * @param channel_id the ID of the Channel
+ * @param sequence the sequence number of the Message
+ * @param entry the sequence index entry of the Message
+ * @return 0 on success, -1 and set err on failure
+ */
+static int index_tree(struct core_object *co, int seq_fd, int channel_id, size_t sequence,
+                      const struct sequence_entry *entry);
+
+/**
+ * rebuild_tree
+ * <p>
+ * Empty the tree of a Channel and add an entry for every Message before a sequence number. Must be called while
+ * holding the lock of the Channel for writing.
+ * </p>
+ * @param co the core object
+ * @param seq_fd the sequence index of the Channel
+ * @param tree_fd the tree of the Channel
+ * @param count the number of Messages to add
+ * @return 0 on success, -1 and set err on failure
+ */
+static int rebuild_tree(struct core_object *co, int seq_fd, int tree_fd, size_t count);
+
+/**
+ * read_range_locked
+ * <p>
+ * Read the Messages of a Channel found by a scan of its tree. Must be called while holding the lock of the Channel.
+ * </p>
+ * @param co the core object
+ * @param channel_id the ID of the Channel
+ * @param start the key at which to start the scan
+ * @param after if set, skip a Message equal to start
+ * @param to the latest timestamp to read
+ * @param count the maximum number of Messages to read
+ * @param messages_get memory in which to store a NULL terminated list of pointers to the Messages
+ * @return the number of Messages read on success, -1 and set err on failure
+ */
+static long read_range_locked(struct core_object *co, int channel_id, const struct message_tree_entry *start,
+                              int after, time_t to, size_t count, Message ***messages_get);
+
+/**
+ * read_messages_locked
+ * <p>
+ * Read a range of Messages from the log of a Channel. Must be called while holding the lock of the Channel.
+ * </p>
+ * @param co the core object
+ * @param channel_id the ID of the Channel
+ * @param latest if set, read the last count Messages and ignore first
+ * @param first the sequence number of the first Message to read
+ * @param count the number of Messages to read
+ * @param messages_get memory in which to store a NULL terminated list of pointers to the Messages
+ * @return the number of Messages read on success, -1 and set err on failure
+ */
+static long read_messages_locked(struct core_object *co, int channel_id, int latest, size_t first, size_t count,
+                                 Message ***messages_get);
+
+/**
+ * read_indexed_messages
+ * <p>
+ * Read the Messages located by sequence index entries. Runs of entries which lie in the same segment, one after
+ * another, are read with a single read.
+ * </p>
+ * @param co the core object
+ * @param channel_id the ID of the Channel
+ * @param entries the index entries
+ * @param count the number of entries
+ * @param messages memory in which to store pointers to the Messages; freed and cleared on failure
+ * @return 0 on success, -1 and set err on failure
+ */
+static int read_indexed_messages(struct core_object *co, int channel_id, const struct sequence_entry *entries,
+                                 size_t count, Message **messages);
+
+/**
+ * read_segment_span
+ * <p>
+ * Read a run of index entries which all lie in the same segment, and deserialize their Messages.
+ * </p>
+ * @param co the core object
+ * @param channel_id the ID of the Channel
+ * @param entries the index entries
+ * @param count the number of entries
+ * @param messages memory in which to store pointers to the Messages
+ * @return 0 on success, -1 and set err on failure
+ */
+static int read_segment_span(struct core_object *co, int channel_id, const struct sequence_entry *entries,
+                             size_t count, Message **messages);
+
+int open_message_log(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (mkdir(MESSAGE_LOG_DIR, LOG_DIR_MODE) == -1 && errno != EEXIST)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    so->message_log = map_shared_memory(co, MESSAGE_LOG_SHM_NAME, sizeof(struct message_log));
+    if (!so->message_log)
+    {
+        return -1;
+    }
+    for (size_t l = 0; l < MESSAGE_LOG_LOCK_STRIPES; ++l)
+    {
+        if (rw_lock_init(co, &so->message_log->locks[l]) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+void close_message_log(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->message_log)
+    {
+        munmap(so->message_log, sizeof(struct message_log));
+        so->message_log = NULL;
+    }
+}
+
+int message_log_append(struct core_object *co, struct server_object *so, const Message *message)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct rw_lock *lock;
+    uint8_t        *serial_message;
+    unsigned long  serial_message_size;
+    int            seq_fd;
+    int            ret_val;
+    
+    serial_message_size = serialize_message(co, &serial_message, message);
+    if (serial_message_size == 0)
+    {
+        return -1;
+    }
+    
+    lock = channel_lock(so, message->channel_id);
+    if (rw_lock_write(co, lock) == -1)
+    {
+        mm_free(co->mm, serial_message);
+        return -1;
+    }
+    seq_fd = open_log_file(co, message->channel_id, "seq", 0, O_RDWR | O_CREAT);
+    if (seq_fd == -1)
+    {
+        ret_val = -1;
+    } else
+    {
+        ret_val = append_locked(co, seq_fd, message, serial_message, serial_message_size);
+        close(seq_fd);
+    }
+    rw_lock_unlock(lock);
+    mm_free(co->mm, serial_message);
+    
+    return ret_val;
+}
+
+long message_log_read(struct core_object *co, struct server_object *so, int channel_id, size_t first, size_t count,
+                      Message ***messages_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct rw_lock *lock;
+    long           ret_val;
+    
+    lock = channel_lock(so, channel_id);
+    if (rw_lock_read(co, lock) == -1)
+    {
+        return -1;
+    }
+    ret_val = read_messages_locked(co, channel_id, 0, first, count, messages_get);
+    rw_lock_unlock(lock);
+    
+    return ret_val;
+}
+
+long message_log_read_latest(struct core_object *co, struct server_object *so, int channel_id, size_t count,
+                             Message ***messages_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct rw_lock *lock;
+    long           ret_val;
+    
+    lock = channel_lock(so, channel_id);
+    if (rw_lock_read(co, lock) == -1)
+    {
+        return -1;
+    }
+    ret_val = read_messages_locked(co, channel_id, 1, 0, count, messages_get);
+    rw_lock_unlock(lock);
+    
+    return ret_val;
+}
+
+long message_log_read_range(struct core_object *co, struct server_object *so, int channel_id, time_t from, time_t to,
+                            const struct message_cursor *after, size_t count, Message ***messages_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct message_tree_entry start;
+    struct rw_lock            *lock;
+    long                      ret_val;
+    
+    if (after)
+    {
+        start.timestamp  = after->timestamp;
+        start.message_id = after->message_id;
+        start.sequence   = after->sequence;
+    } else
+    {
+        start.timestamp  = (int64_t) from;
+        start.message_id = INT32_MIN;
+        start.sequence   = 0;
+    }
+    
+    lock = channel_lock(so, channel_id);
+    if (rw_lock_read(co, lock) == -1)
+    {
+        return -1;
+    }
+    ret_val = read_range_locked(co, channel_id, &start, after != NULL, to, count, messages_get);
+    rw_lock_unlock(lock);
+    
+    return ret_val;
+}
+
+static struct rw_lock *channel_lock(struct server_object *so, int channel_id)
+{
+    return &so->message_log->locks[(unsigned int) channel_id & (MESSAGE_LOG_LOCK_STRIPES - 1)];
+}
+
+static int open_log_file(struct core_object *co, int channel_id, const char *suffix, uint32_t segment, int flags)
+{
+    char path[LOG_PATH_SIZE];
+    int  fd;
+    
+    if (strcmp(suffix, "log") == 0)
+    {
+        (void) snprintf(path, sizeof(path), "%s/%d.%u.%s", MESSAGE_LOG_DIR, channel_id, segment, suffix);
+    } else
+    {
+        (void) snprintf(path, sizeof(path), "%s/%d.%s", MESSAGE_LOG_DIR, channel_id, suffix);
+    }
+    
+    fd = open(path, flags, DB_FILE_MODE); // NOLINT(android-cloexec-open,hicpp-signed-bitwise) : Matches db files
+    if (fd == -1)
+    {
+        SET_ERROR(co->err);
+    }
+    
+    return fd;
+}
+
+static int read_at(struct core_object *co, int fd, void *buffer, size_t size, off_t offset)
+{
+    ssize_t bytes;
+    
+    while (size > 0)
+    {
+        bytes = pread(fd, buffer, size, offset);
+        if (bytes == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            if (bytes == 0)
+            {
+                errno = EIO; // The index points past the end of the file.
+            }
+            SET_ERROR(co->err);
+            return -1;
+        }
+        buffer = (uint8_t *) buffer + bytes;
+        size -= (size_t) bytes;
+        offset += bytes;
+    }
+    
+    return 0;
+}
+
+static int write_at(struct core_object *co, int fd, const void *buffer, size_t size, off_t offset)
+{
+    ssize_t bytes;
+    
+    while (size > 0)
+    {
+        bytes = pwrite(fd, buffer, size, offset);
+        if (bytes == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            SET_ERROR(co->err);
+            return -1;
+        }
+        buffer = (const uint8_t *) buffer + bytes;
+        size -= (size_t) bytes;
+        offset += bytes;
+    }
+    
+    return 0;
+}
+
+static long count_entries(struct core_object *co, int fd, size_t entry_size)
+{
+    struct stat file_stat;
+    
+    if (fstat(fd, &file_stat) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    // A partly written trailing entry is not counted, and is overwritten by the next append.
+    return (long) ((size_t) file_stat.st_size / entry_size);
+}
+
+static int append_locked(struct core_object *co, int seq_fd, const Message *message, const uint8_t *serial_message,
+                         unsigned long serial_message_size)
+{
+    struct sequence_entry entry;
+    struct segment_header header;
+    long                  sequence;
+    int                   segment_fd;
+    int                   status;
+    
+    sequence = count_entries(co, seq_fd, sizeof(struct sequence_entry));
+    if (sequence == -1)
+    {
+        return -1;
+    }
+    
+    // Place the Message right after the last indexed one. Bytes past it were left by a write which never completed,
+    // and are overwritten.
+    memset(&entry, 0, sizeof(entry));
+    if (sequence > 0)
+    {
+        if (read_at(co, seq_fd, &entry, sizeof(entry), (off_t) ((size_t) (sequence - 1) * sizeof(entry))) == -1)
+        {
+            return -1;
+        }
+        entry.offset += sizeof(struct segment_header) + entry.size;
+        if (entry.offset >= MESSAGE_LOG_SEGMENT_SIZE)
+        {
+            ++entry.segment;
+            entry.offset = 0;
+        }
+    }
+    entry.size       = (uint32_t) serial_message_size;
+    entry.message_id = message->id;
+    entry.timestamp  = (int64_t) message->timestamp;
+    
+    header.size     = entry.size;
+    header.sequence = (uint32_t) sequence;
+    segment_fd = open_log_file(co, message->channel_id, "log", entry.segment, O_WRONLY | O_CREAT);
+    if (segment_fd == -1)
+    {
+        return -1;
+    }
+    status = write_at(co, segment_fd, &header, sizeof(header), entry.offset);
+    if (status == 0)
+    {
+        status = write_at(co, segment_fd, serial_message, serial_message_size, entry.offset + sizeof(header));
+    }
+    close(segment_fd);
+    if (status == -1)
+    {
+        return -1;
+    }
+    
+    // The Message only becomes visible once its index entry is written.
+    if (write_at(co, seq_fd, &entry, sizeof(entry), (off_t) ((size_t) sequence * sizeof(entry))) == -1)
+    {
+        return -1;
+    }
+    return index_tree(co, seq_fd, message->channel_id, (size_t) sequence, &entry);
+}
+
+static int index_tree(struct core_object *co, int seq_fd, int channel_id, size_t sequence,
+                      const struct sequence_entry *entry)
+{
+    struct message_tree_entry tree_entry;
+    long                      size;
+    int                       tree_fd;
+    int                       ret_val;
+    
+    tree_fd = open_log_file(co, channel_id, "tree", 0, O_RDWR | O_CREAT);
+    if (tree_fd == -1)
+    {
+        return -1;
+    }
+    
+    // A tree which does not hold every earlier Message was left by a crash in the middle of an insert, or by a log
+    // written before Channels had trees.
+    size    = message_tree_size(co, tree_fd);
+    ret_val = (size == -1) ? -1 : 0;
+    if (ret_val == 0 && (size_t) size != sequence)
+    {
+        ret_val = rebuild_tree(co, seq_fd, tree_fd, sequence);
+    }
+    if (ret_val == 0)
+    {
+        tree_entry.timestamp  = entry->timestamp;
+        tree_entry.message_id = entry->message_id;
+        tree_entry.sequence   = (uint32_t) sequence;
+        ret_val = message_tree_insert(co, tree_fd, &tree_entry);
+    }
+    close(tree_fd);
+    
+    return ret_val;
+}
+
+static int rebuild_tree(struct core_object *co, int seq_fd, int tree_fd, size_t count)
+{
+    struct sequence_entry     entries[REBUILD_BATCH];
+    struct message_tree_entry tree_entry;
+    size_t                    batch;
+    
+    if (message_tree_reset(co, tree_fd) == -1)
+    {
+        return -1;
+    }
+    for (size_t first = 0; first < count; first += batch)
+    {
+        batch = (count - first < REBUILD_BATCH) ? count - first : REBUILD_BATCH;
+        if (read_at(co, seq_fd, entries, batch * sizeof(entries[0]), (off_t) (first * sizeof(entries[0]))) == -1)
+        {
+            return -1;
+        }
+        for (size_t e = 0; e < batch; ++e)
+        {
+            tree_entry.timestamp  = entries[e].timestamp;
+            tree_entry.message_id = entries[e].message_id;
+            tree_entry.sequence   = (uint32_t) (first + e);
+            if (message_tree_insert(co, tree_fd, &tree_entry) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+static long read_range_locked(struct core_object *co, int channel_id, const struct message_tree_entry *start,
+                              int after, time_t to, size_t count, Message ***messages_get)
+{
+    struct message_tree_entry *found;
+    struct sequence_entry     *entries;
+    Message                   **messages;
+    long                      total;
+    int                       tree_fd;
+    int                       seq_fd;
+    
+    messages = mm_calloc(count + 1, sizeof(Message *), co->mm);
+    if (!messages)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    tree_fd = open_log_file(co, channel_id, "tree", 0, O_RDONLY);
+    if (tree_fd == -1 || count == 0)
+    {
+        if (tree_fd != -1)
+        {
+            close(tree_fd);
+        } else if (errno != ENOENT)
+        {
+            mm_free(co->mm, messages);
+            return -1;
+        }
+        *messages_get = messages; // The Channel has no Messages, or none were asked for.
+        return 0;
+    }
+    
+    found   = mm_malloc(count * sizeof(struct message_tree_entry), co->mm);
+    entries = mm_malloc(count * sizeof(struct sequence_entry), co->mm);
+    if (!found || !entries)
+    {
+        SET_ERROR(co->err);
+        total = -1;
+    } else
+    {
+        total = message_tree_scan(co, tree_fd, start, after, (int64_t) to, found, count);
+    }
+    close(tree_fd);
+    
+    // The tree gives the sequence numbers of the Messages; the sequence index gives where they are stored.
+    seq_fd = -1;
+    if (total > 0)
+    {
+        seq_fd = open_log_file(co, channel_id, "seq", 0, O_RDONLY);
+        if (seq_fd == -1)
+        {
+            total = -1;
+        }
+    }
+    for (long e = 0; total > 0 && e < total; ++e)
+    {
+        if (read_at(co, seq_fd, &entries[e], sizeof(entries[e]),
+                    (off_t) ((size_t) found[e].sequence * sizeof(entries[e]))) == -1)
+        {
+            total = -1;
+        }
+    }
+    if (seq_fd != -1)
+    {
+        close(seq_fd);
+    }
+    if (total > 0 && read_indexed_messages(co, channel_id, entries, (size_t) total, messages) == -1)
+    {
+        total = -1;
+    }
+    
+    if (found)
+    {
+        mm_free(co->mm, found);
+    }
+    if (entries)
+    {
+        mm_free(co->mm, entries);
+    }
+    if (total == -1)
+    {
+        mm_free(co->mm, messages);
+        return -1;
+    }
+    *messages_get = messages;
+    
+    return total;
+}
+
+static long read_messages_locked(struct core_object *co, int channel_id, int latest, size_t first, size_t count,
+                                 Message ***messages_get)
+{
+    struct sequence_entry *entries;
+    Message               **messages;
+    long                  total;
+    int                   seq_fd;
+    
+    total  = 0;
+    seq_fd = open_log_file(co, channel_id, "seq", 0, O_RDONLY);
+    if (seq_fd == -1 && errno != ENOENT)
+    {
+        return -1;
+    }
+    if (seq_fd != -1)
+    {
+        total = count_entries(co, seq_fd, sizeof(struct sequence_entry));
+        if (total == -1)
+        {
+            close(seq_fd);
+            return -1;
+        }
+    }
+    
+    if (latest)
+    {
+        first = ((size_t) total > count) ? (size_t) total - count : 0;
+    }
+    if (first >= (size_t) total)
+    {
+        count = 0;
+    } else if (count > (size_t) total - first)
+    {
+        count = (size_t) total - first;
+    }
+    
+    messages = mm_calloc(count + 1, sizeof(Message *), co->mm);
+    if (!messages)
+    {
+        SET_ERROR(co->err);
+        if (seq_fd != -1)
+        {
+            close(seq_fd);
+        }
+        return -1;
+    }
+    *messages_get = messages;
+    if (count == 0)
+    {
+        if (seq_fd != -1)
+        {
+            close(seq_fd);
+        }
+        return 0;
+    }
+    
+    // Only the requested entries are read; the length of the history does not matter.
+    entries = mm_malloc(count * sizeof(struct sequence_entry), co->mm);
+    if (!entries)
+    {
+        SET_ERROR(co->err);
+        close(seq_fd);
+        mm_free(co->mm, messages);
+        return -1;
+    }
+    if (read_at(co, seq_fd, entries, count * sizeof(struct sequence_entry),
+                (off_t) (first * sizeof(struct sequence_entry))) == -1)
+    {
+        close(seq_fd);
+        mm_free(co->mm, entries);
+        mm_free(co->mm, messages);
+        return -1;
+    }
+    close(seq_fd);
+    
+    if (read_indexed_messages(co, channel_id, entries, count, messages) == -1)
+    {
+        mm_free(co->mm, entries);
+        mm_free(co->mm, messages);
+        return -1;
+    }
+    mm_free(co->mm, entries);
+    
+    return (long) count;
+}
+
+static int read_indexed_messages(struct core_object *co, int channel_id, const struct sequence_entry *entries,
+                                 size_t count, Message **messages)
+{
+    size_t span;
+    
+    for (size_t e = 0; e < count; e += span)
+    {
+        for (span = 1; e + span < count && entries[e + span].segment == entries[e].segment
+                       && entries[e + span].offset > entries[e + span - 1].offset; ++span);
+        if (read_segment_span(co, channel_id, entries + e, span, messages + e) == -1)
+        {
+            for (size_t m = 0; messages[m]; ++m)
+            {
+                free_message(co, messages[m]);
+                messages[m] = NULL;
+            }
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+static int read_segment_span(struct core_object *co, int channel_id, const struct sequence_entry *entries,
+                             size_t count, Message **messages)
+{
+    uint8_t *buffer;
+    size_t  start;
+    size_t  size;
+    int     segment_fd;
+    
+    start = entries[0].offset;
+    size  = entries[count - 1].offset + sizeof(struct segment_header) + entries[count - 1].size - start;
+    
+    segment_fd = open_log_file(co, channel_id, "log", entries[0].segment, O_RDONLY);
+    if (segment_fd == -1)
+    {
+        return -1;
+    }
+    buffer = mm_malloc(size, co->mm);
+    if (!buffer)
+    {
+        SET_ERROR(co->err);
+        close(segment_fd);
+        return -1;
+    }
+    if (read_at(co, segment_fd, buffer, size, (off_t) start) == -1)
+    {
+        close(segment_fd);
+        mm_free(co->mm, buffer);
+        return -1;
+    }
+    close(segment_fd);
+    
+    for (size_t m = 0; m < count; ++m)
+    {
+        messages[m] = mm_malloc(sizeof(Message), co->mm);
+        if (!messages[m])
+        {
+            SET_ERROR(co->err);
+            mm_free(co->mm, buffer);
+            return -1;
+        }
+        if (deserialize_message(co, &messages[m], buffer + (entries[m].offset - start)
+                                                  + sizeof(struct segment_header)) == -1)
+        {
+            free_message(co, messages[m]);
+            messages[m] = NULL;
+            mm_free(co->mm, buffer);
+            return -1;
+        }
+    }
+    mm_free(co->mm, buffer);
+    
+    return 0;
+}
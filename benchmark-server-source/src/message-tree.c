@@ -0,0 +1,514 @@
+#include "../include/message-tree.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TREE_MAGIC 0x3174726dU /** Marks a file holding a message tree. */
+
+/**
+ * The header of a tree file, at the start of page 0.
+ */
+struct tree_header
+{
+    uint32_t magic;
+    uint32_t root;   // 0 if the tree is empty.
+    uint32_t pages;  // Including page 0.
+    uint32_t height; // Levels of pages, counting the leaves.
+    uint64_t size;   // Number of entries.
+};
+
+/**
+ * read_page
+ * <p>
+ * Read a page of a tree file.
+ * </p>
+ * @param co the core object
+ * @param fd the tree file
+ * @param number the page number
+ * @param page memory in which to store the page
+ * @return 0 on success, -1 and set err on failure or if the file is too short
+ */
+static int read_page(struct core_object *co, int fd, uint32_t number, struct message_tree_page *page);
+
+/**
+ * write_page
+ * <p>
+ * Write a page of a tree file.
+ * </p>
+ * @param co the core object
+ * @param fd the tree file
+ * @param number the page number
+ * @param page the page
+ * @return 0 on success, -1 and set err on failure
+ */
+static int write_page(struct core_object *co, int fd, uint32_t number, const void *page);
+
+/**
+ * read_header
+ * <p>
+ * Read the header of a tree file. A file which does not hold a message tree has an empty header.
+ * </p>
+ * @param co the core object
+ * @param fd the tree file
+ * @param header memory in which to store the header
+ * @return 0 on success, -1 and set err on failure
+ */
+static int read_header(struct core_object *co, int fd, struct tree_header *header);
+
+/**
+ * write_header
+ * <p>
+ * Write the header of a tree file, filling the rest of page 0 with zeros.
+ * </p>
+ * @param co the core object
+ * @param fd the tree file
+ * @param header the header
+ * @return 0 on success, -1 and set err on failure
+ */
+static int write_header(struct core_object *co, int fd, const struct tree_header *header);
+
+/**
+ * compare_keys
+ * <p>
+ * Compare two entries by timestamp, then Message ID, then sequence number.
+ * </p>
+ * @param a the first entry
+ * @param b the second entry
+ * @return less than, equal to or greater than 0 as a is before, equal to or after b
+ */
+static int compare_keys(const struct message_tree_entry *a, const struct message_tree_entry *b);
+
+/**
+ * lower_bound
+ * <p>
+ * Find the first slot of a page whose key is at or after a key.
+ * </p>
+ * @param page the page
+ * @param key the key
+ * @return the slot, or the count of the page if every key is before it
+ */
+static size_t lower_bound(const struct message_tree_page *page, const struct message_tree_entry *key);
+
+/**
+ * upper_bound
+ * <p>
+ * Find the first slot of a page whose key is after a key.
+ * </p>
+ * @param page the page
+ * @param key the key
+ * @return the slot, or the count of the page if no key is after it
+ */
+static size_t upper_bound(const struct message_tree_page *page, const struct message_tree_entry *key);
+
+/**
+ * branch_child
+ * <p>
+ * Get the child of a branch which covers a key.
+ * </p>
+ * @param page the branch
+ * @param key the key
+ * @return the page number of the child
+ */
+static uint32_t branch_child(const struct message_tree_page *page, const struct message_tree_entry *key);
+
+/**
+ * split_page
+ * <p>
+ * Insert a slot into a full page, moving the upper part of its slots to a new page. A leaf keeps the separator as the
+ * first slot of the new page; a branch gives it up, and the child of the separator becomes the first child of the new
+ * page. A slot appended at the end moves alone, so that a tree filled in order leaves its pages full.
+ * </p>
+ * @param page the full page, which keeps the lower part
+ * @param right memory in which to store the new page
+ * @param right_number the page number of the new page
+ * @param position the slot at which to insert
+ * @param slot the slot to insert, which is replaced by the separator and the page number of the new page
+ */
+static void split_page(struct message_tree_page *page, struct message_tree_page *right, uint32_t right_number,
+                       size_t position, struct message_tree_slot *slot);
+
+long message_tree_size(struct core_object *co, int fd)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct tree_header header;
+    
+    if (read_header(co, fd, &header) == -1)
+    {
+        return -1;
+    }
+    
+    return (long) header.size;
+}
+
+int message_tree_reset(struct core_object *co, int fd)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (ftruncate(fd, 0) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int message_tree_insert(struct core_object *co, int fd, const struct message_tree_entry *entry)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct tree_header       header;
+    struct message_tree_page page;
+    struct message_tree_page right;
+    struct message_tree_slot slot;
+    uint32_t                 path[MESSAGE_TREE_MAX_HEIGHT];
+    uint32_t                 right_number;
+    size_t                   position;
+    size_t                   level;
+    
+    if (read_header(co, fd, &header) == -1)
+    {
+        return -1;
+    }
+    if (header.height > MESSAGE_TREE_MAX_HEIGHT)
+    {
+        errno = EIO;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    memset(&page, 0, sizeof(page));
+    if (header.root == 0)
+    {
+        page.leaf         = 1;
+        page.count        = 1;
+        page.slots[0].key = *entry;
+        header.magic      = TREE_MAGIC;
+        header.root       = 1;
+        header.pages      = 2;
+        header.height     = 1;
+        header.size       = 1;
+        if (write_page(co, fd, header.root, &page) == -1)
+        {
+            return -1;
+        }
+        return write_header(co, fd, &header);
+    }
+    
+    // Descend to the leaf, remembering the path for splits.
+    path[0] = header.root;
+    for (level = 0; level + 1 < header.height; ++level)
+    {
+        if (read_page(co, fd, path[level], &page) == -1)
+        {
+            return -1;
+        }
+        path[level + 1] = branch_child(&page, entry);
+    }
+    if (read_page(co, fd, path[level], &page) == -1)
+    {
+        return -1;
+    }
+    position = lower_bound(&page, entry);
+    if (position < page.count && compare_keys(&page.slots[position].key, entry) == 0)
+    {
+        return 0;
+    }
+    
+    memset(&slot, 0, sizeof(slot));
+    slot.key = *entry;
+    while (page.count == MESSAGE_TREE_FANOUT)
+    {
+        right_number = header.pages++;
+        split_page(&page, &right, right_number, position, &slot);
+        if (write_page(co, fd, right_number, &right) == -1 || write_page(co, fd, path[level], &page) == -1)
+        {
+            return -1;
+        }
+        
+        if (level == 0) // The root split; grow a new root above it.
+        {
+            if (header.height == MESSAGE_TREE_MAX_HEIGHT)
+            {
+                errno = EFBIG;
+                SET_ERROR(co->err);
+                return -1;
+            }
+            memset(&page, 0, sizeof(page));
+            page.link     = header.root;
+            page.count    = 1;
+            page.slots[0] = slot;
+            header.root   = header.pages++;
+            ++header.height;
+            if (write_page(co, fd, header.root, &page) == -1)
+            {
+                return -1;
+            }
+            ++header.size;
+            return write_header(co, fd, &header);
+        }
+        
+        --level;
+        if (read_page(co, fd, path[level], &page) == -1)
+        {
+            return -1;
+        }
+        position = upper_bound(&page, &slot.key);
+    }
+    
+    memmove(&page.slots[position + 1], &page.slots[position], (page.count - position) * sizeof(page.slots[0]));
+    page.slots[position] = slot;
+    ++page.count;
+    if (write_page(co, fd, path[level], &page) == -1)
+    {
+        return -1;
+    }
+    ++header.size;
+    
+    return write_header(co, fd, &header);
+}
+
+long message_tree_scan(struct core_object *co, int fd, const struct message_tree_entry *start, int after,
+                       int64_t to_timestamp, struct message_tree_entry *entries, size_t count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct tree_header       header;
+    struct message_tree_page page;
+    uint32_t                 number;
+    size_t                   position;
+    size_t                   found;
+    
+    if (read_header(co, fd, &header) == -1)
+    {
+        return -1;
+    }
+    if (header.root == 0 || count == 0)
+    {
+        return 0;
+    }
+    
+    number = header.root;
+    for (size_t level = 0; level + 1 < header.height; ++level)
+    {
+        if (read_page(co, fd, number, &page) == -1)
+        {
+            return -1;
+        }
+        number = branch_child(&page, start);
+    }
+    if (read_page(co, fd, number, &page) == -1)
+    {
+        return -1;
+    }
+    position = after ? upper_bound(&page, start) : lower_bound(&page, start);
+    
+    // The leaves are linked in order, so the rest of the range is read one page after another.
+    found = 0;
+    while (found < count)
+    {
+        if (position == page.count)
+        {
+            if (page.link == 0)
+            {
+                break;
+            }
+            if (read_page(co, fd, page.link, &page) == -1)
+            {
+                return -1;
+            }
+            position = 0;
+            continue;
+        }
+        if (page.slots[position].key.timestamp > to_timestamp)
+        {
+            break;
+        }
+        entries[found++] = page.slots[position++].key;
+    }
+    
+    return (long) found;
+}
+
+static int read_page(struct core_object *co, int fd, uint32_t number, struct message_tree_page *page)
+{
+    ssize_t bytes;
+    
+    do
+    {
+        bytes = pread(fd, page, MESSAGE_TREE_PAGE_SIZE, (off_t) number * MESSAGE_TREE_PAGE_SIZE);
+    } while (bytes == -1 && errno == EINTR);
+    if (bytes != MESSAGE_TREE_PAGE_SIZE)
+    {
+        if (bytes != -1)
+        {
+            errno = EIO; // The tree points past the end of the file.
+        }
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int write_page(struct core_object *co, int fd, uint32_t number, const void *page)
+{
+    ssize_t bytes;
+    
+    do
+    {
+        bytes = pwrite(fd, page, MESSAGE_TREE_PAGE_SIZE, (off_t) number * MESSAGE_TREE_PAGE_SIZE);
+    } while (bytes == -1 && errno == EINTR);
+    if (bytes != MESSAGE_TREE_PAGE_SIZE)
+    {
+        if (bytes != -1)
+        {
+            errno = ENOSPC;
+        }
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int read_header(struct core_object *co, int fd, struct tree_header *header)
+{
+    ssize_t bytes;
+    
+    do
+    {
+        bytes = pread(fd, header, sizeof(*header), 0);
+    } while (bytes == -1 && errno == EINTR);
+    if (bytes == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if ((size_t) bytes != sizeof(*header) || header->magic != TREE_MAGIC)
+    {
+        memset(header, 0, sizeof(*header));
+    }
+    
+    return 0;
+}
+
+static int write_header(struct core_object *co, int fd, const struct tree_header *header)
+{
+    uint8_t page[MESSAGE_TREE_PAGE_SIZE];
+    
+    memset(page, 0, sizeof(page));
+    memcpy(page, header, sizeof(*header));
+    
+    return write_page(co, fd, 0, page);
+}
+
+static int compare_keys(const struct message_tree_entry *a, const struct message_tree_entry *b)
+{
+    if (a->timestamp != b->timestamp)
+    {
+        return (a->timestamp < b->timestamp) ? -1 : 1;
+    }
+    if (a->message_id != b->message_id)
+    {
+        return (a->message_id < b->message_id) ? -1 : 1;
+    }
+    if (a->sequence != b->sequence)
+    {
+        return (a->sequence < b->sequence) ? -1 : 1;
+    }
+    
+    return 0;
+}
+
+static size_t lower_bound(const struct message_tree_page *page, const struct message_tree_entry *key)
+{
+    size_t low;
+    size_t high;
+    size_t middle;
+    
+    low  = 0;
+    high = page->count;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (compare_keys(&page->slots[middle].key, key) < 0)
+        {
+            low = middle + 1;
+        } else
+        {
+            high = middle;
+        }
+    }
+    
+    return low;
+}
+
+static size_t upper_bound(const struct message_tree_page *page, const struct message_tree_entry *key)
+{
+    size_t low;
+    size_t high;
+    size_t middle;
+    
+    low  = 0;
+    high = page->count;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (compare_keys(&page->slots[middle].key, key) <= 0)
+        {
+            low = middle + 1;
+        } else
+        {
+            high = middle;
+        }
+    }
+    
+    return low;
+}
+
+static uint32_t branch_child(const struct message_tree_page *page, const struct message_tree_entry *key)
+{
+    size_t position;
+    
+    position = upper_bound(page, key);
+    
+    return (position == 0) ? page->link : page->slots[position - 1].child;
+}
+
+static void split_page(struct message_tree_page *page, struct message_tree_page *right, uint32_t right_number,
+                       size_t position, struct message_tree_slot *slot)
+{
+    struct message_tree_slot slots[MESSAGE_TREE_FANOUT + 1];
+    size_t                   total;
+    size_t                   middle;
+    
+    total = MESSAGE_TREE_FANOUT + 1;
+    memcpy(slots, page->slots, position * sizeof(slots[0]));
+    slots[position] = *slot;
+    memcpy(&slots[position + 1], &page->slots[position], (MESSAGE_TREE_FANOUT - position) * sizeof(slots[0]));
+    middle = (position == MESSAGE_TREE_FANOUT) ? MESSAGE_TREE_FANOUT : total / 2;
+    
+    memset(right, 0, sizeof(*right));
+    right->leaf = page->leaf;
+    if (page->leaf)
+    {
+        right->count = (uint16_t) (total - middle);
+        memcpy(right->slots, &slots[middle], right->count * sizeof(slots[0]));
+        right->link = page->link;
+        page->link  = right_number;
+    } else
+    {
+        right->count = (uint16_t) (total - middle - 1);
+        memcpy(right->slots, &slots[middle + 1], right->count * sizeof(slots[0]));
+        right->link = slots[middle].child;
+    }
+    page->count = (uint16_t) middle;
+    memcpy(page->slots, slots, middle * sizeof(slots[0]));
+    memset(&page->slots[middle], 0, (MESSAGE_TREE_FANOUT - middle) * sizeof(slots[0]));
+    
+    slot->key   = slots[middle].key;
+    slot->child = right_number;
+}
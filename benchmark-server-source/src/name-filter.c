@@ -0,0 +1,210 @@
+#include "../../include/manager.h"
+#include "../include/name-filter.h"
+#include "../include/process-server-util.h"
+#include "../include/storage-engine.h"
+
+#include <stdio.h>
+#include <sys/mman.h>
+
+#define FNV_OFFSET_BASIS 14695981039346656037UL /** 64 bit FNV-1a offset basis. */
+#define FNV_PRIME 1099511628211UL               /** 64 bit FNV-1a prime. */
+#define HALF_HASH_BITS 32                       /** Each half of the hash seeds one of the two base hashes. */
+
+/**
+ * filter_counters
+ * <p>
+ * Get the counters to which a name maps. They are derived from two halves of one hash by double hashing.
+ * </p>
+ * @param name the name
+ * @param counters memory in which to store the index of each counter
+ */
+static void filter_counters(const datum *name, size_t *counters);
+
+/**
+ * count_name
+ * <p>
+ * Visitor which counts the name of a record in a filter.
+ * </p>
+ * @param co the core object
+ * @param arg the filter
+ * @param key the key of the record
+ * @param value the record
+ * @return 0
+ */
+static int count_name(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * increment_counters
+ * <p>
+ * Increment the counters of a name in a filter.
+ * </p>
+ * @param filter the filter
+ * @param name the name
+ */
+static void increment_counters(struct name_filter *filter, const datum *name);
+
+int open_name_filters(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    
+    so->name_filters = map_shared_memory(co, NAME_FILTER_SHM_NAME, so->num_databases * sizeof(struct name_filter));
+    if (!so->name_filters)
+    {
+        return -1;
+    }
+    
+    list_databases(so, databases);
+    // The filters of databases without a name index are never touched, so their pages are never allocated.
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        if (!databases[d]->index_name)
+        {
+            continue;
+        }
+        if (databases[d]->engine->for_each(co, databases[d], count_name, &so->name_filters[d]) == -1)
+        {
+            return -1;
+        }
+        databases[d]->name_filter = &so->name_filters[d];
+    }
+    
+    return 0;
+}
+
+void close_name_filters(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    
+    if (so->name_filters)
+    {
+        list_databases(so, databases);
+        for (size_t d = 0; d < so->num_databases; ++d)
+        {
+            databases[d]->name_filter = NULL;
+        }
+        munmap(so->name_filters, so->num_databases * sizeof(struct name_filter));
+        so->name_filters = NULL;
+    }
+}
+
+void print_name_filter_stats(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    
+    list_databases(so, databases);
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        if (databases[d]->name_filter)
+        {
+            (void) fprintf(stdout, "Name filter %s: %lu checks, %lu definite misses\n", databases[d]->name,
+                           atomic_load(&databases[d]->name_filter->checks),
+                           atomic_load(&databases[d]->name_filter->misses));
+        }
+    }
+}
+
+int name_filter_may_contain(struct database *db, const datum *name)
+{
+    size_t counters[NAME_FILTER_HASHES];
+    
+    if (!db->name_filter)
+    {
+        return 1;
+    }
+    
+    atomic_fetch_add_explicit(&db->name_filter->checks, 1, memory_order_relaxed);
+    filter_counters(name, counters);
+    for (size_t h = 0; h < NAME_FILTER_HASHES; ++h)
+    {
+        if (atomic_load(&db->name_filter->counters[counters[h]]) == 0)
+        {
+            atomic_fetch_add_explicit(&db->name_filter->misses, 1, memory_order_relaxed);
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+void name_filter_add(struct database *db, const datum *name)
+{
+    if (db->name_filter)
+    {
+        increment_counters(db->name_filter, name);
+    }
+}
+
+void name_filter_remove(struct database *db, const datum *name)
+{
+    size_t counters[NAME_FILTER_HASHES];
+    
+    if (!db->name_filter)
+    {
+        return;
+    }
+    
+    filter_counters(name, counters);
+    for (size_t h = 0; h < NAME_FILTER_HASHES; ++h)
+    {
+        // A stuck counter may be shared with names which are still present, so it is never decremented.
+        if (atomic_load(&db->name_filter->counters[counters[h]]) < NAME_FILTER_COUNTER_MAX)
+        {
+            atomic_fetch_sub(&db->name_filter->counters[counters[h]], 1);
+        }
+    }
+}
+
+static void filter_counters(const datum *name, size_t *counters)
+{
+    const uint8_t *bytes;
+    uint64_t      hash;
+    uint64_t      step;
+    
+    bytes = (const uint8_t *) name->dptr;
+    hash  = FNV_OFFSET_BASIS;
+    for (int b = 0; b < name->dsize; ++b)
+    {
+        hash ^= bytes[b];
+        hash *= FNV_PRIME;
+    }
+    
+    // An odd step visits distinct counters, since the number of counters is a power of two.
+    step = (hash >> HALF_HASH_BITS) | 1;
+    for (size_t h = 0; h < NAME_FILTER_HASHES; ++h)
+    {
+        counters[h] = (size_t) (hash + h * step) & (NAME_FILTER_COUNTERS - 1);
+    }
+}
+
+static int count_name(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    datum name;
+    
+    (void) key;
+    name = record_name(value);
+    increment_counters((struct name_filter *) arg, &name);
+    
+    return 0;
+}
+
+static void increment_counters(struct name_filter *filter, const datum *name)
+{
+    size_t counters[NAME_FILTER_HASHES];
+    
+    filter_counters(name, counters);
+    for (size_t h = 0; h < NAME_FILTER_HASHES; ++h)
+    {
+        if (atomic_load(&filter->counters[counters[h]]) < NAME_FILTER_COUNTER_MAX)
+        {
+            atomic_fetch_add(&filter->counters[counters[h]], 1);
+        }
+    }
+}
@@ -0,0 +1,928 @@
+#include "../../include/manager.h"
+#include "../include/db.h"
+#include "../include/name-filter.h"
+#include "../include/object-cache.h"
+#include "../include/rw-lock.h"
+#include "../include/storage-engine.h"
+#include "../include/user-table.h"
+#include "../include/write-ahead-log.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * ndbm_open_database
+ * <p>
+ * Create the files of a database if they do not exist yet. If the database has a name index which is empty, fill it
+ * by scanning every record in the database; this covers databases written before the index existed and an index file
+ * which has been removed. Both handles are closed afterwards, so the children do not inherit them.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param db the database to open
+ * @return 0 on success, -1 and set err on failure
+ */
+static int ndbm_open_database(struct core_object *co, struct server_object *so, struct database *db);
+
+/**
+ * ndbm_close_database
+ * <p>
+ * Close this process' handles to a database.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param db the database to close
+ */
+static void ndbm_close_database(struct core_object *co, struct server_object *so, struct database *db);
+
+/**
+ * ndbm_store
+ * <p>
+ * Store a record in a database. If the database has a name index, the index is updated under the same lock.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key under which to store
+ * @param value the value to store
+ * @param store_flags whether to insert or overwrite
+ * @return 0 on success, 1 if insert and record already exists or the name is taken, -1 and set err on failure
+ */
+static int ndbm_store(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags);
+
+/**
+ * ndbm_fetch
+ * <p>
+ * Fetch a record from a database.
+ * </p>
+ * @param co the core object
+ * @param db the database from which to fetch
+ * @param key the key of the record to fetch
+ * @param serial_buffer the buffer into which to copy the fetched record
+ * @param size memory in which to store the size of the record, or NULL if not required
+ * @return 0 if successful and copy occurs, 1 if record not found, -1 and set err on failure
+ */
+static int ndbm_fetch(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer, size_t *size);
+
+/**
+ * ndbm_remove
+ * <p>
+ * Delete a record from a database, along with its name index entry if the database has a name index.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key to delete
+ * @return 0 on success, -1 and set err on failure
+ */
+static int ndbm_remove(struct core_object *co, struct database *db, datum *key);
+
+/**
+ * ndbm_find_by_name
+ * <p>
+ * Find a record by name. If the database has a name index the lookup goes through it; otherwise every record is
+ * scanned.
+ * </p>
+ * @param co the core object
+ * @param db the database in which to search
+ * @param serial_object the object to store the result, or NULL if no result is needed
+ * @param size memory in which to store the size of the result, or NULL if not required
+ * @param name the name for which to search
+ * @return 0 on success and record not located, 1 on success and record located, -1 and set err on failure
+ */
+static int ndbm_find_by_name(struct core_object *co, struct database *db, uint8_t **serial_object,
+                             size_t *size, const char *name);
+
+/**
+ * ndbm_for_each
+ * <p>
+ * Call a visitor on every record of a database while holding the lock for reading.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param visit the visitor
+ * @param arg passed to the visitor
+ * @return 0 on success, -1 and set err on failure
+ */
+static int ndbm_for_each(struct core_object *co, struct database *db, record_visitor visit, void *arg);
+
+/**
+ * ndbm_write_batch
+ * <p>
+ * Apply writes to a database in order under one acquisition of the lock, logging them first. Flushing forces the log
+ * to disk, or if the database is not logged, syncs the files of the database and of its name index.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param ops the writes
+ * @param count the number of writes
+ * @param flush whether to force the writes to disk
+ * @return 0 if the batch was applied, -1 and set err on failure
+ */
+static int ndbm_write_batch(struct core_object *co, struct database *db, struct write_op *ops, size_t count,
+                            int flush);
+
+/**
+ * ndbm_check
+ * <p>
+ * Check whether a write to a database would be refused: a store if inserting and the key already exists, or if the
+ * name belongs to a different record; a remove if the record does not exist.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param op the write
+ * @return 0 if the write would be applied, 1 if it would be refused, -1 and set err on failure
+ */
+static int ndbm_check(struct core_object *co, struct database *db, const struct write_op *op);
+
+/**
+ * ndbm_apply
+ * <p>
+ * Apply writes to a database in order. Flushing syncs the files of the database and of its name index, unless the
+ * database is logged.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param ops the writes
+ * @param count the number of writes
+ * @param flush whether to force the writes to disk
+ * @return 0 if the writes were applied, -1 and set err on failure
+ */
+static int ndbm_apply(struct core_object *co, struct database *db, struct write_op *ops, size_t count, int flush);
+
+/**
+ * ndbm_sync
+ * <p>
+ * Force the files of a database, and of its name index, to disk. The handles are closed afterwards: only the parent
+ * syncs, and it must not carry open handles into a fork.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @return 0 on success, -1 and set err on failure
+ */
+static int ndbm_sync(struct core_object *co, struct database *db);
+
+/**
+ * store_locked
+ * <p>
+ * Store a record in a database, through the name index if it has one. Must be called while holding the database lock
+ * for writing, with the handle synchronized.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key under which to store
+ * @param value the value to store
+ * @param store_flags whether to insert or overwrite
+ * @return 0 on success, 1 if the store is refused, -1 and set err on failure
+ */
+static int store_locked(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags);
+
+/**
+ * remove_locked
+ * <p>
+ * Delete a record from a database, along with its name index entry if it has one. Must be called while holding the
+ * database lock for writing, with the handle synchronized.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key to delete
+ * @return 0 on success, -1 and set err on failure
+ */
+static int remove_locked(struct core_object *co, struct database *db, datum *key);
+
+/**
+ * sync_to_disk
+ * <p>
+ * Force the files of a DBM handle to disk.
+ * </p>
+ * @param co the core object
+ * @param dbm the handle
+ * @return 0 on success, -1 and set err on failure
+ */
+static int sync_to_disk(struct core_object *co, DBM *dbm);
+
+/**
+ * save_dptr_to_serial_object
+ * <p>
+ * Return 1 if value->dptr exists and 0 if value.dptr does not exist.
+ * If a byte array is provided and value->dptr exists, copy the value in a value->dptr into a byte array.
+ * Otherwise if a byte array is provide and value->dptr does not exist, set the byte array to NULL.
+ * </p>
+ * @param co the core object
+ * @param serial_object the byte array into which to copy value->dptr
+ * @param value the datum to copy
+ * @return 1 if value->dptr exists and 0 if value.dptr does not exist, -1 and set err on failure.
+ */
+static int save_dptr_to_serial_object(struct core_object *co, uint8_t **serial_object, datum *value);
+
+/**
+ * sync_dbm_handle
+ * <p>
+ * Make sure this process holds an open handle to a database which reflects every write made by other processes.
+ * If the handle is not yet open, open it. If another process has written to the database since the handle was last
+ * synchronized, reopen it so that no stale cached buckets are used. The handle is private to this process, so holding
+ * the database lock for reading is enough.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @return 0 on success, -1 and set err on failure
+ */
+static int sync_dbm_handle(struct core_object *co, struct database *db);
+
+/**
+ * lookup_name_index
+ * <p>
+ * Find the record to which a name is mapped in the name index of a database. An index entry only counts if the record
+ * it points to still exists and still carries the name; this makes an entry left behind by an interrupted write
+ * harmless. Must be called while holding the database lock.
+ * </p>
+ * @param db the database
+ * @param name the name to look up
+ * @param id memory in which to store the key of the record
+ * @param record memory in which to store the record, or NULL if not required; valid until the next fetch
+ * @return 1 if the name is mapped to a record, 0 if not
+ */
+static int lookup_name_index(struct database *db, const datum *name, int *id, datum *record);
+
+/**
+ * indexed_store
+ * <p>
+ * Store a record in a database with a name index and keep the index in step. The store is refused if the name
+ * belongs to a different record, or if inserting and the key already exists. If the record is renamed, the old name
+ * is released. Must be called while holding the database lock.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key under which to store
+ * @param value the value to store
+ * @param store_flags whether to insert or overwrite
+ * @return 0 on success, 1 if the store is refused, -1 and set err on failure
+ */
+static int indexed_store(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags);
+
+/**
+ * indexed_delete
+ * <p>
+ * Delete a record from a database with a name index, along with the index entry for its name. Must be called while
+ * holding the database lock.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key to delete
+ * @return 0 on success, -1 and set err on failure
+ */
+static int indexed_delete(struct core_object *co, struct database *db, datum *key);
+
+const struct storage_engine ndbm_storage_engine = {
+        "ndbm",
+        ndbm_open_database,
+        ndbm_close_database,
+        ndbm_store,
+        ndbm_fetch,
+        ndbm_remove,
+        ndbm_find_by_name,
+        ndbm_for_each,
+        ndbm_write_batch,
+        ndbm_check,
+        ndbm_apply,
+        ndbm_sync,
+        NULL,
+        NULL
+};
+
+static int ndbm_open_database(struct core_object *co, struct server_object *so, struct database *db)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    datum key;
+    datum value;
+    int   ret_val;
+    
+    (void) so;
+    
+    if (rw_lock_write(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    if (sync_dbm_handle(co, db) == -1)
+    {
+        rw_lock_unlock(db->lock);
+        return -1;
+    }
+    
+    ret_val = 0;
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    if (db->index_dbm && !dbm_firstkey(db->index_dbm).dptr)
+    {
+        for (key = dbm_firstkey(db->dbm); key.dptr && ret_val == 0; key = dbm_nextkey(db->dbm))
+        {
+            value = dbm_fetch(db->dbm, key);
+            if (value.dptr && dbm_store(db->index_dbm, record_name(&value), key, DBM_REPLACE) == -1)
+            {
+                SET_ERROR(co->err);
+                print_db_error(db->index_dbm);
+                ret_val = -1;
+            }
+        }
+    }
+    
+    dbm_close(db->dbm);
+    if (db->index_dbm)
+    {
+        dbm_close(db->index_dbm);
+    }
+    // NOLINTEND(concurrency-mt-unsafe)
+    db->dbm       = NULL;
+    db->index_dbm = NULL;
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static void ndbm_close_database(struct core_object *co, struct server_object *so, struct database *db)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    (void) so;
+    
+    // NOLINTBEGIN(concurrency-mt-unsafe) : No threads here
+    if (db->dbm)
+    {
+        dbm_close(db->dbm);
+        db->dbm = NULL;
+    }
+    if (db->index_dbm)
+    {
+        dbm_close(db->index_dbm);
+        db->index_dbm = NULL;
+    }
+    // NOLINTEND(concurrency-mt-unsafe)
+}
+
+static int ndbm_store(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct write_op op;
+    
+    op.kind        = WRITE_STORE;
+    op.store_flags = store_flags;
+    op.key         = *key;
+    op.value       = *value;
+    if (ndbm_write_batch(co, db, &op, 1, 0) == -1)
+    {
+        return -1;
+    }
+    
+    return op.status;
+}
+
+static int ndbm_fetch(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer, size_t *size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int   ret_val;
+    datum value;
+    
+    if (rw_lock_read(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    if (sync_dbm_handle(co, db) == -1)
+    {
+        rw_lock_unlock(db->lock);
+        return -1;
+    }
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    value = dbm_fetch(db->dbm, (*key));
+    if (!value.dptr && dbm_error(db->dbm))
+    {
+        print_db_error(db->dbm);
+    }
+    // NOLINTEND(concurrency-mt-unsafe) : Protected
+    ret_val = copy_dptr_to_buffer(co, serial_buffer, &value);
+    if (ret_val == 0 && size)
+    {
+        *size = (size_t) value.dsize;
+    }
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int ndbm_remove(struct core_object *co, struct database *db, datum *key)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct write_op op;
+    
+    op.kind        = WRITE_REMOVE;
+    op.store_flags = 0;
+    op.key         = *key;
+    op.value.dptr  = NULL;
+    op.value.dsize = 0;
+    if (ndbm_write_batch(co, db, &op, 1, 0) == -1)
+    {
+        return -1;
+    }
+    
+    return op.status;
+}
+
+static int ndbm_find_by_name(struct core_object *co, struct database *db, uint8_t **serial_object,
+                             size_t *size, const char *name)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    datum key;
+    datum value;
+    
+    // Get first thing in the db
+    if (rw_lock_read(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    if (sync_dbm_handle(co, db) == -1)
+    {
+        rw_lock_unlock(db->lock);
+        return -1;
+    }
+    
+    if (db->index_dbm) // Go straight to the record through the name index.
+    {
+        char  name_buffer[NAME_MAX_SIZE + 1];
+        datum name_key;
+        int   id;
+        
+        if (!name_to_key(name, name_buffer, &name_key) || lookup_name_index(db, &name_key, &id, &value) == 0)
+        {
+            value.dptr = NULL;
+        }
+    } else
+    {
+        // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+        key   = dbm_firstkey(db->dbm);
+        value = dbm_fetch(db->dbm, key);
+        if (!key.dptr && dbm_error(db->dbm))
+        {
+            print_db_error(db->dbm);
+        }
+        
+        // Compare the display name to the name in the db
+        // NOLINTNEXTLINE(clang-diagnostic-cast-align): Intentional cast.
+        while (key.dptr && strcmp((char *) (((int *) value.dptr) + 1), name) != 0)
+        {
+            key   = dbm_nextkey(db->dbm);
+            value = dbm_fetch(db->dbm, key);
+            if (!key.dptr && dbm_error(db->dbm))
+            {
+                print_db_error(db->dbm);
+            }
+        }
+        // NOLINTEND(concurrency-mt-unsafe) : Protected
+    }
+    
+    // Returns 0 if no value.dptr, returns 1 if value.dptr, returns -1 if error.
+    int ret_val = save_dptr_to_serial_object(co, serial_object, &value);
+    if (ret_val == 1 && size)
+    {
+        *size = (size_t) value.dsize;
+    }
+    
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int ndbm_for_each(struct core_object *co, struct database *db, record_visitor visit, void *arg)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    datum key;
+    datum value;
+    int   ret_val;
+    
+    if (rw_lock_read(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    if (sync_dbm_handle(co, db) == -1)
+    {
+        rw_lock_unlock(db->lock);
+        return -1;
+    }
+    
+    ret_val = 0;
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    for (key = dbm_firstkey(db->dbm); key.dptr && ret_val == 0; key = dbm_nextkey(db->dbm))
+    {
+        value = dbm_fetch(db->dbm, key);
+        if (value.dptr)
+        {
+            ret_val = visit(co, arg, &key, &value);
+        }
+    }
+    // NOLINTEND(concurrency-mt-unsafe)
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int ndbm_write_batch(struct core_object *co, struct database *db, struct write_op *ops, size_t count,
+                            int flush)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int ret_val;
+    
+    if (rw_lock_write(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    
+    // The handle is synchronized before logging, so that a write is only logged if it can be applied.
+    ret_val = sync_dbm_handle(co, db);
+    if (ret_val == 0)
+    {
+        ret_val = wal_log(co, db, ops, count, flush);
+    }
+    if (ret_val == 0)
+    {
+        ret_val = ndbm_apply(co, db, ops, count, flush);
+    }
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int ndbm_check(struct core_object *co, struct database *db, const struct write_op *op)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    datum name;
+    datum value;
+    int   owner_id;
+    
+    if (sync_dbm_handle(co, db) == -1)
+    {
+        return -1;
+    }
+    
+    value = dbm_fetch(db->dbm, op->key); // NOLINT(concurrency-mt-unsafe) : Protected
+    if (op->kind == WRITE_REMOVE)
+    {
+        return value.dptr ? 0 : 1;
+    }
+    if (value.dptr && op->store_flags == DBM_INSERT)
+    {
+        return 1;
+    }
+    
+    if (db->index_dbm)
+    {
+        name = record_name(&op->value);
+        if (name_filter_may_contain(db, &name) && lookup_name_index(db, &name, &owner_id, NULL) == 1
+            && memcmp(&owner_id, op->key.dptr, sizeof(int)) != 0)
+        {
+            return 1; // The name belongs to a different record.
+        }
+    }
+    
+    return 0;
+}
+
+static int ndbm_apply(struct core_object *co, struct database *db, struct write_op *ops, size_t count, int flush)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int written;
+    
+    if (sync_dbm_handle(co, db) == -1)
+    {
+        return -1;
+    }
+    
+    written = 0;
+    for (size_t o = 0; o < count; ++o)
+    {
+        if (ops[o].kind == WRITE_STORE)
+        {
+            ops[o].status = store_locked(co, db, &ops[o].key, &ops[o].value, ops[o].store_flags);
+        } else
+        {
+            ops[o].status = remove_locked(co, db, &ops[o].key);
+        }
+        if (ops[o].status == 0)
+        {
+            object_cache_invalidate(db, &ops[o].key);
+            user_table_apply(db, &ops[o]);
+            written = 1;
+        }
+    }
+    
+    // The generation is bumped once for the whole batch, so other workers reopen their handles once.
+    if (written)
+    {
+        mark_db_written(db);
+    }
+    
+    // When the writes are logged, forcing the log to disk was enough.
+    if (flush && !db->wal
+        && (sync_to_disk(co, db->dbm) == -1 || (db->index_dbm && sync_to_disk(co, db->index_dbm) == -1)))
+    {
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int ndbm_sync(struct core_object *co, struct database *db)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int ret_val;
+    
+    if (rw_lock_write(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    ret_val = sync_dbm_handle(co, db);
+    if (ret_val == 0
+        && (sync_to_disk(co, db->dbm) == -1 || (db->index_dbm && sync_to_disk(co, db->index_dbm) == -1)))
+    {
+        ret_val = -1;
+    }
+    ndbm_close_database(co, NULL, db);
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int store_locked(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int status;
+    
+    if (db->index_dbm)
+    {
+        return indexed_store(co, db, key, value, store_flags);
+    }
+    
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    status = dbm_store(db->dbm, *key, *value, store_flags);
+    if (status == -1 && dbm_error(db->dbm))
+    {
+        print_db_error(db->dbm);
+    }
+    // NOLINTEND(concurrency-mt-unsafe)
+    
+    return status;
+}
+
+static int remove_locked(struct core_object *co, struct database *db, datum *key)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (db->index_dbm)
+    {
+        return indexed_delete(co, db, key);
+    }
+    
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    if (dbm_delete(db->dbm, *key) == -1)
+    {
+        SET_ERROR(co->err);
+        print_db_error(db->dbm);
+        return -1;
+    }
+    // NOLINTEND(concurrency-mt-unsafe)
+    
+    return 0;
+}
+
+static int sync_to_disk(struct core_object *co, DBM *dbm)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    // Some implementations keep both in one file; syncing it twice is harmless.
+    if (fsync(dbm_pagfno(dbm)) == -1 || fsync(dbm_dirfno(dbm)) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int sync_dbm_handle(struct core_object *co, struct database *db)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (db->dbm && db->generation == *db->shared_generation)
+    {
+        return 0; // Nobody has written since this handle last synchronized; its cached state is still valid.
+    }
+    
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    if (db->dbm)
+    {
+        dbm_close(db->dbm);
+    }
+    if (db->index_dbm)
+    {
+        dbm_close(db->index_dbm);
+        db->index_dbm = NULL;
+    }
+    // NOLINTNEXTLINE(clang-diagnostic-incompatible-pointer-types-discards-qualifiers): implementation
+    db->dbm = dbm_open(db->name, DB_FLAGS, DB_FILE_MODE);
+    if (db->dbm == (DBM *) 0)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (db->index_name)
+    {
+        // NOLINTNEXTLINE(clang-diagnostic-incompatible-pointer-types-discards-qualifiers): implementation
+        db->index_dbm = dbm_open(db->index_name, DB_FLAGS, DB_FILE_MODE);
+        if (db->index_dbm == (DBM *) 0)
+        {
+            SET_ERROR(co->err);
+            dbm_close(db->dbm);
+            db->dbm = NULL;
+            return -1;
+        }
+    }
+    // NOLINTEND(concurrency-mt-unsafe)
+    db->generation = *db->shared_generation;
+    
+    return 0;
+}
+
+static int lookup_name_index(struct database *db, const datum *name, int *id, datum *record)
+{
+    datum owner;
+    datum value;
+    datum stored_name;
+    
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    owner = dbm_fetch(db->index_dbm, *name);
+    if (!owner.dptr || owner.dsize != sizeof(int))
+    {
+        return 0;
+    }
+    memcpy(id, owner.dptr, sizeof(int));
+    
+    value = dbm_fetch(db->dbm, owner);
+    // NOLINTEND(concurrency-mt-unsafe)
+    if (!value.dptr)
+    {
+        return 0;
+    }
+    stored_name = record_name(&value);
+    if (stored_name.dsize != name->dsize || memcmp(stored_name.dptr, name->dptr, name->dsize) != 0)
+    {
+        return 0;
+    }
+    
+    if (record)
+    {
+        *record = value;
+    }
+    
+    return 1;
+}
+
+static int indexed_store(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags)
+{
+    datum   name;
+    datum   old_value;
+    datum   old_name;
+    uint8_t *old_name_copy;
+    int     owner_id;
+    int     name_is_new;
+    
+    // A name the filter has never seen is not in the index, so most new names skip the lookup.
+    name        = record_name(value);
+    name_is_new = 1;
+    if (name_filter_may_contain(db, &name) && lookup_name_index(db, &name, &owner_id, NULL) == 1)
+    {
+        if (memcmp(&owner_id, key->dptr, sizeof(int)) != 0)
+        {
+            return 1; // The name belongs to a different record.
+        }
+        name_is_new = 0;
+    }
+    
+    // If the record is being renamed, keep a copy of the old name; the fetched value is overwritten by the store.
+    old_name_copy = NULL;
+    old_name.dsize = 0;
+    old_value = dbm_fetch(db->dbm, *key); // NOLINT(concurrency-mt-unsafe) : Protected
+    if (old_value.dptr)
+    {
+        if (store_flags == DBM_INSERT)
+        {
+            return 1;
+        }
+        old_name = record_name(&old_value);
+        if (old_name.dsize != name.dsize || memcmp(old_name.dptr, name.dptr, name.dsize) != 0)
+        {
+            old_name_copy = mm_malloc(old_name.dsize + 1, co->mm);
+            if (!old_name_copy)
+            {
+                SET_ERROR(co->err);
+                return -1;
+            }
+            memcpy(old_name_copy, old_name.dptr, old_name.dsize);
+            old_name.dptr = (void *) old_name_copy;
+        }
+    }
+    
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    if (dbm_store(db->dbm, *key, *value, store_flags) == -1)
+    {
+        SET_ERROR(co->err);
+        print_db_error(db->dbm);
+        if (old_name_copy)
+        {
+            mm_free(co->mm, old_name_copy);
+        }
+        return -1;
+    }
+    if (old_name_copy)
+    {
+        (void) dbm_delete(db->index_dbm, old_name);
+        name_filter_remove(db, &old_name);
+        mm_free(co->mm, old_name_copy);
+    }
+    if (dbm_store(db->index_dbm, name, *key, DBM_REPLACE) == -1)
+    {
+        SET_ERROR(co->err);
+        print_db_error(db->index_dbm);
+        return -1;
+    }
+    // NOLINTEND(concurrency-mt-unsafe)
+    if (name_is_new)
+    {
+        name_filter_add(db, &name);
+    }
+    
+    return 0;
+}
+
+static int indexed_delete(struct core_object *co, struct database *db, datum *key)
+{
+    datum value;
+    datum owner;
+    datum name;
+    
+    // NOLINTBEGIN(concurrency-mt-unsafe) : Protected
+    value = dbm_fetch(db->dbm, *key);
+    if (value.dptr)
+    {
+        // Only release the name if the index still maps it to this record.
+        name  = record_name(&value);
+        owner = dbm_fetch(db->index_dbm, name);
+        if (owner.dptr && owner.dsize == key->dsize && memcmp(owner.dptr, key->dptr, key->dsize) == 0)
+        {
+            (void) dbm_delete(db->index_dbm, name);
+            name_filter_remove(db, &name);
+        }
+    }
+    if (dbm_delete(db->dbm, *key) == -1)
+    {
+        SET_ERROR(co->err);
+        print_db_error(db->dbm);
+        return -1;
+    }
+    // NOLINTEND(concurrency-mt-unsafe)
+    
+    return 0;
+}
+
+static int save_dptr_to_serial_object(struct core_object *co, uint8_t **serial_object, datum *value)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int ret_val;
+    
+    if (value->dptr)
+    {
+        ret_val = 1;
+        if (serial_object)
+        {
+            if (copy_dptr_to_buffer(co, serial_object, value) == -1)
+            {
+                return -1;
+            }
+        }
+    } else
+    {
+        ret_val = 0;
+        if (serial_object)
+        {
+            *serial_object = NULL;
+        }
+    }
+    
+    return ret_val;
+}
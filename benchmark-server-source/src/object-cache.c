@@ -0,0 +1,615 @@
+#include "../../include/manager.h"
+#include "../include/db.h"
+#include "../include/object-cache.h"
+#include "../include/process-server-util.h"
+#include "../include/storage-engine.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define NUM_CACHED_DATABASES 2                  /** The User and Channel databases. */
+#define HASH_MULTIPLIER 2654435761U             /** Knuth's multiplicative hashing constant. */
+#define HASH_SHIFT 16                           /** Fold the high bits of a hash into the low bits. */
+#define FNV_OFFSET_BASIS 14695981039346656037UL /** 64 bit FNV-1a offset basis. */
+#define FNV_PRIME 1099511628211UL               /** 64 bit FNV-1a prime. */
+
+/**
+ * cached_databases
+ * <p>
+ * List the databases whose records are cached, in the order of their generation counters in shared memory.
+ * </p>
+ * @param so the server object
+ * @param databases memory in which to store pointers to the databases
+ */
+static void cached_databases(struct server_object *so, struct database **databases);
+
+/**
+ * hash_id
+ * <p>
+ * Get the bucket of an ID.
+ * </p>
+ * @param id the ID
+ * @return the bucket
+ */
+static size_t hash_id(int id);
+
+/**
+ * hash_name
+ * <p>
+ * Get the bucket of a name.
+ * </p>
+ * @param name the name, without a null terminator
+ * @return the bucket
+ */
+static size_t hash_name(const datum *name);
+
+/**
+ * generation_of
+ * <p>
+ * Get the generation counter of an ID.
+ * </p>
+ * @param shared the generation counters of the database
+ * @param id the ID
+ * @return the counter
+ */
+static atomic_ulong *generation_of(struct object_generations *shared, int id);
+
+/**
+ * entry_name
+ * <p>
+ * Get the name of the record in an entry.
+ * </p>
+ * @param entry the entry
+ * @return the name, without a null terminator
+ */
+static datum entry_name(struct object_cache_entry *entry);
+
+/**
+ * find_entry_by_id
+ * <p>
+ * Find the entry holding the record with an ID, whether or not it is current.
+ * </p>
+ * @param cache the cache
+ * @param id the ID
+ * @return the entry, or OBJECT_CACHE_NONE if there is none
+ */
+static int find_entry_by_id(const struct object_cache *cache, int id);
+
+/**
+ * find_entry_by_name
+ * <p>
+ * Find an entry holding a record with a name, whether or not it is current.
+ * </p>
+ * @param cache the cache
+ * @param name the name, without a null terminator
+ * @return the entry, or OBJECT_CACHE_NONE if there is none
+ */
+static int find_entry_by_name(struct object_cache *cache, const datum *name);
+
+/**
+ * is_current
+ * <p>
+ * Check whether the record in an entry has not been written since it was read.
+ * </p>
+ * @param cache the cache
+ * @param entry the entry
+ * @return 1 if it has not, 0 if it has
+ */
+static int is_current(const struct object_cache *cache, int entry);
+
+/**
+ * use_entry
+ * <p>
+ * Count a hit on an entry, make it the most recently used entry, and copy its record out if required.
+ * </p>
+ * @param co the core object
+ * @param cache the cache
+ * @param entry the entry
+ * @param serial_buffer memory in which to store a new copy of the record, or NULL if no copy is needed
+ * @return 0 on success, -1 and set err on failure
+ */
+static int use_entry(struct core_object *co, struct object_cache *cache, int entry, uint8_t **serial_buffer);
+
+/**
+ * cache_record
+ * <p>
+ * Copy a record into the cache, replacing any entry for its ID and evicting the least recently used entry if the
+ * cache is full. Records too large for an entry are not cached.
+ * </p>
+ * @param cache the cache
+ * @param id the ID of the record
+ * @param generation the generation of the ID before the record was read
+ * @param record the record
+ */
+static void cache_record(struct object_cache *cache, int id, unsigned long generation, const datum *record);
+
+/**
+ * unlink_lru
+ * <p>
+ * Take an entry out of the recency list.
+ * </p>
+ * @param cache the cache
+ * @param entry the entry
+ */
+static void unlink_lru(struct object_cache *cache, int entry);
+
+/**
+ * push_lru
+ * <p>
+ * Put an entry at the head of the recency list, as the most recently used entry.
+ * </p>
+ * @param cache the cache
+ * @param entry the entry
+ */
+static void push_lru(struct object_cache *cache, int entry);
+
+/**
+ * drop_entry
+ * <p>
+ * Take an entry out of the hash tables and the recency list, and free it.
+ * </p>
+ * @param cache the cache
+ * @param entry the entry
+ */
+static void drop_entry(struct object_cache *cache, int entry);
+
+/**
+ * unlink_chain
+ * <p>
+ * Take an entry out of a hash chain.
+ * </p>
+ * @param cache the cache
+ * @param head the head of the chain
+ * @param by_id whether the chain is an ID chain rather than a name chain
+ * @param entry the entry
+ */
+static void unlink_chain(struct object_cache *cache, int *head, int by_id, int entry);
+
+/**
+ * next_in_chain
+ * <p>
+ * Get a pointer to the link to the entry after an entry in its ID chain or its name chain.
+ * </p>
+ * @param cache the cache
+ * @param by_id whether to follow the ID chain rather than the name chain
+ * @param entry the entry
+ * @return the link
+ */
+static int *next_in_chain(struct object_cache *cache, int by_id, int entry);
+
+int open_object_caches(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database     *databases[NUM_CACHED_DATABASES];
+    struct object_cache *cache;
+    
+    so->object_generations = map_shared_memory(co, OBJECT_CACHE_SHM_NAME,
+                                               NUM_CACHED_DATABASES * sizeof(struct object_generations));
+    if (!so->object_generations)
+    {
+        return -1;
+    }
+    
+    cached_databases(so, databases);
+    for (size_t d = 0; d < NUM_CACHED_DATABASES; ++d)
+    {
+        cache = (struct object_cache *) mm_malloc(sizeof(struct object_cache), co->mm);
+        if (!cache)
+        {
+            SET_ERROR(co->err);
+            return -1;
+        }
+        cache->shared     = &so->object_generations[d];
+        cache->stats      = &so->object_generations[d].stats[OBJECT_CACHE_PARENT_SLOT];
+        cache->lru_head   = OBJECT_CACHE_NONE;
+        cache->lru_tail   = OBJECT_CACHE_NONE;
+        cache->free_entry = 0;
+        for (size_t b = 0; b < OBJECT_CACHE_BUCKETS; ++b)
+        {
+            cache->id_buckets[b]   = OBJECT_CACHE_NONE;
+            cache->name_buckets[b] = OBJECT_CACHE_NONE;
+        }
+        for (size_t e = 0; e < OBJECT_CACHE_ENTRIES; ++e)
+        {
+            cache->entries[e].lru_next = e + 1 < OBJECT_CACHE_ENTRIES ? (int) (e + 1) : OBJECT_CACHE_NONE;
+        }
+        databases[d]->object_cache = cache;
+    }
+    
+    return 0;
+}
+
+void close_object_caches(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[NUM_CACHED_DATABASES];
+    
+    cached_databases(so, databases);
+    for (size_t d = 0; d < NUM_CACHED_DATABASES; ++d)
+    {
+        if (databases[d]->object_cache)
+        {
+            mm_free(co->mm, databases[d]->object_cache);
+            databases[d]->object_cache = NULL;
+        }
+    }
+    if (so->object_generations)
+    {
+        munmap(so->object_generations, NUM_CACHED_DATABASES * sizeof(struct object_generations));
+        so->object_generations = NULL;
+    }
+}
+
+void attach_object_caches(struct server_object *so, size_t worker)
+{
+    struct database *databases[NUM_CACHED_DATABASES];
+    
+    cached_databases(so, databases);
+    for (size_t d = 0; d < NUM_CACHED_DATABASES; ++d)
+    {
+        if (databases[d]->object_cache)
+        {
+            databases[d]->object_cache->stats = &so->object_generations[d].stats[worker];
+        }
+    }
+}
+
+void print_object_cache_stats(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database           *databases[NUM_CACHED_DATABASES];
+    struct object_cache_stats *stats;
+    unsigned long             hits;
+    unsigned long             misses;
+    unsigned long             evictions;
+    
+    if (!so->object_generations)
+    {
+        return;
+    }
+    
+    cached_databases(so, databases);
+    for (size_t d = 0; d < NUM_CACHED_DATABASES; ++d)
+    {
+        hits      = 0;
+        misses    = 0;
+        evictions = 0;
+        for (size_t s = 0; s <= OBJECT_CACHE_PARENT_SLOT; ++s)
+        {
+            stats = &so->object_generations[d].stats[s];
+            hits      += atomic_load_explicit(&stats->hits, memory_order_relaxed);
+            misses    += atomic_load_explicit(&stats->misses, memory_order_relaxed);
+            evictions += atomic_load_explicit(&stats->evictions, memory_order_relaxed);
+        }
+        (void) fprintf(stdout, "Object cache %s: %lu hits, %lu misses, %lu evictions\n", databases[d]->name, hits,
+                       misses, evictions);
+    }
+}
+
+int object_cache_fetch(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct object_cache *cache;
+    unsigned long       generation;
+    datum               record;
+    size_t              size;
+    int                 id;
+    int                 entry;
+    int                 ret_val;
+    
+    if ((size_t) key->dsize != sizeof(id))
+    {
+        return db->engine->fetch(co, db, key, serial_buffer, NULL);
+    }
+    
+    cache = db->object_cache;
+    memcpy(&id, key->dptr, sizeof(id));
+    generation = atomic_load(generation_of(cache->shared, id));
+    entry      = find_entry_by_id(cache, id);
+    if (entry != OBJECT_CACHE_NONE)
+    {
+        if (cache->entries[entry].generation == generation)
+        {
+            return use_entry(co, cache, entry, serial_buffer);
+        }
+        drop_entry(cache, entry);
+    }
+    
+    // The generation was read before the record, so a write which lands in between leaves the copy already stale.
+    atomic_fetch_add_explicit(&cache->stats->misses, 1, memory_order_relaxed);
+    ret_val = db->engine->fetch(co, db, key, serial_buffer, &size);
+    if (ret_val == 0)
+    {
+        record.dptr  = (void *) *serial_buffer;
+        record.dsize = (int) size;
+        cache_record(cache, id, generation, &record);
+    }
+    
+    return ret_val;
+}
+
+int object_cache_find_by_name(struct core_object *co, struct database *db, uint8_t **serial_object, const char *name)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct object_cache *cache;
+    unsigned long       writes;
+    unsigned long       generation;
+    char                name_buffer[NAME_MAX_SIZE + 1];
+    datum               name_key;
+    datum               record;
+    size_t              size;
+    int                 id;
+    int                 entry;
+    int                 ret_val;
+    
+    cache = db->object_cache;
+    entry = name_to_key(name, name_buffer, &name_key) ? find_entry_by_name(cache, &name_key) : OBJECT_CACHE_NONE;
+    if (entry != OBJECT_CACHE_NONE)
+    {
+        // A current entry still holds the name, so no other record can have taken it.
+        if (is_current(cache, entry))
+        {
+            return use_entry(co, cache, entry, serial_object) == -1 ? -1 : 1;
+        }
+        drop_entry(cache, entry);
+    }
+    
+    atomic_fetch_add_explicit(&cache->stats->misses, 1, memory_order_relaxed);
+    writes  = atomic_load(&cache->shared->writes);
+    ret_val = db->engine->find_by_name(co, db, serial_object, &size, name);
+    if (ret_val == 1 && serial_object && size >= sizeof(id))
+    {
+        // The ID is only known from the record, so its generation is read afterwards. If no write landed since before
+        // the record was read, the generation read now is the one the record was read at.
+        memcpy(&id, *serial_object, sizeof(id));
+        generation = atomic_load(generation_of(cache->shared, id));
+        if (atomic_load(&cache->shared->writes) == writes)
+        {
+            record.dptr  = (void *) *serial_object;
+            record.dsize = (int) size;
+            cache_record(cache, id, generation, &record);
+        }
+    }
+    
+    return ret_val;
+}
+
+void object_cache_invalidate(struct database *db, const datum *key)
+{
+    int id;
+    
+    if (!db->object_cache || (size_t) key->dsize != sizeof(id))
+    {
+        return;
+    }
+    
+    memcpy(&id, key->dptr, sizeof(id));
+    atomic_fetch_add(&db->object_cache->shared->writes, 1);
+    atomic_fetch_add(generation_of(db->object_cache->shared, id), 1);
+}
+
+unsigned long object_cache_writes(const struct database *db)
+{
+    return atomic_load(&db->object_cache->shared->writes);
+}
+
+unsigned long object_cache_generation(const struct database *db, int id)
+{
+    return atomic_load(generation_of(db->object_cache->shared, id));
+}
+
+static void cached_databases(struct server_object *so, struct database **databases)
+{
+    databases[0] = &so->user_db;
+    databases[1] = &so->channel_db;
+}
+
+static size_t hash_id(int id)
+{
+    uint32_t hash;
+    
+    hash = (uint32_t) id * HASH_MULTIPLIER;
+    
+    return (hash ^ (hash >> HASH_SHIFT)) & (OBJECT_CACHE_BUCKETS - 1);
+}
+
+static size_t hash_name(const datum *name)
+{
+    const uint8_t *bytes;
+    uint64_t      hash;
+    
+    bytes = (const uint8_t *) name->dptr;
+    hash  = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < (size_t) name->dsize; ++i)
+    {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    
+    return hash & (OBJECT_CACHE_BUCKETS - 1);
+}
+
+static atomic_ulong *generation_of(struct object_generations *shared, int id)
+{
+    return &shared->counters[(unsigned int) id & (OBJECT_CACHE_GENERATIONS - 1)];
+}
+
+static datum entry_name(struct object_cache_entry *entry)
+{
+    datum record;
+    
+    record.dptr  = entry->record;
+    record.dsize = (int) entry->size;
+    
+    return record_name(&record);
+}
+
+static int find_entry_by_id(const struct object_cache *cache, int id)
+{
+    int entry;
+    
+    for (entry = cache->id_buckets[hash_id(id)]; entry != OBJECT_CACHE_NONE; entry = cache->entries[entry].id_next)
+    {
+        if (cache->entries[entry].id == id)
+        {
+            break;
+        }
+    }
+    
+    return entry;
+}
+
+static int find_entry_by_name(struct object_cache *cache, const datum *name)
+{
+    datum candidate;
+    int   entry;
+    
+    for (entry = cache->name_buckets[hash_name(name)]; entry != OBJECT_CACHE_NONE;
+         entry = cache->entries[entry].name_next)
+    {
+        candidate = entry_name(&cache->entries[entry]);
+        if (candidate.dsize == name->dsize && memcmp(candidate.dptr, name->dptr, (size_t) name->dsize) == 0)
+        {
+            break;
+        }
+    }
+    
+    return entry;
+}
+
+static int is_current(const struct object_cache *cache, int entry)
+{
+    return atomic_load(generation_of(cache->shared, cache->entries[entry].id)) == cache->entries[entry].generation;
+}
+
+static int use_entry(struct core_object *co, struct object_cache *cache, int entry, uint8_t **serial_buffer)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    datum record;
+    
+    atomic_fetch_add_explicit(&cache->stats->hits, 1, memory_order_relaxed);
+    unlink_lru(cache, entry);
+    push_lru(cache, entry);
+    
+    if (!serial_buffer)
+    {
+        return 0;
+    }
+    record.dptr  = (void *) cache->entries[entry].record;
+    record.dsize = (int) cache->entries[entry].size;
+    
+    return copy_dptr_to_buffer(co, serial_buffer, &record);
+}
+
+static void cache_record(struct object_cache *cache, int id, unsigned long generation, const datum *record)
+{
+    struct object_cache_entry *slot;
+    datum                     name;
+    size_t                    bucket;
+    int                       entry;
+    
+    if ((size_t) record->dsize > OBJECT_CACHE_RECORD_MAX)
+    {
+        return;
+    }
+    
+    entry = find_entry_by_id(cache, id);
+    if (entry != OBJECT_CACHE_NONE)
+    {
+        drop_entry(cache, entry);
+    }
+    if (cache->free_entry == OBJECT_CACHE_NONE)
+    {
+        drop_entry(cache, cache->lru_tail);
+        atomic_fetch_add_explicit(&cache->stats->evictions, 1, memory_order_relaxed);
+    }
+    entry             = cache->free_entry;
+    slot              = &cache->entries[entry];
+    cache->free_entry = slot->lru_next;
+    
+    slot->generation = generation;
+    slot->id         = id;
+    slot->size       = (size_t) record->dsize;
+    memcpy(slot->record, record->dptr, slot->size);
+    
+    bucket                    = hash_id(id);
+    slot->id_next             = cache->id_buckets[bucket];
+    cache->id_buckets[bucket] = entry;
+    
+    name                        = entry_name(slot);
+    bucket                      = hash_name(&name);
+    slot->name_next             = cache->name_buckets[bucket];
+    cache->name_buckets[bucket] = entry;
+    
+    push_lru(cache, entry);
+}
+
+static void unlink_lru(struct object_cache *cache, int entry)
+{
+    struct object_cache_entry *slot;
+    
+    slot = &cache->entries[entry];
+    if (slot->lru_prev != OBJECT_CACHE_NONE)
+    {
+        cache->entries[slot->lru_prev].lru_next = slot->lru_next;
+    } else
+    {
+        cache->lru_head = slot->lru_next;
+    }
+    if (slot->lru_next != OBJECT_CACHE_NONE)
+    {
+        cache->entries[slot->lru_next].lru_prev = slot->lru_prev;
+    } else
+    {
+        cache->lru_tail = slot->lru_prev;
+    }
+}
+
+static void push_lru(struct object_cache *cache, int entry)
+{
+    cache->entries[entry].lru_prev = OBJECT_CACHE_NONE;
+    cache->entries[entry].lru_next = cache->lru_head;
+    if (cache->lru_head != OBJECT_CACHE_NONE)
+    {
+        cache->entries[cache->lru_head].lru_prev = entry;
+    } else
+    {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+static void drop_entry(struct object_cache *cache, int entry)
+{
+    datum name;
+    
+    name = entry_name(&cache->entries[entry]);
+    unlink_chain(cache, &cache->id_buckets[hash_id(cache->entries[entry].id)], 1, entry);
+    unlink_chain(cache, &cache->name_buckets[hash_name(&name)], 0, entry);
+    unlink_lru(cache, entry);
+    cache->entries[entry].lru_next = cache->free_entry;
+    cache->free_entry              = entry;
+}
+
+static void unlink_chain(struct object_cache *cache, int *head, int by_id, int entry)
+{
+    int *link;
+    
+    link = head;
+    while (*link != entry)
+    {
+        link = next_in_chain(cache, by_id, *link);
+    }
+    *link = *next_in_chain(cache, by_id, entry);
+}
+
+static int *next_in_chain(struct object_cache *cache, int by_id, int entry)
+{
+    return by_id ? &cache->entries[entry].id_next : &cache->entries[entry].name_next;
+}
@@ -1,240 +1,732 @@
 #include "../../include/error-handlers.h"
 #include "../../include/manager.h"
+#include "../include/id-list.h"
 #include "../include/object-util.h"
 
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 
+/**
+ * Codec steps, generated from the object schemas in objects.h. Each expands one field of a schema within a function
+ * holding the object in object and the record in record, and, while encoding, the size of the record in size and the
+ * offset of the next string or list in byte_offset.
+ */
+#define SIZE_FIELD(kind, type, name) SIZE_##kind(name)
+#define SIZE_ID(name)
+#define SIZE_STRING(name) size += strlen(object->name) + 1;
+#define SIZE_INT(name)
+#define SIZE_TIME(name)
+#define SIZE_IDS(name) size = record_size(size) + ids_size(object->name, object->name##_count);
+
+// The fixed part is filled in a copy of it and then copied into the bytes, which are never written through its struct.
+#define ENCODE_FIELD(kind, type, name) ENCODE_##kind(name)
+#define ENCODE_ID(name) record.header.id = object->name;
+#define ENCODE_STRING(name) put_string(bytes, &byte_offset, &record.name, object->name);
+#define ENCODE_INT(name) record.name = (int32_t) object->name;
+#define ENCODE_TIME(name) record.name = (int64_t) object->name;
+#define ENCODE_IDS(name) put_ids(bytes, &byte_offset, &record.name, object->name, object->name##_count);
+
+// A field of the patch replaces that of the source if it is set; an ID list which is kept is copied still encoded.
+// Only Channels are patched, so only the kinds of field a Channel has are defined.
+#define PATCHED_STRING(name) (patch->name ? patch->name : record_string(source, &source->name))
+#define PATCH_SIZE_FIELD(kind, type, name) PATCH_SIZE_##kind(name)
+#define PATCH_SIZE_ID(name)
+#define PATCH_SIZE_STRING(name) size += strlen(PATCHED_STRING(name)) + 1;
+#define PATCH_SIZE_IDS(name) \
+    size = record_size(size) + (patch->name ? ids_size(patch->name, patch->name##_count) : source->name.size);
+
+#define PATCH_FIELD(kind, type, name) PATCH_##kind(name)
+#define PATCH_ID(name) record.header.id = source->header.id;
+#define PATCH_STRING(name) put_string(bytes, &byte_offset, &record.name, PATCHED_STRING(name));
+#define PATCH_IDS(name)                                                               \
+    if (patch->name)                                                                  \
+    {                                                                                 \
+        put_ids(bytes, &byte_offset, &record.name, patch->name, patch->name##_count); \
+    } else                                                                            \
+    {                                                                                 \
+        copy_encoded_ids(bytes, &byte_offset, &record.name, source, &source->name);   \
+    }
+
+#define CLEAR_FIELD(kind, type, name) CLEAR_##kind(name)
+#define CLEAR_ID(name)
+#define CLEAR_STRING(name) object->name = NULL;
+#define CLEAR_INT(name)
+#define CLEAR_TIME(name)
+#define CLEAR_IDS(name) object->name = NULL; object->name##_count = 0;
+
+#define DECODE_FIELD(kind, type, name) DECODE_##kind(type, name)
+#define DECODE_ID(type, name) object->name = record->header.id;
+#define DECODE_STRING(type, name) \
+    object->name = mm_strdup(record_string(record, &record->name), co->mm); failed |= !object->name;
+#define DECODE_INT(type, name) object->name = (type) record->name;
+#define DECODE_TIME(type, name) object->name = (type) record->name;
+#define DECODE_IDS(type, name) \
+    failed |= copy_ids(co, record, &record->name, &object->name, &object->name##_count) == -1;
+
+#define FREE_FIELD(kind, type, name) FREE_##kind(name)
+#define FREE_ID(name)
+#define FREE_STRING(name) if (object->name) { mm_free(co->mm, object->name); }
+#define FREE_INT(name)
+#define FREE_TIME(name)
+#define FREE_IDS(name) if (object->name) { mm_free(co->mm, object->name); }
+
+#define WIRE_FIELD(kind, type, name)                                                                          \
+    length += (size_t) snprintf(length < size ? buffer + length : NULL, length < size ? size - length : 0, \
+                                WIRE_FORMAT_##kind "\x03", (WIRE_TYPE_##kind) object->name);
+
+/**
+ * Checks at compile time that the strings of a schema come first, so that the members locating them in a record form
+ * the table of strings which view_record reads after the header, and every other member follows the table.
+ */
+#define STRINGS_END(strings) (sizeof(struct record_header) + (strings) * sizeof(struct record_field))
+#define STRING_FIRST_ID(record, strings, name)
+#define STRING_FIRST_STRING(record, strings, name) \
+    static_assert(offsetof(struct record, name) < STRINGS_END(strings), "The strings of a schema must come first");
+#define STRING_FIRST_INT(record, strings, name) \
+    static_assert(offsetof(struct record, name) >= STRINGS_END(strings), "The strings of a schema must come first");
+#define STRING_FIRST_TIME(record, strings, name) STRING_FIRST_INT(record, strings, name)
+#define STRING_FIRST_IDS(record, strings, name) STRING_FIRST_INT(record, strings, name)
+#define USER_STRING_FIRST(kind, type, name) STRING_FIRST_##kind(user_record, USER_RECORD_STRINGS, name)
+#define CHANNEL_STRING_FIRST(kind, type, name) STRING_FIRST_##kind(channel_record, CHANNEL_RECORD_STRINGS, name)
+#define MESSAGE_STRING_FIRST(kind, type, name) STRING_FIRST_##kind(message_record, MESSAGE_RECORD_STRINGS, name)
+#define AUTH_STRING_FIRST(kind, type, name) STRING_FIRST_##kind(auth_record, AUTH_RECORD_STRINGS, name)
+
+USER_SCHEMA(USER_STRING_FIRST)
+CHANNEL_SCHEMA(CHANNEL_STRING_FIRST)
+MESSAGE_SCHEMA(MESSAGE_STRING_FIRST)
+AUTH_SCHEMA(AUTH_STRING_FIRST)
+
+/**
+ * record_size
+ * <p>
+ * Get the size of a record, padded to a multiple of RECORD_ALIGNMENT bytes.
+ * </p>
+ * @param size the size of the fixed part and the fields
+ * @return the padded size
+ */
+static size_t record_size(size_t size);
+
+/**
+ * ids_size
+ * <p>
+ * Get the size of a list of IDs once encoded.
+ * </p>
+ * @param ids the IDs, sorted and without duplicates
+ * @param count the number of IDs
+ * @return the size in bytes
+ */
+static size_t ids_size(const int *ids, size_t count);
+
+/**
+ * allocate_record
+ * <p>
+ * Allocate a zeroed record and fill in its header, but for the ID.
+ * </p>
+ * @param co the core object
+ * @param field_count the number of strings
+ * @param size the size of the record, as given by record_size
+ * @return the record on success, NULL and set err on failure
+ */
+static uint8_t *allocate_record(struct core_object *co, uint16_t field_count, size_t size);
+
+/**
+ * put_string
+ * <p>
+ * Copy a string into a record and locate it in a field.
+ * </p>
+ * @param record the record
+ * @param byte_offset the offset at which to copy the string, moved past it
+ * @param field the field
+ * @param string the string
+ */
+static void put_string(uint8_t *record, size_t *byte_offset, struct record_field *field, const char *string);
+
+/**
+ * put_ids
+ * <p>
+ * Encode a list of IDs into a record, at the next multiple of RECORD_ALIGNMENT bytes, and locate it.
+ * </p>
+ * @param record the record
+ * @param byte_offset the offset after which to encode the list, moved past it
+ * @param location the location of the list
+ * @param ids the IDs, sorted and without duplicates
+ * @param count the number of IDs
+ */
+static void put_ids(uint8_t *record, size_t *byte_offset, struct record_ids *location, const int *ids, size_t count);
+
+/**
+ * copy_encoded_ids
+ * <p>
+ * Copy an encoded list of IDs from another record, at the next multiple of RECORD_ALIGNMENT bytes, and locate it.
+ * </p>
+ * @param record the record
+ * @param byte_offset the offset after which to copy the list, moved past it
+ * @param location the location of the list
+ * @param source the record holding the list, through the view of its kind
+ * @param ids the list in that record
+ */
+static void copy_encoded_ids(uint8_t *record, size_t *byte_offset, struct record_ids *location, const void *source,
+                             const struct record_ids *ids);
+
+/**
+ * ids_fit
+ * <p>
+ * Check that a list of IDs lies within a record, after its fixed part, and is well formed.
+ * </p>
+ * @param record the record
+ * @param ids the list
+ * @param fixed_size the size of the fixed part of the record
+ * @return 1 if it does, 0 if not
+ */
+static int ids_fit(const void *record, const struct record_ids *ids, size_t fixed_size);
+
+/**
+ * copy_ids
+ * <p>
+ * Decode a list of IDs of a viewed record into a new array.
+ * </p>
+ * @param co the core object
+ * @param record the record, through the view of its kind
+ * @param location the list
+ * @param ids memory in which to store the array, or NULL if the list is empty
+ * @param count memory in which to store the number of IDs
+ * @return 0 on success, -1 on failure
+ */
+static int copy_ids(struct core_object *co, const void *record, const struct record_ids *location, int **ids,
+                    size_t *count);
+
+/**
+ * malformed
+ * <p>
+ * Record that a serialized record is malformed.
+ * </p>
+ * @param co the core object
+ * @return -1
+ */
+static int malformed(struct core_object *co);
+
 unsigned long serialize_user(struct core_object *co, uint8_t **serial_user, const User *user)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    unsigned long serial_user_size;
+    const User         *object;
+    struct user_record record;
+    uint8_t            *bytes;
+    size_t             size;
+    size_t             byte_offset;
     
-    serial_user_size = sizeof(user->id)
-                       + strlen(user->display_name) + 1
-                       + sizeof(user->privilege_level)
-                       + sizeof(user->online_status);
+    object = user;
+    size   = sizeof(struct user_record);
+    USER_SCHEMA(SIZE_FIELD)
+    size = record_size(size);
     
-    *serial_user = mm_malloc(serial_user_size, co->mm);
-    if (!*serial_user)
+    bytes = allocate_record(co, USER_RECORD_STRINGS, size);
+    if (!bytes)
     {
-        SET_ERROR(co->err);
         return 0;
     }
     
-    size_t byte_offset;
+    memcpy(&record, bytes, sizeof(record));
+    byte_offset = sizeof(struct user_record);
+    USER_SCHEMA(ENCODE_FIELD)
+    memcpy(bytes, &record, sizeof(record));
+    *serial_user = bytes;
     
-    memcpy(*serial_user, &user->id, sizeof(user->id));
-    byte_offset = sizeof(user->id);
-    memcpy((*serial_user + byte_offset), user->display_name, strlen(user->display_name) + 1);
-    byte_offset += strlen(user->display_name) + 1;
-    memcpy((*serial_user + byte_offset), &user->privilege_level, sizeof(user->privilege_level));
-    byte_offset += sizeof(user->privilege_level);
-    memcpy((*serial_user + byte_offset), &user->online_status, sizeof(user->online_status));
-    
-    return serial_user_size;
+    return size;
 }
 
 unsigned long serialize_channel(struct core_object *co, uint8_t **serial_channel, const Channel *channel)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    unsigned long serial_channel_size;
+    const Channel         *object;
+    struct channel_record record;
+    uint8_t               *bytes;
+    size_t                size;
+    size_t                byte_offset;
     
-    serial_channel_size = sizeof(channel->id)
-                          + strlen(channel->channel_name) + 1
-                          + strlen(channel->creator) + 1
-                          + sizeof(channel->users_count)
-                          + channel->users_size_bytes
-                          + sizeof(channel->administrators_count)
-                          + channel->administrators_size_bytes
-                          + sizeof(channel->banned_users_count)
-                          + channel->banned_users_size_bytes;
+    object = channel;
+    size   = sizeof(struct channel_record);
+    CHANNEL_SCHEMA(SIZE_FIELD)
+    size = record_size(size);
     
-    *serial_channel = mm_malloc(serial_channel_size, co->mm);
-    if (!*serial_channel)
+    bytes = allocate_record(co, CHANNEL_RECORD_STRINGS, size);
+    if (!bytes)
     {
-        SET_ERROR(co->err);
-        return -1;
+        return 0;
     }
     
-    size_t byte_offset;
-    memcpy(*serial_channel, &channel->id, sizeof(channel->id));
-    byte_offset = sizeof(channel->id);
-    memcpy((*serial_channel + byte_offset), channel->channel_name, strlen(channel->channel_name) + 1);
-    byte_offset += strlen(channel->channel_name) + 1;
-    memcpy((*serial_channel + byte_offset), channel->creator, strlen(channel->creator) + 1);
-    byte_offset += strlen(channel->creator) + 1;
+    memcpy(&record, bytes, sizeof(record));
+    byte_offset = sizeof(struct channel_record);
+    CHANNEL_SCHEMA(ENCODE_FIELD)
+    memcpy(bytes, &record, sizeof(record));
+    *serial_channel = bytes;
     
-    memcpy((*serial_channel + byte_offset), &channel->users_count, sizeof(channel->users_count));
-    byte_offset += sizeof(channel->users_count);
-    for (const char **list = channel->users; list && *list != NULL; ++list)
-    {
-        memcpy((*serial_channel + byte_offset), *list, strlen(*list) + 1);
-        byte_offset += strlen(*list) + 1;
-    }
+    return size;
+}
+
+unsigned long serialize_message(struct core_object *co, uint8_t **serial_message, const Message *message)
+{
+    PRINT_STACK_TRACE(co->tracer);
     
-    memcpy((*serial_channel + byte_offset), &channel->administrators_count, sizeof(channel->administrators_count));
-    byte_offset += sizeof(channel->administrators_count);
-    for (const char **list = channel->administrators; list && *list != NULL; ++list)
+    const Message         *object;
+    struct message_record record;
+    uint8_t               *bytes;
+    size_t                size;
+    size_t                byte_offset;
+    
+    object = message;
+    size   = sizeof(struct message_record);
+    MESSAGE_SCHEMA(SIZE_FIELD)
+    size = record_size(size);
+    
+    bytes = allocate_record(co, MESSAGE_RECORD_STRINGS, size);
+    if (!bytes)
     {
-        memcpy((*serial_channel + byte_offset), *list, strlen(*list) + 1);
-        byte_offset += strlen(*list) + 1;
+        return 0;
     }
     
-    memcpy((*serial_channel + byte_offset), &channel->banned_users_count, sizeof(channel->banned_users_count));
-    byte_offset += sizeof(channel->banned_users_count);
-    for (const char **list = channel->banned_users; list && *list != NULL; ++list)
+    memcpy(&record, bytes, sizeof(record));
+    byte_offset = sizeof(struct message_record);
+    MESSAGE_SCHEMA(ENCODE_FIELD)
+    memcpy(bytes, &record, sizeof(record));
+    *serial_message = bytes;
+    
+    return size;
+}
+
+unsigned long serialize_auth(struct core_object *co, uint8_t **serial_auth, const Auth *auth)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const Auth         *object;
+    struct auth_record record;
+    uint8_t            *bytes;
+    size_t             size;
+    size_t             byte_offset;
+    
+    object = auth;
+    size   = sizeof(struct auth_record);
+    AUTH_SCHEMA(SIZE_FIELD)
+    size = record_size(size);
+    
+    bytes = allocate_record(co, AUTH_RECORD_STRINGS, size);
+    if (!bytes)
     {
-        memcpy((*serial_channel + byte_offset), *list, strlen(*list) + 1);
-        byte_offset += strlen(*list) + 1;
+        return 0;
     }
     
-    return serial_channel_size;
+    memcpy(&record, bytes, sizeof(record));
+    byte_offset = sizeof(struct auth_record);
+    AUTH_SCHEMA(ENCODE_FIELD)
+    memcpy(bytes, &record, sizeof(record));
+    *serial_auth = bytes;
+    
+    return size;
 }
 
-unsigned long serialize_message(struct core_object *co, uint8_t **serial_message, const Message *message)
+unsigned long patch_channel(struct core_object *co, uint8_t **serial_channel, const struct channel_record *source,
+                            const Channel *patch)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    unsigned long serial_message_size;
+    struct channel_record record;
+    uint8_t               *bytes;
+    size_t                size;
+    size_t                byte_offset;
     
-    serial_message_size = sizeof(message->id)
-                          + sizeof(message->user_id)
-                          + sizeof(message->channel_id)
-                          + strlen(message->message_content) + 1
-                          + sizeof(message->timestamp);
+    size = sizeof(struct channel_record);
+    CHANNEL_SCHEMA(PATCH_SIZE_FIELD)
+    size = record_size(size);
     
-    *serial_message = mm_malloc(serial_message_size, co->mm);
-    if (!*serial_message)
+    bytes = allocate_record(co, CHANNEL_RECORD_STRINGS, size);
+    if (!bytes)
     {
-        SET_ERROR(co->err);
         return 0;
     }
     
-    size_t byte_offset;
+    memcpy(&record, bytes, sizeof(record));
+    byte_offset = sizeof(struct channel_record);
+    CHANNEL_SCHEMA(PATCH_FIELD)
+    memcpy(bytes, &record, sizeof(record));
+    *serial_channel = bytes;
+    
+    return size;
+}
+
+int deserialize_user(struct core_object *co, User **user_get, const uint8_t *serial_user)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct user_record *record;
+    User                     *object;
+    int                      failed;
     
-    memcpy(*serial_message, &message->id, sizeof(message->id));
-    byte_offset = sizeof(message->id);
-    memcpy((*serial_message + byte_offset), &message->user_id, sizeof(message->user_id));
-    byte_offset += sizeof(message->user_id);
-    memcpy((*serial_message + byte_offset), &message->channel_id, sizeof(message->channel_id));
-    byte_offset += sizeof(message->channel_id);
-    memcpy((*serial_message + byte_offset), message->message_content, strlen(message->message_content) + 1);
-    byte_offset += strlen(message->message_content) + 1;
-    memcpy((*serial_message + byte_offset), &message->timestamp, sizeof(message->timestamp));
+    object = *user_get;
+    failed = 0;
+    USER_SCHEMA(CLEAR_FIELD)
+    record = view_user(serial_user);
+    if (!record)
+    {
+        return malformed(co);
+    }
     
-    return serial_message_size;
+    USER_SCHEMA(DECODE_FIELD)
+    if (failed)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
 }
 
-unsigned long serialize_auth(struct core_object *co, uint8_t **serial_auth, const Auth *auth)
+int deserialize_channel(struct core_object *co, Channel **channel_get, const uint8_t *serial_channel)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    unsigned long serial_auth_size;
+    const struct channel_record *record;
+    Channel                     *object;
+    int                         failed;
     
-    serial_auth_size = sizeof(auth->user_id)
-                       + strlen(auth->login_token) + 1
-                       + strlen(auth->password) + 1;
+    object = *channel_get;
+    failed = 0;
+    CHANNEL_SCHEMA(CLEAR_FIELD)
+    record = view_channel(serial_channel);
+    if (!record)
+    {
+        return malformed(co);
+    }
     
-    *serial_auth = mm_malloc(sizeof(auth->user_id)
-                             * strlen(auth->login_token) + 1
-                             + strlen(auth->password) + 1, co->mm);
-    if (!*serial_auth)
+    CHANNEL_SCHEMA(DECODE_FIELD)
+    if (failed)
     {
         SET_ERROR(co->err);
-        return 0;
+        return -1;
     }
     
-    size_t byte_offset;
+    return 0;
+}
+
+int deserialize_message(struct core_object *co, Message **message_get, const uint8_t *serial_message)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct message_record *record;
+    Message                     *object;
+    int                         failed;
     
-    memcpy(*serial_auth, &auth->user_id, sizeof(auth->user_id));
-    byte_offset = sizeof(auth->user_id);
-    memcpy((*serial_auth + byte_offset), auth->login_token, strlen(auth->login_token) + 1);
-    byte_offset += strlen(auth->login_token) + 1;
-    memcpy((*serial_auth + byte_offset), auth->password, strlen(auth->password) + 1);
+    object = *message_get;
+    failed = 0;
+    MESSAGE_SCHEMA(CLEAR_FIELD)
+    record = view_message(serial_message);
+    if (!record)
+    {
+        return malformed(co);
+    }
     
-    return serial_auth_size;
+    MESSAGE_SCHEMA(DECODE_FIELD)
+    if (failed)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
 }
 
-unsigned long serialize_addr_id_pair(struct core_object *co, uint8_t **addr_id_dst,
-                                     struct sockaddr_in *addr, int *user_id)
+int deserialize_auth(struct core_object *co, Auth **auth_get, const uint8_t *serial_auth)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    size_t addr_id_size;
+    const struct auth_record *record;
+    Auth                     *object;
+    int                      failed;
+    
+    object = *auth_get;
+    failed = 0;
+    AUTH_SCHEMA(CLEAR_FIELD)
+    record = view_auth(serial_auth);
+    if (!record)
+    {
+        return malformed(co);
+    }
     
-    (*addr_id_dst) = mm_malloc(SOCKET_ADDR_SIZE + sizeof(int), co->mm);
-    if (!(*addr_id_dst))
+    AUTH_SCHEMA(DECODE_FIELD)
+    if (failed)
     {
         SET_ERROR(co->err);
-        return 0;
+        return -1;
     }
     
-    memcpy((*addr_id_dst), &(*addr).sin_addr.s_addr, sizeof(in_addr_t));
-    addr_id_size = sizeof(in_addr_t);
-    memcpy((*addr_id_dst) + addr_id_size, &(*addr).sin_port, sizeof(in_port_t));
-    addr_id_size += sizeof(in_port_t);
-    memcpy((*addr_id_dst) + addr_id_size, user_id, sizeof(int));
-    addr_id_size += sizeof(int);
+    return 0;
+}
+
+const struct record_header *view_record(const void *record, uint16_t field_count, size_t fixed_size)
+{
+    const struct record_header *header;
+    const struct record_field  *fields;
+    const uint8_t              *bytes;
+    size_t                     fields_end;
+    
+    header     = record;
+    fields     = (const struct record_field *) (header + 1);
+    bytes      = record;
+    fields_end = sizeof(struct record_header) + (size_t) field_count * sizeof(struct record_field);
+    if (fixed_size < fields_end)
+    {
+        fixed_size = fields_end;
+    }
+    if (header->version != RECORD_VERSION || header->field_count != field_count || header->size < fixed_size)
+    {
+        return NULL;
+    }
     
-    return addr_id_size;
+    // Offsets and lengths are 32 bits wide, so their sum cannot overflow a 64 bit size_t.
+    for (uint16_t f = 0; f < field_count; ++f)
+    {
+        if (fields[f].offset < fixed_size || (size_t) fields[f].offset + fields[f].length >= header->size
+            || bytes[fields[f].offset + fields[f].length] != '\0')
+        {
+            return NULL;
+        }
+    }
+    
+    return header;
+}
+
+const uint8_t *datum_record(const datum *value)
+{
+    const struct record_header *header;
+    
+    if (!value->dptr || (size_t) value->dsize < sizeof(struct record_header))
+    {
+        return NULL;
+    }
+    header = (const struct record_header *) value->dptr;
+    if (header->size > (size_t) value->dsize)
+    {
+        return NULL;
+    }
+    
+    return (const uint8_t *) value->dptr;
+}
+
+const struct user_record *view_user(const void *serial_user)
+{
+    return (const struct user_record *) view_record(serial_user, USER_RECORD_STRINGS,
+                                                    sizeof(struct user_record));
+}
+
+const struct channel_record *view_channel(const void *serial_channel)
+{
+    const struct channel_record *record;
+    
+    record = (const struct channel_record *) view_record(serial_channel, CHANNEL_RECORD_STRINGS,
+                                                         sizeof(struct channel_record));
+    if (!record
+        || !ids_fit(record, &record->users, sizeof(struct channel_record))
+        || !ids_fit(record, &record->administrators, sizeof(struct channel_record))
+        || !ids_fit(record, &record->banned_users, sizeof(struct channel_record)))
+    {
+        return NULL;
+    }
+    
+    return record;
+}
+
+const struct message_record *view_message(const void *serial_message)
+{
+    return (const struct message_record *) view_record(serial_message, MESSAGE_RECORD_STRINGS,
+                                                       sizeof(struct message_record));
 }
 
-void deserialize_user(struct core_object *co, User **user_get, uint8_t *serial_user)
+const struct auth_record *view_auth(const void *serial_auth)
+{
+    return (const struct auth_record *) view_record(serial_auth, AUTH_RECORD_STRINGS,
+                                                    sizeof(struct auth_record));
+}
+
+const char *record_string(const void *record, const struct record_field *field)
+{
+    return (const char *) record + field->offset;
+}
+
+int record_has_id(const void *record, const struct record_ids *ids, int id)
+{
+    return id_list_contains((const uint8_t *) record + ids->offset, ids->size, ids->count,
+                            (enum id_list_container) ids->container, id);
+}
+
+size_t record_copy_ids(const void *record, const struct record_ids *ids, int *dst)
+{
+    return id_list_decode((const uint8_t *) record + ids->offset, ids->size, ids->count,
+                          (enum id_list_container) ids->container, dst);
+}
+
+void free_user(struct core_object *co, User *user)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    size_t byte_offset;
+    User *object;
     
-    memcpy(&(*user_get)->id, serial_user, sizeof((*user_get)->id));
-    byte_offset = sizeof((*user_get)->id);
-    (*user_get)->display_name = mm_strdup((char *) (serial_user + byte_offset), co->mm);
-    byte_offset += strlen((*user_get)->display_name);
-    memcpy(&(*user_get)->privilege_level, (serial_user + byte_offset), sizeof((*user_get)->privilege_level));
-    byte_offset += sizeof((*user_get)->privilege_level);
-    memcpy(&(*user_get)->online_status, (serial_user + byte_offset), sizeof((*user_get)->online_status));
+    object = user;
+    USER_SCHEMA(FREE_FIELD)
+    mm_free(co->mm, object);
 }
 
-void deserialize_auth(struct core_object *co, Auth **auth_get, uint8_t *serial_auth)
+void free_channel(struct core_object *co, Channel *channel)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    size_t byte_offset;
+    Channel *object;
     
-    memcpy(&(*auth_get)->user_id, serial_auth, sizeof((*auth_get)->user_id));
-    byte_offset = sizeof((*auth_get)->user_id);
-    (*auth_get)->login_token = mm_strdup((char *) (serial_auth + byte_offset), co->mm);
-    byte_offset += strlen((*auth_get)->login_token) + 1;
-    (*auth_get)->password = mm_strdup((char *) (serial_auth + byte_offset), co->mm);
+    object = channel;
+    CHANNEL_SCHEMA(FREE_FIELD)
+    mm_free(co->mm, object);
 }
 
-void deserialize_addr_id_pair(struct core_object *co, AddrIdPair **addr_id_pair_get, uint8_t *serial_addr_id)
+void free_message(struct core_object *co, Message *message)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    size_t byte_offset;
+    Message *object;
+    
+    object = message;
+    MESSAGE_SCHEMA(FREE_FIELD)
+    mm_free(co->mm, object);
+}
 
-    memcpy(&(*addr_id_pair_get)->socket_ip, serial_addr_id, sizeof(in_addr_t));
-    byte_offset = sizeof(in_addr_t);
-    memcpy(&(*addr_id_pair_get)->socket_port, serial_addr_id + byte_offset, sizeof(in_port_t));
-    byte_offset += sizeof(in_port_t);
-    memcpy(&(*addr_id_pair_get)->id, serial_addr_id + byte_offset, sizeof(int));
+void free_auth(struct core_object *co, Auth *auth)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    Auth *object;
+    
+    object = auth;
+    AUTH_SCHEMA(FREE_FIELD)
+    mm_free(co->mm, object);
 }
 
-void free_user(struct core_object *co, User *user)
+size_t format_user(char *buffer, size_t size, const User *user)
+{
+    const User *object;
+    size_t     length;
+    
+    object = user;
+    length = 0;
+    USER_SCHEMA(WIRE_FIELD)
+    
+    return length;
+}
+
+static size_t record_size(size_t size)
+{
+    return (size + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+}
+
+static size_t ids_size(const int *ids, size_t count)
+{
+    enum id_list_container container;
+    
+    return id_list_size(ids, count, &container);
+}
+
+static uint8_t *allocate_record(struct core_object *co, uint16_t field_count, size_t size)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    mm_free(co->mm, user->display_name);
-    mm_free(co->mm, user);
+    struct record_header *header;
+    
+    header = mm_calloc(1, size, co->mm);
+    if (!header)
+    {
+        SET_ERROR(co->err);
+        return NULL;
+    }
+    
+    header->version     = RECORD_VERSION;
+    header->field_count = field_count;
+    header->size        = (uint32_t) size;
+    
+    return (uint8_t *) header;
 }
 
-void free_auth(struct core_object *co, Auth *auth)
+static void put_string(uint8_t *record, size_t *byte_offset, struct record_field *field, const char *string)
+{
+    size_t length;
+    
+    length        = strlen(string);
+    field->offset = (uint32_t) *byte_offset;
+    field->length = (uint32_t) length;
+    memcpy(record + *byte_offset, string, length + 1);
+    *byte_offset += length + 1;
+}
+
+static void put_ids(uint8_t *record, size_t *byte_offset, struct record_ids *location, const int *ids, size_t count)
+{
+    enum id_list_container container;
+    
+    *byte_offset        = record_size(*byte_offset);
+    location->offset    = (uint32_t) *byte_offset;
+    location->size      = (uint32_t) id_list_size(ids, count, &container);
+    location->count     = (uint32_t) count;
+    location->container = container;
+    id_list_encode(record + *byte_offset, ids, count, container);
+    *byte_offset += location->size;
+}
+
+static void copy_encoded_ids(uint8_t *record, size_t *byte_offset, struct record_ids *location, const void *source,
+                             const struct record_ids *ids)
+{
+    *byte_offset     = record_size(*byte_offset);
+    *location        = *ids;
+    location->offset = (uint32_t) *byte_offset;
+    memcpy(record + *byte_offset, (const uint8_t *) source + ids->offset, ids->size);
+    *byte_offset += ids->size;
+}
+
+static int ids_fit(const void *record, const struct record_ids *ids, size_t fixed_size)
+{
+    const struct record_header *header;
+    
+    header = (const struct record_header *) record;
+    
+    return ids->offset >= fixed_size && ids->offset % RECORD_ALIGNMENT == 0
+           && (size_t) ids->offset + ids->size <= header->size
+           && id_list_check((const uint8_t *) record + ids->offset, ids->size, ids->count,
+                            (enum id_list_container) ids->container);
+}
+
+static int copy_ids(struct core_object *co, const void *record, const struct record_ids *location, int **ids,
+                    size_t *count)
 {
     PRINT_STACK_TRACE(co->tracer);
     
-    mm_free(co->mm, auth->login_token);
-    mm_free(co->mm, auth->password);
-    mm_free(co->mm, auth);
+    *ids   = NULL;
+    *count = 0;
+    if (location->count == 0)
+    {
+        return 0;
+    }
+    
+    *ids = mm_malloc(location->count * sizeof(int), co->mm);
+    if (!*ids)
+    {
+        return -1;
+    }
+    *count = record_copy_ids(record, location, *ids);
+    
+    return 0;
+}
+
+static int malformed(struct core_object *co)
+{
+    errno = EIO;
+    SET_ERROR(co->err);
+    
+    return -1;
 }
@@ -0,0 +1,195 @@
+#include "../../include/manager.h"
+#include "../include/presence.h"
+#include "../include/process-server-util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define PRESENCE_SHM_NAME "/pr_3fda69" /** Presence set shared memory name. */
+
+/**
+ * find_entry
+ * <p>
+ * Find the entry of a User in the presence set.
+ * </p>
+ * @param presence the presence set
+ * @param user_id the ID of the User
+ * @return the position of the entry, or -1 if the User is not online
+ */
+static long find_entry(const struct presence *presence, int user_id);
+
+/**
+ * build_body
+ * <p>
+ * Build the cached body of the Read-User Response listing the online Users.
+ * </p>
+ * @param presence the presence set
+ */
+static void build_body(struct presence *presence);
+
+int open_presence(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    so->presence = map_shared_memory(co, PRESENCE_SHM_NAME, sizeof(struct presence));
+    if (!so->presence)
+    {
+        return -1;
+    }
+    
+    memset(so->presence, 0, sizeof(struct presence));
+    
+    return rw_lock_init(co, &so->presence->lock);
+}
+
+void close_presence(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->presence)
+    {
+        munmap(so->presence, sizeof(struct presence));
+        so->presence = NULL;
+    }
+}
+
+int presence_add(struct core_object *co, struct server_object *so, const User *user)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct presence       *presence;
+    struct presence_entry *entry;
+    int                   added;
+    
+    if (rw_lock_write(co, &so->presence->lock) == -1)
+    {
+        return -1;
+    }
+    presence = so->presence;
+    
+    // Every online User holds a session, so the set has room for one more while a session is being started.
+    added = find_entry(presence, user->id) == -1 && presence->count < PRESENCE_CAPACITY;
+    if (added)
+    {
+        entry          = &presence->entries[presence->count++];
+        entry->user_id = user->id;
+        strncpy(entry->display_name, user->display_name, NAME_MAX_SIZE);
+        entry->display_name[NAME_MAX_SIZE] = '\0';
+        presence->body_valid               = 0;
+    }
+    rw_lock_unlock(&so->presence->lock);
+    
+    return added;
+}
+
+int presence_remove(struct core_object *co, struct server_object *so, int user_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct presence *presence;
+    long            position;
+    
+    if (rw_lock_write(co, &so->presence->lock) == -1)
+    {
+        return -1;
+    }
+    presence = so->presence;
+    
+    position = find_entry(presence, user_id);
+    if (position != -1)
+    {
+        // Keep the entries packed by moving the last one into the hole.
+        presence->entries[position] = presence->entries[--presence->count];
+        presence->body_valid        = 0;
+    }
+    rw_lock_unlock(&so->presence->lock);
+    
+    return position != -1;
+}
+
+int presence_list(struct core_object *co, struct server_object *so, struct presence_entry *entries_get,
+                  size_t *count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (rw_lock_read(co, &so->presence->lock) == -1)
+    {
+        return -1;
+    }
+    *count = so->presence->count;
+    memcpy(entries_get, so->presence->entries, *count * sizeof(struct presence_entry));
+    rw_lock_unlock(&so->presence->lock);
+    
+    return 0;
+}
+
+int presence_read_body(struct core_object *co, struct server_object *so, char **body_get, size_t *body_size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (rw_lock_read(co, &so->presence->lock) == -1)
+    {
+        return -1;
+    }
+    if (!so->presence->body_valid)
+    {
+        // Rebuilding writes the cache, so it needs the lock for writing; another worker may rebuild it meanwhile.
+        rw_lock_unlock(&so->presence->lock);
+        if (rw_lock_write(co, &so->presence->lock) == -1)
+        {
+            return -1;
+        }
+        if (!so->presence->body_valid)
+        {
+            build_body(so->presence);
+        }
+    }
+    
+    *body_size = so->presence->body_size;
+    *body_get  = mm_malloc(*body_size + 1, co->mm);
+    if (*body_get)
+    {
+        memcpy(*body_get, so->presence->body, *body_size + 1);
+    }
+    rw_lock_unlock(&so->presence->lock);
+    
+    if (!*body_get)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static long find_entry(const struct presence *presence, int user_id)
+{
+    for (size_t e = 0; e < presence->count; ++e)
+    {
+        if (presence->entries[e].user_id == user_id)
+        {
+            return (long) e;
+        }
+    }
+    
+    return -1;
+}
+
+static void build_body(struct presence *presence)
+{
+    size_t body_size;
+    size_t name_size;
+    
+    body_size = (size_t) sprintf(presence->body, "200\x03%zu\x03", presence->count);
+    for (size_t e = 0; e < presence->count; ++e)
+    {
+        name_size = strlen(presence->entries[e].display_name);
+        memcpy(presence->body + body_size, presence->entries[e].display_name, name_size);
+        body_size                   += name_size;
+        presence->body[body_size++] = '\x03';
+    }
+    presence->body[body_size] = '\0';
+    presence->body_size       = body_size;
+    presence->body_valid      = 1;
+}
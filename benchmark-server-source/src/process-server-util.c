@@ -1,11 +1,29 @@
 #include "../../include/manager.h"
 #include "../include/process-server-util.h"
+#include "../include/channel-body-cache.h"
+#include "../include/db.h"
+#include "../include/fanout.h"
+#include "../include/group-commit.h"
+#include "../include/id-allocator.h"
+#include "../include/membership-index.h"
+#include "../include/message-log.h"
+#include "../include/name-filter.h"
+#include "../include/object-cache.h"
+#include "../include/presence.h"
+#include "../include/rw-lock.h"
+#include "../include/session-table.h"
+#include "../include/snapshot.h"
+#include "../include/storage-engine.h"
+#include "../include/user-table.h"
+#include "../include/write-ahead-log.h"
 
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <semaphore.h>
 #include <signal.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -21,6 +39,16 @@
  */
 static int open_semaphores(struct core_object *co, struct server_object *so);
 
+/**
+ * print_lock_stats
+ * <p>
+ * Print the acquisition and wait counters of the database and session table locks.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ */
+static void print_lock_stats(struct core_object *co, struct server_object *so);
+
 /**
  * p_setup_parent
  * <p>
@@ -104,24 +132,12 @@ static int open_semaphores(struct core_object *co, struct server_object *so)
     sem_t *pipe_write_sem;
     sem_t *domain_read_sem;
     sem_t *domain_write_sem;
-    sem_t *user_db_sem;
-    sem_t *channel_db_sem;
-    sem_t *message_db_sem;
-    sem_t *auth_db_sem;
-    sem_t *name_addr_db_sem;
     
     // Value 0 will block; value 1 will allow first process to enter, then behave as if value was 0.
     pipe_write_sem   = sem_open(PIPE_WRITE_SEM_NAME, O_CREAT, S_IRUSR | S_IWUSR, 1);
     domain_read_sem  = sem_open(DOMAIN_READ_SEM_NAME, O_CREAT, S_IRUSR | S_IWUSR, 0);
     domain_write_sem = sem_open(DOMAIN_WRITE_SEM_NAME, O_CREAT, S_IRUSR | S_IWUSR, 1);
-    user_db_sem      = sem_open(USER_SEM_NAME, O_CREAT, S_IRUSR | S_IWUSR, 1);
-    channel_db_sem   = sem_open(CHANNEL_SEM_NAME, O_CREAT, S_IRUSR | S_IWUSR, 1);
-    message_db_sem   = sem_open(MESSAGE_SEM_NAME, O_CREAT, S_IRUSR | S_IWUSR, 1);
-    auth_db_sem      = sem_open(AUTH_SEM_NAME, O_CREAT, S_IRUSR | S_IWUSR, 1);
-    name_addr_db_sem = sem_open(NAME_ADDR_SEM_NAME, O_CREAT, S_IRUSR | S_IWUSR, 1);
-    if (pipe_write_sem == SEM_FAILED || domain_read_sem == SEM_FAILED || domain_write_sem == SEM_FAILED
-        || user_db_sem == SEM_FAILED || channel_db_sem == SEM_FAILED || message_db_sem == SEM_FAILED ||
-        auth_db_sem == SEM_FAILED || name_addr_db_sem == SEM_FAILED)
+    if (pipe_write_sem == SEM_FAILED || domain_read_sem == SEM_FAILED || domain_write_sem == SEM_FAILED)
     {
         SET_ERROR(co->err);
         // Closing an unopened semaphore will return -1 and set errno = EINVAL, which can be ignored.
@@ -129,32 +145,77 @@ static int open_semaphores(struct core_object *co, struct server_object *so)
         sem_close(pipe_write_sem);
         sem_close(domain_read_sem);
         sem_close(domain_write_sem);
-        sem_close(user_db_sem);
-        sem_close(channel_db_sem);
-        sem_close(message_db_sem);
-        sem_close(auth_db_sem);
-        sem_close(name_addr_db_sem);
         // NOLINTEND(clang-analyzer-core.NonNullParamChecker): intentional
         // Unlinking an unopened semaphore will return -1 and set errno = ENOENT, which can be ignored.
         sem_unlink(PIPE_WRITE_SEM_NAME);
         sem_unlink(DOMAIN_READ_SEM_NAME);
         sem_unlink(DOMAIN_WRITE_SEM_NAME);
-        sem_unlink(USER_SEM_NAME);
-        sem_unlink(CHANNEL_SEM_NAME);
-        sem_unlink(MESSAGE_SEM_NAME);
-        sem_unlink(AUTH_SEM_NAME);
-        sem_unlink(NAME_ADDR_SEM_NAME);
         return -1;
     }
     
     so->c_to_p_pipe_sem_write = pipe_write_sem;
     so->domain_sems[READ_END]  = domain_read_sem;
     so->domain_sems[WRITE_END] = domain_write_sem;
-    so->user_db_sem    = user_db_sem;
-    so->channel_db_sem = channel_db_sem;
-    so->message_db_sem = message_db_sem;
-    so->auth_db_sem    = auth_db_sem;
-    so->addr_id_db_sem = name_addr_db_sem;
+    
+    return 0;
+}
+
+int open_databases(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    
+    if (select_storage_engine(co, so) == -1 || select_message_shards(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    so->db_generations = map_shared_memory(co, DB_GENERATIONS_SHM_NAME, so->num_databases * sizeof(unsigned long));
+    if (!so->db_generations)
+    {
+        return -1;
+    }
+    so->db_locks = map_shared_memory(co, DB_LOCKS_SHM_NAME, so->num_databases * sizeof(struct rw_lock));
+    if (!so->db_locks)
+    {
+        return -1;
+    }
+    
+    so->user_db.name    = USER_DB_NAME;
+    so->channel_db.name = CHANNEL_DB_NAME;
+    so->auth_db.name    = AUTH_DB_NAME;
+    
+    so->user_db.index_name    = USER_INDEX_NAME;
+    so->channel_db.index_name = CHANNEL_INDEX_NAME;
+    so->auth_db.index_name    = AUTH_INDEX_NAME;
+    for (size_t s = 0; s < so->num_message_shards; ++s)
+    {
+        (void) snprintf(so->message_db_names[s], MESSAGE_DB_NAME_SIZE, MESSAGE_DB_NAME_FORMAT, s);
+        so->message_dbs[s].name       = so->message_db_names[s];
+        so->message_dbs[s].index_name = NULL;
+    }
+    
+    list_databases(so, databases);
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        databases[d]->dbm               = NULL;
+        databases[d]->index_dbm         = NULL;
+        databases[d]->generation        = 0;
+        databases[d]->shared_generation = so->db_generations + d;
+        databases[d]->lock              = so->db_locks + d;
+        if (rw_lock_init(co, databases[d]->lock) == -1)
+        {
+            return -1;
+        }
+        
+        // Prepare every database before forking, so that workers never race to create or load one.
+        if (so->engine->open(co, so, databases[d]) == -1)
+        {
+            return -1;
+        }
+        databases[d]->engine = so->engine;
+    }
     
     return 0;
 }
@@ -165,6 +226,7 @@ int fork_child_processes(struct core_object *co, struct server_object *so)
     
     pid_t pid;
     
+    (void) fflush(stdout); // Otherwise every child prints whatever startup output is still buffered when it exits.
     memset(so->child_pids, 0, sizeof(so->child_pids));
     FOR_EACH_CHILD_c_IN_CHILD_PIDS
     {
@@ -181,6 +243,8 @@ int fork_child_processes(struct core_object *co, struct server_object *so)
             {
                 return -1;
             }
+            so->child->worker = c;
+            attach_object_caches(so, c);
             
             break; // Do not fork bomb.
         }
@@ -303,22 +367,51 @@ void p_destroy_parent_state(struct core_object *co, struct server_object *so, st
     
     mm_free(co->mm, parent);
     
+    // Every child has exited, so the lock counters are final and no process holds a lock.
+    print_lock_stats(co, so);
+    print_name_filter_stats(co, so);
+    print_object_cache_stats(co, so);
+    print_channel_body_stats(co, so);
+    if (persist_databases(co, so, 1) == -1)
+    {
+        (void) fprintf(stderr, "Failed to persist databases; recent changes may be lost.\n");
+    }
+    if (wal_checkpoint(co, so, 1) == -1)
+    {
+        (void) fprintf(stderr, "Failed to checkpoint the write-ahead log; it will be replayed at the next start.\n");
+    }
+    if (reap_snapshot(co, so, 1) == -1)
+    {
+        (void) fprintf(stderr, "Failed to write a snapshot.\n");
+    }
+    if (write_snapshot(co, so) == -1)
+    {
+        (void) fprintf(stderr, "Failed to write a snapshot; the next start will load the databases from disk.\n");
+    }
+    if (release_unused_ids(co, so) == -1)
+    {
+        (void) fprintf(stderr, "Failed to record unused IDs; some IDs will be skipped after a restart.\n");
+    }
+    close_databases(co, so);
+    close_session_table(co, so);
+    close_fanout(co, so);
+    close_presence(co, so);
+    close_channel_body_cache(co, so);
+    close_message_log(co, so);
+    close_id_allocator(co, so);
+    close_commit_queues(co, so);
+    close_name_filters(co, so);
+    close_membership_index(co, so);
+    close_object_caches(co, so);
+    close_user_table(co, so);
+    close_write_ahead_log(co, so);
+    
     sem_close(so->c_to_p_pipe_sem_write);
     sem_close(so->domain_sems[READ_END]);
     sem_close(so->domain_sems[WRITE_END]);
-    sem_close(so->user_db_sem);
-    sem_close(so->channel_db_sem);
-    sem_close(so->message_db_sem);
-    sem_close(so->auth_db_sem);
-    sem_close(so->addr_id_db_sem);
     sem_unlink(PIPE_WRITE_SEM_NAME);
     sem_unlink(DOMAIN_READ_SEM_NAME);
     sem_unlink(DOMAIN_WRITE_SEM_NAME);
-    sem_unlink(USER_SEM_NAME);
-    sem_unlink(CHANNEL_SEM_NAME);
-    sem_unlink(MESSAGE_SEM_NAME);
-    sem_unlink(AUTH_SEM_NAME);
-    sem_unlink(NAME_ADDR_SEM_NAME);
 }
 
 void c_destroy_child_state(struct core_object *co, struct server_object *so, struct child *child)
@@ -327,9 +420,110 @@ void c_destroy_child_state(struct core_object *co, struct server_object *so, str
     close_fd_report_undefined_error(so->c_to_p_pipe_fds[WRITE_END], "state of pipe write is undefined.");
     close_fd_report_undefined_error(so->domain_fds[READ_END], "state of child domain socket is undefined.");
     
+    close_databases(co, so);
+    close_session_table(co, so);
+    close_fanout(co, so);
+    close_presence(co, so);
+    close_channel_body_cache(co, so);
+    close_message_log(co, so);
+    close_id_allocator(co, so);
+    close_commit_queues(co, so);
+    close_name_filters(co, so);
+    close_membership_index(co, so);
+    close_object_caches(co, so);
+    close_user_table(co, so);
+    close_write_ahead_log(co, so);
+    
     mm_free(co->mm, child);
 }
 
+void close_databases(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    
+    list_databases(so, databases);
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        if (databases[d]->engine)
+        {
+            databases[d]->engine->close(co, so, databases[d]);
+            databases[d]->engine = NULL;
+        }
+    }
+    
+    if (so->db_generations)
+    {
+        munmap(so->db_generations, so->num_databases * sizeof(unsigned long));
+        so->db_generations = NULL;
+    }
+    if (so->db_locks)
+    {
+        munmap(so->db_locks, so->num_databases * sizeof(struct rw_lock));
+        so->db_locks = NULL;
+    }
+}
+
+static void print_lock_stats(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    
+    list_databases(so, databases);
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        if (databases[d]->lock)
+        {
+            rw_lock_print_stats(databases[d]->lock, databases[d]->name);
+        }
+    }
+    if (so->session_table)
+    {
+        rw_lock_print_stats(&so->session_table->lock, "session table");
+    }
+    if (so->presence)
+    {
+        rw_lock_print_stats(&so->presence->lock, "presence set");
+    }
+}
+
+void *map_shared_memory(struct core_object *co, const char *name, size_t size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int  fd;
+    void *mem;
+    
+    shm_unlink(name); // A stale object may be left over from a crash; unlinking an absent object can be ignored.
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+    {
+        SET_ERROR(co->err);
+        return NULL;
+    }
+    shm_unlink(name); // The mapping keeps the object alive; nothing is left behind when every process unmaps.
+    
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    if (ftruncate(fd, (off_t) size) == -1)
+    {
+        SET_ERROR(co->err);
+        (void) close(fd);
+        return NULL;
+    }
+    
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    (void) close(fd);
+    if (mem == MAP_FAILED)
+    {
+        SET_ERROR(co->err);
+        return NULL;
+    }
+    
+    return mem;
+}
+
 void close_fd_report_undefined_error(int fd, const char *err_msg)
 {
     if (close(fd) == -1)
@@ -1,11 +1,26 @@
 #include "../../include/manager.h"
 #include "../../include/util.h"
+#include "../include/channel-body-cache.h"
 #include "../include/chat.h"
+#include "../include/fanout.h"
+#include "../include/group-commit.h"
+#include "../include/id-allocator.h"
+#include "../include/membership-index.h"
+#include "../include/message-log.h"
+#include "../include/name-filter.h"
+#include "../include/object-cache.h"
+#include "../include/presence.h"
 #include "../include/process-server-util.h"
 #include "../include/process-server.h"
+#include "../include/session-table.h"
+#include "../include/snapshot.h"
+#include "../include/storage-engine.h"
+#include "../include/user-table.h"
+#include "../include/write-ahead-log.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <poll.h>
 #include <signal.h>
@@ -22,6 +37,11 @@
  * Whether the loop at the heart of the program should be running.
  */
 volatile int GOGO_PROCESS = 1;
+
+/**
+ * Whether a snapshot has been requested since the last one was started.
+ */
+volatile int SNAPSHOT_REQUESTED = 0;
 // NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
 
 /**
@@ -45,9 +65,10 @@ static int p_run_poll_loop(struct core_object *co, struct server_object *so, str
  * </p>
  * @param sa sigaction struct to fill
  * @param signal the signal for which to listen
+ * @param handler the handler
  * @return 0 on success, -1 and set errno on failure
  */
-static int setup_signal_handler(struct sigaction *sa, int signal);
+static int setup_signal_handler(struct sigaction *sa, int signal, void (*handler)(int));
 
 /**
  * end_gogo_handler
@@ -58,6 +79,15 @@ static int setup_signal_handler(struct sigaction *sa, int signal);
  */
 static void end_gogo_handler(int signal);
 
+/**
+ * request_snapshot_handler
+ * <p>
+ * Handler for signal. Request a snapshot, which the poll loop starts once it wakes up.
+ * </p>
+ * @param signal the signal received
+ */
+static void request_snapshot_handler(int signal);
+
 /**
  * p_accept_new_connection
  * <p>
@@ -84,7 +114,9 @@ static size_t p_get_pollfd_index(const struct pollfd *pollfds);
 /**
  * p_read_pipe_reenable_fd
  * <p>
- * Wait for the read semaphore to be signaled on the child-to-parent pipe. Invert the fd that is passed in the pipe.
+ * Wait for the read semaphore to be signaled on the child-to-parent pipe. Invert the fd that is passed in the pipe,
+ * send the forwards which waited for the child to give it back, then deliver the frame and schedule the Ping passed
+ * in the pipe, if any.
  * </p>
  * @param co the core object
  * @param so the state object
@@ -97,6 +129,7 @@ static int p_read_pipe_reenable_fd(struct core_object *co, struct server_object
  * p_handle_socket_action
  * <p>
  * Send all file descriptors in pollfds for which POLLIN is set on the domain socket.
+ * Send the waiting forwards of all file descriptors in pollfds for which POLLOUT is set.
  * Remove all file descriptors in pollfds for which POLLHUP is set.
  * </p>
  * @param co the core object
@@ -121,17 +154,29 @@ static int p_send_to_child(struct core_object *co, struct server_object *so, str
 /**
  * p_remove_connection
  * <p>
- * Close a connection and remove the fd from the list of pollfds.
+ * Close a connection, end its session, and remove the fd from the list of pollfds.
  * </p>
  * @param co the core object
- * @param parent the state object
+ * @param so the state object
  * @param pollfd the pollfd to close and clean
  * @param conn_index the index of the connection in the array of client_addrs
  * @param listen_pollfd the listen pollfd
  */
-static void p_remove_connection(struct core_object *co, struct parent *parent,
+static void p_remove_connection(struct core_object *co, struct server_object *so,
                                 struct pollfd *pollfd, size_t conn_index, struct pollfd *listen_pollfd);
 
+/**
+ * p_log_out_session
+ * <p>
+ * Mark the User of a session ended by a disconnect offline, and let every Client know.
+ * </p>
+ * @param co the core object
+ * @param so the state object
+ * @param session the ended session
+ * @return 0 on success, -1 and set err on failure
+ */
+static int p_log_out_session(struct core_object *co, struct server_object *so, const Session *session);
+
 /**
  * c_run_child_process
  * <p>
@@ -185,7 +230,8 @@ static int c_handle_network_dispatch(struct core_object *co, struct server_objec
 /**
  * c_inform_parent_recv_finished
  * <p>
- * Send the original fd number to the parent over the child-to-parent pipe.
+ * Send the original fd number, and the frame to forward and the Ping to broadcast if there are any, to the parent
+ * over the child-to-parent pipe.
  * </p>
  * @param co the core object
  * @param so the state object
@@ -214,6 +260,76 @@ int setup_process_server(struct core_object *co, struct server_object *so)
         return -1;
     }
     
+    if (open_databases(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_write_ahead_log(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_commit_queues(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_name_filters(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_membership_index(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_object_caches(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_user_table(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_session_table(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_presence(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_channel_body_cache(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_fanout(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_message_log(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (check_stored_records(co, so) == -1)
+    {
+        return -1;
+    }
+    
+    if (open_id_allocator(co, so) == -1)
+    {
+        return -1;
+    }
+    
     GOGO_PROCESS = 1;
     
     if (fork_child_processes(co, so) == -1)
@@ -250,16 +366,23 @@ static int p_run_poll_loop(struct core_object *co, struct server_object *so, str
 {
     PRINT_STACK_TRACE(co->tracer);
     struct sigaction sigint;
+    struct sigaction sigusr1;
     int              poll_status;
     struct pollfd    *pollfds;
     nfds_t           nfds;
+    int              timeout;
     
-    if (setup_signal_handler(&sigint, SIGINT) == -1)
+    if (setup_signal_handler(&sigint, SIGINT, end_gogo_handler) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (setup_signal_handler(&sigint, SIGTERM, end_gogo_handler) == -1)
     {
         SET_ERROR(co->err);
         return -1;
     }
-    if (setup_signal_handler(&sigint, SIGTERM) == -1)
+    if (setup_signal_handler(&sigusr1, SIGUSR1, request_snapshot_handler) == -1)
     {
         SET_ERROR(co->err);
         return -1;
@@ -268,13 +391,47 @@ static int p_run_poll_loop(struct core_object *co, struct server_object *so, str
     pollfds = parent->pollfds;
     nfds    = POLLFDS_SIZE;
     
+    // Wake up at least once per persistence interval so that changes reach the disk even when the server is idle.
+    timeout = (so->persist_interval_ms > 0 && so->persist_interval_ms < INT_MAX) ? (int) so->persist_interval_ms : -1;
+    
     while (GOGO_PROCESS)
     {
-        poll_status = poll(pollfds, nfds, -1);
+        // Wake up when a Ping coalescing window closes, too.
+        poll_status = poll(pollfds, nfds, fanout_ping_timeout(so, timeout));
         if (poll_status == -1)
         {
             SET_ERROR(co->err);
-            return (errno == EINTR) ? 0 : -1;
+            if (errno != EINTR)
+            {
+                return -1;
+            }
+            poll_status = 0; // Interrupted by a signal; the loop condition says whether it was a request to stop.
+        }
+        
+        if (persist_databases(co, so, 0) == -1)
+        {
+            (void) fprintf(stderr, "Failed to persist databases; retrying at the next interval.\n");
+        }
+        if (wal_checkpoint(co, so, 0) == -1)
+        {
+            (void) fprintf(stderr, "Failed to checkpoint the write-ahead log; retrying later.\n");
+        }
+        if (reap_snapshot(co, so, 0) == -1)
+        {
+            (void) fprintf(stderr, "Failed to write a snapshot.\n");
+        }
+        if (SNAPSHOT_REQUESTED)
+        {
+            SNAPSHOT_REQUESTED = 0;
+            if (start_snapshot(co, so) == -1)
+            {
+                (void) fprintf(stderr, "Failed to start a snapshot.\n");
+            }
+        }
+        fanout_send_due_pings(co, so);
+        if (poll_status == 0)
+        {
+            continue;
         }
         
         if ((*pollfds).revents == POLLIN) // Action on the listen socket.
@@ -301,11 +458,11 @@ static int p_run_poll_loop(struct core_object *co, struct server_object *so, str
     return 0;
 }
 
-static int setup_signal_handler(struct sigaction *sa, int signal)
+static int setup_signal_handler(struct sigaction *sa, int signal, void (*handler)(int))
 {
     sigemptyset(&sa->sa_mask);
     sa->sa_flags   = 0;
-    sa->sa_handler = end_gogo_handler;
+    sa->sa_handler = handler;
     if (sigaction(signal, sa, 0) == -1)
     {
         return -1;
@@ -321,6 +478,11 @@ static void end_gogo_handler(int signal)
     GOGO_PROCESS = 0;
 }
 
+static void request_snapshot_handler(int signal)
+{
+    SNAPSHOT_REQUESTED = 1;
+}
+
 #pragma GCC diagnostic pop
 
 static int p_accept_new_connection(struct core_object *co, struct parent *parent, struct pollfd *pollfds)
@@ -378,10 +540,11 @@ static size_t p_get_pollfd_index(const struct pollfd *pollfds)
 static int p_read_pipe_reenable_fd(struct core_object *co, struct server_object *so, struct pollfd *pollfds)
 {
     PRINT_STACK_TRACE(co->tracer);
-    int     fd;
-    ssize_t bytes_read;
+    struct child_report report;
+    int                 fd;
+    ssize_t             bytes_read;
     
-    bytes_read = read(so->c_to_p_pipe_fds[READ_END], &fd, sizeof(int));
+    bytes_read = read(so->c_to_p_pipe_fds[READ_END], &report, sizeof(struct child_report));
     
     sem_post(so->c_to_p_pipe_sem_write);
     
@@ -390,23 +553,35 @@ static int p_read_pipe_reenable_fd(struct core_object *co, struct server_object
         SET_ERROR(co->err);
         return -1;
     }
+    fd = report.client_fd;
     
     FOR_EACH_SOCKET_POLLFD_p_IN_POLLFDS
     {
         // Case: the fd has disconnected
         if (pollfds[p].fd == fd) // pollfd.fd here is negative.
         {
-            pollfds[p].fd = pollfds[p].fd * -1;  // Invert pollfd.fd so it will be read from in poll loop.
-            pollfds[p].revents = POLLHUP;
+            pollfds[p].fd = pollfds[p].fd * -1; // Invert pollfd.fd so that it can be closed.
+            p_remove_connection(co, so, &pollfds[p], p - 2, pollfds);
+            break;
         }
         // Case: reenable the fd
         if (pollfds[p].fd == fd * -1) // pollfd.fd here is negative.
         {
             pollfds[p].fd = pollfds[p].fd * -1; // Invert pollfd.fd so it will be read from in poll loop.
+            fanout_flush(co, so, p - 2);
             break;
         }
     }
     
+    if (report.fanout_frame != FANOUT_NONE)
+    {
+        fanout_deliver(co, so, report.fanout_frame);
+    }
+    if (report.ping.type != 0)
+    {
+        fanout_schedule_ping(co, so, &report.ping);
+    }
+    
     return 0;
 }
 
@@ -425,12 +600,15 @@ static int p_handle_socket_action(struct core_object *co, struct server_object *
                 return -1;
             }
             pollfd->fd *= -1; // Disable the pollfd until it is signaled by the child to be re-enabled.
+        } else if (pollfd->revents == POLLOUT) // Forwards are waiting on the socket.
+        {
+            fanout_flush(co, so, p - 2);
             
             // NOLINTNEXTLINE(hicpp-signed-bitwise): never negative
         } else if ((pollfd->revents & POLLHUP) || (pollfd->revents & POLLERR) || (pollfd->revents & POLLNVAL)) // Client has closed other end of socket.
             // On macOS, POLLHUP will be set; on Linux, POLLERR will be set.
         {
-            (p_remove_connection(co, so->parent, pollfd, p - 2, pollfds));
+            (p_remove_connection(co, so, pollfd, p - 2, pollfds));
         }
         pollfd->revents = 0; // Reset revents to be sure.
     }
@@ -488,11 +666,25 @@ static int p_send_to_child(struct core_object *co, struct server_object *so, str
     return 0;
 }
 
-static void p_remove_connection(struct core_object *co, struct parent *parent,
+static void p_remove_connection(struct core_object *co, struct server_object *so,
                                 struct pollfd *pollfd, size_t conn_index, struct pollfd *listen_pollfd)
 {
     PRINT_STACK_TRACE(co->tracer);
     
+    struct parent *parent;
+    Session       session;
+    int           ended;
+    
+    parent = so->parent;
+    
+    // A disconnected client can no longer send requests, so its session is ended.
+    ended = session_remove_by_addr(co, so, &parent->client_addrs[conn_index], &session);
+    if (ended == -1)
+    {
+        (void) fprintf(stdout, "Session of disconnected client could not be removed.\n");
+    }
+    
+    fanout_drop(so, conn_index);
     close_fd_report_undefined_error(pollfd->fd, "state of client socket is undefined.");
     
     // NOLINTNEXTLINE(concurrency-mt-unsafe): No threads here
@@ -509,6 +701,49 @@ static void p_remove_connection(struct core_object *co, struct parent *parent,
     {
         listen_pollfd->events = POLLIN; // Turn on POLLIN on the listening socket when less than max connections.
     }
+    
+    // Once the connection is gone, so that it is not pinged.
+    if (ended == 1 && p_log_out_session(co, so, &session) == -1)
+    {
+        (void) fprintf(stdout, "User of disconnected client could not be marked offline.\n");
+    }
+}
+
+static int p_log_out_session(struct core_object *co, struct server_object *so, const Session *session)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    User        user;
+    struct ping ping;
+    int         status;
+    
+    status = presence_remove(co, so, session->user_id);
+    if (status != 1) // An error occurred, or the User is online through a later login.
+    {
+        return status == -1 ? -1 : 0;
+    }
+    
+    status = read_user_by_id(co, so, session->user_id, &user);
+    if (status == -1)
+    {
+        return -1;
+    }
+    if (status == 0)
+    {
+        status = set_online_status(co, so, &user, 0);
+        mm_free(co->mm, user.display_name);
+        if (status == -1)
+        {
+            return -1;
+        }
+    }
+    
+    ping.type = PINGUSER;
+    strncpy(ping.name, session->display_name, PING_NAME_MAX_SIZE);
+    ping.name[PING_NAME_MAX_SIZE] = '\0';
+    fanout_schedule_ping(co, so, &ping);
+    
+    return 0;
 }
 
 static int c_run_child_process(struct core_object *co, struct server_object *so)
@@ -516,17 +751,23 @@ static int c_run_child_process(struct core_object *co, struct server_object *so)
     PRINT_STACK_TRACE(co->tracer);
     pid_t            pid;
     struct sigaction sigint;
+    struct sigaction sigusr1;
     
     pid = getpid();
     
     (void) fprintf(stdout, "Child process with pid %d started.\n", pid);
     
-    if (setup_signal_handler(&sigint, SIGINT) == -1)
+    if (setup_signal_handler(&sigint, SIGINT, end_gogo_handler) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (setup_signal_handler(&sigint, SIGTERM, end_gogo_handler) == -1)
     {
         SET_ERROR(co->err);
         return -1;
     }
-    if (setup_signal_handler(&sigint, SIGTERM) == -1)
+    if (setup_signal_handler(&sigusr1, SIGUSR1, SIG_IGN) == -1) // Snapshots are taken by the parent.
     {
         SET_ERROR(co->err);
         return -1;
@@ -553,6 +794,7 @@ static int c_receive_and_handle_messages(struct core_object *co, struct server_o
     {
         // Clean the child struct.
         memset(child, 0, sizeof(struct child));
+        child->fanout_frame = FANOUT_NONE;
         
         if (c_get_file_description_from_domain_socket(co, so, child) == -1)
         {
@@ -563,7 +805,7 @@ static int c_receive_and_handle_messages(struct core_object *co, struct server_o
         {
             break;
         }
-    
+        
         status = c_handle_network_dispatch(co, so, child);
         if (status == -1)
         {
@@ -664,13 +906,10 @@ static int c_handle_network_dispatch(struct core_object *co, struct server_objec
         return 1;
     }
     
-    if (dispatch.body_size == 0)
-    {
-        body_tokens = NULL;
-    }
     print_dispatch((struct state *) co, &dispatch, "Request");
     
     mm_free(co->mm, dispatch.body); // Free the body after tokenizing.
+    dispatch.body = NULL;
     
     if (perform_dispatch_operation(co, so, &dispatch, body_tokens) == -1)
     {
@@ -681,6 +920,11 @@ static int c_handle_network_dispatch(struct core_object *co, struct server_objec
     
     free_body_tokens((struct state *) co, body_tokens); // Free the body tokens after performing the operation.
     
+    if (!dispatch.body) // The dispatch was a response to a forward, which is not answered.
+    {
+        return 0;
+    }
+    
     print_dispatch((struct state *) co, &dispatch, "Response");
     
     status = assemble_message_send((struct state *) co, child->client_fd_local, &dispatch);
@@ -696,7 +940,12 @@ static int c_handle_network_dispatch(struct core_object *co, struct server_objec
 static int c_inform_parent_recv_finished(struct core_object *co, struct server_object *so, struct child *child)
 {
     PRINT_STACK_TRACE(co->tracer);
-    ssize_t bytes_written;
+    struct child_report report;
+    ssize_t             bytes_written;
+    
+    report.client_fd    = child->client_fd_parent; // Negative if the parent should close it.
+    report.fanout_frame = child->fanout_frame;
+    report.ping         = child->ping;
     
     if (sem_wait(so->c_to_p_pipe_sem_write) == -1) // Wait for the pipe write semaphore.
     {
@@ -704,8 +953,7 @@ static int c_inform_parent_recv_finished(struct core_object *co, struct server_o
         return (errno == EINTR) ? 0 : -1;
     }
     
-    // FD will be negative if the parent should close it.
-    bytes_written = write(so->c_to_p_pipe_fds[WRITE_END], &child->client_fd_parent, sizeof(int));
+    bytes_written = write(so->c_to_p_pipe_fds[WRITE_END], &report, sizeof(struct child_report));
     
     if (bytes_written == -1)
     {
@@ -0,0 +1,575 @@
+#include "../include/channel-body-cache.h"
+#include "../include/db.h"
+#include "../include/message-log.h"
+#include "../include/object-util.h"
+#include "../include/presence.h"
+#include "../include/read.h"
+#include "../include/user-table.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NOLINTBEGIN(modernize-macro-to-enum)
+#define DECIMAL_BASE 10
+#define HEX_BASE 16
+#define NAME_CACHE_SIZE 16          /** Display names remembered while assembling one Read-Message Response. */
+#define MESSAGE_CURSOR_MAX_SIZE 27  /** A 16 digit timestamp, a dot, an 8 digit Message ID and two ETXs. */
+// NOLINTEND(modernize-macro-to-enum)
+
+#define USER_INFO_FORMAT "200\x03%s\x03%d\x03%d\x03" /** Display name, privilege level and online status. */
+#define MESSAGE_CURSOR_FORMAT "%lx.%x\x03"             /** The timestamp and Message ID of the last Message of a page. */
+
+#define IS_BOOLEAN(token) (((token)[0] == '0' || (token)[0] == '1') && (token)[1] == '\0') /** A BOOLEAN field. */
+
+/**
+ * The smallest message-info is a one character display name, an empty message, a one digit timestamp and three
+ * ETXs, so no more Messages than this can fit in a dispatch body.
+ */
+#define READ_MESSAGE_MAX_MESSAGES (UINT16_MAX / 4)
+
+/** Number of tokens that should be present in Read Type Dispatches. */
+enum BodyTokenSizes
+{
+    READ_CHANNEL_BODY_TOKEN_SIZE       = 4,
+    READ_MESSAGE_BODY_TOKEN_SIZE       = 2,
+    READ_MESSAGE_RANGE_BODY_TOKEN_SIZE = 4 // Not in RFC 7.2.3; followed by a cursor when reading a later page.
+};
+
+/**
+ * The display name of a User read by ID. Entries are never evicted while a Response is assembled, because the display
+ * names handed out point into them.
+ */
+struct name_cache_entry
+{
+    int  user_id;
+    int  in_use;
+    char display_name[NAME_MAX_SIZE + 1];
+};
+
+/**
+ * lookup_display_name
+ * <p>
+ * Get the display name of a User by ID, remembering lookups so that a User who sent many of the Messages is usually
+ * only read once. If the User's cache slot is held by another User, the name is copied into a buffer of its own.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param cache the remembered lookups
+ * @param user_id the ID of the User
+ * @param display_name_get memory in which to store the display name; empty if the User no longer exists
+ * @param owned_get memory in which to store a buffer the caller must free, or NULL if there is none
+ * @return 0 on success, -1 and set err on failure
+ */
+static int lookup_display_name(struct core_object *co, struct server_object *so, struct name_cache_entry *cache,
+                               int user_id, const char **display_name_get, uint8_t **owned_get);
+
+/**
+ * parse_message_range
+ * <p>
+ * Parse the time range of a Read-Message Dispatch, and the cursor of the previous page if there is one.
+ * </p>
+ * @param tokens the tokens following the number of Messages
+ * @param count the number of tokens
+ * @param from memory in which to store the earliest timestamp
+ * @param to memory in which to store the latest timestamp
+ * @param after memory in which to store the cursor
+ * @return 1 if the tokens are valid, 0 if not
+ */
+static int parse_message_range(char **tokens, size_t count, time_t *from, time_t *to, struct message_cursor *after);
+
+/**
+ * assemble_read_message_response
+ * <p>
+ * Assemble the body of a Read-Message Response. If the Messages do not all fit in a dispatch body, the oldest are
+ * left out, or for a page of a range the newest, followed by the cursor of the last Message included.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param dispatch the dispatch
+ * @param channel_name the name of the Channel
+ * @param num_messages the number of Messages requested
+ * @param messages the Messages, oldest first
+ * @param count the number of Messages
+ * @param page whether the Messages are a page of a range
+ * @return 0 on success, -1 and set err on failure
+ */
+static int assemble_read_message_response(struct core_object *co, struct server_object *so,
+                                          struct dispatch *dispatch, const char *channel_name, long num_messages,
+                                          Message **messages, size_t count, int page);
+
+int handle_read(struct core_object *co, struct server_object *so, struct dispatch *dispatch, char **body_tokens)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (dispatch->object == USER)
+    {
+        if (handle_read_user(co, so, dispatch, body_tokens) == -1)
+        {
+            return -1;
+        }
+    } else if (dispatch->object == CHANNEL)
+    {
+        if (handle_read_channel(co, so, dispatch, body_tokens) == -1)
+        {
+            return -1;
+        }
+    } else if (dispatch->object == MESSAGE)
+    {
+        if (handle_read_message(co, so, dispatch, body_tokens) == -1)
+        {
+            return -1;
+        }
+    } else
+    {
+        dispatch->body      = mm_strdup("501\x03Not implemented\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+    }
+    
+    return 0;
+}
+
+int handle_read_user(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
+                     char **body_tokens)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    User              *user;
+    User              *allocated;
+    struct user_entry entry;
+    size_t            body_size;
+    int               read_status;
+    
+    // Without a display name, list the online Users. The body is cached, so this is a copy.
+    if (!body_tokens || !*body_tokens)
+    {
+        if (presence_read_body(co, so, &dispatch->body, &body_size) == -1)
+        {
+            return -1;
+        }
+        dispatch->body_size = (uint16_t) body_size; // Never larger than PRESENCE_BODY_MAX_SIZE.
+        return 0;
+    }
+    
+    if (*(body_tokens + 1) || !VALIDATE_NAME(*body_tokens))
+    {
+        dispatch->body      = mm_strdup("400\x03Invalid fields\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    
+    user = mm_calloc(1, sizeof(User), co->mm);
+    if (!user)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    allocated   = user; // The read sets user to NULL if the User is not found.
+    read_status = db_read(co, so, USER, &user, *body_tokens);
+    if (read_status != 1)
+    {
+        free_user(co, allocated);
+        if (read_status == -1)
+        {
+            return -1;
+        }
+        dispatch->body      = mm_strdup("404\x03User not found.\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    
+    // The user table holds the current privilege level and online status of the Users it holds.
+    if (USER_TABLE_HOLDS(user->id) && user_table_read(so, user->id, &entry))
+    {
+        user->privilege_level = entry.privilege_level;
+        user->online_status   = entry.online_status;
+    }
+    
+    body_size      = (size_t) snprintf(NULL, 0, USER_INFO_FORMAT, user->display_name, (int) user->privilege_level,
+                                       user->online_status);
+    dispatch->body = mm_malloc(body_size + 1, co->mm);
+    if (!dispatch->body)
+    {
+        free_user(co, user);
+        SET_ERROR(co->err);
+        return -1;
+    }
+    (void) snprintf(dispatch->body, body_size + 1, USER_INFO_FORMAT, user->display_name, (int) user->privilege_level,
+                    user->online_status);
+    dispatch->body_size = (uint16_t) body_size;
+    free_user(co, user);
+    
+    return 0;
+}
+
+int handle_read_channel(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
+                        char **body_tokens)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    char   *channel_name_in_dispatch;
+    size_t body_size;
+    int    get_flags;
+    int    read_status;
+    
+    size_t count;
+    char   **body_tokens_cpy;
+    
+    count           = 0;
+    body_tokens_cpy = body_tokens;
+    COUNT_TOKENS(count, body_tokens_cpy);
+    if (count != READ_CHANNEL_BODY_TOKEN_SIZE)
+    {
+        dispatch->body      = mm_strdup("400\x03Invalid number of fields\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    
+    // The Get Flags are in the order User, Admin, Banned.
+    channel_name_in_dispatch = *body_tokens;
+    get_flags                = 0;
+    for (size_t f = 1; f < READ_CHANNEL_BODY_TOKEN_SIZE; ++f)
+    {
+        if (!IS_BOOLEAN(*(body_tokens + f)))
+        {
+            get_flags = -1;
+            break;
+        }
+        get_flags |= (**(body_tokens + f) == '1') << (f - 1);
+    }
+    if (!VALIDATE_NAME(channel_name_in_dispatch) || get_flags == -1)
+    {
+        dispatch->body      = mm_strdup("400\x03Invalid fields\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    
+    // The body is encoded once per change to the Channel, so this is usually a copy.
+    read_status = channel_body_read(co, so, channel_name_in_dispatch, get_flags, &dispatch->body, &body_size);
+    if (read_status == -1)
+    {
+        return -1;
+    }
+    if (read_status == 0)
+    {
+        dispatch->body      = mm_strdup("404\x03""Channel not found.\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    if (read_status == CHANNEL_BODY_TOO_LARGE)
+    {
+        dispatch->body      = mm_strdup("500\x03Lists too large to send.\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    dispatch->body_size = (uint16_t) body_size; // Never larger than UINT16_MAX.
+    
+    return 0;
+}
+
+int handle_read_message(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
+                        char **body_tokens)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct message_cursor after;
+    char                  *channel_name_in_dispatch;
+    char                  *num_messages_in_dispatch;
+    char                  *end;
+    long                  num_messages;
+    time_t                from;
+    time_t                to;
+    uint8_t               *serial_channel;
+    Message               **messages;
+    int                   query[2];
+    int                   read_status;
+    int                   ret_val;
+    
+    size_t count;
+    char   **body_tokens_cpy;
+    
+    count           = 0;
+    body_tokens_cpy = body_tokens;
+    COUNT_TOKENS(count, body_tokens_cpy);
+    if (count != READ_MESSAGE_BODY_TOKEN_SIZE && count != READ_MESSAGE_RANGE_BODY_TOKEN_SIZE
+        && count != READ_MESSAGE_RANGE_BODY_TOKEN_SIZE + 1)
+    {
+        dispatch->body      = mm_strdup("400\x03Invalid number of fields\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    
+    channel_name_in_dispatch = *body_tokens;
+    num_messages_in_dispatch = *(body_tokens + 1);
+    from         = 0;
+    to           = 0;
+    errno        = 0;
+    num_messages = strtol(num_messages_in_dispatch, &end, DECIMAL_BASE);
+    if (!VALIDATE_NAME(channel_name_in_dispatch) || *end != '\0' || errno != 0 || num_messages < 0
+        || (count > READ_MESSAGE_BODY_TOKEN_SIZE
+            && !parse_message_range(body_tokens + READ_MESSAGE_BODY_TOKEN_SIZE, count - READ_MESSAGE_BODY_TOKEN_SIZE,
+                                    &from, &to, &after)))
+    {
+        dispatch->body      = mm_strdup("400\x03Invalid fields\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    
+    read_status = find_by_name(co, &so->channel_db, &serial_channel, channel_name_in_dispatch);
+    if (read_status == -1)
+    {
+        return -1;
+    }
+    if (read_status == 0)
+    {
+        dispatch->body      = mm_strdup("404\x03""Channel not found.\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    
+    // The Channel's log is read from the end, or a range of it through its tree, so the cost depends on the Messages
+    // returned and not on its history.
+    query[0] = (num_messages > READ_MESSAGE_MAX_MESSAGES) ? READ_MESSAGE_MAX_MESSAGES : (int) num_messages;
+    memcpy(&query[1], serial_channel, sizeof(query[1]));
+    mm_free(co->mm, serial_channel);
+    if (count == READ_MESSAGE_BODY_TOKEN_SIZE)
+    {
+        read_status = db_read(co, so, MESSAGE, &messages, query);
+    } else
+    {
+        read_status = (int) message_log_read_range(co, so, query[1], from, to,
+                                                   (count > READ_MESSAGE_RANGE_BODY_TOKEN_SIZE) ? &after : NULL,
+                                                   (size_t) query[0], &messages);
+    }
+    if (read_status == -1)
+    {
+        return -1;
+    }
+    
+    ret_val = assemble_read_message_response(co, so, dispatch, channel_name_in_dispatch, num_messages, messages,
+                                             (size_t) read_status, count > READ_MESSAGE_BODY_TOKEN_SIZE);
+    for (size_t m = 0; messages[m]; ++m)
+    {
+        free_message(co, messages[m]);
+    }
+    mm_free(co->mm, messages);
+    
+    return ret_val;
+}
+
+static int lookup_display_name(struct core_object *co, struct server_object *so, struct name_cache_entry *cache,
+                               int user_id, const char **display_name_get, uint8_t **owned_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct name_cache_entry  *slot;
+    struct user_entry        entry;
+    const struct user_record *record;
+    uint8_t                  *serial_user;
+    const char               *display_name;
+    datum                    key;
+    int                      read_status;
+    
+    *owned_get = NULL;
+    slot       = &cache[(unsigned int) user_id % NAME_CACHE_SIZE];
+    if (slot->in_use && slot->user_id == user_id)
+    {
+        *display_name_get = slot->display_name;
+        return 0;
+    }
+    
+    serial_user = NULL;
+    if (USER_TABLE_HOLDS(user_id))
+    {
+        read_status = user_table_read(so, user_id, &entry) ? 0 : 1;
+    } else
+    {
+        key.dptr    = (void *) &user_id;
+        key.dsize   = sizeof(user_id);
+        read_status = safe_dbm_fetch(co, &so->user_db, &key, &serial_user);
+    }
+    if (read_status == -1)
+    {
+        return -1;
+    }
+    if (read_status == 1) // The User has been deleted since sending the Message.
+    {
+        *display_name_get = "";
+        return 0;
+    }
+    display_name = entry.display_name;
+    if (serial_user)
+    {
+        record       = view_user(serial_user);
+        display_name = record ? record_string(record, &record->display_name) : "";
+    }
+    
+    if (!slot->in_use && strlen(display_name) <= NAME_MAX_SIZE)
+    {
+        slot->user_id = user_id;
+        slot->in_use  = 1;
+        strcpy(slot->display_name, display_name); // NOLINT(clang-analyzer-security.insecureAPI.strcpy) : Sized above
+        *display_name_get = slot->display_name;
+    } else
+    {
+        *owned_get = (uint8_t *) mm_strdup(display_name, co->mm);
+        if (!*owned_get)
+        {
+            SET_ERROR(co->err);
+            if (serial_user)
+            {
+                mm_free(co->mm, serial_user);
+            }
+            return -1;
+        }
+        *display_name_get = (const char *) *owned_get;
+    }
+    if (serial_user)
+    {
+        mm_free(co->mm, serial_user);
+    }
+    
+    return 0;
+}
+
+static int parse_message_range(char **tokens, size_t count, time_t *from, time_t *to, struct message_cursor *after)
+{
+    char *end;
+    
+    errno = 0;
+    *from = strtol(tokens[0], &end, HEX_BASE);
+    if (*end != '\0' || errno != 0)
+    {
+        return 0;
+    }
+    *to = strtol(tokens[1], &end, HEX_BASE);
+    if (*end != '\0' || errno != 0 || *to < *from)
+    {
+        return 0;
+    }
+    if (count < 3) // NOLINT(readability-magic-numbers) : From, to and cursor
+    {
+        return 1;
+    }
+    
+    // Message IDs are unique, so no other Message shares the timestamp and ID; the cursor is after all of its entries.
+    after->timestamp  = strtol(tokens[2], &end, HEX_BASE);
+    after->message_id = 0;
+    after->sequence   = UINT32_MAX;
+    if (*end == '.' && errno == 0)
+    {
+        after->message_id = (int) strtol(end + 1, &end, HEX_BASE);
+    }
+    
+    return *end == '\0' && errno == 0 && after->message_id > 0;
+}
+
+static int assemble_read_message_response(struct core_object *co, struct server_object *so,
+                                          struct dispatch *dispatch, const char *channel_name, long num_messages,
+                                          Message **messages, size_t count, int page)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct name_cache_entry cache[NAME_CACHE_SIZE];
+    const char              **display_names;
+    uint8_t                 **owned;
+    char                    *body_buffer;
+    size_t                  body_size;
+    size_t                  message_size;
+    size_t                  first;
+    size_t                  included;
+    size_t                  offset;
+    size_t                  m;
+    int                     ret_val;
+    
+    display_names = mm_calloc(count + 1, sizeof(char *), co->mm);
+    owned         = mm_calloc(count + 1, sizeof(uint8_t *), co->mm);
+    if (!display_names || !owned)
+    {
+        SET_ERROR(co->err);
+        if (display_names)
+        {
+            mm_free(co->mm, display_names);
+        }
+        if (owned)
+        {
+            mm_free(co->mm, owned);
+        }
+        return -1;
+    }
+    memset(cache, 0, sizeof(cache));
+    
+    // 3 digit status code, channel name and list size, each followed by an ETX.
+    body_size = 3 + strlen(channel_name) + (size_t) snprintf(NULL, 0, "%zu", count) + 3; // NOLINT : Magic numbers
+    if (page)
+    {
+        body_size += MESSAGE_CURSOR_MAX_SIZE;
+    }
+    
+    // Take Messages from the newest back for as long as they fit. A page takes them from the oldest on instead, so
+    // that the next page starts where it ends.
+    ret_val  = 0;
+    included = 0;
+    while (included < count && ret_val == 0)
+    {
+        m       = page ? included : count - included - 1;
+        ret_val = lookup_display_name(co, so, cache, messages[m]->user_id, &display_names[m], &owned[m]);
+        if (ret_val == 0)
+        {
+            message_size = strlen(display_names[m]) + strlen(messages[m]->message_content)
+                           + (size_t) snprintf(NULL, 0, "%lx", (unsigned long) messages[m]->timestamp) + 3;
+            if (body_size + message_size > UINT16_MAX)
+            {
+                break;
+            }
+            body_size += message_size;
+            ++included;
+        }
+    }
+    first = page ? 0 : count - included;
+    
+    body_buffer = NULL;
+    if (ret_val == 0)
+    {
+        body_buffer = mm_malloc(body_size + 1, co->mm);
+        if (!body_buffer)
+        {
+            SET_ERROR(co->err);
+            ret_val = -1;
+        }
+    }
+    if (ret_val == 0)
+    {
+        offset = (size_t) sprintf(body_buffer, "%s\x03%s\x03%zu\x03", // NOLINT(cert-err33-c) : Sized above
+                                  (included < (size_t) num_messages) ? "206" : "200", channel_name, included);
+        for (m = first; m < first + included; ++m)
+        {
+            offset += (size_t) sprintf(body_buffer + offset, "%s\x03%s\x03%lx\x03", // NOLINT(cert-err33-c)
+                                       display_names[m], messages[m]->message_content,
+                                       (unsigned long) messages[m]->timestamp);
+        }
+        if (page && included > 0)
+        {
+            offset += (size_t) sprintf(body_buffer + offset, MESSAGE_CURSOR_FORMAT, // NOLINT(cert-err33-c)
+                                       (unsigned long) messages[included - 1]->timestamp,
+                                       (unsigned int) messages[included - 1]->id);
+        }
+        dispatch->body      = body_buffer;
+        dispatch->body_size = (uint16_t) offset;
+    }
+    
+    for (m = 0; m < count; ++m)
+    {
+        if (owned[m])
+        {
+            mm_free(co->mm, owned[m]);
+        }
+    }
+    mm_free(co->mm, owned);
+    mm_free(co->mm, display_names);
+    
+    return ret_val;
+}
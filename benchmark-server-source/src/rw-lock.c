@@ -0,0 +1,139 @@
+#include "../include/rw-lock.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NS_PER_S 1000000000UL /** Nanoseconds per second. */
+#define NS_PER_US 1000UL      /** Nanoseconds per microsecond. */
+
+/**
+ * elapsed_ns
+ * <p>
+ * Get the number of nanoseconds between two monotonic clock readings.
+ * </p>
+ * @param start the earlier reading
+ * @param end the later reading
+ * @return the elapsed time in nanoseconds
+ */
+static unsigned long elapsed_ns(const struct timespec *start, const struct timespec *end);
+
+int rw_lock_init(struct core_object *co, struct rw_lock *lock)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    pthread_rwlockattr_t attr;
+    int                  status;
+    
+    status = pthread_rwlockattr_init(&attr);
+    if (status == 0)
+    {
+        status = pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __GLIBC__
+        // glibc prefers readers by default, which lets a steady stream of reads starve writers.
+        if (status == 0)
+        {
+            status = pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        }
+#endif
+        if (status == 0)
+        {
+            status = pthread_rwlock_init(&lock->lock, &attr);
+        }
+        pthread_rwlockattr_destroy(&attr);
+    }
+    if (status != 0)
+    {
+        errno = status;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    atomic_init(&lock->read_acquisitions, 0);
+    atomic_init(&lock->read_waits, 0);
+    atomic_init(&lock->read_wait_ns, 0);
+    atomic_init(&lock->write_acquisitions, 0);
+    atomic_init(&lock->write_waits, 0);
+    atomic_init(&lock->write_wait_ns, 0);
+    
+    return 0;
+}
+
+int rw_lock_read(struct core_object *co, struct rw_lock *lock)
+{
+    struct timespec start;
+    struct timespec end;
+    int             status;
+    
+    // Only read the clock when the lock is contended, so uncontended acquisitions stay cheap.
+    status = pthread_rwlock_tryrdlock(&lock->lock);
+    if (status == EBUSY)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        status = pthread_rwlock_rdlock(&lock->lock);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (status == 0)
+        {
+            atomic_fetch_add_explicit(&lock->read_waits, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&lock->read_wait_ns, elapsed_ns(&start, &end), memory_order_relaxed);
+        }
+    }
+    if (status != 0)
+    {
+        errno = status;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    atomic_fetch_add_explicit(&lock->read_acquisitions, 1, memory_order_relaxed);
+    
+    return 0;
+}
+
+int rw_lock_write(struct core_object *co, struct rw_lock *lock)
+{
+    struct timespec start;
+    struct timespec end;
+    int             status;
+    
+    status = pthread_rwlock_trywrlock(&lock->lock);
+    if (status == EBUSY)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        status = pthread_rwlock_wrlock(&lock->lock);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (status == 0)
+        {
+            atomic_fetch_add_explicit(&lock->write_waits, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&lock->write_wait_ns, elapsed_ns(&start, &end), memory_order_relaxed);
+        }
+    }
+    if (status != 0)
+    {
+        errno = status;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    atomic_fetch_add_explicit(&lock->write_acquisitions, 1, memory_order_relaxed);
+    
+    return 0;
+}
+
+void rw_lock_unlock(struct rw_lock *lock)
+{
+    pthread_rwlock_unlock(&lock->lock);
+}
+
+void rw_lock_print_stats(struct rw_lock *lock, const char *name)
+{
+    (void) fprintf(stdout, "Lock %s: %lu reads (%lu waited, %lu us), %lu writes (%lu waited, %lu us)\n", name,
+                   atomic_load(&lock->read_acquisitions), atomic_load(&lock->read_waits),
+                   atomic_load(&lock->read_wait_ns) / NS_PER_US, atomic_load(&lock->write_acquisitions),
+                   atomic_load(&lock->write_waits), atomic_load(&lock->write_wait_ns) / NS_PER_US);
+}
+
+static unsigned long elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never negative
+    return (unsigned long) (end->tv_sec - start->tv_sec) * NS_PER_S + (unsigned long) end->tv_nsec
+           - (unsigned long) start->tv_nsec;
+}
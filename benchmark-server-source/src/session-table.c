@@ -0,0 +1,413 @@
+#include "../include/session-table.h"
+#include "../include/process-server-util.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define SESSION_TABLE_SHM_NAME "/st_3fda69" /** Session table shared memory name. */
+#define HASH_MULTIPLIER 2654435761U         /** Knuth's multiplicative hashing constant. */
+#define HASH_SHIFT 16                       /** Fold the high bits of a hash into the low bits. */
+
+/**
+ * hash_addr
+ * <p>
+ * Get the home bucket of a socket address.
+ * </p>
+ * @param socket_ip the ip address
+ * @param socket_port the port
+ * @return the home bucket
+ */
+static size_t hash_addr(in_addr_t socket_ip, in_port_t socket_port);
+
+/**
+ * hash_id
+ * <p>
+ * Get the home bucket of a User ID.
+ * </p>
+ * @param user_id the User ID
+ * @return the home bucket
+ */
+static size_t hash_id(int user_id);
+
+/**
+ * addr_home
+ * <p>
+ * Get the home bucket in the address index of the session in a slot.
+ * </p>
+ * @param table the session table
+ * @param slot the slot
+ * @return the home bucket
+ */
+static size_t addr_home(const struct session_table *table, int slot);
+
+/**
+ * id_home
+ * <p>
+ * Get the home bucket in the User ID index of the session in a slot.
+ * </p>
+ * @param table the session table
+ * @param slot the slot
+ * @return the home bucket
+ */
+static size_t id_home(const struct session_table *table, int slot);
+
+/**
+ * find_addr_bucket
+ * <p>
+ * Probe the address index for a socket address.
+ * </p>
+ * @param table the session table
+ * @param socket_ip the ip address
+ * @param socket_port the port
+ * @return the bucket holding the session, or -1 if there is none
+ */
+static int find_addr_bucket(const struct session_table *table, in_addr_t socket_ip, in_port_t socket_port);
+
+/**
+ * find_id_bucket
+ * <p>
+ * Probe the User ID index for a User ID.
+ * </p>
+ * @param table the session table
+ * @param user_id the User ID
+ * @return the bucket holding the session, or -1 if there is none
+ */
+static int find_id_bucket(const struct session_table *table, int user_id);
+
+/**
+ * insert_bucket
+ * <p>
+ * Put a slot into the first empty bucket at or after its home bucket.
+ * </p>
+ * @param buckets the index
+ * @param home the home bucket of the slot
+ * @param slot the slot
+ */
+static void insert_bucket(int *buckets, size_t home, int slot);
+
+/**
+ * remove_bucket
+ * <p>
+ * Empty a bucket, then shift later entries of the same probe run back so that no lookup stops short of them.
+ * </p>
+ * @param table the session table
+ * @param buckets the index
+ * @param bucket the bucket to empty
+ * @param home the function giving the home bucket of a slot in this index
+ */
+static void remove_bucket(const struct session_table *table, int *buckets, size_t bucket,
+                          size_t (*home)(const struct session_table *, int));
+
+/**
+ * remove_slot
+ * <p>
+ * End the session in a slot, removing it from both indexes.
+ * </p>
+ * @param table the session table
+ * @param slot the slot
+ */
+static void remove_slot(struct session_table *table, int slot);
+
+int open_session_table(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    so->session_table = map_shared_memory(co, SESSION_TABLE_SHM_NAME, sizeof(struct session_table));
+    if (!so->session_table)
+    {
+        return -1;
+    }
+    
+    memset(so->session_table, 0, sizeof(struct session_table));
+    if (rw_lock_init(co, &so->session_table->lock) == -1)
+    {
+        return -1;
+    }
+    for (size_t b = 0; b < SESSION_TABLE_BUCKETS; ++b)
+    {
+        so->session_table->addr_buckets[b] = SESSION_EMPTY;
+        so->session_table->id_buckets[b]   = SESSION_EMPTY;
+    }
+    
+    return 0;
+}
+
+void close_session_table(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->session_table)
+    {
+        munmap(so->session_table, sizeof(struct session_table));
+        so->session_table = NULL;
+    }
+}
+
+int session_insert(struct core_object *co, struct server_object *so, const struct sockaddr_in *addr,
+                   const User *user)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct session_table *table;
+    Session              *session;
+    int                  bucket;
+    int                  slot;
+    
+    if (rw_lock_write(co, &so->session_table->lock) == -1)
+    {
+        return -1;
+    }
+    table = so->session_table;
+    
+    // End the sessions this one replaces.
+    bucket = find_addr_bucket(table, addr->sin_addr.s_addr, addr->sin_port);
+    if (bucket != -1)
+    {
+        remove_slot(table, table->addr_buckets[bucket]);
+    }
+    bucket = find_id_bucket(table, user->id);
+    if (bucket != -1)
+    {
+        remove_slot(table, table->id_buckets[bucket]);
+    }
+    
+    for (slot = 0; slot < SESSION_TABLE_CAPACITY && table->in_use[slot]; ++slot);
+    if (slot == SESSION_TABLE_CAPACITY)
+    {
+        rw_lock_unlock(&so->session_table->lock);
+        errno = ENOSPC;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    session = &table->sessions[slot];
+    session->socket_ip       = addr->sin_addr.s_addr;
+    session->socket_port     = addr->sin_port;
+    session->user_id         = user->id;
+    session->privilege_level = user->privilege_level;
+    strncpy(session->display_name, user->display_name, NAME_MAX_SIZE);
+    session->display_name[NAME_MAX_SIZE] = '\0';
+    table->in_use[slot] = 1;
+    
+    insert_bucket(table->addr_buckets, addr_home(table, slot), slot);
+    insert_bucket(table->id_buckets, id_home(table, slot), slot);
+    
+    rw_lock_unlock(&so->session_table->lock);
+    
+    return 0;
+}
+
+int session_find_by_addr(struct core_object *co, struct server_object *so, const struct sockaddr_in *addr,
+                         Session *session_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int bucket;
+    
+    if (rw_lock_read(co, &so->session_table->lock) == -1)
+    {
+        return -1;
+    }
+    bucket = find_addr_bucket(so->session_table, addr->sin_addr.s_addr, addr->sin_port);
+    if (bucket != -1 && session_get)
+    {
+        *session_get = so->session_table->sessions[so->session_table->addr_buckets[bucket]];
+    }
+    rw_lock_unlock(&so->session_table->lock);
+    
+    return bucket != -1;
+}
+
+int session_find_by_user_id(struct core_object *co, struct server_object *so, int user_id, Session *session_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int bucket;
+    
+    if (rw_lock_read(co, &so->session_table->lock) == -1)
+    {
+        return -1;
+    }
+    bucket = find_id_bucket(so->session_table, user_id);
+    if (bucket != -1 && session_get)
+    {
+        *session_get = so->session_table->sessions[so->session_table->id_buckets[bucket]];
+    }
+    rw_lock_unlock(&so->session_table->lock);
+    
+    return bucket != -1;
+}
+
+int session_list(struct core_object *co, struct server_object *so, Session *sessions_get, size_t *count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (rw_lock_read(co, &so->session_table->lock) == -1)
+    {
+        return -1;
+    }
+    *count = 0;
+    for (size_t slot = 0; slot < SESSION_TABLE_CAPACITY; ++slot)
+    {
+        if (so->session_table->in_use[slot])
+        {
+            sessions_get[(*count)++] = so->session_table->sessions[slot];
+        }
+    }
+    rw_lock_unlock(&so->session_table->lock);
+    
+    return 0;
+}
+
+int session_remove_by_addr(struct core_object *co, struct server_object *so, const struct sockaddr_in *addr,
+                           Session *session_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int bucket;
+    
+    if (rw_lock_write(co, &so->session_table->lock) == -1)
+    {
+        return -1;
+    }
+    bucket = find_addr_bucket(so->session_table, addr->sin_addr.s_addr, addr->sin_port);
+    if (bucket != -1)
+    {
+        if (session_get)
+        {
+            *session_get = so->session_table->sessions[so->session_table->addr_buckets[bucket]];
+        }
+        remove_slot(so->session_table, so->session_table->addr_buckets[bucket]);
+    }
+    rw_lock_unlock(&so->session_table->lock);
+    
+    return bucket != -1;
+}
+
+int session_remove_by_user_id(struct core_object *co, struct server_object *so, int user_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int bucket;
+    
+    if (rw_lock_write(co, &so->session_table->lock) == -1)
+    {
+        return -1;
+    }
+    bucket = find_id_bucket(so->session_table, user_id);
+    if (bucket != -1)
+    {
+        remove_slot(so->session_table, so->session_table->id_buckets[bucket]);
+    }
+    rw_lock_unlock(&so->session_table->lock);
+    
+    return 0;
+}
+
+static size_t hash_addr(in_addr_t socket_ip, in_port_t socket_port)
+{
+    uint32_t hash;
+    
+    hash = (socket_ip ^ ((uint32_t) socket_port << HASH_SHIFT)) * HASH_MULTIPLIER;
+    
+    return (hash ^ (hash >> HASH_SHIFT)) & (SESSION_TABLE_BUCKETS - 1);
+}
+
+static size_t hash_id(int user_id)
+{
+    uint32_t hash;
+    
+    hash = (uint32_t) user_id * HASH_MULTIPLIER;
+    
+    return (hash ^ (hash >> HASH_SHIFT)) & (SESSION_TABLE_BUCKETS - 1);
+}
+
+static size_t addr_home(const struct session_table *table, int slot)
+{
+    return hash_addr(table->sessions[slot].socket_ip, table->sessions[slot].socket_port);
+}
+
+static size_t id_home(const struct session_table *table, int slot)
+{
+    return hash_id(table->sessions[slot].user_id);
+}
+
+static int find_addr_bucket(const struct session_table *table, in_addr_t socket_ip, in_port_t socket_port)
+{
+    const Session *session;
+    size_t        bucket;
+    
+    for (bucket = hash_addr(socket_ip, socket_port);
+         table->addr_buckets[bucket] != SESSION_EMPTY; bucket = (bucket + 1) & (SESSION_TABLE_BUCKETS - 1))
+    {
+        session = &table->sessions[table->addr_buckets[bucket]];
+        if (session->socket_ip == socket_ip && session->socket_port == socket_port)
+        {
+            return (int) bucket;
+        }
+    }
+    
+    return -1;
+}
+
+static int find_id_bucket(const struct session_table *table, int user_id)
+{
+    size_t bucket;
+    
+    for (bucket = hash_id(user_id);
+         table->id_buckets[bucket] != SESSION_EMPTY; bucket = (bucket + 1) & (SESSION_TABLE_BUCKETS - 1))
+    {
+        if (table->sessions[table->id_buckets[bucket]].user_id == user_id)
+        {
+            return (int) bucket;
+        }
+    }
+    
+    return -1;
+}
+
+static void insert_bucket(int *buckets, size_t home, int slot)
+{
+    size_t bucket;
+    
+    // There are twice as many buckets as slots, so an empty bucket always exists.
+    for (bucket = home; buckets[bucket] != SESSION_EMPTY; bucket = (bucket + 1) & (SESSION_TABLE_BUCKETS - 1));
+    buckets[bucket] = slot;
+}
+
+static void remove_bucket(const struct session_table *table, int *buckets, size_t bucket,
+                          size_t (*home)(const struct session_table *, int))
+{
+    size_t next;
+    size_t next_home;
+    
+    for (next = (bucket + 1) & (SESSION_TABLE_BUCKETS - 1); buckets[next] != SESSION_EMPTY;
+         next = (next + 1) & (SESSION_TABLE_BUCKETS - 1))
+    {
+        next_home = home(table, buckets[next]);
+        
+        // The entry may fill the hole only if its home does not lie cyclically in (bucket, next].
+        if (((next - next_home) & (SESSION_TABLE_BUCKETS - 1)) >= ((next - bucket) & (SESSION_TABLE_BUCKETS - 1)))
+        {
+            buckets[bucket] = buckets[next];
+            bucket = next;
+        }
+    }
+    buckets[bucket] = SESSION_EMPTY;
+}
+
+static void remove_slot(struct session_table *table, int slot)
+{
+    const Session *session;
+    int           bucket;
+    
+    session = &table->sessions[slot];
+    
+    bucket = find_addr_bucket(table, session->socket_ip, session->socket_port);
+    remove_bucket(table, table->addr_buckets, (size_t) bucket, addr_home);
+    bucket = find_id_bucket(table, session->user_id);
+    remove_bucket(table, table->id_buckets, (size_t) bucket, id_home);
+    
+    table->in_use[slot] = 0;
+}
@@ -0,0 +1,1525 @@
+#include "../../include/manager.h"
+#include "../include/db.h"
+#include "../include/name-filter.h"
+#include "../include/object-cache.h"
+#include "../include/process-server-util.h"
+#include "../include/rw-lock.h"
+#include "../include/snapshot.h"
+#include "../include/storage-engine.h"
+#include "../include/user-table.h"
+#include "../include/write-ahead-log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define SHM_ARENA_ENV "CHAT_SHM_ARENA_MB"  /** Megabytes of shared memory per database. */
+#define SHM_DEFAULT_ARENA_MB 32             /** Megabytes of shared memory per database if SHM_ARENA_ENV is unset. */
+#define BYTES_PER_MB (1024UL * 1024UL)      /** Bytes per megabyte. */
+#define SHM_NAME_FORMAT "/se_%s"            /** Shared memory name of a database, formatted with the database name. */
+#define SHM_NAME_SIZE 32                    /** Size of a buffer holding a shared memory name. */
+#define SHM_BUCKETS 65536                   /** Hash buckets per table; a power of two. */
+#define SHM_MIN_BLOCK_SHIFT 6               /** The smallest block is 64 bytes. */
+#define SHM_SIZE_CLASSES 32                 /** Block sizes are powers of two from the smallest block upwards. */
+#define SHM_DIRTY_RING_SIZE 4096            /** Changed keys remembered between flushes; a power of two. */
+#define SHM_DIRTY_KEY_MAX 16                /** Longest key which is remembered individually. */
+#define SHM_ALIGN 8                         /** Alignment of the value of an entry. */
+#define SHM_NULL 0                          /** Offset 0 is the table header, so it never locates an entry. */
+#define FNV_OFFSET_BASIS 14695981039346656037UL /** 64 bit FNV-1a offset basis. */
+#define FNV_PRIME 1099511628211UL               /** 64 bit FNV-1a prime. */
+
+/**
+ * A key which has changed since the last flush.
+ */
+struct shm_dirty_key
+{
+    uint32_t size;
+    uint8_t  bytes[SHM_DIRTY_KEY_MAX];
+};
+
+/**
+ * The header of a table in shared memory. Entries are allocated from the arena which follows the header and are
+ * addressed by their offset from the start of the header, so the table is valid at any mapping address. Freed blocks
+ * are kept on one free list per size class. Two chained hash tables index the entries: one by record key, and one by
+ * record name for databases with a name index. Only read or written while holding the database lock.
+ * <p>
+ * Every write records the changed key in the dirty ring, from which the parent persists changes. If the ring fills up
+ * before the parent drains it, it is marked overflowed and the next flush rewrites the whole database.
+ * </p>
+ */
+struct shm_table
+{
+    size_t               size;
+    size_t               used;
+    size_t               free_blocks[SHM_SIZE_CLASSES];
+    size_t               buckets[SHM_BUCKETS];
+    size_t               name_buckets[SHM_BUCKETS];
+    unsigned long        dirty_head;
+    unsigned long        dirty_tail;
+    int                  dirty_overflow;
+    struct shm_dirty_key dirty[SHM_DIRTY_RING_SIZE];
+};
+
+/**
+ * An entry in a table. The key follows the header, and the value follows the key at the next aligned offset. In the
+ * name index the key is a name and the value is the key of the record holding it.
+ */
+struct shm_entry
+{
+    size_t   next;
+    uint32_t size_class;
+    uint32_t key_size;
+    uint32_t value_size;
+};
+
+/**
+ * The smallest block of a table. Every block starts at a multiple of its size from the start of the header, so the
+ * table is addressed as an array of these and each entry is reached with the alignment of its header.
+ */
+struct shm_block
+{
+    struct shm_entry entry;
+    uint8_t          data[(1UL << SHM_MIN_BLOCK_SHIFT) - sizeof(struct shm_entry)];
+};
+
+static_assert(sizeof(struct shm_block) == 1UL << SHM_MIN_BLOCK_SHIFT, "A block must be as large as the smallest one");
+
+/**
+ * The state of a shared memory database in one process. The backing database stores the same records in ndbm files;
+ * it is only used by the parent, so its lock and generation are private.
+ */
+struct shm_database
+{
+    struct shm_table *table;
+    struct database  backing;
+    struct rw_lock   backing_lock;
+    unsigned long    backing_generation;
+};
+
+/**
+ * The keys of records in the backing database which are no longer in the table.
+ */
+struct key_list
+{
+    struct shm_table *table;
+    datum            *keys;
+    size_t           count;
+    size_t           capacity;
+};
+
+/**
+ * shm_open_database
+ * <p>
+ * Map the table of a database into shared memory and load every record from the ndbm files of the database.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param db the database to open
+ * @return 0 on success, -1 and set err on failure
+ */
+static int shm_open_database(struct core_object *co, struct server_object *so, struct database *db);
+
+/**
+ * shm_close_database
+ * <p>
+ * Unmap the table of a database and release the backing database.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param db the database to close
+ */
+static void shm_close_database(struct core_object *co, struct server_object *so, struct database *db);
+
+/**
+ * shm_store
+ * <p>
+ * Store a record in a database. If the database has a name index, the index is updated under the same lock.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key under which to store
+ * @param value the value to store
+ * @param store_flags whether to insert or overwrite
+ * @return 0 on success, 1 if insert and record already exists or the name is taken, -1 and set err on failure
+ */
+static int shm_store(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags);
+
+/**
+ * shm_fetch
+ * <p>
+ * Fetch a record from a database.
+ * </p>
+ * @param co the core object
+ * @param db the database from which to fetch
+ * @param key the key of the record to fetch
+ * @param serial_buffer the buffer into which to copy the fetched record
+ * @param size memory in which to store the size of the record, or NULL if not required
+ * @return 0 if successful and copy occurs, 1 if record not found, -1 and set err on failure
+ */
+static int shm_fetch(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer, size_t *size);
+
+/**
+ * shm_remove
+ * <p>
+ * Delete a record from a database, along with its name index entry if the database has a name index.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param key the key to delete
+ * @return 0 on success, -1 and set err on failure or if the record does not exist
+ */
+static int shm_remove(struct core_object *co, struct database *db, datum *key);
+
+/**
+ * shm_find_by_name
+ * <p>
+ * Find a record by name. If the database has a name index the lookup goes through it; otherwise every record is
+ * scanned.
+ * </p>
+ * @param co the core object
+ * @param db the database in which to search
+ * @param serial_object the object to store the result, or NULL if no result is needed
+ * @param size memory in which to store the size of the result, or NULL if not required
+ * @param name the name for which to search
+ * @return 0 on success and record not located, 1 on success and record located, -1 and set err on failure
+ */
+static int shm_find_by_name(struct core_object *co, struct database *db, uint8_t **serial_object,
+                            size_t *size, const char *name);
+
+/**
+ * shm_for_each
+ * <p>
+ * Call a visitor on every record of a database while holding the lock for reading.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param visit the visitor
+ * @param arg passed to the visitor
+ * @return 0 on success, -1 and set err on failure
+ */
+static int shm_for_each(struct core_object *co, struct database *db, record_visitor visit, void *arg);
+
+/**
+ * shm_write_batch
+ * <p>
+ * Apply writes to a database in order under one acquisition of the lock, logging them first. Flushing forces the log
+ * to disk; if the database is not logged there is nothing to flush, and the writes reach disk with the next
+ * background persistence flush.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param ops the writes
+ * @param count the number of writes
+ * @param flush whether to force the log to disk
+ * @return 0 if the batch was applied, -1 and set err on failure
+ */
+static int shm_write_batch(struct core_object *co, struct database *db, struct write_op *ops, size_t count,
+                           int flush);
+
+/**
+ * shm_check
+ * <p>
+ * Check whether a write to a table would be refused, with the same semantics as the ndbm engine.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param op the write
+ * @return 0 if the write would be applied, 1 if it would be refused
+ */
+static int shm_check(struct core_object *co, struct database *db, const struct write_op *op);
+
+/**
+ * shm_apply
+ * <p>
+ * Apply writes to a table in order and track the changed keys. Records in memory are made durable by the write-ahead
+ * log or by persistence, so flushing does nothing.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param ops the writes
+ * @param count the number of writes
+ * @param flush ignored
+ * @return 0 if the writes were applied
+ */
+static int shm_apply(struct core_object *co, struct database *db, struct write_op *ops, size_t count, int flush);
+
+/**
+ * shm_sync
+ * <p>
+ * Persist the records changed since the last flush to the backing database, and force it to disk.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @return 0 on success, -1 and set err on failure
+ */
+static int shm_sync(struct core_object *co, struct database *db);
+
+/**
+ * shm_persist
+ * <p>
+ * Write the records changed since the last flush through to the backing database. The changed records are copied
+ * out under the lock for reading, so workers are only held up for the copy and not for the disk writes. If the dirty
+ * ring overflowed, the whole backing database is rewritten instead, holding the lock throughout.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @return 0 on success, -1 and set err on failure
+ */
+static int shm_persist(struct core_object *co, struct database *db);
+
+/**
+ * shm_snapshot
+ * <p>
+ * Copy the table of a database into a new buffer. Entries are addressed by their offsets, so the copy is loaded back
+ * by copying it into the table of a later run.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param image memory in which to store the copy
+ * @param size memory in which to store the size of the copy
+ * @return 0 on success, -1 and set err on failure
+ */
+static int shm_snapshot(struct core_object *co, struct database *db, uint8_t **image, size_t *size);
+
+/**
+ * load_table_image
+ * <p>
+ * Fill a freshly mapped table from the latest snapshot.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param db the database
+ * @param table the table
+ * @param size the size of the table
+ * @return 1 if the table was loaded, 0 if there is no usable image, -1 and set err on failure
+ */
+static int load_table_image(struct core_object *co, struct server_object *so, struct database *db,
+                            struct shm_table *table, size_t size);
+
+/**
+ * for_each_entry
+ * <p>
+ * Call a visitor on every record of a table. Must be called while holding the database lock.
+ * </p>
+ * @param co the core object
+ * @param table the table
+ * @param visit the visitor
+ * @param arg passed to the visitor
+ * @return 0 on success, -1 if the visitor failed
+ */
+static int for_each_entry(struct core_object *co, struct shm_table *table, record_visitor visit, void *arg);
+
+/**
+ * entry_at
+ * <p>
+ * Get the entry at an offset in a table.
+ * </p>
+ * @param table the table
+ * @param offset the offset of the entry
+ * @return the entry
+ */
+static struct shm_entry *entry_at(struct shm_table *table, size_t offset);
+
+/**
+ * entry_key
+ * <p>
+ * Get the key of an entry as a datum pointing into the table.
+ * </p>
+ * @param entry the entry
+ * @return the key
+ */
+static datum entry_key(struct shm_entry *entry);
+
+/**
+ * entry_value
+ * <p>
+ * Get the value of an entry as a datum pointing into the table.
+ * </p>
+ * @param entry the entry
+ * @return the value
+ */
+static datum entry_value(struct shm_entry *entry);
+
+/**
+ * same_bytes
+ * <p>
+ * Check whether two datums hold the same bytes.
+ * </p>
+ * @param a a datum
+ * @param b a datum
+ * @return 1 if the bytes are the same, 0 if not
+ */
+static int same_bytes(const datum *a, const datum *b);
+
+/**
+ * hash_bytes
+ * <p>
+ * Get the bucket of a key.
+ * </p>
+ * @param key the key
+ * @return the bucket
+ */
+static size_t hash_bytes(const datum *key);
+
+/**
+ * find_link
+ * <p>
+ * Find the link which points to the entry holding a key: either its bucket or the next field of the entry before it.
+ * </p>
+ * @param table the table
+ * @param buckets the hash table in which to search
+ * @param key the key
+ * @return the link, or NULL if no entry holds the key
+ */
+static size_t *find_link(struct shm_table *table, size_t *buckets, const datum *key);
+
+/**
+ * lookup_entry
+ * <p>
+ * Find the entry holding a key.
+ * </p>
+ * @param table the table
+ * @param buckets the hash table in which to search
+ * @param key the key
+ * @return the entry, or NULL if no entry holds the key
+ */
+static struct shm_entry *lookup_entry(struct shm_table *table, size_t *buckets, const datum *key);
+
+/**
+ * allocate_entry
+ * <p>
+ * Allocate an entry and copy a key and value into it. The entry is not linked into a hash table.
+ * </p>
+ * @param table the table
+ * @param key the key
+ * @param value the value
+ * @return the offset of the entry, or SHM_NULL if the arena is full
+ */
+static size_t allocate_entry(struct shm_table *table, const datum *key, const datum *value);
+
+/**
+ * release_entry
+ * <p>
+ * Return the block of an unlinked entry to its free list.
+ * </p>
+ * @param table the table
+ * @param offset the offset of the entry
+ */
+static void release_entry(struct shm_table *table, size_t offset);
+
+/**
+ * link_entry
+ * <p>
+ * Link an entry into a hash table in place of any entry holding the same key.
+ * </p>
+ * @param table the table
+ * @param buckets the hash table
+ * @param offset the offset of the entry
+ * @return the offset of the replaced entry, which is unlinked but not released, or SHM_NULL if there was none
+ */
+static size_t link_entry(struct shm_table *table, size_t *buckets, size_t offset);
+
+/**
+ * unlink_entry
+ * <p>
+ * Unlink the entry holding a key from a hash table.
+ * </p>
+ * @param table the table
+ * @param buckets the hash table
+ * @param key the key
+ * @return the offset of the entry, which is not released, or SHM_NULL if no entry holds the key
+ */
+static size_t unlink_entry(struct shm_table *table, size_t *buckets, const datum *key);
+
+/**
+ * put_record
+ * <p>
+ * Store a record in a table with the same semantics as the ndbm engine. Must be called while holding the database
+ * lock for writing.
+ * </p>
+ * @param co the core object
+ * @param db the database
+ * @param table the table of the database
+ * @param key the key under which to store
+ * @param value the value to store
+ * @param store_flags whether to insert or overwrite
+ * @return 0 on success, 1 if the store is refused, -1 and set err if the arena is full
+ */
+static int put_record(struct core_object *co, struct database *db, struct shm_table *table, datum *key, datum *value,
+                      int store_flags);
+
+/**
+ * delete_record
+ * <p>
+ * Delete a record from a table, along with its name index entry. Must be called while holding the database lock
+ * for writing.
+ * </p>
+ * @param db the database
+ * @param table the table of the database
+ * @param key the key to delete
+ * @return 0 on success, 1 if the record does not exist
+ */
+static int delete_record(struct database *db, struct shm_table *table, const datum *key);
+
+/**
+ * track_change
+ * <p>
+ * Record a changed key in the dirty ring. Must be called while holding the database lock for writing.
+ * </p>
+ * @param table the table
+ * @param key the changed key
+ */
+static void track_change(struct shm_table *table, const datum *key);
+
+/**
+ * load_record
+ * <p>
+ * Visitor which puts a record of the backing database into the table of a database.
+ * </p>
+ * @param co the core object
+ * @param arg the database
+ * @param key the key of the record
+ * @param value the record
+ * @return 0 on success, -1 and set err if the arena is full
+ */
+static int load_record(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * write_back_record
+ * <p>
+ * Visitor which stores a record of a table in the backing database.
+ * </p>
+ * @param co the core object
+ * @param arg the shm_database
+ * @param key the key of the record
+ * @param value the record
+ * @return 0 on success, -1 and set err on failure
+ */
+static int write_back_record(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * collect_missing_key
+ * <p>
+ * Visitor which collects the keys of records in the backing database which are no longer in the table.
+ * </p>
+ * @param co the core object
+ * @param arg the key_list
+ * @param key the key of the record
+ * @param value the record
+ * @return 0 on success, -1 and set err on failure
+ */
+static int collect_missing_key(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * write_back_change
+ * <p>
+ * Apply one changed key to the backing database: store the record if it still exists, otherwise delete it.
+ * </p>
+ * @param co the core object
+ * @param state the shm_database
+ * @param key the changed key
+ * @param value the current record, or a datum with a NULL dptr if the record was deleted
+ * @return 0 on success, -1 and set err on failure
+ */
+static int write_back_change(struct core_object *co, struct shm_database *state, datum *key, datum *value);
+
+/**
+ * rewrite_backing
+ * <p>
+ * Rewrite the backing database to hold exactly the records of the table. Must be called while holding the database
+ * lock for reading.
+ * </p>
+ * @param co the core object
+ * @param state the shm_database
+ * @return 0 on success, -1 and set err on failure
+ */
+static int rewrite_backing(struct core_object *co, struct shm_database *state);
+
+const struct storage_engine shm_storage_engine = {
+        "shm",
+        shm_open_database,
+        shm_close_database,
+        shm_store,
+        shm_fetch,
+        shm_remove,
+        shm_find_by_name,
+        shm_for_each,
+        shm_write_batch,
+        shm_check,
+        shm_apply,
+        shm_sync,
+        shm_persist,
+        shm_snapshot
+};
+
+static int shm_open_database(struct core_object *co, struct server_object *so, struct database *db)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_database *state;
+    char                shm_name[SHM_NAME_SIZE];
+    const char          *arena_mb;
+    size_t              size;
+    int                 loaded;
+    
+    size     = SHM_DEFAULT_ARENA_MB;
+    arena_mb = getenv(SHM_ARENA_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (arena_mb && strtoul(arena_mb, NULL, 10) > 0) // NOLINT(readability-magic-numbers) : Base 10
+    {
+        size = strtoul(arena_mb, NULL, 10); // NOLINT(readability-magic-numbers) : Base 10
+    }
+    size = size * BYTES_PER_MB + sizeof(struct shm_table);
+    
+    state = mm_calloc(1, sizeof(struct shm_database), co->mm);
+    if (!state)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    db->engine_state = state;
+    
+    (void) snprintf(shm_name, sizeof(shm_name), SHM_NAME_FORMAT, db->name);
+    state->table = map_shared_memory(co, shm_name, size);
+    if (!state->table)
+    {
+        return -1;
+    }
+    state->table->size = size;
+    state->table->used = (sizeof(struct shm_table) + (1UL << SHM_MIN_BLOCK_SHIFT) - 1)
+                         & ~((1UL << SHM_MIN_BLOCK_SHIFT) - 1);
+    
+    // The backing database holds the records between runs. It is prepared and closed again before forking, so the
+    // children never inherit its handles; the parent reopens it on the first flush.
+    state->backing.name              = db->name;
+    state->backing.index_name        = db->index_name;
+    state->backing.engine            = &ndbm_storage_engine;
+    state->backing.lock              = &state->backing_lock;
+    state->backing.shared_generation = &state->backing_generation;
+    if (rw_lock_init(co, &state->backing_lock) == -1)
+    {
+        return -1;
+    }
+    if (ndbm_storage_engine.open(co, so, &state->backing) == -1)
+    {
+        return -1;
+    }
+    
+    // A snapshot spares scanning the backing database; the write-ahead log then replays whatever came after it.
+    loaded = load_table_image(co, so, db, state->table, size);
+    if (loaded != 0)
+    {
+        ndbm_storage_engine.close(co, so, &state->backing);
+        return loaded == -1 ? -1 : 0;
+    }
+    if (ndbm_storage_engine.for_each(co, &state->backing, load_record, db) == -1)
+    {
+        ndbm_storage_engine.close(co, so, &state->backing);
+        return -1;
+    }
+    ndbm_storage_engine.close(co, so, &state->backing);
+    
+    return 0;
+}
+
+static void shm_close_database(struct core_object *co, struct server_object *so, struct database *db)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_database *state;
+    
+    state = db->engine_state;
+    if (!state)
+    {
+        return;
+    }
+    
+    ndbm_storage_engine.close(co, so, &state->backing);
+    if (state->table)
+    {
+        munmap(state->table, state->table->size);
+    }
+    mm_free(co->mm, state);
+    db->engine_state = NULL;
+}
+
+static int shm_store(struct core_object *co, struct database *db, datum *key, datum *value, int store_flags)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct write_op op;
+    
+    op.kind        = WRITE_STORE;
+    op.store_flags = store_flags;
+    op.key         = *key;
+    op.value       = *value;
+    if (shm_write_batch(co, db, &op, 1, 0) == -1)
+    {
+        return -1;
+    }
+    
+    return op.status;
+}
+
+static int shm_fetch(struct core_object *co, struct database *db, datum *key, uint8_t **serial_buffer, size_t *size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_table *table;
+    struct shm_entry *entry;
+    datum            value;
+    int              ret_val;
+    
+    if (rw_lock_read(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    table = ((struct shm_database *) db->engine_state)->table;
+    entry = lookup_entry(table, table->buckets, key);
+    if (entry)
+    {
+        value   = entry_value(entry);
+        ret_val = copy_dptr_to_buffer(co, serial_buffer, &value);
+        if (size)
+        {
+            *size = (size_t) value.dsize;
+        }
+    } else
+    {
+        ret_val = 1;
+    }
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int shm_remove(struct core_object *co, struct database *db, datum *key)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct write_op op;
+    
+    op.kind        = WRITE_REMOVE;
+    op.store_flags = 0;
+    op.key         = *key;
+    op.value.dptr  = NULL;
+    op.value.dsize = 0;
+    if (shm_write_batch(co, db, &op, 1, 0) == -1)
+    {
+        return -1;
+    }
+    
+    return op.status;
+}
+
+static int shm_write_batch(struct core_object *co, struct database *db, struct write_op *ops, size_t count,
+                           int flush)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int ret_val;
+    
+    if (rw_lock_write(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    ret_val = wal_log(co, db, ops, count, flush);
+    if (ret_val == 0)
+    {
+        ret_val = shm_apply(co, db, ops, count, flush);
+    }
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int shm_check(struct core_object *co, struct database *db, const struct write_op *op)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_table *table;
+    struct shm_entry *owner;
+    datum            name;
+    datum            owner_key;
+    int              exists;
+    
+    table  = ((struct shm_database *) db->engine_state)->table;
+    exists = lookup_entry(table, table->buckets, &op->key) != NULL;
+    if (op->kind == WRITE_REMOVE)
+    {
+        return exists ? 0 : 1;
+    }
+    if (exists && op->store_flags == DBM_INSERT)
+    {
+        return 1;
+    }
+    
+    if (db->index_name)
+    {
+        name  = record_name(&op->value);
+        owner = lookup_entry(table, table->name_buckets, &name);
+        if (owner)
+        {
+            owner_key = entry_value(owner);
+            if (!same_bytes(&owner_key, &op->key))
+            {
+                return 1; // The name belongs to a different record.
+            }
+        }
+    }
+    
+    return 0;
+}
+
+static int shm_apply(struct core_object *co, struct database *db, struct write_op *ops, size_t count, int flush)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_table *table;
+    int              written;
+    
+    (void) flush;
+    table   = ((struct shm_database *) db->engine_state)->table;
+    written = 0;
+    for (size_t o = 0; o < count; ++o)
+    {
+        if (ops[o].kind == WRITE_STORE)
+        {
+            ops[o].status = put_record(co, db, table, &ops[o].key, &ops[o].value, ops[o].store_flags);
+        } else if (delete_record(db, table, &ops[o].key) == 1)
+        {
+            errno = ENOENT;
+            SET_ERROR(co->err);
+            ops[o].status = -1;
+        } else
+        {
+            ops[o].status = 0;
+        }
+        if (ops[o].status == 0)
+        {
+            track_change(table, &ops[o].key);
+            object_cache_invalidate(db, &ops[o].key);
+            user_table_apply(db, &ops[o]);
+            written = 1;
+        }
+    }
+    if (written)
+    {
+        mark_db_written(db);
+    }
+    
+    return 0;
+}
+
+static int shm_find_by_name(struct core_object *co, struct database *db, uint8_t **serial_object,
+                            size_t *size, const char *name)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_table *table;
+    struct shm_entry *entry;
+    struct shm_entry *owner;
+    char             name_buffer[NAME_MAX_SIZE + 1];
+    datum            name_key;
+    datum            owner_key;
+    datum            value;
+    int              ret_val;
+    
+    if (rw_lock_read(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    table = ((struct shm_database *) db->engine_state)->table;
+    
+    entry = NULL;
+    if (db->index_name) // Go straight to the record through the name index.
+    {
+        owner = name_to_key(name, name_buffer, &name_key) ? lookup_entry(table, table->name_buckets, &name_key) : NULL;
+        if (owner)
+        {
+            owner_key = entry_value(owner);
+            entry     = lookup_entry(table, table->buckets, &owner_key);
+        }
+    } else
+    {
+        for (size_t b = 0; b < SHM_BUCKETS && !entry; ++b)
+        {
+            for (size_t offset = table->buckets[b]; offset != SHM_NULL; offset = entry_at(table, offset)->next)
+            {
+                value = entry_value(entry_at(table, offset));
+                if (strcmp((char *) record_name(&value).dptr, name) == 0)
+                {
+                    entry = entry_at(table, offset);
+                    break;
+                }
+            }
+        }
+    }
+    
+    ret_val = entry != NULL;
+    if (serial_object)
+    {
+        *serial_object = NULL;
+        if (entry)
+        {
+            value = entry_value(entry);
+            if (copy_dptr_to_buffer(co, serial_object, &value) == -1)
+            {
+                ret_val = -1;
+            }
+            if (size)
+            {
+                *size = (size_t) value.dsize;
+            }
+        }
+    }
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int shm_for_each(struct core_object *co, struct database *db, record_visitor visit, void *arg)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int ret_val;
+    
+    if (rw_lock_read(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    ret_val = for_each_entry(co, ((struct shm_database *) db->engine_state)->table, visit, arg);
+    rw_lock_unlock(db->lock);
+    
+    return ret_val;
+}
+
+static int shm_sync(struct core_object *co, struct database *db)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_database *state;
+    
+    state = db->engine_state;
+    if (shm_persist(co, db) == -1)
+    {
+        return -1;
+    }
+    
+    return ndbm_storage_engine.sync(co, &state->backing);
+}
+
+static int shm_persist(struct core_object *co, struct database *db)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_database  *state;
+    struct shm_table     *table;
+    struct shm_dirty_key *keys;
+    datum                *values;
+    struct shm_entry     *entry;
+    datum                key;
+    datum                current;
+    uint8_t              *copy;
+    size_t               count;
+    int                  ret_val;
+    
+    state = db->engine_state;
+    table = state->table;
+    if (rw_lock_read(co, db->lock) == -1)
+    {
+        return -1;
+    }
+    if (table->dirty_overflow)
+    {
+        ret_val = rewrite_backing(co, state);
+        if (ret_val == 0)
+        {
+            table->dirty_overflow = 0;
+            table->dirty_tail     = table->dirty_head;
+        }
+        rw_lock_unlock(db->lock);
+        return ret_val;
+    }
+    
+    // Writers are excluded, so the ring and the records cannot change while they are copied out.
+    count = table->dirty_head - table->dirty_tail;
+    if (count == 0)
+    {
+        rw_lock_unlock(db->lock);
+        return 0;
+    }
+    keys   = mm_malloc(count * sizeof(struct shm_dirty_key), co->mm);
+    values = mm_calloc(count, sizeof(datum), co->mm);
+    if (!keys || !values)
+    {
+        SET_ERROR(co->err);
+        rw_lock_unlock(db->lock);
+        if (keys)
+        {
+            mm_free(co->mm, keys);
+        }
+        if (values)
+        {
+            mm_free(co->mm, values);
+        }
+        return -1;
+    }
+    ret_val = 0;
+    for (size_t k = 0; k < count && ret_val == 0; ++k)
+    {
+        keys[k]   = table->dirty[(table->dirty_tail + k) & (SHM_DIRTY_RING_SIZE - 1)];
+        key.dptr  = (void *) keys[k].bytes;
+        key.dsize = (int) keys[k].size;
+        entry = lookup_entry(table, table->buckets, &key);
+        if (entry)
+        {
+            current = entry_value(entry);
+            if (copy_dptr_to_buffer(co, &copy, &current) == -1)
+            {
+                ret_val = -1;
+            } else
+            {
+                values[k].dptr  = (void *) copy;
+                values[k].dsize = current.dsize;
+            }
+        }
+    }
+    if (ret_val == 0)
+    {
+        table->dirty_tail = table->dirty_head;
+    }
+    rw_lock_unlock(db->lock);
+    
+    for (size_t k = 0; k < count; ++k)
+    {
+        key.dptr  = (void *) keys[k].bytes;
+        key.dsize = (int) keys[k].size;
+        if (ret_val == 0 && write_back_change(co, state, &key, &values[k]) == -1)
+        {
+            ret_val = -1;
+        }
+        if (values[k].dptr)
+        {
+            mm_free(co->mm, values[k].dptr);
+        }
+    }
+    mm_free(co->mm, keys);
+    mm_free(co->mm, values);
+    
+    return ret_val;
+}
+
+static int shm_snapshot(struct core_object *co, struct database *db, uint8_t **image, size_t *size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct shm_table *table;
+    
+    // Only the part of the arena handed out so far is copied; the rest of the table is still zero.
+    table  = ((struct shm_database *) db->engine_state)->table;
+    *image = mm_malloc(table->used, co->mm);
+    if (!*image)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    memcpy(*image, table, table->used);
+    *size = table->used;
+    
+    return 0;
+}
+
+static int load_table_image(struct core_object *co, struct server_object *so, struct database *db,
+                            struct shm_table *table, size_t size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    size_t image_size;
+    int    ret_val;
+    
+    ret_val = load_snapshot_image(co, so, db, table, size, &image_size);
+    if (ret_val != 1)
+    {
+        return ret_val;
+    }
+    if (image_size < sizeof(struct shm_table) || table->used != image_size)
+    {
+        memset(table, 0, image_size);
+        table->size = size;
+        table->used = (sizeof(struct shm_table) + (1UL << SHM_MIN_BLOCK_SHIFT) - 1)
+                      & ~((1UL << SHM_MIN_BLOCK_SHIFT) - 1);
+        return 0;
+    }
+    
+    // The arena may have been resized since. The dirty ring of the snapshot is dropped: every change it lists either
+    // reached the backing database at a checkpoint or is replayed from the write-ahead log, which marks it again.
+    table->size           = size;
+    table->dirty_head     = 0;
+    table->dirty_tail     = 0;
+    table->dirty_overflow = 0;
+    (void) fprintf(stdout, "Loaded %s from snapshot %s.\n", db->name, SNAPSHOT_FILE_NAME);
+    
+    return 1;
+}
+
+static int for_each_entry(struct core_object *co, struct shm_table *table, record_visitor visit, void *arg)
+{
+    struct shm_entry *entry;
+    datum            key;
+    datum            value;
+    
+    for (size_t b = 0; b < SHM_BUCKETS; ++b)
+    {
+        for (size_t offset = table->buckets[b]; offset != SHM_NULL; offset = entry->next)
+        {
+            entry = entry_at(table, offset);
+            key   = entry_key(entry);
+            value = entry_value(entry);
+            if (visit(co, arg, &key, &value) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+static struct shm_entry *entry_at(struct shm_table *table, size_t offset)
+{
+    return &((struct shm_block *) table)[offset >> SHM_MIN_BLOCK_SHIFT].entry;
+}
+
+static datum entry_key(struct shm_entry *entry)
+{
+    datum key;
+    
+    key.dptr  = (void *) (entry + 1);
+    key.dsize = (int) entry->key_size;
+    
+    return key;
+}
+
+static datum entry_value(struct shm_entry *entry)
+{
+    datum  value;
+    size_t key_size;
+    
+    key_size    = (entry->key_size + SHM_ALIGN - 1) & ~((size_t) SHM_ALIGN - 1);
+    value.dptr  = (void *) ((uint8_t *) (entry + 1) + key_size);
+    value.dsize = (int) entry->value_size;
+    
+    return value;
+}
+
+static int same_bytes(const datum *a, const datum *b)
+{
+    return a->dsize == b->dsize && memcmp(a->dptr, b->dptr, (size_t) a->dsize) == 0;
+}
+
+static size_t hash_bytes(const datum *key)
+{
+    const uint8_t *bytes;
+    unsigned long hash;
+    
+    bytes = (const uint8_t *) key->dptr;
+    hash  = FNV_OFFSET_BASIS;
+    for (int i = 0; i < key->dsize; ++i)
+    {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    
+    return hash & (SHM_BUCKETS - 1);
+}
+
+static size_t *find_link(struct shm_table *table, size_t *buckets, const datum *key)
+{
+    struct shm_entry *entry;
+    datum            entry_key_datum;
+    size_t           *link;
+    
+    for (link = &buckets[hash_bytes(key)]; *link != SHM_NULL; link = &entry->next)
+    {
+        entry           = entry_at(table, *link);
+        entry_key_datum = entry_key(entry);
+        if (same_bytes(&entry_key_datum, key))
+        {
+            return link;
+        }
+    }
+    
+    return NULL;
+}
+
+static struct shm_entry *lookup_entry(struct shm_table *table, size_t *buckets, const datum *key)
+{
+    size_t *link;
+    
+    link = find_link(table, buckets, key);
+    
+    return link ? entry_at(table, *link) : NULL;
+}
+
+static size_t allocate_entry(struct shm_table *table, const datum *key, const datum *value)
+{
+    struct shm_entry *entry;
+    datum            entry_value_datum;
+    size_t           needed;
+    size_t           offset;
+    uint32_t         size_class;
+    
+    needed = sizeof(struct shm_entry) + (((size_t) key->dsize + SHM_ALIGN - 1) & ~((size_t) SHM_ALIGN - 1))
+             + (size_t) value->dsize;
+    for (size_class = 0; (1UL << (size_class + SHM_MIN_BLOCK_SHIFT)) < needed; ++size_class);
+    if (size_class >= SHM_SIZE_CLASSES)
+    {
+        return SHM_NULL;
+    }
+    
+    offset = table->free_blocks[size_class];
+    if (offset != SHM_NULL)
+    {
+        table->free_blocks[size_class] = entry_at(table, offset)->next;
+    } else
+    {
+        if (table->size - table->used < (1UL << (size_class + SHM_MIN_BLOCK_SHIFT)))
+        {
+            return SHM_NULL;
+        }
+        offset = table->used;
+        table->used += 1UL << (size_class + SHM_MIN_BLOCK_SHIFT);
+    }
+    
+    entry = entry_at(table, offset);
+    entry->next       = SHM_NULL;
+    entry->size_class = size_class;
+    entry->key_size   = (uint32_t) key->dsize;
+    entry->value_size = (uint32_t) value->dsize;
+    memcpy(entry_key(entry).dptr, key->dptr, (size_t) key->dsize);
+    entry_value_datum = entry_value(entry);
+    memcpy(entry_value_datum.dptr, value->dptr, (size_t) value->dsize);
+    
+    return offset;
+}
+
+static void release_entry(struct shm_table *table, size_t offset)
+{
+    struct shm_entry *entry;
+    
+    entry = entry_at(table, offset);
+    entry->next = table->free_blocks[entry->size_class];
+    table->free_blocks[entry->size_class] = offset;
+}
+
+static size_t link_entry(struct shm_table *table, size_t *buckets, size_t offset)
+{
+    struct shm_entry *entry;
+    datum            key;
+    size_t           *link;
+    size_t           replaced;
+    
+    entry = entry_at(table, offset);
+    key   = entry_key(entry);
+    link  = find_link(table, buckets, &key);
+    if (link)
+    {
+        replaced    = *link;
+        entry->next = entry_at(table, replaced)->next;
+        *link       = offset;
+        return replaced;
+    }
+    
+    link        = &buckets[hash_bytes(&key)];
+    entry->next = *link;
+    *link       = offset;
+    
+    return SHM_NULL;
+}
+
+static size_t unlink_entry(struct shm_table *table, size_t *buckets, const datum *key)
+{
+    size_t *link;
+    size_t offset;
+    
+    link = find_link(table, buckets, key);
+    if (!link)
+    {
+        return SHM_NULL;
+    }
+    offset = *link;
+    *link  = entry_at(table, offset)->next;
+    
+    return offset;
+}
+
+static int put_record(struct core_object *co, struct database *db, struct shm_table *table, datum *key, datum *value,
+                      int store_flags)
+{
+    struct shm_entry *owner;
+    datum            name;
+    datum            owner_key;
+    datum            old_value;
+    datum            old_name;
+    size_t           name_entry;
+    size_t           record;
+    size_t           replaced;
+    
+    if (store_flags == DBM_INSERT && lookup_entry(table, table->buckets, key))
+    {
+        return 1;
+    }
+    
+    name_entry = SHM_NULL;
+    if (db->index_name)
+    {
+        name  = record_name(value);
+        owner = lookup_entry(table, table->name_buckets, &name);
+        if (owner)
+        {
+            owner_key = entry_value(owner);
+            if (!same_bytes(&owner_key, key))
+            {
+                return 1; // The name belongs to a different record.
+            }
+        } else
+        {
+            name_entry = allocate_entry(table, &name, key);
+            if (name_entry == SHM_NULL)
+            {
+                errno = ENOSPC;
+                SET_ERROR(co->err);
+                return -1;
+            }
+        }
+    }
+    
+    record = allocate_entry(table, key, value);
+    if (record == SHM_NULL)
+    {
+        if (name_entry != SHM_NULL)
+        {
+            release_entry(table, name_entry);
+        }
+        errno = ENOSPC;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (name_entry != SHM_NULL)
+    {
+        (void) link_entry(table, table->name_buckets, name_entry);
+        name_filter_add(db, &name);
+    }
+    
+    replaced = link_entry(table, table->buckets, record);
+    if (replaced != SHM_NULL)
+    {
+        // If the record was renamed, release the old name.
+        if (db->index_name)
+        {
+            old_value = entry_value(entry_at(table, replaced));
+            old_name  = record_name(&old_value);
+            if (!same_bytes(&old_name, &name))
+            {
+                name_entry = unlink_entry(table, table->name_buckets, &old_name);
+                if (name_entry != SHM_NULL)
+                {
+                    name_filter_remove(db, &old_name);
+                    release_entry(table, name_entry);
+                }
+            }
+        }
+        release_entry(table, replaced);
+    }
+    
+    return 0;
+}
+
+static int delete_record(struct database *db, struct shm_table *table, const datum *key)
+{
+    struct shm_entry *owner;
+    datum            value;
+    datum            name;
+    datum            owner_key;
+    size_t           record;
+    size_t           name_entry;
+    
+    record = unlink_entry(table, table->buckets, key);
+    if (record == SHM_NULL)
+    {
+        return 1;
+    }
+    
+    if (db->index_name)
+    {
+        value = entry_value(entry_at(table, record));
+        name  = record_name(&value);
+        owner = lookup_entry(table, table->name_buckets, &name);
+        if (owner)
+        {
+            owner_key = entry_value(owner);
+            if (same_bytes(&owner_key, key))
+            {
+                name_entry = unlink_entry(table, table->name_buckets, &name);
+                name_filter_remove(db, &name);
+                release_entry(table, name_entry);
+            }
+        }
+    }
+    release_entry(table, record);
+    
+    return 0;
+}
+
+static void track_change(struct shm_table *table, const datum *key)
+{
+    struct shm_dirty_key *dirty_key;
+    
+    if (table->dirty_overflow)
+    {
+        return; // The next flush rewrites everything anyway.
+    }
+    if (table->dirty_head - table->dirty_tail == SHM_DIRTY_RING_SIZE || key->dsize > SHM_DIRTY_KEY_MAX)
+    {
+        table->dirty_overflow = 1;
+        return;
+    }
+    
+    dirty_key = &table->dirty[table->dirty_head & (SHM_DIRTY_RING_SIZE - 1)];
+    dirty_key->size = (uint32_t) key->dsize;
+    memcpy(dirty_key->bytes, key->dptr, (size_t) key->dsize);
+    ++table->dirty_head;
+}
+
+static int load_record(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    struct database  *db;
+    struct shm_table *table;
+    
+    db    = arg;
+    table = ((struct shm_database *) db->engine_state)->table;
+    
+    // The children have not been forked yet, so the table needs no lock.
+    if (put_record(co, db, table, key, value, DBM_REPLACE) == -1)
+    {
+        (void) fprintf(stderr, "Database %s does not fit in shared memory; raise %s.\n", db->name, SHM_ARENA_ENV);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int write_back_record(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    struct shm_database *state;
+    
+    state = arg;
+    
+    return write_back_change(co, state, key, value);
+}
+
+static int collect_missing_key(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    struct key_list *missing;
+    datum           *keys;
+    size_t          capacity;
+    
+    (void) value;
+    missing = arg;
+    if (lookup_entry(missing->table, missing->table->buckets, key))
+    {
+        return 0;
+    }
+    
+    if (missing->count == missing->capacity)
+    {
+        capacity = missing->capacity ? 2 * missing->capacity : SHM_DIRTY_RING_SIZE;
+        keys     = missing->keys ? mm_realloc(missing->keys, capacity * sizeof(datum), co->mm)
+                                 : mm_malloc(capacity * sizeof(datum), co->mm);
+        if (!keys)
+        {
+            SET_ERROR(co->err);
+            return -1;
+        }
+        missing->keys     = keys;
+        missing->capacity = capacity;
+    }
+    
+    // The key points into the dbm buffer, which the next fetch overwrites.
+    keys = &missing->keys[missing->count];
+    keys->dptr = mm_malloc((size_t) key->dsize, co->mm);
+    if (!keys->dptr)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    memcpy(keys->dptr, key->dptr, (size_t) key->dsize);
+    keys->dsize = key->dsize;
+    ++missing->count;
+    
+    return 0;
+}
+
+static int write_back_change(struct core_object *co, struct shm_database *state, datum *key, datum *value)
+{
+    uint8_t *existing;
+    int     status;
+    
+    if (value->dptr)
+    {
+        status = ndbm_storage_engine.store(co, &state->backing, key, value, DBM_REPLACE);
+        if (status == 1)
+        {
+            (void) fprintf(stderr, "Could not persist a record of %s: its name is held by another record.\n",
+                           state->backing.name);
+        }
+        return status == -1 ? -1 : 0;
+    }
+    
+    // The record was deleted; it may never have reached the backing database.
+    status = ndbm_storage_engine.fetch(co, &state->backing, key, &existing, NULL);
+    if (status == 0)
+    {
+        mm_free(co->mm, existing);
+        status = ndbm_storage_engine.remove(co, &state->backing, key);
+    }
+    
+    return status == -1 ? -1 : 0;
+}
+
+static int rewrite_backing(struct core_object *co, struct shm_database *state)
+{
+    struct key_list missing;
+    datum           deleted;
+    int             ret_val;
+    
+    missing.table    = state->table;
+    missing.keys     = NULL;
+    missing.count    = 0;
+    missing.capacity = 0;
+    
+    // Delete first, so that no stale record holds a name which a current record needs.
+    ret_val      = ndbm_storage_engine.for_each(co, &state->backing, collect_missing_key, &missing);
+    deleted.dptr = NULL;
+    for (size_t k = 0; k < missing.count; ++k)
+    {
+        if (ret_val == 0 && write_back_change(co, state, &missing.keys[k], &deleted) == -1)
+        {
+            ret_val = -1;
+        }
+        mm_free(co->mm, missing.keys[k].dptr);
+    }
+    if (missing.keys)
+    {
+        mm_free(co->mm, missing.keys);
+    }
+    
+    if (ret_val == 0)
+    {
+        ret_val = for_each_entry(co, state->table, write_back_record, state);
+    }
+    
+    return ret_val;
+}
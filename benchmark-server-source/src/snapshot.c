@@ -0,0 +1,353 @@
+#include "../../include/manager.h"
+#include "../include/rw-lock.h"
+#include "../include/snapshot.h"
+#include "../include/write-ahead-log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * copy_images
+ * <p>
+ * Copy the image of every database out of memory, holding every database lock for reading, and note the active
+ * segment of the write-ahead log.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param header the header in which to note the segment
+ * @param images memory in which to store the images
+ * @param sizes memory in which to store the sizes of the images
+ * @return 0 on success, -1 and set err on failure; the images copied so far must be freed either way
+ */
+static int copy_images(struct core_object *co, struct server_object *so, struct snapshot_header *header,
+                       uint8_t **images, size_t *sizes);
+
+/**
+ * write_snapshot_file
+ * <p>
+ * Write the images to a temporary file, force it to disk, and rename it over the latest snapshot.
+ * </p>
+ * @param co the core object
+ * @param header the header of the file
+ * @param entries the entries of the file
+ * @param images the images
+ * @return 0 on success, -1 and set err on failure
+ */
+static int write_snapshot_file(struct core_object *co, const struct snapshot_header *header,
+                               const struct snapshot_entry *entries, uint8_t **images);
+
+/**
+ * write_fully
+ * <p>
+ * Write all of a buffer to a file.
+ * </p>
+ * @param fd the file
+ * @param bytes the buffer
+ * @param size the size of the buffer
+ * @return 0 on success, -1 and set errno on failure
+ */
+static int write_fully(int fd, const void *bytes, size_t size);
+
+int start_snapshot(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    pid_t pid;
+    
+    if (so->snapshot_pid != 0)
+    {
+        return 0;
+    }
+    if (!so->engine->snapshot || !so->wal)
+    {
+        (void) fprintf(stderr, "Snapshots need a storage engine which keeps records in memory and the write-ahead "
+                               "log.\n");
+        return 0;
+    }
+    
+    pid = fork();
+    if (pid == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        // Leave without running any exit handlers or flushing buffers inherited from the parent.
+        _exit(write_snapshot(co, so) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    so->snapshot_pid = pid;
+    
+    return 0;
+}
+
+int reap_snapshot(struct core_object *co, struct server_object *so, int wait)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    pid_t pid;
+    int   status;
+    
+    if (so->snapshot_pid == 0)
+    {
+        return 0;
+    }
+    
+    pid = waitpid(so->snapshot_pid, &status, wait ? 0 : WNOHANG);
+    if (pid == 0)
+    {
+        return 0;
+    }
+    so->snapshot_pid = 0;
+    if (pid == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    {
+        errno = EIO;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    (void) fprintf(stdout, "Wrote snapshot %s.\n", SNAPSHOT_FILE_NAME);
+    return 0;
+}
+
+int write_snapshot(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database        *databases[MAX_DATABASES];
+    struct snapshot_header header;
+    struct snapshot_entry  entries[MAX_DATABASES];
+    uint8_t                *images[MAX_DATABASES];
+    size_t                 sizes[MAX_DATABASES];
+    uint64_t               offset;
+    int                    ret_val;
+    
+    if (!so->engine->snapshot || !so->wal)
+    {
+        return 0;
+    }
+    
+    memset(&header, 0, sizeof(header));
+    memset(entries, 0, sizeof(entries));
+    memset(images, 0, sizeof(images));
+    header.magic   = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.count   = (uint32_t) so->num_databases;
+    (void) snprintf(header.engine, sizeof(header.engine), "%s", so->engine->name);
+    
+    ret_val = copy_images(co, so, &header, images, sizes);
+    if (ret_val == 0)
+    {
+        list_databases(so, databases);
+        offset = sizeof(header) + header.count * sizeof(*entries);
+        for (size_t d = 0; d < so->num_databases; ++d)
+        {
+            (void) snprintf(entries[d].name, sizeof(entries[d].name), "%s", databases[d]->name);
+            entries[d].offset = offset;
+            entries[d].size   = sizes[d];
+            offset += sizes[d];
+        }
+        ret_val = write_snapshot_file(co, &header, entries, images);
+    }
+    
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        if (images[d])
+        {
+            mm_free(co->mm, images[d]);
+        }
+    }
+    
+    return ret_val;
+}
+
+int load_snapshot_image(struct core_object *co, struct server_object *so, struct database *db, void *image,
+                        size_t capacity, size_t *size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct snapshot_header header;
+    struct snapshot_entry  entry;
+    struct stat            file_stat;
+    uint8_t                *map;
+    size_t                 file_size;
+    int                    fd;
+    int                    ret_val;
+    
+    fd = open(SNAPSHOT_FILE_NAME, O_RDONLY); // NOLINT(android-cloexec-open) : Closed again before forking
+    if (fd == -1)
+    {
+        if (errno == ENOENT)
+        {
+            return 0;
+        }
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (fstat(fd, &file_stat) == -1)
+    {
+        SET_ERROR(co->err);
+        (void) close(fd);
+        return -1;
+    }
+    file_size = (size_t) file_stat.st_size;
+    if (file_size < sizeof(header))
+    {
+        (void) close(fd);
+        return 0;
+    }
+    map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void) close(fd);
+    if (map == MAP_FAILED)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    (void) posix_madvise(map, file_size, POSIX_MADV_SEQUENTIAL);
+    
+    memcpy(&header, map, sizeof(header));
+    ret_val = 0;
+    if (header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION
+        && strncmp(header.engine, so->engine->name, sizeof(header.engine)) == 0
+        && header.count <= (file_size - sizeof(header)) / sizeof(entry))
+    {
+        ret_val = wal_covers(co, header.wal_sequence);
+    }
+    for (uint32_t e = 0; ret_val == 1 && e < header.count; ++e)
+    {
+        memcpy(&entry, map + sizeof(header) + e * sizeof(entry), sizeof(entry));
+        if (strncmp(entry.name, db->name, sizeof(entry.name)) != 0)
+        {
+            continue;
+        }
+        if (entry.offset > file_size || entry.size > file_size - entry.offset || entry.size > capacity)
+        {
+            break;
+        }
+        memcpy(image, map + entry.offset, entry.size);
+        *size = entry.size;
+        munmap(map, file_size);
+        return 1;
+    }
+    munmap(map, file_size);
+    
+    return ret_val == -1 ? -1 : 0;
+}
+
+static int copy_images(struct core_object *co, struct server_object *so, struct snapshot_header *header,
+                       uint8_t **images, size_t *sizes)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    size_t          locked;
+    int             ret_val;
+    
+    // The locks are taken in the same order as a checkpoint takes them, and the log only switches segments while a
+    // checkpoint holds every lock, so the noted segment is the one every copied write was logged to or before.
+    list_databases(so, databases);
+    ret_val = 0;
+    for (locked = 0; locked < so->num_databases; ++locked)
+    {
+        if (rw_lock_read(co, databases[locked]->lock) == -1)
+        {
+            ret_val = -1;
+            break;
+        }
+    }
+    if (ret_val == 0)
+    {
+        header->wal_sequence = so->wal->sequence;
+    }
+    for (size_t d = 0; d < so->num_databases && ret_val == 0; ++d)
+    {
+        ret_val = databases[d]->engine->snapshot(co, databases[d], &images[d], &sizes[d]);
+    }
+    while (locked > 0)
+    {
+        rw_lock_unlock(databases[--locked]->lock);
+    }
+    
+    return ret_val;
+}
+
+static int write_snapshot_file(struct core_object *co, const struct snapshot_header *header,
+                               const struct snapshot_entry *entries, uint8_t **images)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int fd;
+    int ret_val;
+    
+    // NOLINTNEXTLINE(android-cloexec-open,hicpp-signed-bitwise) : Matches db files
+    fd = open(SNAPSHOT_TEMP_FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, DB_FILE_MODE);
+    if (fd == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    ret_val = write_fully(fd, header, sizeof(*header));
+    if (ret_val == 0)
+    {
+        ret_val = write_fully(fd, entries, header->count * sizeof(*entries));
+    }
+    for (size_t d = 0; d < header->count && ret_val == 0; ++d)
+    {
+        ret_val = write_fully(fd, images[d], entries[d].size);
+    }
+    if (ret_val == 0)
+    {
+        ret_val = fdatasync(fd);
+    }
+    if (ret_val == -1)
+    {
+        SET_ERROR(co->err);
+        (void) close(fd);
+        (void) unlink(SNAPSHOT_TEMP_FILE_NAME);
+        return -1;
+    }
+    (void) close(fd);
+    
+    // The rename replaces the previous snapshot all at once, so a crash never leaves a partial snapshot behind.
+    if (rename(SNAPSHOT_TEMP_FILE_NAME, SNAPSHOT_FILE_NAME) == -1)
+    {
+        SET_ERROR(co->err);
+        (void) unlink(SNAPSHOT_TEMP_FILE_NAME);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int write_fully(int fd, const void *bytes, size_t size)
+{
+    const uint8_t *next;
+    ssize_t       bytes_written;
+    
+    next = bytes;
+    while (size > 0)
+    {
+        bytes_written = write(fd, next, size);
+        if (bytes_written == -1)
+        {
+            return -1;
+        }
+        next += bytes_written;
+        size -= (size_t) bytes_written;
+    }
+    
+    return 0;
+}
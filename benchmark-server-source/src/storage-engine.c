@@ -0,0 +1,425 @@
+#include "../../include/global-objects.h"
+#include "../../include/manager.h"
+#include "../include/db.h"
+#include "../include/message-log.h"
+#include "../include/object-util.h"
+#include "../include/storage-engine.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MS_PER_S 1000L              /** Milliseconds per second. */
+#define NS_PER_MS 1000000L          /** Nanoseconds per millisecond. */
+#define HASH_MULTIPLIER 2654435761U /** Knuth's multiplicative hashing constant. */
+#define HASH_SHIFT 16               /** Take the shard from the well mixed high bits of the hash. */
+
+#define UNSHARDED_MESSAGE_DB_FILE_NAME "dbm_3fda69.pag" /** Held every Message before Messages were sharded. */
+
+/**
+ * The database being checked by check_stored_records, and the kind of record it holds.
+ */
+struct record_check
+{
+    struct server_object *so;
+    const char           *db_name;
+    enum Object          object;
+};
+
+/**
+ * elapsed_ms
+ * <p>
+ * Get the number of milliseconds between two monotonic clock readings.
+ * </p>
+ * @param start the earlier reading
+ * @param end the later reading
+ * @return the elapsed time in milliseconds
+ */
+static long elapsed_ms(const struct timespec *start, const struct timespec *end);
+
+/**
+ * check_record
+ * <p>
+ * Check that a record can be read by this version of the server, and for a Channel that its message log can too.
+ * Visits records for check_stored_records.
+ * </p>
+ * @param co the core object
+ * @param arg the record_check
+ * @param key the key of the record
+ * @param value the record
+ * @return 0 if it can be read, -1 and set err if not
+ */
+static int check_record(struct core_object *co, void *arg, datum *key, datum *value);
+
+/**
+ * refuse_earlier_data
+ * <p>
+ * Explain that data written by an earlier version of the server was found, and fail.
+ * </p>
+ * @param co the core object
+ * @param what the data which cannot be read
+ * @param id the ID of the record, or 0 if the data is not a record
+ * @return -1
+ */
+static int refuse_earlier_data(struct core_object *co, const char *what, int id);
+
+int select_storage_engine(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const char *engine_name;
+    const char *interval;
+    char       *end;
+    
+    engine_name = getenv(STORAGE_ENGINE_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (!engine_name || strcmp(engine_name, ndbm_storage_engine.name) == 0)
+    {
+        so->engine = &ndbm_storage_engine;
+    } else if (strcmp(engine_name, shm_storage_engine.name) == 0)
+    {
+        so->engine = &shm_storage_engine;
+    } else
+    {
+        (void) fprintf(stderr, "Unknown storage engine \"%s\"\n", engine_name);
+        errno = EINVAL;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    so->persist_interval_ms = 0;
+    interval = getenv(PERSIST_INTERVAL_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (interval && so->engine->persist)
+    {
+        errno = 0;
+        so->persist_interval_ms = strtol(interval, &end, 10); // NOLINT(readability-magic-numbers) : Base 10
+        if (errno != 0 || end == interval || *end != '\0' || so->persist_interval_ms < 0)
+        {
+            (void) fprintf(stderr, "Invalid persistence interval \"%s\"\n", interval);
+            errno = EINVAL;
+            SET_ERROR(co->err);
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &so->last_persist);
+    
+    return 0;
+}
+
+int select_message_shards(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const char *setting;
+    char       *end;
+    long       requested;
+    uint32_t   stored;
+    ssize_t    bytes_read;
+    int        fd;
+    
+    requested = 0;
+    setting   = getenv(MESSAGE_SHARDS_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (setting)
+    {
+        errno     = 0;
+        requested = strtol(setting, &end, 10); // NOLINT(readability-magic-numbers) : Base 10
+        if (errno != 0 || end == setting || *end != '\0' || requested < 1 || requested > MAX_MESSAGE_SHARDS)
+        {
+            (void) fprintf(stderr, "Invalid number of message shards \"%s\"; must be 1 to %d\n", setting,
+                           MAX_MESSAGE_SHARDS);
+            errno = EINVAL;
+            SET_ERROR(co->err);
+            return -1;
+        }
+    }
+    
+    fd = open(MESSAGE_SHARDS_FILE_NAME, O_RDWR | O_CREAT, DB_FILE_MODE); // NOLINT(hicpp-signed-bitwise)
+    if (fd == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    bytes_read = pread(fd, &stored, sizeof(stored), 0);
+    if (bytes_read == -1)
+    {
+        SET_ERROR(co->err);
+        (void) close(fd);
+        return -1;
+    }
+    
+    if ((size_t) bytes_read < sizeof(stored))
+    {
+        // New data: fix the number of shards now, before anything is routed by it.
+        stored = requested ? (uint32_t) requested : DEFAULT_MESSAGE_SHARDS;
+        if (pwrite(fd, &stored, sizeof(stored), 0) != (ssize_t) sizeof(stored) || fdatasync(fd) == -1)
+        {
+            SET_ERROR(co->err);
+            (void) close(fd);
+            return -1;
+        }
+    } else if (stored < 1 || stored > MAX_MESSAGE_SHARDS || (requested && (uint32_t) requested != stored))
+    {
+        (void) fprintf(stderr,
+                       "The existing data is split into %u message shards, which %s cannot change; unset it or move "
+                       "the data away\n", stored, MESSAGE_SHARDS_ENV);
+        (void) close(fd);
+        errno = EINVAL;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    (void) close(fd);
+    
+    so->num_message_shards = stored;
+    so->num_databases      = 3 + so->num_message_shards; // NOLINT(readability-magic-numbers) : Users, Channels, Auths
+    
+    return 0;
+}
+
+int persist_databases(struct core_object *co, struct server_object *so, int force)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    struct timespec now;
+    int             ret_val;
+    
+    if (!so->engine || !so->engine->persist || so->persist_interval_ms == 0)
+    {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!force && elapsed_ms(&so->last_persist, &now) < so->persist_interval_ms)
+    {
+        return 0;
+    }
+    
+    list_databases(so, databases);
+    ret_val = 0;
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        if (so->engine->persist(co, databases[d]) == -1)
+        {
+            ret_val = -1;
+        }
+    }
+    so->last_persist = now;
+    
+    return ret_val;
+}
+
+int check_stored_records(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct record_check check;
+    
+    if (access(UNSHARDED_MESSAGE_DB_FILE_NAME, F_OK) == 0)
+    {
+        return refuse_earlier_data(co, UNSHARDED_MESSAGE_DB_FILE_NAME, 0);
+    }
+    
+    check.so      = so;
+    check.db_name = so->user_db.name;
+    check.object  = USER;
+    if (so->user_db.engine->for_each(co, &so->user_db, check_record, &check) == -1)
+    {
+        return -1;
+    }
+    check.db_name = so->channel_db.name;
+    check.object  = CHANNEL;
+    if (so->channel_db.engine->for_each(co, &so->channel_db, check_record, &check) == -1)
+    {
+        return -1;
+    }
+    check.db_name = so->auth_db.name;
+    check.object  = AUTH;
+    if (so->auth_db.engine->for_each(co, &so->auth_db, check_record, &check) == -1)
+    {
+        return -1;
+    }
+    check.object = MESSAGE;
+    for (size_t s = 0; s < so->num_message_shards; ++s)
+    {
+        check.db_name = so->message_dbs[s].name;
+        if (so->message_dbs[s].engine->for_each(co, &so->message_dbs[s], check_record, &check) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+void list_databases(struct server_object *so, struct database **databases)
+{
+    size_t d;
+    
+    d              = 0;
+    databases[d++] = &so->user_db;
+    databases[d++] = &so->channel_db;
+    for (size_t s = 0; s < so->num_message_shards; ++s)
+    {
+        databases[d++] = &so->message_dbs[s];
+    }
+    databases[d] = &so->auth_db;
+}
+
+struct database *message_shard(struct server_object *so, int channel_id)
+{
+    uint32_t hash;
+    
+    // IDs are leased to workers in blocks, so Channels created around the same time have IDs which agree modulo
+    // small powers of two; hash them before picking the shard.
+    hash = (uint32_t) channel_id * HASH_MULTIPLIER;
+    
+    return &so->message_dbs[(hash >> HASH_SHIFT) % so->num_message_shards];
+}
+
+datum record_name(const datum *record)
+{
+    static char no_name[1]; // Never written; datum has no const pointer.
+    
+    struct record_header       stored;
+    const struct record_header *header;
+    const struct record_field  *field;
+    const uint8_t              *bytes;
+    datum                      name;
+    
+    name.dptr  = no_name;
+    name.dsize = 0;
+    bytes      = datum_record(record);
+    if (!bytes)
+    {
+        return name;
+    }
+    memcpy(&stored, bytes, sizeof(stored));
+    header = view_record(bytes, stored.field_count, 0);
+    if (!header || header->field_count == 0)
+    {
+        return name;
+    }
+    
+    // The name lies within the record, so it is reached through the record's own pointer rather than a const view.
+    field      = (const struct record_field *) (header + 1);
+    name.dptr  = (char *) record->dptr + field->offset;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    name.dsize = field->length;
+    
+    return name;
+}
+
+int name_to_key(const char *name, char *buffer, datum *key)
+{
+    size_t size;
+    
+    size = strlen(name);
+    if (size > NAME_MAX_SIZE)
+    {
+        return 0;
+    }
+    memcpy(buffer, name, size + 1);
+    key->dptr  = buffer;
+    // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+    key->dsize = size;
+    
+    return 1;
+}
+
+void mark_db_written(struct database *db)
+{
+    ++*db->shared_generation;
+    db->generation = *db->shared_generation;
+}
+
+static long elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * MS_PER_S + (end->tv_nsec - start->tv_nsec) / NS_PER_MS;
+}
+
+static int check_record(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct record_check *check;
+    const uint8_t             *bytes;
+    Message                   **messages;
+    int                       readable;
+    int                       id;
+    
+    (void) key;
+    check    = (const struct record_check *) arg;
+    bytes    = datum_record(value);
+    readable = 0;
+    switch (check->object)
+    {
+        case USER:
+        {
+            readable = bytes && view_user(bytes);
+            break;
+        }
+        case CHANNEL:
+        {
+            readable = bytes && view_channel(bytes);
+            break;
+        }
+        case MESSAGE:
+        {
+            readable = bytes && view_message(bytes);
+            break;
+        }
+        case AUTH:
+        {
+            readable = bytes && view_auth(bytes);
+            break;
+        }
+        case CONN_USER:
+        default:
+        {
+            break;
+        }
+    }
+    id = 0;
+    if ((size_t) value->dsize >= sizeof(id))
+    {
+        memcpy(&id, value->dptr, sizeof(id));
+    }
+    if (!readable)
+    {
+        return refuse_earlier_data(co, check->db_name, id);
+    }
+    
+    // A message log holds one layout throughout, so its first Message shows whether the rest can be read.
+    if (check->object == CHANNEL)
+    {
+        if (message_log_read(co, check->so, id, 0, 1, &messages) == -1)
+        {
+            return refuse_earlier_data(co, MESSAGE_LOG_DIR, id);
+        }
+        for (size_t m = 0; messages[m]; ++m)
+        {
+            free_message(co, messages[m]);
+        }
+        mm_free(co->mm, messages);
+    }
+    
+    return 0;
+}
+
+static int refuse_earlier_data(struct core_object *co, const char *what, int id)
+{
+    if (id != 0)
+    {
+        (void) fprintf(stderr, "Record %d in %s cannot be read by this version of the server", id, what);
+    } else
+    {
+        (void) fprintf(stderr, "%s cannot be read by this version of the server", what);
+    }
+    (void) fprintf(stderr, ". It was probably written by an earlier version, whose data is not converted; move the "
+                           "data files away to start with empty databases.\n");
+    errno = EINVAL;
+    SET_ERROR(co->err);
+    
+    return -1;
+}
@@ -0,0 +1,114 @@
+#include "../include/rw-lock.h"
+#include "../include/transaction.h"
+#include "../include/write-ahead-log.h"
+
+/**
+ * lock_written_databases
+ * <p>
+ * Acquire the lock of every database written by a transaction for writing, in lock order.
+ * </p>
+ * @param co the core object
+ * @param databases the databases in lock order
+ * @param written whether each database is written
+ * @param count the number of databases
+ * @return 0 on success, -1 and set err on failure; no lock is held on failure
+ */
+static int lock_written_databases(struct core_object *co, struct database **databases, const int *written,
+                                  size_t count);
+
+/**
+ * unlock_written_databases
+ * <p>
+ * Release the locks acquired by lock_written_databases, in reverse lock order.
+ * </p>
+ * @param databases the databases in lock order
+ * @param written whether each database is written
+ * @param count the number of databases, in lock order, whose locks to release
+ */
+static void unlock_written_databases(struct database **databases, const int *written, size_t count);
+
+int run_transaction(struct core_object *co, struct server_object *so, struct transaction_write *writes, size_t count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    int             written[MAX_DATABASES];
+    int             flush;
+    int             refused;
+    int             ret_val;
+    
+    list_databases(so, databases);
+    flush = 0;
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        written[d] = 0;
+        for (size_t w = 0; w < count; ++w)
+        {
+            written[d] = written[d] || writes[w].db == databases[d];
+        }
+        flush = flush || (written[d] && databases[d]->flush_writes);
+    }
+    
+    if (lock_written_databases(co, databases, written, so->num_databases) == -1)
+    {
+        return -1;
+    }
+    
+    // Nothing is applied until every write has been checked, so a refused transaction leaves nothing to undo.
+    refused = 0;
+    ret_val = 0;
+    for (size_t w = 0; w < count && ret_val != -1; ++w)
+    {
+        ret_val             = writes[w].db->engine->check(co, writes[w].db, &writes[w].op);
+        writes[w].op.status = ret_val;
+        refused             = refused || ret_val == 1;
+    }
+    if (ret_val != -1)
+    {
+        ret_val = refused;
+    }
+    
+    if (ret_val == 0)
+    {
+        ret_val = wal_log_transaction(co, writes, count, flush);
+    }
+    for (size_t w = 0; w < count && ret_val == 0; ++w)
+    {
+        ret_val = writes[w].db->engine->apply(co, writes[w].db, &writes[w].op, 1, flush);
+        if (ret_val == 0 && writes[w].op.status == -1)
+        {
+            ret_val = -1;
+        }
+    }
+    unlock_written_databases(databases, written, so->num_databases);
+    
+    return ret_val;
+}
+
+static int lock_written_databases(struct core_object *co, struct database **databases, const int *written,
+                                  size_t count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    for (size_t d = 0; d < count; ++d)
+    {
+        if (written[d] && rw_lock_write(co, databases[d]->lock) == -1)
+        {
+            unlock_written_databases(databases, written, d);
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+static void unlock_written_databases(struct database **databases, const int *written, size_t count)
+{
+    for (size_t d = count; d > 0; --d)
+    {
+        if (written[d - 1])
+        {
+            rw_lock_unlock(databases[d - 1]->lock);
+        }
+    }
+}
@@ -0,0 +1,921 @@
+#include "../include/channel-body-cache.h"
+#include "../include/db.h"
+#include "../include/fanout.h"
+#include "../include/membership-index.h"
+#include "../include/object-util.h"
+#include "../include/update.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NOLINTBEGIN(modernize-macro-to-enum)
+#define DECIMAL_BASE 10
+// NOLINTEND(modernize-macro-to-enum)
+
+#define IS_BOOLEAN(token) (((token)[0] == '0' || (token)[0] == '1') && (token)[1] == '\0') /** A BOOLEAN field. */
+#define IS_LIST_SIGNAL(token) ((token)[0] >= '0' && (token)[0] <= '3' && (token)[1] == '\0') /** A list signal. */
+
+/**
+ * The lists of a Channel, in the order in which an Update-Channel Request alters them.
+ */
+enum ChannelList
+{
+    LIST_USERS,
+    LIST_ADMINS,
+    LIST_BANNED,
+    CHANNEL_LISTS
+};
+
+/**
+ * The changes to a list, in the order in which an Update-Channel Request gives them. The alter-channel-list-signal of
+ * a list has the bit 1 << change set for each change made to it.
+ */
+enum ListChange
+{
+    CHANGE_ADD,
+    CHANGE_REMOVE,
+    LIST_CHANGES
+};
+
+/**
+ * The changes asked for to one list of a Channel.
+ */
+struct list_update
+{
+    int    signal;
+    char   **names[LIST_CHANGES]; // Point into the body tokens.
+    size_t name_counts[LIST_CHANGES];
+    int    *ids[LIST_CHANGES];    // Sorted and without duplicates; NULL if there are none.
+    size_t id_counts[LIST_CHANGES];
+};
+
+/**
+ * An Update-Channel Request.
+ */
+struct channel_update
+{
+    char               *channel_name;
+    char               *new_channel_name; // NULL if the Channel is not renamed.
+    int                change_publicity;
+    int                new_publicity;
+    struct list_update lists[CHANNEL_LISTS];
+};
+
+/**
+ * parse_update_channel
+ * <p>
+ * Parse the body of an Update-Channel Request.
+ * </p>
+ * @param body_tokens the tokenized dispatch body
+ * @param update memory in which to store the Request, which must be zeroed
+ * @return 0 on success, 1 if the body is invalid
+ */
+static int parse_update_channel(char **body_tokens, struct channel_update *update);
+
+/**
+ * parse_name_list
+ * <p>
+ * Parse a display-name-list: its size, then as many display names.
+ * </p>
+ * @param tokens the position of the list in the body tokens; moved past the list
+ * @param names_get memory in which to store the position of the first display name
+ * @param count_get memory in which to store the number of display names
+ * @return 0 on success, 1 if the list is invalid
+ */
+static int parse_name_list(char ***tokens, char ***names_get, size_t *count_get);
+
+/**
+ * apply_update
+ * <p>
+ * Apply an Update-Channel Request to the Channel record and the membership index. Must be called while holding the
+ * update lock of the Channel, so that the record does not change between being read and being written back.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param update the Request; its IDs are filled in with the changes which were made
+ * @param request_sender the User who sent the Request
+ * @param channel_id the ID of the Channel
+ * @param changed_get memory in which to store whether the Channel changed
+ * @return 0 on success, or the code of the error to send: 403 if the request sender may not make the changes, 404 if
+ * the Channel or a User does not exist, 409 if the new name is taken; -1 and set err on failure
+ */
+static int apply_update(struct core_object *co, struct server_object *so, struct channel_update *update,
+                        const User *request_sender, int channel_id, int *changed_get);
+
+/**
+ * is_self_service
+ * <p>
+ * Check whether an Update-Channel Request only adds the request sender to, or only removes the request sender from,
+ * the list of Users of the Channel, which a User who is not an Administrator may do. A User banned from the Channel
+ * may not add themselves.
+ * </p>
+ * @param update the Request
+ * @param request_sender the User who sent the Request
+ * @param record the Channel
+ * @return 1 if it does, 0 if not
+ */
+static int is_self_service(const struct channel_update *update, const User *request_sender,
+                           const struct channel_record *record);
+
+/**
+ * resolve_names
+ * <p>
+ * Look up the IDs of the Users named in a list change.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param list the list update
+ * @param change the change
+ * @return 0 on success, 1 if a User does not exist, -1 and set err on failure
+ */
+static int resolve_names(struct core_object *co, struct server_object *so, struct list_update *list,
+                         enum ListChange change);
+
+/**
+ * diff_list
+ * <p>
+ * Reduce the Users to add to those who are not on a list, and the Users to remove to those who are, in place. A User
+ * both added and removed is removed, since the additions come first. Each User costs one lookup in the encoded list,
+ * so the cost depends on the number of changes rather than the length of the list.
+ * </p>
+ * @param record the Channel
+ * @param ids the list in the record
+ * @param list the list update
+ * @return 1 if the list changes, 0 if not
+ */
+static int diff_list(const struct channel_record *record, const struct record_ids *ids, struct list_update *list);
+
+/**
+ * apply_list
+ * <p>
+ * Produce a list of a Channel with the changes of a list update made to it, in one merge of the sorted IDs.
+ * </p>
+ * @param co the core object
+ * @param record the Channel
+ * @param ids the list in the record
+ * @param list the list update, reduced by diff_list
+ * @param list_get memory in which to store a new array of the IDs on the list
+ * @param count_get memory in which to store the number of IDs on the list
+ * @return 0 on success, -1 and set err on failure
+ */
+static int apply_list(struct core_object *co, const struct channel_record *record, const struct record_ids *ids,
+                      const struct list_update *list, int **list_get, size_t *count_get);
+
+/**
+ * write_channel
+ * <p>
+ * Write a Channel record back with the changes of an Update-Channel Request made to it, along with the membership
+ * index. The record is written whole, as the storage engines replace records whole, but the lists which do not change
+ * are copied without being decoded.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param record the Channel
+ * @param update the Request, reduced by diff_list
+ * @return 0 on success, 1 if the new name is taken, -1 and set err on failure
+ */
+static int write_channel(struct core_object *co, struct server_object *so, const struct channel_record *record,
+                         const struct channel_update *update);
+
+/**
+ * write_with_memberships
+ * <p>
+ * Store a Channel record and record the Users who joined or left it in the membership index. The lock of the index is
+ * held across the store, and recording the memberships cannot fail, so the index changes if and only if the record
+ * does.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param key the ID of the Channel
+ * @param value the record
+ * @param users the update of the list of Users, reduced by diff_list
+ * @return 0 on success, 1 if the new name is taken, -1 and set err on failure
+ */
+static int write_with_memberships(struct core_object *co, struct server_object *so, datum *key, datum *value,
+                                  const struct list_update *users);
+
+/**
+ * ping_changed_users
+ * <p>
+ * Ping the members of a Channel and every User added to or removed from one of its lists.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param update the Request, reduced by diff_list
+ * @param channel_name the name of the Channel
+ * @param channel_id the ID of the Channel
+ * @return 0 on success, -1 and set err on failure
+ */
+static int ping_changed_users(struct core_object *co, struct server_object *so, const struct channel_update *update,
+                              const char *channel_name, int channel_id);
+
+/**
+ * record_list
+ * <p>
+ * Get a list of a Channel record.
+ * </p>
+ * @param record the Channel
+ * @param list the list
+ * @return the list in the record
+ */
+static const struct record_ids *record_list(const struct channel_record *record, enum ChannelList list);
+
+/**
+ * free_update
+ * <p>
+ * Free the IDs of an Update-Channel Request.
+ * </p>
+ * @param co the core object
+ * @param update the Request
+ */
+static void free_update(struct core_object *co, struct channel_update *update);
+
+/**
+ * compare_ids
+ * <p>
+ * Order two IDs for qsort and bsearch.
+ * </p>
+ * @param a the first ID
+ * @param b the second ID
+ * @return less than, equal to, or greater than 0 as the first ID is less than, equal to, or greater than the second
+ */
+static int compare_ids(const void *a, const void *b);
+
+int handle_update(struct core_object *co, struct server_object *so, struct dispatch *dispatch, char **body_tokens)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (dispatch->object == CHANNEL)
+    {
+        if (handle_update_channel(co, so, dispatch, body_tokens) == -1)
+        {
+            return -1;
+        }
+    } else
+    {
+        dispatch->body      = mm_strdup("501\x03Not implemented\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+    }
+    
+    return 0;
+}
+
+int handle_update_channel(struct core_object *co, struct server_object *so, struct dispatch *dispatch,
+                          char **body_tokens)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct channel_update update;
+    User                  request_sender;
+    uint8_t               *serial_channel;
+    const char            *channel_name;
+    size_t                body_size;
+    int                   channel_id;
+    int                   get_flags;
+    int                   changed;
+    int                   status;
+    static int            private_noted = 0;
+    
+    memset(&update, 0, sizeof(update));
+    if (parse_update_channel(body_tokens, &update) == 1)
+    {
+        dispatch->body      = mm_strdup("400\x03Invalid fields\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    if (update.change_publicity && update.new_publicity && !private_noted)
+    {
+        // Noted once per worker; the Channel named by the client stays public all the same.
+        (void) fprintf(stdout, "Note: Private channels are not supported. Channels stay public.\n");
+        private_noted = 1;
+    }
+    
+    if (determine_request_sender(co, so, &request_sender) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    status = find_by_name(co, &so->channel_db, &serial_channel, update.channel_name);
+    if (status == -1)
+    {
+        return -1;
+    }
+    if (status == 0)
+    {
+        dispatch->body      = mm_strdup("404\x03""Channel not found.\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    memcpy(&channel_id, serial_channel, sizeof(channel_id));
+    mm_free(co->mm, serial_channel);
+    
+    if (membership_lock_channel(co, so, channel_id) == -1)
+    {
+        return -1;
+    }
+    status = apply_update(co, so, &update, &request_sender, channel_id, &changed);
+    membership_unlock_channel(so, channel_id);
+    
+    channel_name = update.new_channel_name ? update.new_channel_name : update.channel_name;
+    if (status == 0 && changed)
+    {
+        status = ping_changed_users(co, so, &update, channel_name, channel_id);
+    }
+    free_update(co, &update);
+    
+    switch (status)
+    {
+        case 0:
+        {
+            break;
+        }
+        case 403: // NOLINT(readability-magic-numbers) : Response code
+        {
+            dispatch->body = mm_strdup("403\x03Not permitted to update the Channel.\x03", co->mm);
+            break;
+        }
+        case 404: // NOLINT(readability-magic-numbers) : Response code
+        {
+            dispatch->body = mm_strdup("404\x03""Channel or User not found.\x03", co->mm);
+            break;
+        }
+        case 409: // NOLINT(readability-magic-numbers) : Response code
+        {
+            dispatch->body = mm_strdup("409\x03""Channel name is taken.\x03", co->mm);
+            break;
+        }
+        default:
+        {
+            return -1;
+        }
+    }
+    if (status != 0)
+    {
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    
+    // The Response holds the Channel as it now is, with the lists which were altered. Reading it encodes the Channel
+    // for the members about to read it after the Ping.
+    get_flags = 0;
+    for (int l = 0; l < CHANNEL_LISTS; ++l)
+    {
+        get_flags |= (update.lists[l].signal != 0) << l;
+    }
+    status = channel_body_read(co, so, channel_name, get_flags, &dispatch->body, &body_size);
+    if (status == -1)
+    {
+        return -1;
+    }
+    if (status == 0) // Renamed or updated again since.
+    {
+        dispatch->body      = mm_strdup("404\x03""Channel not found.\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    if (status == CHANNEL_BODY_TOO_LARGE)
+    {
+        dispatch->body      = mm_strdup("500\x03Lists too large to send.\x03", co->mm);
+        dispatch->body_size = strlen(dispatch->body);
+        return 0;
+    }
+    dispatch->body_size = (uint16_t) body_size; // Never larger than UINT16_MAX.
+    
+    return 0;
+}
+
+static int parse_update_channel(char **body_tokens, struct channel_update *update)
+{
+    char **tokens;
+    
+    tokens = body_tokens;
+    if (!tokens || !*tokens || !VALIDATE_NAME(*tokens))
+    {
+        return 1;
+    }
+    update->channel_name = *tokens++;
+    
+    if (!*tokens || !IS_BOOLEAN(*tokens))
+    {
+        return 1;
+    }
+    if (**tokens++ == '1')
+    {
+        if (!*tokens || !VALIDATE_NAME(*tokens))
+        {
+            return 1;
+        }
+        update->new_channel_name = *tokens++;
+        if (strcmp(update->new_channel_name, update->channel_name) == 0)
+        {
+            update->new_channel_name = NULL;
+        }
+    }
+    
+    if (!*tokens || !IS_BOOLEAN(*tokens))
+    {
+        return 1;
+    }
+    update->change_publicity = **tokens++ == '1';
+    if (update->change_publicity)
+    {
+        if (!*tokens || !IS_BOOLEAN(*tokens))
+        {
+            return 1;
+        }
+        update->new_publicity = **tokens++ == '1';
+    }
+    
+    // Each list gives the Users to add before the Users to remove.
+    for (int l = 0; l < CHANNEL_LISTS; ++l)
+    {
+        if (!*tokens || !IS_LIST_SIGNAL(*tokens))
+        {
+            return 1;
+        }
+        update->lists[l].signal = **tokens++ - '0';
+        for (int c = 0; c < LIST_CHANGES; ++c)
+        {
+            if ((update->lists[l].signal & (1 << c))
+                && parse_name_list(&tokens, &update->lists[l].names[c], &update->lists[l].name_counts[c]) == 1)
+            {
+                return 1;
+            }
+        }
+    }
+    
+    return *tokens ? 1 : 0;
+}
+
+static int parse_name_list(char ***tokens, char ***names_get, size_t *count_get)
+{
+    char *end;
+    long count;
+    
+    if (!**tokens || ***tokens == '\0')
+    {
+        return 1;
+    }
+    errno = 0;
+    count = strtol(**tokens, &end, DECIMAL_BASE);
+    if (*end != '\0' || errno != 0 || count < 0)
+    {
+        return 1;
+    }
+    ++*tokens;
+    
+    *names_get = *tokens;
+    for (long n = 0; n < count; ++n)
+    {
+        if (!**tokens || !VALIDATE_NAME(**tokens))
+        {
+            return 1;
+        }
+        ++*tokens;
+    }
+    *count_get = (size_t) count;
+    
+    return 0;
+}
+
+static int apply_update(struct core_object *co, struct server_object *so, struct channel_update *update,
+                        const User *request_sender, int channel_id, int *changed_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct channel_record *record;
+    uint8_t                     *serial_channel;
+    datum                       key;
+    int                         is_admin;
+    int                         changed;
+    int                         status;
+    
+    *changed_get = 0;
+    
+    // Read the record again now that no other update can change it.
+    key.dptr  = (void *) &channel_id;
+    key.dsize = sizeof(channel_id);
+    status    = safe_dbm_fetch(co, &so->channel_db, &key, &serial_channel);
+    if (status != 0)
+    {
+        return status == -1 ? -1 : 404; // NOLINT(readability-magic-numbers) : Response code
+    }
+    record = view_channel(serial_channel);
+    if (!record)
+    {
+        mm_free(co->mm, serial_channel);
+        errno = EIO;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (strcmp(record_string(record, &record->channel_name), update->channel_name) != 0) // Renamed meanwhile.
+    {
+        mm_free(co->mm, serial_channel);
+        return 404; // NOLINT(readability-magic-numbers) : Response code
+    }
+    
+    is_admin = request_sender->privilege_level == GLOBAL_ADMIN
+               || record_has_id(record, &record->administrators, request_sender->id);
+    if (!is_admin && !is_self_service(update, request_sender, record))
+    {
+        mm_free(co->mm, serial_channel);
+        return 403; // NOLINT(readability-magic-numbers) : Response code
+    }
+    
+    status = 0;
+    for (int l = 0; l < CHANNEL_LISTS && status == 0; ++l)
+    {
+        for (int c = 0; c < LIST_CHANGES && status == 0; ++c)
+        {
+            status = resolve_names(co, so, &update->lists[l], (enum ListChange) c);
+        }
+    }
+    if (status != 0)
+    {
+        mm_free(co->mm, serial_channel);
+        return status == -1 ? -1 : 404; // NOLINT(readability-magic-numbers) : Response code
+    }
+    
+    changed = update->new_channel_name != NULL;
+    for (int l = 0; l < CHANNEL_LISTS; ++l)
+    {
+        changed |= diff_list(record, record_list(record, (enum ChannelList) l), &update->lists[l]);
+    }
+    if (!changed)
+    {
+        mm_free(co->mm, serial_channel);
+        return 0;
+    }
+    
+    status = write_channel(co, so, record, update);
+    mm_free(co->mm, serial_channel);
+    if (status != 0)
+    {
+        return status == -1 ? -1 : 409; // NOLINT(readability-magic-numbers) : Response code
+    }
+    *changed_get = 1;
+    
+    return 0;
+}
+
+static int is_self_service(const struct channel_update *update, const User *request_sender,
+                           const struct channel_record *record)
+{
+    const struct list_update *users;
+    const char               *name;
+    
+    users = &update->lists[LIST_USERS];
+    if (update->new_channel_name || update->change_publicity || update->lists[LIST_ADMINS].signal != 0
+        || update->lists[LIST_BANNED].signal != 0
+        || users->name_counts[CHANGE_ADD] + users->name_counts[CHANGE_REMOVE] != 1)
+    {
+        return 0;
+    }
+    
+    name = users->name_counts[CHANGE_ADD] == 1 ? users->names[CHANGE_ADD][0] : users->names[CHANGE_REMOVE][0];
+    if (strcmp(name, request_sender->display_name) != 0)
+    {
+        return 0;
+    }
+    
+    return users->name_counts[CHANGE_ADD] == 0 || !record_has_id(record, &record->banned_users, request_sender->id);
+}
+
+static int resolve_names(struct core_object *co, struct server_object *so, struct list_update *list,
+                         enum ListChange change)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    uint8_t *serial_user;
+    int     *ids;
+    size_t  count;
+    size_t  unique;
+    int     read_status;
+    
+    count = list->name_counts[change];
+    if (count == 0)
+    {
+        return 0;
+    }
+    
+    ids = mm_malloc(count * sizeof(int), co->mm);
+    if (!ids)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    for (size_t n = 0; n < count; ++n)
+    {
+        read_status = find_by_name(co, &so->user_db, &serial_user, list->names[change][n]);
+        if (read_status != 1)
+        {
+            mm_free(co->mm, ids);
+            return read_status == -1 ? -1 : 1;
+        }
+        memcpy(&ids[n], serial_user, sizeof(int));
+        mm_free(co->mm, serial_user);
+    }
+    
+    qsort(ids, count, sizeof(int), compare_ids);
+    unique = 1;
+    for (size_t i = 1; i < count; ++i)
+    {
+        if (ids[i] != ids[unique - 1])
+        {
+            ids[unique++] = ids[i];
+        }
+    }
+    list->ids[change]       = ids;
+    list->id_counts[change] = unique;
+    
+    return 0;
+}
+
+static int diff_list(const struct channel_record *record, const struct record_ids *ids, struct list_update *list)
+{
+    int    *added;
+    int    *removed;
+    size_t kept;
+    
+    added   = list->ids[CHANGE_ADD];
+    removed = list->ids[CHANGE_REMOVE];
+    
+    kept = 0;
+    for (size_t a = 0; a < list->id_counts[CHANGE_ADD]; ++a)
+    {
+        if (!record_has_id(record, ids, added[a])
+            && !bsearch(&added[a], removed, list->id_counts[CHANGE_REMOVE], sizeof(int), compare_ids))
+        {
+            added[kept++] = added[a];
+        }
+    }
+    list->id_counts[CHANGE_ADD] = kept;
+    
+    kept = 0;
+    for (size_t r = 0; r < list->id_counts[CHANGE_REMOVE]; ++r)
+    {
+        if (record_has_id(record, ids, removed[r]))
+        {
+            removed[kept++] = removed[r];
+        }
+    }
+    list->id_counts[CHANGE_REMOVE] = kept;
+    
+    return list->id_counts[CHANGE_ADD] > 0 || list->id_counts[CHANGE_REMOVE] > 0;
+}
+
+static int apply_list(struct core_object *co, const struct channel_record *record, const struct record_ids *ids,
+                      const struct list_update *list, int **list_get, size_t *count_get)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const int *added;
+    const int *removed;
+    int       *current;
+    int       *merged;
+    size_t    current_count;
+    size_t    added_count;
+    size_t    removed_count;
+    size_t    count;
+    size_t    c;
+    size_t    a;
+    
+    added         = list->ids[CHANGE_ADD];
+    removed       = list->ids[CHANGE_REMOVE];
+    added_count   = list->id_counts[CHANGE_ADD];
+    removed_count = list->id_counts[CHANGE_REMOVE];
+    
+    current = mm_malloc((ids->count + 1) * sizeof(int), co->mm);
+    merged  = mm_malloc((ids->count + added_count + 1) * sizeof(int), co->mm);
+    if (!current || !merged)
+    {
+        SET_ERROR(co->err);
+        if (current)
+        {
+            mm_free(co->mm, current);
+        }
+        if (merged)
+        {
+            mm_free(co->mm, merged);
+        }
+        return -1;
+    }
+    current_count = record_copy_ids(record, ids, current);
+    
+    // The added IDs are not on the list and the removed IDs are, so one pass keeps the list sorted and unique.
+    count = 0;
+    c     = 0;
+    a     = 0;
+    while (c < current_count || a < added_count)
+    {
+        if (a == added_count || (c < current_count && current[c] < added[a]))
+        {
+            if (!bsearch(&current[c], removed, removed_count, sizeof(int), compare_ids))
+            {
+                merged[count++] = current[c];
+            }
+            ++c;
+        } else
+        {
+            merged[count++] = added[a++];
+        }
+    }
+    mm_free(co->mm, current);
+    
+    *list_get  = merged;
+    *count_get = count;
+    
+    return 0;
+}
+
+static int write_channel(struct core_object *co, struct server_object *so, const struct channel_record *record,
+                         const struct channel_update *update)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    const struct list_update *list;
+    Channel                  patch;
+    int                      *lists[CHANNEL_LISTS];
+    size_t                   counts[CHANNEL_LISTS];
+    uint8_t                  *serial_channel;
+    unsigned long            serial_channel_size;
+    datum                    key;
+    datum                    value;
+    int                      status;
+    
+    // Only the lists which change are decoded and merged; the others are copied into the new record still encoded.
+    status = 0;
+    memset(lists, 0, sizeof(lists));
+    memset(counts, 0, sizeof(counts));
+    for (size_t l = 0; l < CHANNEL_LISTS && status == 0; ++l)
+    {
+        list = &update->lists[l];
+        if (list->id_counts[CHANGE_ADD] > 0 || list->id_counts[CHANGE_REMOVE] > 0)
+        {
+            status = apply_list(co, record, record_list(record, (enum ChannelList) l), list, &lists[l], &counts[l]);
+        }
+    }
+    
+    if (status == 0)
+    {
+        memset(&patch, 0, sizeof(patch));
+        patch.channel_name         = update->new_channel_name;
+        patch.users                = lists[LIST_USERS];
+        patch.users_count          = counts[LIST_USERS];
+        patch.administrators       = lists[LIST_ADMINS];
+        patch.administrators_count = counts[LIST_ADMINS];
+        patch.banned_users         = lists[LIST_BANNED];
+        patch.banned_users_count   = counts[LIST_BANNED];
+        serial_channel_size        = patch_channel(co, &serial_channel, record, &patch);
+        status                     = serial_channel_size == 0 ? -1 : 0;
+    }
+    
+    if (status == 0)
+    {
+        key.dptr    = (void *) serial_channel;
+        // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+        key.dsize   = sizeof(int);
+        value.dptr  = (void *) serial_channel;
+        // NOLINTNEXTLINE(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+        value.dsize = serial_channel_size;
+        status      = write_with_memberships(co, so, &key, &value, &update->lists[LIST_USERS]);
+        mm_free(co->mm, serial_channel);
+    }
+    
+    for (int l = 0; l < CHANNEL_LISTS; ++l)
+    {
+        if (lists[l])
+        {
+            mm_free(co->mm, lists[l]);
+        }
+    }
+    
+    return status;
+}
+
+static int write_with_memberships(struct core_object *co, struct server_object *so, datum *key, datum *value,
+                                  const struct list_update *users)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int channel_id;
+    int status;
+    
+    if (membership_begin_apply(co, so) == -1)
+    {
+        return -1;
+    }
+    status = safe_dbm_store(co, &so->channel_db, key, value, DBM_REPLACE);
+    if (status != 0)
+    {
+        membership_end_apply(so, 0, NULL, 0, NULL, 0);
+        return status;
+    }
+    memcpy(&channel_id, key->dptr, sizeof(channel_id));
+    membership_end_apply(so, channel_id, users->ids[CHANGE_ADD], users->id_counts[CHANGE_ADD],
+                         users->ids[CHANGE_REMOVE], users->id_counts[CHANGE_REMOVE]);
+    
+    return 0;
+}
+
+static int ping_changed_users(struct core_object *co, struct server_object *so, const struct channel_update *update,
+                              const char *channel_name, int channel_id)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    int    *user_ids;
+    size_t count;
+    size_t unique;
+    int    ret_val;
+    
+    count = 0;
+    for (int l = 0; l < CHANNEL_LISTS; ++l)
+    {
+        count += update->lists[l].id_counts[CHANGE_ADD] + update->lists[l].id_counts[CHANGE_REMOVE];
+    }
+    
+    user_ids = mm_malloc((count + 1) * sizeof(int), co->mm);
+    if (!user_ids)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    count = 0;
+    for (int l = 0; l < CHANNEL_LISTS; ++l)
+    {
+        for (int c = 0; c < LIST_CHANGES; ++c)
+        {
+            if (update->lists[l].id_counts[c] > 0)
+            {
+                memcpy(user_ids + count, update->lists[l].ids[c], update->lists[l].id_counts[c] * sizeof(int));
+                count += update->lists[l].id_counts[c];
+            }
+        }
+    }
+    
+    // A User may be on several lists.
+    qsort(user_ids, count, sizeof(int), compare_ids);
+    unique = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (unique == 0 || user_ids[i] != user_ids[unique - 1])
+        {
+            user_ids[unique++] = user_ids[i];
+        }
+    }
+    
+    ret_val = fanout_ping_channel(co, so, channel_name, channel_id, user_ids, unique);
+    mm_free(co->mm, user_ids);
+    
+    return ret_val;
+}
+
+static const struct record_ids *record_list(const struct channel_record *record, enum ChannelList list)
+{
+    switch (list)
+    {
+        case LIST_ADMINS:
+        {
+            return &record->administrators;
+        }
+        case LIST_BANNED:
+        {
+            return &record->banned_users;
+        }
+        case LIST_USERS:
+        case CHANNEL_LISTS:
+        default:
+        {
+            return &record->users;
+        }
+    }
+}
+
+static void free_update(struct core_object *co, struct channel_update *update)
+{
+    for (int l = 0; l < CHANNEL_LISTS; ++l)
+    {
+        for (int c = 0; c < LIST_CHANGES; ++c)
+        {
+            if (update->lists[l].ids[c])
+            {
+                mm_free(co->mm, update->lists[l].ids[c]);
+                update->lists[l].ids[c] = NULL;
+            }
+        }
+    }
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    int left;
+    int right;
+    
+    left  = *(const int *) a;
+    right = *(const int *) b;
+    
+    return (left > right) - (left < right);
+}
@@ -0,0 +1,218 @@
+#include "../include/object-util.h"
+#include "../include/process-server-util.h"
+#include "../include/user-table.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#define USER_TABLE_SHM_NAME "/ut_3fda69" /** User table shared memory name. */
+
+/**
+ * parse_user
+ * <p>
+ * Read the ID, display name and privilege level of a serialized User. The online status in the record is ignored.
+ * </p>
+ * @param value the serialized User
+ * @param user memory in which to store the User
+ * @return 0 on success, -1 if the record is malformed
+ */
+static int parse_user(const datum *value, struct user_entry *user);
+
+/**
+ * write_begin
+ * <p>
+ * Wait for any other writer of a slot to finish, then make its sequence odd.
+ * </p>
+ * @param slot the slot
+ */
+static void write_begin(struct user_slot *slot);
+
+/**
+ * write_end
+ * <p>
+ * Make the sequence of a slot even again, publishing the write.
+ * </p>
+ * @param slot the slot
+ */
+static void write_end(struct user_slot *slot);
+
+/**
+ * store_user
+ * <p>
+ * Put a User into its slot. A User already in the slot keeps its online status; a new one starts offline.
+ * </p>
+ * @param table the user table
+ * @param user the User
+ */
+static void store_user(struct user_table *table, const struct user_entry *user);
+
+/**
+ * load_user
+ * <p>
+ * Put a record of the User database into the user table.
+ * </p>
+ * @param co the core object
+ * @param arg the user table
+ * @param key the key of the record
+ * @param value the record
+ * @return 0
+ */
+static int load_user(struct core_object *co, void *arg, datum *key, datum *value);
+
+int open_user_table(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    so->user_table = map_shared_memory(co, USER_TABLE_SHM_NAME, sizeof(struct user_table));
+    if (!so->user_table)
+    {
+        return -1;
+    }
+    so->user_db.user_table = so->user_table;
+    
+    return so->user_db.engine->for_each(co, &so->user_db, load_user, so->user_table);
+}
+
+void close_user_table(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    so->user_db.user_table = NULL;
+    if (so->user_table)
+    {
+        munmap(so->user_table, sizeof(struct user_table));
+        so->user_table = NULL;
+    }
+}
+
+int user_table_read(struct server_object *so, int user_id, struct user_entry *user)
+{
+    struct user_slot *slot;
+    unsigned int     sequence;
+    int              in_use;
+    
+    slot = &so->user_table->slots[user_id];
+    do
+    {
+        sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        in_use   = slot->in_use;
+        *user    = slot->user;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((sequence & 1U) || atomic_load_explicit(&slot->sequence, memory_order_relaxed) != sequence);
+    
+    return in_use;
+}
+
+int user_table_set_online(struct server_object *so, int user_id, int online_status)
+{
+    struct user_slot *slot;
+    int              in_use;
+    
+    slot = &so->user_table->slots[user_id];
+    write_begin(slot);
+    in_use = slot->in_use;
+    if (in_use)
+    {
+        slot->user.online_status = online_status;
+    }
+    write_end(slot);
+    
+    return in_use;
+}
+
+void user_table_apply(struct database *db, const struct write_op *op)
+{
+    struct user_entry user;
+    struct user_slot  *slot;
+    
+    if (!db->user_table)
+    {
+        return;
+    }
+    
+    if (op->kind == WRITE_STORE)
+    {
+        if (parse_user(&op->value, &user) == 0 && USER_TABLE_HOLDS(user.id))
+        {
+            store_user(db->user_table, &user);
+        }
+    } else if ((size_t) op->key.dsize == sizeof(user.id))
+    {
+        memcpy(&user.id, op->key.dptr, sizeof(user.id));
+        if (USER_TABLE_HOLDS(user.id))
+        {
+            slot = &db->user_table->slots[user.id];
+            write_begin(slot);
+            slot->in_use = 0;
+            write_end(slot);
+        }
+    }
+}
+
+static int parse_user(const datum *value, struct user_entry *user)
+{
+    const struct user_record *record;
+    const uint8_t            *bytes;
+    
+    bytes  = datum_record(value);
+    record = bytes ? view_user(bytes) : NULL;
+    if (!record || record->display_name.length > NAME_MAX_SIZE)
+    {
+        return -1;
+    }
+    
+    user->id              = record->header.id;
+    user->privilege_level = (enum PrivilegeLevel) record->privilege_level;
+    user->online_status   = 0;
+    memcpy(user->display_name, record_string(record, &record->display_name), record->display_name.length + 1);
+    
+    return 0;
+}
+
+static void write_begin(struct user_slot *slot)
+{
+    unsigned int sequence;
+    
+    // Expecting an even sequence makes the swap fail, and so retry, for as long as another writer holds the slot.
+    do
+    {
+        sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed) & ~1U;
+    } while (!atomic_compare_exchange_weak_explicit(&slot->sequence, &sequence, sequence + 1, memory_order_acquire,
+                                                    memory_order_relaxed));
+    atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(struct user_slot *slot)
+{
+    atomic_fetch_add_explicit(&slot->sequence, 1, memory_order_release);
+}
+
+static void store_user(struct user_table *table, const struct user_entry *user)
+{
+    struct user_slot *slot;
+    int              online_status;
+    
+    slot = &table->slots[user->id];
+    write_begin(slot);
+    online_status            = slot->in_use ? slot->user.online_status : 0;
+    slot->user               = *user;
+    slot->user.online_status = online_status;
+    slot->in_use             = 1;
+    write_end(slot);
+}
+
+static int load_user(struct core_object *co, void *arg, datum *key, datum *value)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct user_entry user;
+    
+    (void) key;
+    
+    if (parse_user(value, &user) == 0 && USER_TABLE_HOLDS(user.id))
+    {
+        store_user((struct user_table *) arg, &user);
+    }
+    
+    return 0;
+}
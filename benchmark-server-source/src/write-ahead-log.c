@@ -0,0 +1,809 @@
+#include "../../include/manager.h"
+#include "../include/process-server-util.h"
+#include "../include/rw-lock.h"
+#include "../include/write-ahead-log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WAL_SHM_NAME "/wl_3fda69"  /** Write-ahead log shared memory name. */
+#define WAL_FILE_NAME_SIZE 32      /** Room for the name of a segment file. */
+#define CRC_POLYNOMIAL 0xEDB88320U /** Reversed CRC-32 (IEEE 802.3) polynomial. */
+#define CRC_TABLE_SIZE 256         /** One entry per byte value. */
+#define BYTES_PER_KB 1024L         /** Bytes per kilobyte. */
+#define NO_SEGMENT (-1)            /** No segment is waiting to be emptied. */
+
+/**
+ * The CRC of every byte value, filled in by the parent before forking.
+ */
+static uint32_t crc_table[CRC_TABLE_SIZE];
+
+/**
+ * The segment which was switched away from by a checkpoint whose databases could not all be forced to disk. It must
+ * not be reused until it has been emptied. Only used by the parent.
+ */
+static int retired_segment = NO_SEGMENT;
+
+/**
+ * init_crc_table
+ * <p>
+ * Fill in the CRC table.
+ * </p>
+ */
+static void init_crc_table(void);
+
+/**
+ * crc32
+ * <p>
+ * Get the CRC-32 of a run of bytes.
+ * </p>
+ * @param bytes the bytes
+ * @param size the number of bytes
+ * @return the CRC
+ */
+static uint32_t crc32(const uint8_t *bytes, size_t size);
+
+/**
+ * read_segment_header
+ * <p>
+ * Read the header of a segment.
+ * </p>
+ * @param fd the segment file
+ * @param header memory in which to store the header
+ * @return 1 if the segment has a valid header, 0 if it is empty or not a segment
+ */
+static int read_segment_header(int fd, struct wal_segment_header *header);
+
+/**
+ * start_segment
+ * <p>
+ * Empty a segment and write a header to it.
+ * </p>
+ * @param co the core object
+ * @param wal the write-ahead log
+ * @param segment the index of the segment
+ * @param sequence the sequence of the segment
+ * @return 0 on success, -1 and set err on failure
+ */
+static int start_segment(struct core_object *co, struct write_ahead_log *wal, int segment, uint64_t sequence);
+
+/**
+ * retire_segment
+ * <p>
+ * Force every database to disk, then empty a segment whose writes have all been applied.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param segment the index of the segment
+ * @return 0 on success, -1 and set err on failure
+ */
+static int retire_segment(struct core_object *co, struct server_object *so, int segment);
+
+/**
+ * replay_segment
+ * <p>
+ * Apply every intact record of a segment, stopping at the first torn record.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param fd the segment file
+ * @param replayed incremented for each record applied
+ * @return 0 on success, -1 and set err on failure
+ */
+static int replay_segment(struct core_object *co, struct server_object *so, int fd, size_t *replayed);
+
+/**
+ * replay_record
+ * <p>
+ * Apply the writes of a record whose CRC checked out.
+ * </p>
+ * @param co the core object
+ * @param so the server object
+ * @param payload the payload of the record
+ * @param size the size of the payload
+ * @return 0 on success, 1 if the record is malformed, -1 and set err on failure
+ */
+static int replay_record(struct core_object *co, struct server_object *so, uint8_t *payload, size_t size);
+
+/**
+ * lock_all_databases
+ * <p>
+ * Acquire the lock of every database for writing, in the order of their IDs.
+ * </p>
+ * @param co the core object
+ * @param databases the databases
+ * @param count the number of databases
+ * @return 0 on success, -1 and set err on failure; no lock is held on failure
+ */
+static int lock_all_databases(struct core_object *co, struct database **databases, size_t count);
+
+/**
+ * op_size
+ * <p>
+ * Get the number of bytes a write takes up in the payload of a record.
+ * </p>
+ * @param op the write
+ * @return the number of bytes
+ */
+static size_t op_size(const struct write_op *op);
+
+/**
+ * encode_op
+ * <p>
+ * Copy a write into the payload of a record.
+ * </p>
+ * @param buffer memory in which to copy the write, with room for op_size bytes
+ * @param db_id the ID of the database written
+ * @param op the write
+ * @return the number of bytes copied
+ */
+static size_t encode_op(uint8_t *buffer, uint32_t db_id, const struct write_op *op);
+
+/**
+ * start_record
+ * <p>
+ * Allocate a record with room for a payload and fill in the payload header.
+ * </p>
+ * @param co the core object
+ * @param payload_size the size of the payload, including its header
+ * @param count the number of writes in the payload
+ * @return the record, or NULL and set err on failure
+ */
+static uint8_t *start_record(struct core_object *co, size_t payload_size, size_t count);
+
+/**
+ * append_record
+ * <p>
+ * Frame a record started by start_record, append it to the active segment, and free it. A record which is only
+ * partly written is cut off again, so that the records appended after it are not lost behind a torn record.
+ * </p>
+ * @param co the core object
+ * @param wal the write-ahead log
+ * @param buffer the record
+ * @param size the size of the record, including its frame
+ * @param flush whether to force the record to disk before returning
+ * @return 0 on success, -1 and set err on failure
+ */
+static int append_record(struct core_object *co, struct write_ahead_log *wal, uint8_t *buffer, size_t size,
+                         int flush);
+
+int open_write_ahead_log(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database           *databases[MAX_DATABASES];
+    struct wal_segment_header headers[2];
+    int                       valid[2];
+    char                      file_name[WAL_FILE_NAME_SIZE];
+    const char                *setting;
+    char                      *end;
+    long                      checkpoint_kb;
+    uint64_t                  sequence;
+    size_t                    replayed;
+    int                       first;
+    
+    setting = getenv(WAL_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (setting && strcmp(setting, "off") == 0)
+    {
+        return 0;
+    }
+    if (setting && strcmp(setting, "on") != 0)
+    {
+        (void) fprintf(stderr, "Unknown write-ahead log setting \"%s\"\n", setting);
+        errno = EINVAL;
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    checkpoint_kb = WAL_DEFAULT_CHECKPOINT_KB;
+    setting       = getenv(WAL_CHECKPOINT_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (setting)
+    {
+        errno         = 0;
+        checkpoint_kb = strtol(setting, &end, 10); // NOLINT(readability-magic-numbers) : Base 10
+        if (errno != 0 || end == setting || *end != '\0' || checkpoint_kb <= 0)
+        {
+            (void) fprintf(stderr, "Invalid checkpoint size \"%s\"\n", setting);
+            errno = EINVAL;
+            SET_ERROR(co->err);
+            return -1;
+        }
+    }
+    
+    so->wal = map_shared_memory(co, WAL_SHM_NAME, sizeof(struct write_ahead_log));
+    if (!so->wal)
+    {
+        return -1;
+    }
+    so->wal->checkpoint_bytes = checkpoint_kb * BYTES_PER_KB;
+    if (rw_lock_init(co, &so->wal->append_lock) == -1)
+    {
+        munmap(so->wal, sizeof(struct write_ahead_log));
+        so->wal = NULL;
+        return -1;
+    }
+    init_crc_table();
+    
+    for (int s = 0; s < 2; ++s)
+    {
+        (void) snprintf(file_name, sizeof(file_name), WAL_FILE_FORMAT, s);
+        // NOLINTNEXTLINE(hicpp-signed-bitwise)
+        so->wal->fds[s] = open(file_name, O_RDWR | O_CREAT | O_APPEND, DB_FILE_MODE);
+        if (so->wal->fds[s] == -1)
+        {
+            SET_ERROR(co->err);
+            if (s == 1)
+            {
+                (void) close(so->wal->fds[0]);
+            }
+            munmap(so->wal, sizeof(struct write_ahead_log));
+            so->wal = NULL;
+            return -1;
+        }
+        valid[s] = read_segment_header(so->wal->fds[s], &headers[s]);
+    }
+    
+    // Replay the older segment first; it holds writes from before the checkpoint which was interrupted.
+    first    = (valid[0] && valid[1] && headers[1].sequence < headers[0].sequence) ? 1 : 0;
+    sequence = 0;
+    replayed = 0;
+    for (int s = first; s < first + 2; ++s)
+    {
+        if (valid[s % 2])
+        {
+            if (replay_segment(co, so, so->wal->fds[s % 2], &replayed) == -1)
+            {
+                return -1;
+            }
+            sequence = headers[s % 2].sequence;
+        }
+    }
+    if (replayed > 0)
+    {
+        (void) fprintf(stdout, "Replayed %zu write-ahead log records.\n", replayed);
+    }
+    
+    // Everything replayed is forced to disk before the log is emptied and logging starts.
+    if (retire_segment(co, so, 1) == -1 || retire_segment(co, so, 0) == -1
+        || start_segment(co, so->wal, 0, sequence + 1) == -1)
+    {
+        return -1;
+    }
+    so->wal->active   = 0;
+    so->wal->sequence = sequence + 1;
+    
+    list_databases(so, databases);
+    for (uint32_t d = 0; d < so->num_databases; ++d)
+    {
+        databases[d]->wal_id = d;
+        databases[d]->wal    = so->wal;
+    }
+    
+    return 0;
+}
+
+void close_write_ahead_log(struct core_object *co, struct server_object *so)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    if (so->wal)
+    {
+        (void) close(so->wal->fds[0]);
+        (void) close(so->wal->fds[1]);
+        munmap(so->wal, sizeof(struct write_ahead_log));
+        so->wal = NULL;
+    }
+}
+
+int wal_log(struct core_object *co, struct database *db, const struct write_op *ops, size_t count, int flush)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    uint8_t *buffer;
+    size_t  size;
+    
+    if (!db->wal)
+    {
+        return 0;
+    }
+    
+    size = sizeof(struct wal_payload_header);
+    for (size_t o = 0; o < count; ++o)
+    {
+        size += op_size(&ops[o]);
+    }
+    buffer = start_record(co, size, count);
+    if (!buffer)
+    {
+        return -1;
+    }
+    
+    size = sizeof(struct wal_record_header) + sizeof(struct wal_payload_header);
+    for (size_t o = 0; o < count; ++o)
+    {
+        size += encode_op(buffer + size, db->wal_id, &ops[o]);
+    }
+    
+    return append_record(co, db->wal, buffer, size, flush);
+}
+
+int wal_log_transaction(struct core_object *co, const struct transaction_write *writes, size_t count, int flush)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    uint8_t *buffer;
+    size_t  size;
+    
+    if (count == 0 || !writes[0].db->wal)
+    {
+        return 0;
+    }
+    
+    size = sizeof(struct wal_payload_header);
+    for (size_t w = 0; w < count; ++w)
+    {
+        size += op_size(&writes[w].op);
+    }
+    buffer = start_record(co, size, count);
+    if (!buffer)
+    {
+        return -1;
+    }
+    
+    size = sizeof(struct wal_record_header) + sizeof(struct wal_payload_header);
+    for (size_t w = 0; w < count; ++w)
+    {
+        size += encode_op(buffer + size, writes[w].db->wal_id, &writes[w].op);
+    }
+    
+    return append_record(co, writes[0].db->wal, buffer, size, flush);
+}
+
+int wal_checkpoint(struct core_object *co, struct server_object *so, int force)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    struct stat     segment_stat;
+    int             old;
+    int             ret_val;
+    
+    if (!so->wal)
+    {
+        return 0;
+    }
+    
+    // A segment left over from a failed checkpoint must be emptied before it can become active again.
+    if (retired_segment != NO_SEGMENT && retire_segment(co, so, retired_segment) == -1)
+    {
+        return -1;
+    }
+    
+    if (fstat(so->wal->fds[so->wal->active], &segment_stat) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    if (segment_stat.st_size <= (off_t) sizeof(struct wal_segment_header)
+        || (!force && segment_stat.st_size < so->wal->checkpoint_bytes))
+    {
+        return 0;
+    }
+    
+    // With every lock held, every write in the active segment has been applied and no worker is appending.
+    list_databases(so, databases);
+    if (lock_all_databases(co, databases, so->num_databases) == -1)
+    {
+        return -1;
+    }
+    old     = so->wal->active;
+    ret_val = start_segment(co, so->wal, 1 - old, so->wal->sequence + 1);
+    if (ret_val == 0)
+    {
+        so->wal->active = 1 - old;
+        ++so->wal->sequence;
+    }
+    for (size_t d = so->num_databases; d > 0; --d)
+    {
+        rw_lock_unlock(databases[d - 1]->lock);
+    }
+    if (ret_val == -1)
+    {
+        return -1;
+    }
+    
+    retired_segment = old;
+    return retire_segment(co, so, old);
+}
+
+int wal_covers(struct core_object *co, uint64_t sequence)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct wal_segment_header header;
+    char                      file_name[WAL_FILE_NAME_SIZE];
+    const char                *setting;
+    uint64_t                  oldest;
+    uint64_t                  newest;
+    int                       found;
+    int                       fd;
+    
+    setting = getenv(WAL_ENV); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (setting && strcmp(setting, "on") != 0)
+    {
+        return 0;
+    }
+    
+    found  = 0;
+    oldest = 0;
+    newest = 0;
+    for (int s = 0; s < 2; ++s)
+    {
+        (void) snprintf(file_name, sizeof(file_name), WAL_FILE_FORMAT, s);
+        fd = open(file_name, O_RDONLY); // NOLINT(android-cloexec-open) : Closed again before forking
+        if (fd == -1)
+        {
+            if (errno == ENOENT)
+            {
+                continue;
+            }
+            SET_ERROR(co->err);
+            return -1;
+        }
+        if (read_segment_header(fd, &header))
+        {
+            oldest = (!found || header.sequence < oldest) ? header.sequence : oldest;
+            newest = (!found || header.sequence > newest) ? header.sequence : newest;
+            found  = 1;
+        }
+        (void) close(fd);
+    }
+    
+    // Segments older than the oldest on disk were emptied by checkpoints, so their writes are only in the databases.
+    return found && oldest <= sequence && sequence <= newest;
+}
+
+static void init_crc_table(void)
+{
+    uint32_t crc;
+    
+    for (uint32_t b = 0; b < CRC_TABLE_SIZE; ++b)
+    {
+        crc = b;
+        for (int bit = 0; bit < 8; ++bit) // NOLINT(readability-magic-numbers) : Bits per byte
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC_POLYNOMIAL : crc >> 1;
+        }
+        crc_table[b] = crc;
+    }
+}
+
+static uint32_t crc32(const uint8_t *bytes, size_t size)
+{
+    uint32_t crc;
+    
+    crc = 0xFFFFFFFFU;
+    for (size_t b = 0; b < size; ++b)
+    {
+        crc = crc_table[(crc ^ bytes[b]) & 0xFFU] ^ (crc >> 8); // NOLINT(readability-magic-numbers) : Byte mask
+    }
+    
+    return ~crc;
+}
+
+static int read_segment_header(int fd, struct wal_segment_header *header)
+{
+    ssize_t bytes_read;
+    
+    bytes_read = pread(fd, header, sizeof(struct wal_segment_header), 0);
+    
+    return bytes_read == (ssize_t) sizeof(struct wal_segment_header) && header->magic == WAL_MAGIC
+           && header->version == WAL_VERSION;
+}
+
+static int start_segment(struct core_object *co, struct write_ahead_log *wal, int segment, uint64_t sequence)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct wal_segment_header header;
+    ssize_t                   bytes_written;
+    
+    header.magic    = WAL_MAGIC;
+    header.version  = WAL_VERSION;
+    header.sequence = sequence;
+    if (ftruncate(wal->fds[segment], 0) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    bytes_written = write(wal->fds[segment], &header, sizeof(header));
+    if (bytes_written != (ssize_t) sizeof(header) || fdatasync(wal->fds[segment]) == -1)
+    {
+        if (bytes_written != -1)
+        {
+            errno = EIO;
+        }
+        SET_ERROR(co->err);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int retire_segment(struct core_object *co, struct server_object *so, int segment)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database *databases[MAX_DATABASES];
+    
+    list_databases(so, databases);
+    for (size_t d = 0; d < so->num_databases; ++d)
+    {
+        if (databases[d]->engine->sync(co, databases[d]) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    if (ftruncate(so->wal->fds[segment], 0) == -1 || fdatasync(so->wal->fds[segment]) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    retired_segment = NO_SEGMENT;
+    
+    return 0;
+}
+
+static int replay_segment(struct core_object *co, struct server_object *so, int fd, size_t *replayed)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct wal_record_header record;
+    struct stat              segment_stat;
+    uint8_t                  *buffer;
+    size_t                   size;
+    size_t                   offset;
+    ssize_t                  bytes_read;
+    int                      status;
+    
+    if (fstat(fd, &segment_stat) == -1)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    size = (size_t) segment_stat.st_size;
+    if (size <= sizeof(struct wal_segment_header))
+    {
+        return 0;
+    }
+    
+    buffer = mm_malloc(size, co->mm);
+    if (!buffer)
+    {
+        SET_ERROR(co->err);
+        return -1;
+    }
+    offset = 0;
+    while (offset < size)
+    {
+        bytes_read = pread(fd, buffer + offset, size - offset, (off_t) offset);
+        if (bytes_read <= 0)
+        {
+            break;
+        }
+        offset += (size_t) bytes_read;
+    }
+    size = offset;
+    
+    status = 0;
+    offset = sizeof(struct wal_segment_header);
+    while (status == 0 && offset + sizeof(record) <= size)
+    {
+        memcpy(&record, buffer + offset, sizeof(record));
+        if (record.size > size - offset - sizeof(record)
+            || crc32(buffer + offset + sizeof(record), record.size) != record.crc)
+        {
+            break;
+        }
+        status = replay_record(co, so, buffer + offset + sizeof(record), record.size);
+        if (status == 0)
+        {
+            offset += sizeof(record) + record.size;
+            ++*replayed;
+        }
+    }
+    mm_free(co->mm, buffer);
+    
+    if (status != -1 && offset < size)
+    {
+        (void) fprintf(stdout, "Ignoring %zu bytes of the write-ahead log after a torn record.\n", size - offset);
+    }
+    
+    return status == -1 ? -1 : 0;
+}
+
+static int replay_record(struct core_object *co, struct server_object *so, uint8_t *payload, size_t size)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct database           *databases[MAX_DATABASES];
+    struct wal_payload_header header;
+    struct wal_op_header      op_header;
+    struct write_op           op;
+    size_t                    offset;
+    
+    if (size < sizeof(header))
+    {
+        return 1;
+    }
+    memcpy(&header, payload, sizeof(header));
+    
+    list_databases(so, databases);
+    offset = sizeof(header);
+    for (uint32_t o = 0; o < header.count; ++o)
+    {
+        if (size - offset < sizeof(op_header))
+        {
+            return 1;
+        }
+        memcpy(&op_header, payload + offset, sizeof(op_header));
+        offset += sizeof(op_header);
+        if (op_header.db_id >= so->num_databases || op_header.kind > WRITE_REMOVE
+            || size - offset < (size_t) op_header.key_size + op_header.value_size)
+        {
+            return 1;
+        }
+        
+        op.kind        = (enum WriteKind) op_header.kind;
+        op.store_flags = op_header.store_flags;
+        op.key.dptr    = (void *) (payload + offset);
+        op.value.dptr  = (void *) (payload + offset + op_header.key_size);
+        // NOLINTBEGIN(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions): never large enough
+        op.key.dsize   = op_header.key_size;
+        op.value.dsize = op_header.value_size;
+        // NOLINTEND(bugprone-narrowing-conversions,cppcoreguidelines-narrowing-conversions)
+        offset += op_header.key_size + op_header.value_size;
+        
+        // The status of each write is ignored: a write refused the first time is refused again.
+        if (databases[op_header.db_id]->engine->write_batch(co, databases[op_header.db_id], &op, 1, 0) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+static int lock_all_databases(struct core_object *co, struct database **databases, size_t count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    for (size_t d = 0; d < count; ++d)
+    {
+        if (rw_lock_write(co, databases[d]->lock) == -1)
+        {
+            while (d > 0)
+            {
+                rw_lock_unlock(databases[--d]->lock);
+            }
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+static size_t op_size(const struct write_op *op)
+{
+    size_t size;
+    
+    size = sizeof(struct wal_op_header) + (size_t) op->key.dsize;
+    if (op->kind == WRITE_STORE)
+    {
+        size += (size_t) op->value.dsize;
+    }
+    
+    return size;
+}
+
+static size_t encode_op(uint8_t *buffer, uint32_t db_id, const struct write_op *op)
+{
+    struct wal_op_header header;
+    size_t               offset;
+    
+    header.db_id       = db_id;
+    header.kind        = (uint32_t) op->kind;
+    header.store_flags = op->store_flags;
+    header.key_size    = (uint32_t) op->key.dsize;
+    header.value_size  = (op->kind == WRITE_STORE) ? (uint32_t) op->value.dsize : 0;
+    memcpy(buffer, &header, sizeof(header));
+    offset = sizeof(header);
+    memcpy(buffer + offset, op->key.dptr, header.key_size);
+    offset += header.key_size;
+    if (header.value_size > 0)
+    {
+        memcpy(buffer + offset, op->value.dptr, header.value_size);
+        offset += header.value_size;
+    }
+    
+    return offset;
+}
+
+static uint8_t *start_record(struct core_object *co, size_t payload_size, size_t count)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct wal_payload_header payload;
+    uint8_t                   *buffer;
+    
+    buffer = mm_malloc(sizeof(struct wal_record_header) + payload_size, co->mm);
+    if (!buffer)
+    {
+        SET_ERROR(co->err);
+        return NULL;
+    }
+    
+    payload.count    = (uint32_t) count;
+    payload.reserved = 0;
+    memcpy(buffer + sizeof(struct wal_record_header), &payload, sizeof(payload));
+    
+    return buffer;
+}
+
+static int append_record(struct core_object *co, struct write_ahead_log *wal, uint8_t *buffer, size_t size,
+                         int flush)
+{
+    PRINT_STACK_TRACE(co->tracer);
+    
+    struct wal_record_header record;
+    ssize_t                  bytes_written;
+    off_t                    end;
+    int                      fd;
+    int                      ret_val;
+    
+    record.size = (uint32_t) (size - sizeof(struct wal_record_header));
+    record.crc  = crc32(buffer + sizeof(struct wal_record_header), record.size);
+    memcpy(buffer, &record, sizeof(record));
+    
+    // One write per record, under the append lock: no other worker appends between finding the end of the segment
+    // and cutting a failed write back to it.
+    if (rw_lock_write(co, &wal->append_lock) == -1)
+    {
+        mm_free(co->mm, buffer);
+        return -1;
+    }
+    fd            = wal->fds[wal->active];
+    end           = lseek(fd, 0, SEEK_END);
+    bytes_written = (end == -1) ? -1 : write(fd, buffer, size);
+    mm_free(co->mm, buffer);
+    ret_val = 0;
+    if (bytes_written == -1 || (size_t) bytes_written != size)
+    {
+        if (bytes_written != -1)
+        {
+            errno = EIO;
+        }
+        SET_ERROR(co->err);
+        if (end != -1)
+        {
+            (void) ftruncate(fd, end); // Drop whatever part of the record was written.
+        }
+        ret_val = -1;
+    }
+    rw_lock_unlock(&wal->append_lock);
+    
+    if (ret_val == 0 && flush && fdatasync(fd) == -1)
+    {
+        SET_ERROR(co->err);
+        ret_val = -1;
+    }
+    
+    return ret_val;
+}
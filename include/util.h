@@ -11,7 +11,7 @@
  * @param state the state object
  * @param socket_fd the socket on which to receive a message
  * @param dispatch the dispatch to receive into
- * @param body_tokens pointer to array in which to store strings of body
+ * @param body_tokens pointer to array in which to store strings of body; NULL terminated, and empty for an empty body
  * @return 0 on success, 1 if connection is closed, -1 on set err failure
  */
 int recv_parse_message(struct state *state, int socket_fd, struct dispatch *dispatch, char ***body_tokens);
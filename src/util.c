@@ -116,15 +116,19 @@ int recv_parse_message(struct state *state, int socket_fd, struct dispatch *disp
         return -1;
     }
     
-    bytes_read = recv(socket_fd, dispatch->body, dispatch->body_size, 0);
-    if (bytes_read == 0 || errno == ECONNRESET)
-    {
-        return 1;
-    }
-    if (bytes_read == -1)
+    // An empty body is not received, since receiving 0 bytes would look like a disconnect; it has no tokens.
+    if (dispatch->body_size > 0)
     {
-        SET_ERROR(state->err);
-        return -1;
+        bytes_read = recv(socket_fd, dispatch->body, dispatch->body_size, 0);
+        if (bytes_read == 0 || errno == ECONNRESET)
+        {
+            return 1;
+        }
+        if (bytes_read == -1)
+        {
+            SET_ERROR(state->err);
+            return -1;
+        }
     }
     
     if (parse_body(state, body_tokens, dispatch->body_size, dispatch->body) == -1)
@@ -145,7 +149,8 @@ static int parse_body(struct state *state, char ***body_tokens, uint16_t body_si
     
     num_tokens = count_tokens(body_size, body, state->tracer);
     
-    *body_tokens = mm_malloc((num_tokens + 1) * sizeof(char *), state->mm);
+    // Always a NULL terminated list, even for a body with no tokens.
+    *body_tokens = mm_calloc((size_t) num_tokens + 1, sizeof(char *), state->mm);
     if (!*body_tokens)
     {
         SET_ERROR(state->err);
@@ -153,22 +158,21 @@ static int parse_body(struct state *state, char ***body_tokens, uint16_t body_si
     }
     
     token_head = strdup(body);
-    token      = strtok(token_head, "\x03"); // NOLINT(concurrency-mt-unsafe) : No threads here
+    if (!token_head)
+    {
+        SET_ERROR(state->err);
+        return -1;
+    }
     
-    **body_tokens = strdup(token);
-    mm_add(state->mm, **body_tokens);
-    for (size_t i = 1; token; ++i)
+    // Empty fields are skipped, so there may be fewer tokens than ETXs; the rest of the list stays NULL.
+    token = strtok(token_head, "\x03"); // NOLINT(concurrency-mt-unsafe) : No threads here
+    for (size_t i = 0; token && i < (size_t) num_tokens; ++i)
     {
+        *(*body_tokens + i) = strdup(token);
+        mm_add(state->mm, *(*body_tokens + i));
         token = strtok(NULL, "\x03"); // NOLINT(concurrency-mt-unsafe) : No threads here
-        if (token)
-        {
-            *(*body_tokens + i) = strdup(token);
-            mm_add(state->mm, *(*body_tokens + i));
-        }
     }
     
-    *(*body_tokens + num_tokens) = NULL;
-    
     free(token_head);
     
     return 0;
@@ -41,6 +41,8 @@ enum TestNumber
     DESTROY_MESSAGE,
     DESTROY_AUTH,
     
+    EMPTY_BODY,
+    
     STOP
 };
 
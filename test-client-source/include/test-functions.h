@@ -303,4 +303,14 @@ int destroy_message_test(struct client_state *state);
  */
 int destroy_auth_test(struct client_state *state);
 
+/**
+ * empty_body_test
+ * <p>
+ * Send a Request with an empty body to every Request handler
+ * </p>
+ * @param state the state object
+ * @return 0 on success, -1 on failure
+ */
+int empty_body_test(struct client_state *state);
+
 #endif //CHAT_TEST_SADDLE_TEST_FUNCTIONS_H
@@ -117,6 +117,14 @@ int run_client_saddle(struct client_state *state)
                 }
                 break;
             }
+            case EMPTY_BODY:
+            {
+                if (empty_body_test(state) == -1)
+                {
+                    return -1;
+                }
+                break;
+            }
             case STOP:
             {
                 run = 0;
@@ -4,6 +4,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/**
+ * The Type and Object of every Request handler.
+ */
+static const uint8_t HANDLED_REQUESTS[][2] = {
+    {CREATE, USER}, {CREATE, CHANNEL}, {CREATE, MESSAGE}, {CREATE, AUTH},
+    {READ, USER}, {READ, CHANNEL}, {READ, MESSAGE},
+    {UPDATE, USER}, {UPDATE, CHANNEL}, {UPDATE, MESSAGE}, {UPDATE, AUTH},
+    {DESTROY, USER}, {DESTROY, CHANNEL}, {DESTROY, MESSAGE}, {DESTROY, AUTH}
+};
+
 /**
  * test_dispatch
  * <p>
@@ -710,3 +720,26 @@ int destroy_auth_test(struct client_state *state)
     
     return 0;
 }
+
+int empty_body_test(struct client_state *state)
+{
+    printf("\nSending a Request with an empty body to every handler.\n");
+    
+    struct dispatch dispatch;
+    
+    for (size_t r = 0; r < sizeof(HANDLED_REQUESTS) / sizeof(*HANDLED_REQUESTS); ++r)
+    {
+        dispatch.version   = (unsigned int) 1;
+        dispatch.type      = (unsigned int) HANDLED_REQUESTS[r][0];
+        dispatch.object    = (unsigned int) HANDLED_REQUESTS[r][1];
+        dispatch.body      = strdup("");
+        dispatch.body_size = 0;
+        
+        if (test_dispatch(state, &dispatch) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
@@ -54,6 +54,7 @@
     "|28.\tDestroy Channel Test                                                   |\n"\
     "|29.\tDestroy Message Test                                                   |\n"\
     "|30.\tDestroy Auth Test                                                      |\n"\
+    "|31.\tEmpty Body Test                                                        |\n"\
     "+------------------------------------------------------------------------------+\n"\
     "Enter number or type \"q\" to quit:\n"
 